@@ -5,6 +5,9 @@
 #include "cli_commands.hpp"
 #include "cli_output.hpp"
 #include "cli_repl.hpp"
+#include "core/big_factorization.hpp"
+#include "core/expression.hpp"
+#include "core/expression_cache.hpp"
 #include "core/variables.hpp"
 #include "menu_handlers.hpp"
 
@@ -22,22 +25,36 @@ CalculatorApp::executeCliAction(const CliParseResult &parseResult) {
     return std::nullopt;
   }
   return dispatchAction(*parseResult.action, parseResult.outputFormat,
-                        parseResult.useBigInt, parseResult.useBigDouble);
+                        parseResult.useBigInt, parseResult.useBigDouble,
+                        parseResult.useAdaptive);
 }
 
 int CalculatorApp::dispatchAction(const CliAction &action,
                                   OutputFormat format, bool useBigInt,
-                                  bool useBigDouble) {
+                                  bool useBigDouble, bool useAdaptive) {
   switch (action.type) {
   case CliActionType::Eval:
     return runEval(action.params.empty() ? "" : action.params.front(), format,
-                   nullptr, useBigInt, useBigDouble);
+                   nullptr, useBigInt, useBigDouble, useAdaptive);
+  case CliActionType::EvalInterval:
+    return runEvalInterval(action.params.empty() ? "" : action.params.front(),
+                           format);
+  case CliActionType::EvalGradient:
+    if (action.params.size() < 2) {
+      printStructuredError(std::cerr, format, "eval-grad",
+                           "missing arguments after --eval-grad");
+      return 2;
+    }
+    return runEvalGradient(action.params[0], action.params[1], format);
   case CliActionType::SquareRoot:
     return runSquareRoot(action.params.empty() ? "" : action.params.front(),
                          format);
   case CliActionType::Divisors:
     return runDivisors(action.params.empty() ? "" : action.params.front(),
                        format);
+  case CliActionType::DivisorSummary:
+    return runDivisorSummary(
+        action.params.empty() ? "" : action.params.front(), format);
   case CliActionType::Convert:
     if (action.params.size() < 3) {
       printStructuredError(std::cerr, format, "convert",
@@ -57,6 +74,20 @@ int CalculatorApp::dispatchAction(const CliAction &action,
   case CliActionType::PrimeFactorization:
     return runPrimeFactorization(
         action.params.empty() ? "" : action.params.front(), format);
+  case CliActionType::Primes:
+    if (action.params.size() < 2) {
+      printStructuredError(std::cerr, format, "primes",
+                           "missing arguments after --primes");
+      return 2;
+    }
+    return runPrimes(action.params[0], action.params[1], format);
+  case CliActionType::PrimeCount:
+    if (action.params.size() < 2) {
+      printStructuredError(std::cerr, format, "prime-count",
+                           "missing arguments after --prime-count");
+      return 2;
+    }
+    return runPrimeCount(action.params[0], action.params[1], format);
   case CliActionType::SolveLinear:
     if (action.params.size() < 2) {
       printStructuredError(std::cerr, format, "solve-linear",
@@ -97,8 +128,16 @@ int CalculatorApp::dispatchAction(const CliAction &action,
     return runStatistics(action.params, format);
   case CliActionType::GraphValues:
     return runGraphValues(action.params, format);
+  case CliActionType::Plot:
+    return runPlot(action.params, format);
+  case CliActionType::Integrate:
+    return runIntegrate(action.params, format);
+  case CliActionType::Solve:
+    return runSolve(action.params, format);
   case CliActionType::GraphCsv:
     return runGraphCsv(action.params, format);
+  case CliActionType::EvalColumn:
+    return runEvalColumn(action.params, format);
   case CliActionType::Version:
     return runVersion(format);
   case CliActionType::Variables:
@@ -157,6 +196,13 @@ int CalculatorApp::run(int argc, char **argv) {
     return parseError->exitCode;
   }
 
+  globalExpressionCache().setCapacity(parseResult.evalCacheCapacity);
+  setDefaultEvalEngine(parseResult.evalEngine);
+  setFactorialLimit(parseResult.factorialLimit);
+  setPowerResultLimit(parseResult.powerResultLimit);
+  setBigDoublePrecision(parseResult.bigDoublePrecision);
+  setFactorTimeLimit(parseResult.factorTimeLimit);
+
   if (!globalVariableStore().load()) {
     std::cerr << RED
               << "Warning: unable to load vars.toml; variable changes will not "
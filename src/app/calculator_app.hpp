@@ -12,5 +12,6 @@ private:
   static std::optional<int> executeCliAction(const CliParseResult &parseResult);
 
   static int dispatchAction(const CliAction &action, OutputFormat format,
-                            bool useBigInt, bool useBigDouble);
+                            bool useBigInt, bool useBigDouble,
+                            bool useAdaptive);
 };
@@ -140,6 +140,9 @@ std::string normalizeBatchFlag(const std::string &flag) {
   if (stripped == "d" || stripped == "divisors") {
     return "--divisors";
   }
+  if (stripped == "divisor-summary" || stripped == "divisorsummary") {
+    return "--divisor-summary";
+  }
   if (stripped == "c" || stripped == "convert") {
     return "--convert";
   }
@@ -150,6 +153,12 @@ std::string normalizeBatchFlag(const std::string &flag) {
       stripped == "prime-factorization") {
     return "--prime-factorization";
   }
+  if (stripped == "primes") {
+    return "--primes";
+  }
+  if (stripped == "prime-count" || stripped == "primecount") {
+    return "--prime-count";
+  }
   if (stripped == "solve-linear" || stripped == "solvelinear") {
     return "--solve-linear";
   }
@@ -168,12 +177,30 @@ std::string normalizeBatchFlag(const std::string &flag) {
   if (stripped == "stats" || stripped == "statistics") {
     return "--stats";
   }
+  if (stripped == "solve") {
+    return "--solve";
+  }
+  if (stripped == "integrate") {
+    return "--integrate";
+  }
+  if (stripped == "plot") {
+    return "--plot";
+  }
   if (stripped == "graph-values" || stripped == "graphvalues") {
     return "--graph-values";
   }
   if (stripped == "graph-csv" || stripped == "graphcsv") {
     return "--graph-csv";
   }
+  if (stripped == "eval-interval" || stripped == "evalinterval") {
+    return "--eval-interval";
+  }
+  if (stripped == "eval-grad" || stripped == "evalgrad") {
+    return "--eval-grad";
+  }
+  if (stripped == "eval-column" || stripped == "evalcolumn") {
+    return "--eval-column";
+  }
   if (stripped == "v" || stripped == "version") {
     return "--version";
   }
@@ -280,6 +307,40 @@ int dispatchBatchCommand(const std::vector<std::string> &tokens,
     }
     return runEval(joinTokens(tokens, 1), outputFormat, &state.lastResult);
   }
+  if (flag == "--eval-interval") {
+    if (tokens.size() < 2) {
+      if (outputFormat == OutputFormat::Text) {
+        std::cerr << RED << "Error: missing expression after --eval-interval"
+                  << RESET << '\n';
+      } else {
+        printStructuredError(std::cerr, outputFormat, "eval-interval",
+                             "missing expression after --eval-interval");
+      }
+      return 1;
+    }
+    state.lastResult.reset();
+    return runEvalInterval(joinTokens(tokens, 1), outputFormat);
+  }
+  if (flag == "--eval-grad") {
+    if (tokens.size() < 3) {
+      if (outputFormat == OutputFormat::Text) {
+        std::cerr << RED
+                  << "Error: missing expression or variables after --eval-grad"
+                  << RESET << '\n';
+      } else {
+        printStructuredError(
+            std::cerr, outputFormat, "eval-grad",
+            "missing expression or variables after --eval-grad");
+      }
+      return 1;
+    }
+    // The variable list is the last token; the expression may contain
+    // spaces.
+    state.lastResult.reset();
+    std::vector<std::string> expression(tokens.begin(), tokens.end() - 1);
+    return runEvalGradient(joinTokens(expression, 1), tokens.back(),
+                           outputFormat);
+  }
   if (flag == "--square-root") {
     if (tokens.size() < 2) {
       if (outputFormat == OutputFormat::Text) {
@@ -307,6 +368,20 @@ int dispatchBatchCommand(const std::vector<std::string> &tokens,
     state.lastResult.reset();
     return runDivisors(tokens[1], outputFormat);
   }
+  if (flag == "--divisor-summary") {
+    if (tokens.size() < 2) {
+      if (outputFormat == OutputFormat::Text) {
+        std::cerr << RED << "Error: Missing value after --divisor-summary"
+                  << RESET << '\n';
+      } else {
+        printStructuredError(std::cerr, outputFormat, "divisor-summary",
+                             "missing value after --divisor-summary");
+      }
+      return 2;
+    }
+    state.lastResult.reset();
+    return runDivisorSummary(tokens[1], outputFormat);
+  }
   if (flag == "--convert") {
     if (tokens.size() < 4) {
       if (outputFormat == OutputFormat::Text) {
@@ -363,6 +438,23 @@ int dispatchBatchCommand(const std::vector<std::string> &tokens,
     state.lastResult.reset();
     return runPrimeFactorization(tokens[1], outputFormat);
   }
+  if (flag == "--primes" || flag == "--prime-count") {
+    const std::string actionId = flag.substr(2);
+    if (tokens.size() < 3) {
+      if (outputFormat == OutputFormat::Text) {
+        std::cerr << RED << "Error: missing arguments after " << flag << RESET
+                  << '\n';
+      } else {
+        printStructuredError(std::cerr, outputFormat, actionId,
+                             "missing arguments after " + flag);
+      }
+      return 2;
+    }
+    state.lastResult.reset();
+    return flag == "--primes"
+               ? runPrimes(tokens[1], tokens[2], outputFormat)
+               : runPrimeCount(tokens[1], tokens[2], outputFormat);
+  }
   if (flag == "--solve-linear") {
     if (tokens.size() < 3) {
       if (outputFormat == OutputFormat::Text) {
@@ -467,6 +559,51 @@ int dispatchBatchCommand(const std::vector<std::string> &tokens,
     std::vector<std::string> args(tokens.begin() + 1, tokens.end());
     return runGraphValues(args, outputFormat);
   }
+  if (flag == "--plot") {
+    if (tokens.size() < 4) {
+      if (outputFormat == OutputFormat::Text) {
+        std::cerr << RED << "Error: missing arguments after --plot" << RESET
+                  << '\n';
+      } else {
+        printStructuredError(std::cerr, outputFormat, "plot",
+                             "missing arguments after --plot");
+      }
+      return 2;
+    }
+    state.lastResult.reset();
+    std::vector<std::string> args(tokens.begin() + 1, tokens.end());
+    return runPlot(args, outputFormat);
+  }
+  if (flag == "--solve") {
+    if (tokens.size() < 3) {
+      if (outputFormat == OutputFormat::Text) {
+        std::cerr << RED << "Error: missing arguments after --solve" << RESET
+                  << '\n';
+      } else {
+        printStructuredError(std::cerr, outputFormat, "solve",
+                             "missing arguments after --solve");
+      }
+      return 2;
+    }
+    state.lastResult.reset();
+    std::vector<std::string> args(tokens.begin() + 1, tokens.end());
+    return runSolve(args, outputFormat);
+  }
+  if (flag == "--integrate") {
+    if (tokens.size() < 5) {
+      if (outputFormat == OutputFormat::Text) {
+        std::cerr << RED << "Error: missing arguments after --integrate"
+                  << RESET << '\n';
+      } else {
+        printStructuredError(std::cerr, outputFormat, "integrate",
+                             "missing arguments after --integrate");
+      }
+      return 2;
+    }
+    state.lastResult.reset();
+    std::vector<std::string> args(tokens.begin() + 1, tokens.end());
+    return runIntegrate(args, outputFormat);
+  }
   if (flag == "--graph-csv") {
     if (tokens.size() < 4) {
       if (outputFormat == OutputFormat::Text) {
@@ -482,6 +619,21 @@ int dispatchBatchCommand(const std::vector<std::string> &tokens,
     std::vector<std::string> args(tokens.begin() + 1, tokens.end());
     return runGraphCsv(args, outputFormat);
   }
+  if (flag == "--eval-column") {
+    if (tokens.size() < 4) {
+      if (outputFormat == OutputFormat::Text) {
+        std::cerr << RED << "Error: missing arguments after --eval-column"
+                  << RESET << '\n';
+      } else {
+        printStructuredError(std::cerr, outputFormat, "eval-column",
+                             "missing arguments after --eval-column");
+      }
+      return 2;
+    }
+    state.lastResult.reset();
+    std::vector<std::string> args(tokens.begin() + 1, tokens.end());
+    return runEvalColumn(args, outputFormat);
+  }
   if (flag == "--version") {
     state.lastResult.reset();
     return runVersion(outputFormat);
@@ -639,20 +791,20 @@ int dispatchBatchCommand(const std::vector<std::string> &tokens,
       return 1;
     }
 
-    double value = 0.0;
-    try {
-      value = evaluateExpression(trimmed, globalVariableStore().variables());
-    } catch (const std::exception &ex) {
+    EvalResult evaluation =
+        tryEvaluateExpression(trimmed, globalVariableStore().variables());
+    if (!evaluation.ok()) {
       if (outputFormat == OutputFormat::Text) {
-        std::cerr << RED << "Error: unable to evaluate value: " << ex.what()
-                  << RESET << '\n';
+        std::cerr << RED << "Error: unable to evaluate value: "
+                  << evaluation.message << RESET << '\n';
       } else {
         printStructuredError(std::cerr, outputFormat, "input",
                              "unable to evaluate value: " +
-                                 std::string(ex.what()));
+                                 evaluation.message);
       }
       return 1;
     }
+    double value = evaluation.value;
 
     globalVariableStore().set(variableName, value);
     if (!globalVariableStore().save()) {
@@ -779,20 +931,19 @@ int dispatchBatchCommand(const std::vector<std::string> &tokens,
     }
     std::string conditionExpr =
         normalizeConditionExpression(joinTokens(tokens, 1));
-    try {
-      double conditionValue =
-          evaluateExpression(conditionExpr, globalVariableStore().variables());
-      state.conditionStack.push_back(conditionValue != 0.0);
-      return 0;
-    } catch (const std::exception &ex) {
+    EvalResult condition = tryEvaluateExpression(
+        conditionExpr, globalVariableStore().variables());
+    if (!condition.ok()) {
       state.conditionStack.push_back(false);
       if (outputFormat == OutputFormat::Text) {
-        std::cerr << RED << "Error: " << ex.what() << RESET << '\n';
+        std::cerr << RED << "Error: " << condition.message << RESET << '\n';
       } else {
-        printStructuredError(std::cerr, outputFormat, "if", ex.what());
+        printStructuredError(std::cerr, outputFormat, "if", condition.message);
       }
       return 1;
     }
+    state.conditionStack.push_back(condition.value != 0.0);
+    return 0;
   }
   if (flag == "@endif") {
     if (state.conditionStack.empty()) {
@@ -1,9 +1,13 @@
 #include "cli_commands.hpp"
 #include "ansi_colors.hpp"
 #include "cli_numeric.hpp"
+#include "core/big_factorization.hpp"
+#include "core/bigint_decimal.hpp"
+#include "core/expression_cache.hpp"
 #include "core/graph_png.hpp"
 #include "core/matrix.hpp"
 #include "core/parse_utils.hpp"
+#include "core/prime_sieve.hpp"
 #include "core/statistics.hpp"
 #include "core/unit_conversion.hpp"
 #include "core/variables.hpp"
@@ -11,7 +15,6 @@
 #include "expression.hpp"
 #include "math_utils.hpp"
 #include "numeral_conversion.hpp"
-#include "prime_factors.hpp"
 #include <algorithm>
 #include <cctype>
 #include <cmath>
@@ -265,6 +268,169 @@ bool parseGraphHeight(const std::string &token, std::size_t &height,
   }
 }
 
+bool parseSampleCount(const std::string &token, std::size_t &samples,
+                      std::string &error) {
+  try {
+    long long parsed = std::stoll(token);
+    if (parsed < 2 || parsed > static_cast<long long>(MaxPlotSamples)) {
+      error = "sample count must be between 2 and " +
+              std::to_string(MaxPlotSamples);
+      return false;
+    }
+    samples = static_cast<std::size_t>(parsed);
+    return true;
+  } catch (const std::exception &) {
+    error = "invalid sample count";
+    return false;
+  }
+}
+
+enum class CsvCell { Value, Missing, Invalid };
+
+struct CsvColumn {
+  std::vector<double> values;
+  // One entry per data row in file order; the Value rows are the ones
+  // `values` holds, in the same order.
+  std::vector<CsvCell> cells;
+  std::size_t skippedMissing = 0;
+  std::size_t skippedInvalid = 0;
+};
+
+// Reads the numeric cells of one CSV column, selected by 1-based index or by
+// case-insensitive header name. Rows with missing or non-numeric cells are
+// skipped and counted.
+bool readCsvColumn(const std::string &csvPath, const std::string &columnSpec,
+                   bool hasHeaders, CsvColumn &column, std::string &error) {
+  std::ifstream input(csvPath);
+  if (!input) {
+    error = "unable to open '" + csvPath + "'.";
+    return false;
+  }
+
+  std::vector<std::vector<std::string>> rows;
+  std::string line;
+  while (std::getline(input, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    rows.push_back(parseCsvLine(line));
+  }
+  if (rows.empty()) {
+    error = "CSV file is empty.";
+    return false;
+  }
+
+  std::vector<std::string> headers;
+  std::size_t dataStartIndex = 0;
+  if (hasHeaders) {
+    headers = rows.front();
+    dataStartIndex = 1;
+    if (headers.empty()) {
+      error = "header row does not contain any columns.";
+      return false;
+    }
+    for (std::size_t idx = 0; idx < headers.size(); ++idx) {
+      if (trimCopy(headers[idx]).empty()) {
+        std::ostringstream fallback;
+        fallback << "Column " << (idx + 1);
+        headers[idx] = fallback.str();
+      }
+    }
+  } else {
+    if (rows.front().empty()) {
+      error = "unable to determine column count from first row.";
+      return false;
+    }
+    headers.resize(rows.front().size());
+    for (std::size_t idx = 0; idx < rows.front().size(); ++idx) {
+      std::ostringstream fallback;
+      fallback << "Column " << (idx + 1);
+      headers[idx] = fallback.str();
+    }
+  }
+
+  std::size_t columnIndex = 0;
+  bool matched = false;
+  try {
+    long long idx = std::stoll(columnSpec);
+    if (idx >= 1 && static_cast<std::size_t>(idx) <= headers.size()) {
+      columnIndex = static_cast<std::size_t>(idx - 1);
+      matched = true;
+    }
+  } catch (const std::exception &) {
+  }
+  if (!matched) {
+    std::string lowered = toLowerCopy(columnSpec);
+    for (std::size_t idx = 0; idx < headers.size(); ++idx) {
+      if (toLowerCopy(headers[idx]) == lowered) {
+        columnIndex = idx;
+        matched = true;
+        break;
+      }
+    }
+  }
+  if (!matched) {
+    error = "unable to match column selection.";
+    return false;
+  }
+
+  column = CsvColumn{};
+  for (std::size_t idx = dataStartIndex; idx < rows.size(); ++idx) {
+    if (columnIndex >= rows[idx].size()) {
+      ++column.skippedMissing;
+      column.cells.push_back(CsvCell::Missing);
+      continue;
+    }
+    std::string cell = trimCopy(rows[idx][columnIndex]);
+    if (cell.empty()) {
+      ++column.skippedMissing;
+      column.cells.push_back(CsvCell::Missing);
+      continue;
+    }
+    try {
+      std::size_t processed = 0;
+      double parsed = std::stod(cell, &processed);
+      if (processed != cell.size()) {
+        ++column.skippedInvalid;
+        column.cells.push_back(CsvCell::Invalid);
+        continue;
+      }
+      column.values.push_back(parsed);
+      column.cells.push_back(CsvCell::Value);
+    } catch (const std::exception &) {
+      ++column.skippedInvalid;
+      column.cells.push_back(CsvCell::Invalid);
+    }
+  }
+  if (column.values.empty()) {
+    error = "no numeric values found in selected column.";
+    return false;
+  }
+  return true;
+}
+
+bool resolvePrimeRange(const std::string &fromStr, const std::string &toStr,
+                       std::uint64_t &from, std::uint64_t &to,
+                       std::string &error) {
+  long long first = 0;
+  long long last = 0;
+  if (!resolveIntegerArgument(fromStr, first, error) ||
+      !resolveIntegerArgument(toStr, last, error)) {
+    return false;
+  }
+  if (first < 0 || last < 0) {
+    error = "prime ranges must not be negative";
+    return false;
+  }
+  if (first > last) {
+    error = "the range start must not exceed its end";
+    return false;
+  }
+  from = static_cast<std::uint64_t>(first);
+  to = static_cast<std::uint64_t>(last);
+  return true;
+}
+
 void openUrl(const std::string &url) {
   int ret = std::system("command -v snapctl >/dev/null 2>&1");
   if (ret == 0) {
@@ -277,15 +443,15 @@ void openUrl(const std::string &url) {
 
 int runEval(const std::string &expression, OutputFormat outputFormat,
             std::optional<double> *lastResult, bool useBigInt,
-            bool useBigDouble) {
+            bool useBigDouble, bool useAdaptive) {
   if (lastResult) {
     lastResult->reset();
   }
+  const VariableStore &store = globalVariableStore();
   try {
     if (useBigInt) {
-      std::string result =
-          evaluateExpressionBigInt(expression,
-                                   globalVariableStore().variables());
+      std::string result = globalExpressionCache().evaluateBigInt(
+          expression, store.variables(), store.version());
       if (outputFormat == OutputFormat::Text) {
         std::cout << GREEN << "Result: " << RESET << result << '\n';
       } else {
@@ -303,9 +469,8 @@ int runEval(const std::string &expression, OutputFormat outputFormat,
                                yamlPayload.str());
       }
     } else if (useBigDouble) {
-      std::string result =
-          evaluateExpressionBigDouble(expression,
-                                      globalVariableStore().variables());
+      std::string result = globalExpressionCache().evaluateBigDouble(
+          expression, store.variables(), store.version());
       if (outputFormat == OutputFormat::Text) {
         std::cout << GREEN << "Result: " << RESET << result << '\n';
       } else {
@@ -322,9 +487,53 @@ int runEval(const std::string &expression, OutputFormat outputFormat,
                                jsonPayload.str(), xmlPayload.str(),
                                yamlPayload.str());
       }
+    } else if (useAdaptive) {
+      AdaptiveResult result =
+          evaluateExpressionAdaptive(expression, store.variables());
+      const char *path =
+          result.path == EvalPath::Double ? "double" : "bigdouble";
+      if (outputFormat == OutputFormat::Text) {
+        std::cout << GREEN << "Result: " << RESET << result.text << " ("
+                  << path << ")\n";
+      } else {
+        std::ostringstream jsonPayload;
+        jsonPayload << "\"expression\":\"" << jsonEscape(expression)
+                    << "\",\"result\":" << result.text << ",\"path\":\""
+                    << path << '"';
+        std::ostringstream xmlPayload;
+        xmlPayload << "<expression>" << xmlEscape(expression)
+                   << "</expression><result>" << result.text
+                   << "</result><path>" << path << "</path>";
+        std::ostringstream yamlPayload;
+        yamlPayload << "expression: " << yamlEscape(expression) << '\n'
+                    << "result: " << result.text << '\n'
+                    << "path: " << path;
+        printStructuredSuccess(std::cout, outputFormat, "eval",
+                               jsonPayload.str(), xmlPayload.str(),
+                               yamlPayload.str());
+      }
+      if (lastResult) {
+        *lastResult = result.value;
+      }
     } else {
-      double result =
-          evaluateExpression(expression, globalVariableStore().variables());
+      // Evaluation failures come back as a result rather than an exception;
+      // the batch runner pushes many failing rows through here.
+      EvalResult evaluation = globalExpressionCache().evaluate(
+          expression, store.variables(), store.version());
+      if (!evaluation.ok()) {
+        if (outputFormat == OutputFormat::Text) {
+          std::cout << RED << "Error: " << RESET << evaluation.message;
+          if (evaluation.error != EvalErrorCode::InvalidExpression) {
+            std::cout << " (at position " << evaluation.position << ')';
+          }
+          std::cout << '\n';
+        } else {
+          printStructuredError(std::cout, outputFormat, "eval",
+                               evaluation.message);
+        }
+        return 1;
+      }
+      double result = evaluation.value;
       if (outputFormat == OutputFormat::Text) {
         std::cout << GREEN << "Result: " << RESET << result << '\n';
       } else {
@@ -359,6 +568,119 @@ int runEval(const std::string &expression, OutputFormat outputFormat,
   }
 }
 
+int runEvalInterval(const std::string &expression, OutputFormat outputFormat) {
+  const VariableStore &store = globalVariableStore();
+  Interval bounds;
+  try {
+    bounds = evaluateExpressionInterval(expression, store.variables());
+  } catch (const std::exception &ex) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cout << RED << "Error: " << RESET << ex.what() << '\n';
+    } else {
+      printStructuredError(std::cout, outputFormat, "eval-interval",
+                           ex.what());
+    }
+    return 1;
+  }
+
+  // Enough digits to tell neighbouring doubles apart.
+  auto formatBound = [](double value, const char *infinite) {
+    if (std::isinf(value)) {
+      return std::string(value < 0 ? "-" : "") + infinite;
+    }
+    std::ostringstream out;
+    out << std::setprecision(17) << value;
+    return out.str();
+  };
+  if (outputFormat == OutputFormat::Text) {
+    std::cout << GREEN << "Result: " << RESET << '['
+              << formatBound(bounds.lo, "inf") << ", "
+              << formatBound(bounds.hi, "inf") << "]\n";
+    return 0;
+  }
+  std::ostringstream jsonPayload;
+  jsonPayload << "\"expression\":\"" << jsonEscape(expression)
+              << "\",\"lower\":\"" << formatBound(bounds.lo, "inf")
+              << "\",\"upper\":\"" << formatBound(bounds.hi, "inf") << '"';
+  std::ostringstream xmlPayload;
+  xmlPayload << "<expression>" << xmlEscape(expression)
+             << "</expression><lower>" << formatBound(bounds.lo, "inf")
+             << "</lower><upper>" << formatBound(bounds.hi, "inf")
+             << "</upper>";
+  std::ostringstream yamlPayload;
+  yamlPayload << "expression: " << yamlEscape(expression) << '\n'
+              << "lower: " << formatBound(bounds.lo, ".inf") << '\n'
+              << "upper: " << formatBound(bounds.hi, ".inf");
+  printStructuredSuccess(std::cout, outputFormat, "eval-interval",
+                         jsonPayload.str(), xmlPayload.str(),
+                         yamlPayload.str());
+  return 0;
+}
+
+int runEvalGradient(const std::string &expression,
+                    const std::string &variableList,
+                    OutputFormat outputFormat) {
+  // "x,y" or "x, y"; empty entries are ignored.
+  std::vector<std::string> names;
+  std::stringstream list(variableList);
+  for (std::string name; std::getline(list, name, ',');) {
+    name = trimCopy(name);
+    if (!name.empty()) {
+      names.push_back(std::move(name));
+    }
+  }
+
+  const VariableStore &store = globalVariableStore();
+  GradientResult result;
+  try {
+    if (names.empty()) {
+      throw std::invalid_argument("no variables to differentiate by.");
+    }
+    result = evaluateGradient(expression, names, store.variables());
+  } catch (const std::exception &ex) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cout << RED << "Error: " << RESET << ex.what() << '\n';
+    } else {
+      printStructuredError(std::cout, outputFormat, "eval-grad", ex.what());
+    }
+    return 1;
+  }
+
+  if (outputFormat == OutputFormat::Text) {
+    std::cout << GREEN << "Value: " << RESET << result.value << '\n';
+    for (std::size_t idx = 0; idx < names.size(); ++idx) {
+      std::cout << GREEN << "d/d" << names[idx] << ": " << RESET
+                << result.gradient[idx] << '\n';
+    }
+    return 0;
+  }
+  std::ostringstream jsonPayload;
+  jsonPayload << "\"expression\":\"" << jsonEscape(expression)
+              << "\",\"value\":" << result.value << ",\"gradient\":{";
+  std::ostringstream xmlPayload;
+  xmlPayload << "<expression>" << xmlEscape(expression)
+             << "</expression><value>" << result.value
+             << "</value><gradient>";
+  std::ostringstream yamlPayload;
+  yamlPayload << "expression: " << yamlEscape(expression) << '\n'
+              << "value: " << result.value << '\n'
+              << "gradient:";
+  for (std::size_t idx = 0; idx < names.size(); ++idx) {
+    jsonPayload << (idx > 0 ? "," : "") << '"' << jsonEscape(names[idx])
+                << "\":" << result.gradient[idx];
+    xmlPayload << "<partial variable=\"" << xmlEscape(names[idx]) << "\">"
+               << result.gradient[idx] << "</partial>";
+    yamlPayload << "\n  " << yamlEscape(names[idx]) << ": "
+                << result.gradient[idx];
+  }
+  jsonPayload << '}';
+  xmlPayload << "</gradient>";
+  printStructuredSuccess(std::cout, outputFormat, "eval-grad",
+                         jsonPayload.str(), xmlPayload.str(),
+                         yamlPayload.str());
+  return 0;
+}
+
 int runSquareRoot(const std::string &number, OutputFormat outputFormat,
                   std::optional<double> *lastResult) {
   if (lastResult) {
@@ -490,7 +812,17 @@ int runDivisors(const std::string &input, OutputFormat outputFormat) {
     return 1;
   }
 
-  std::vector<long long> result = calculateDivisors(n);
+  std::vector<long long> result;
+  try {
+    result = calculateDivisors(n);
+  } catch (const std::exception &ex) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Error: " << ex.what() << RESET << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "divisors", ex.what());
+    }
+    return 1;
+  }
   if (outputFormat == OutputFormat::Text) {
     std::cout << GREEN << "Divisors: " << RESET;
     for (std::size_t idx = 0; idx < result.size(); ++idx) {
@@ -531,6 +863,49 @@ int runDivisors(const std::string &input, OutputFormat outputFormat) {
   return 0;
 }
 
+int runDivisorSummary(const std::string &input, OutputFormat outputFormat) {
+  long long n = 0;
+  std::string error;
+  long long count = 0;
+  boost::multiprecision::cpp_int sum;
+  if (resolveIntegerArgument(input, n, error)) {
+    try {
+      count = countDivisors(n);
+      sum = sumDivisors(n);
+    } catch (const std::exception &ex) {
+      error = ex.what();
+    }
+  }
+  if (!error.empty()) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Error: " << error << RESET << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "divisor-summary", error);
+    }
+    return 1;
+  }
+
+  if (outputFormat == OutputFormat::Text) {
+    std::cout << GREEN << "Divisor count: " << RESET << count << '\n';
+    std::cout << GREEN << "Divisor sum: " << RESET << sum << '\n';
+    return 0;
+  }
+  std::ostringstream jsonPayload;
+  jsonPayload << "\"number\":" << n << ",\"count\":" << count
+              << ",\"sum\":" << sum;
+  std::ostringstream xmlPayload;
+  xmlPayload << "<number>" << n << "</number><count>" << count
+             << "</count><sum>" << sum << "</sum>";
+  std::ostringstream yamlPayload;
+  yamlPayload << "number: " << n << '\n'
+              << "count: " << count << '\n'
+              << "sum: " << sum;
+  printStructuredSuccess(std::cout, outputFormat, "divisor-summary",
+                         jsonPayload.str(), xmlPayload.str(),
+                         yamlPayload.str());
+  return 0;
+}
+
 int runConvert(const std::string &fromBaseStr, const std::string &toBaseStr,
                const std::string &valueStr, OutputFormat outputFormat) {
   long long fromBaseValue = 0;
@@ -755,23 +1130,39 @@ int runUnitConvert(const std::string &categoryToken,
 }
 
 int runPrimeFactorization(const std::string &input, OutputFormat outputFormat) {
-  long long value = 0;
+  // Integers beyond a long long, such as 2^128+1, are evaluated in bigint
+  // mode, and an argument that fails there reports the bigint error.
+  boost::multiprecision::cpp_int value;
+  long long smallValue = 0;
   std::string parseError;
-  if (!resolveIntegerArgument(input, value, parseError)) {
-    if (outputFormat == OutputFormat::Text) {
-      std::cerr << RED << "Error: " << parseError << RESET << '\n';
-    } else {
-      printStructuredError(std::cerr, outputFormat, "prime-factorization",
-                           parseError);
+  if (resolveIntegerArgument(input, smallValue, parseError)) {
+    value = smallValue;
+  } else {
+    try {
+      std::string digits =
+          evaluateExpressionBigInt(input, globalVariableStore().variables());
+      bool negative = !digits.empty() && digits.front() == '-';
+      value = parseDecimalInteger(
+          std::string_view(digits).substr(negative ? 1 : 0));
+      if (negative) {
+        value = -value;
+      }
+    } catch (const std::exception &ex) {
+      if (outputFormat == OutputFormat::Text) {
+        std::cerr << RED << "Error: " << ex.what() << RESET << '\n';
+      } else {
+        printStructuredError(std::cerr, outputFormat, "prime-factorization",
+                             ex.what());
+      }
+      return 1;
     }
-    return 1;
   }
 
-  if (value == 0 || value == 1 || value == -1) {
+  if (abs(value) <= 1) {
     std::string noFactorsMessage =
-        std::to_string(value) + " has no prime factors.";
+        toDecimalString(value) + " has no prime factors.";
     if (outputFormat == OutputFormat::Text) {
-      std::cout << YELLOW << value << " has no prime factors." << RESET << '\n';
+      std::cout << YELLOW << noFactorsMessage << RESET << '\n';
     } else {
       std::ostringstream jsonPayload;
       jsonPayload << "\"value\":" << value << ",\"message\":\""
@@ -789,20 +1180,28 @@ int runPrimeFactorization(const std::string &input, OutputFormat outputFormat) {
     return 0;
   }
 
-  long long absValue = value < 0 ? -value : value;
   try {
-    auto factors = calculatePrimeFactors(absValue);
+    BigFactorization factorization = factorBigInteger(abs(value));
+    auto formatPower = [](const boost::multiprecision::cpp_int &base,
+                          int exponent) {
+      std::string text = toDecimalString(base);
+      if (exponent > 1) {
+        text += '^' + std::to_string(exponent);
+      }
+      return text;
+    };
     std::vector<std::string> parts;
     if (value < 0) {
       parts.push_back("-1");
     }
-    for (const auto &factor : factors) {
-      std::ostringstream part;
-      part << factor.first;
-      if (factor.second > 1) {
-        part << '^' << factor.second;
-      }
-      parts.push_back(part.str());
+    for (const auto &factor : factorization.factors) {
+      parts.push_back(formatPower(factor.first, factor.second));
+    }
+    // Composites the time budget left unsplit; the parts times these give
+    // the value.
+    std::vector<std::string> unfactored;
+    for (const auto &composite : factorization.composites) {
+      unfactored.push_back(formatPower(composite.first, composite.second));
     }
     if (outputFormat == OutputFormat::Text) {
       std::cout << GREEN << "Prime factorization: " << RESET;
@@ -813,6 +1212,18 @@ int runPrimeFactorization(const std::string &input, OutputFormat outputFormat) {
         std::cout << parts[idx];
       }
       std::cout << '\n';
+      if (!unfactored.empty()) {
+        std::cout << YELLOW << "Unfactored composite part"
+                  << (unfactored.size() > 1 ? "s" : "")
+                  << " (time limit reached): " << RESET;
+        for (std::size_t idx = 0; idx < unfactored.size(); ++idx) {
+          if (idx > 0) {
+            std::cout << " * ";
+          }
+          std::cout << unfactored[idx];
+        }
+        std::cout << '\n';
+      }
     } else {
       std::ostringstream jsonPayload;
       jsonPayload << "\"value\":" << value << ",\"parts\":[";
@@ -823,6 +1234,16 @@ int runPrimeFactorization(const std::string &input, OutputFormat outputFormat) {
         jsonPayload << "\"" << jsonEscape(parts[idx]) << "\"";
       }
       jsonPayload << ']';
+      if (!unfactored.empty()) {
+        jsonPayload << ",\"unfactored\":[";
+        for (std::size_t idx = 0; idx < unfactored.size(); ++idx) {
+          if (idx > 0) {
+            jsonPayload << ',';
+          }
+          jsonPayload << "\"" << jsonEscape(unfactored[idx]) << "\"";
+        }
+        jsonPayload << ']';
+      }
 
       std::ostringstream xmlPayload;
       xmlPayload << "<value>" << value << "</value><parts>";
@@ -830,12 +1251,25 @@ int runPrimeFactorization(const std::string &input, OutputFormat outputFormat) {
         xmlPayload << "<part>" << xmlEscape(part) << "</part>";
       }
       xmlPayload << "</parts>";
+      if (!unfactored.empty()) {
+        xmlPayload << "<unfactored>";
+        for (const auto &part : unfactored) {
+          xmlPayload << "<part>" << xmlEscape(part) << "</part>";
+        }
+        xmlPayload << "</unfactored>";
+      }
 
       std::ostringstream yamlPayload;
       yamlPayload << "value: " << value << '\n' << "parts:";
       for (const auto &part : parts) {
         yamlPayload << "\n  - " << yamlEscape(part);
       }
+      if (!unfactored.empty()) {
+        yamlPayload << "\nunfactored:";
+        for (const auto &part : unfactored) {
+          yamlPayload << "\n  - " << yamlEscape(part);
+        }
+      }
 
       printStructuredSuccess(std::cout, outputFormat, "prime-factorization",
                              jsonPayload.str(), xmlPayload.str(),
@@ -853,41 +1287,175 @@ int runPrimeFactorization(const std::string &input, OutputFormat outputFormat) {
   return 0;
 }
 
-int runSolveLinear(const std::string &aStr, const std::string &bStr,
-                   OutputFormat outputFormat) {
-  double a = 0.0;
-  double b = 0.0;
-  std::string parseError;
-  if (!resolveDoubleArgument(aStr, a, parseError) ||
-      !resolveDoubleArgument(bStr, b, parseError)) {
+int runPrimes(const std::string &fromStr, const std::string &toStr,
+              OutputFormat outputFormat) {
+  auto reportError = [&](const std::string &message) {
     if (outputFormat == OutputFormat::Text) {
-      std::cerr << RED << "Error: " << parseError << RESET << '\n';
+      std::cerr << RED << "Error: " << message << RESET << '\n';
     } else {
-      printStructuredError(std::cerr, outputFormat, "solve-linear",
-                           parseError);
+      printStructuredError(std::cerr, outputFormat, "primes", message);
     }
     return 1;
+  };
+  std::uint64_t from = 0;
+  std::uint64_t to = 0;
+  std::string error;
+  if (!resolvePrimeRange(fromStr, toStr, from, to, error)) {
+    return reportError(error);
   }
 
-  if (isApproximatelyZero(a)) {
-    if (isApproximatelyZero(b)) {
-      if (outputFormat == OutputFormat::Text) {
-        std::cout << CYAN << "Every real number is a solution." << RESET
-                  << '\n';
-      } else {
-        printStructuredSuccess(std::cout, outputFormat, "solve-linear",
-                               "\"status\":\"all-real\"",
-                               "<status>all-real</status>",
-                               "status: all-real");
-      }
-      return 0;
-    }
+  // Primes arrive a block at a time and are written straight out, so even
+  // a range with billions of primes never sits in memory. The opening is
+  // written with the first block, once the range has been accepted.
+  std::uint64_t count = 0;
+  bool opened = false;
+  auto open = [&] {
+    opened = true;
     if (outputFormat == OutputFormat::Text) {
-      std::cout << RED << "No solution exists for this equation." << RESET
-                << '\n';
+      std::cout << GREEN << "Primes: " << RESET;
+      return;
+    }
+    beginStructuredSuccess(std::cout, outputFormat, "primes");
+    if (outputFormat == OutputFormat::Json) {
+      std::cout << ",\"from\":" << from << ",\"to\":" << to
+                << ",\"primes\":[";
+    } else if (outputFormat == OutputFormat::Xml) {
+      std::cout << "<from>" << from << "</from><to>" << to
+                << "</to><primes>";
     } else {
-      printStructuredSuccess(std::cout, outputFormat, "solve-linear",
-                             "\"status\":\"none\"",
+      std::cout << "\nfrom: " << from << "\nto: " << to << "\nprimes:";
+    }
+  };
+  std::string buffer;
+  try {
+    streamPrimes(from, to, [&](const std::vector<std::uint64_t> &primes) {
+      if (!opened) {
+        open();
+      }
+      buffer.clear();
+      for (std::uint64_t prime : primes) {
+        switch (outputFormat) {
+        case OutputFormat::Text:
+          buffer += count > 0 ? ", " : "";
+          buffer += std::to_string(prime);
+          break;
+        case OutputFormat::Json:
+          buffer += count > 0 ? "," : "";
+          buffer += std::to_string(prime);
+          break;
+        case OutputFormat::Xml:
+          buffer += "<prime>" + std::to_string(prime) + "</prime>";
+          break;
+        case OutputFormat::Yaml:
+          buffer += "\n  - " + std::to_string(prime);
+          break;
+        }
+        ++count;
+      }
+      std::cout << buffer;
+    });
+  } catch (const std::exception &ex) {
+    return reportError(ex.what());
+  }
+  if (!opened) {
+    open();
+  }
+
+  switch (outputFormat) {
+  case OutputFormat::Text:
+    std::cout << '\n';
+    break;
+  case OutputFormat::Json:
+    std::cout << "],\"count\":" << count;
+    break;
+  case OutputFormat::Xml:
+    std::cout << "</primes><count>" << count << "</count>";
+    break;
+  case OutputFormat::Yaml:
+    std::cout << (count == 0 ? " []" : "") << "\ncount: " << count;
+    break;
+  }
+  endStructuredSuccess(std::cout, outputFormat);
+  return 0;
+}
+
+int runPrimeCount(const std::string &fromStr, const std::string &toStr,
+                  OutputFormat outputFormat) {
+  std::uint64_t from = 0;
+  std::uint64_t to = 0;
+  std::uint64_t count = 0;
+  std::string error;
+  if (resolvePrimeRange(fromStr, toStr, from, to, error)) {
+    try {
+      count = countPrimes(from, to);
+    } catch (const std::exception &ex) {
+      error = ex.what();
+    }
+  }
+  if (!error.empty()) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Error: " << error << RESET << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "prime-count", error);
+    }
+    return 1;
+  }
+
+  if (outputFormat == OutputFormat::Text) {
+    std::cout << GREEN << "Prime count: " << RESET << count << '\n';
+    return 0;
+  }
+  std::ostringstream jsonPayload;
+  jsonPayload << "\"from\":" << from << ",\"to\":" << to
+              << ",\"count\":" << count;
+  std::ostringstream xmlPayload;
+  xmlPayload << "<from>" << from << "</from><to>" << to << "</to><count>"
+             << count << "</count>";
+  std::ostringstream yamlPayload;
+  yamlPayload << "from: " << from << '\n'
+              << "to: " << to << '\n'
+              << "count: " << count;
+  printStructuredSuccess(std::cout, outputFormat, "prime-count",
+                         jsonPayload.str(), xmlPayload.str(),
+                         yamlPayload.str());
+  return 0;
+}
+
+int runSolveLinear(const std::string &aStr, const std::string &bStr,
+                   OutputFormat outputFormat) {
+  double a = 0.0;
+  double b = 0.0;
+  std::string parseError;
+  if (!resolveDoubleArgument(aStr, a, parseError) ||
+      !resolveDoubleArgument(bStr, b, parseError)) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Error: " << parseError << RESET << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "solve-linear",
+                           parseError);
+    }
+    return 1;
+  }
+
+  if (isApproximatelyZero(a)) {
+    if (isApproximatelyZero(b)) {
+      if (outputFormat == OutputFormat::Text) {
+        std::cout << CYAN << "Every real number is a solution." << RESET
+                  << '\n';
+      } else {
+        printStructuredSuccess(std::cout, outputFormat, "solve-linear",
+                               "\"status\":\"all-real\"",
+                               "<status>all-real</status>",
+                               "status: all-real");
+      }
+      return 0;
+    }
+    if (outputFormat == OutputFormat::Text) {
+      std::cout << RED << "No solution exists for this equation." << RESET
+                << '\n';
+    } else {
+      printStructuredSuccess(std::cout, outputFormat, "solve-linear",
+                             "\"status\":\"none\"",
                              "<status>none</status>", "status: none");
     }
     return 0;
@@ -1425,6 +1993,301 @@ int runGraphValues(const std::vector<std::string> &tokens,
   return 0;
 }
 
+int runPlot(const std::vector<std::string> &tokens,
+            OutputFormat outputFormat) {
+  auto reportError = [outputFormat](const std::string &message, int code) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Error: " << message << RESET << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "plot", message);
+    }
+    return code;
+  };
+  const std::string usage =
+      "usage: --plot <expression> <x=a:b> [--samples N] <output.png>";
+  if (tokens.size() < 3) {
+    return reportError(usage, 2);
+  }
+
+  std::string range;
+  std::string outputPath;
+  std::size_t samples = DefaultPlotSamples;
+  std::string error;
+  for (std::size_t idx = 1; idx < tokens.size(); ++idx) {
+    const std::string &token = tokens[idx];
+    if (token.rfind("--samples=", 0) == 0) {
+      if (!parseSampleCount(token.substr(10), samples, error)) {
+        return reportError(error, 1);
+      }
+      continue;
+    }
+    if (token == "--samples") {
+      if (idx + 1 >= tokens.size()) {
+        return reportError("missing value after --samples", 1);
+      }
+      if (!parseSampleCount(tokens[++idx], samples, error)) {
+        return reportError(error, 1);
+      }
+      continue;
+    }
+    if (range.empty() && token.find('=') != std::string::npos) {
+      range = token;
+    } else if (outputPath.empty()) {
+      outputPath = token;
+    } else {
+      return reportError("unexpected argument '" + token + "'", 2);
+    }
+  }
+  std::size_t equals = range.find('=');
+  std::size_t colon = range.find(':', equals);
+  if (outputPath.empty() || range.empty() || colon == std::string::npos) {
+    return reportError(usage, 2);
+  }
+  std::string variable = trimCopy(range.substr(0, equals));
+  outputPath = ensurePngExtension(outputPath);
+
+  // The range ends may be expressions, e.g. x=-2*3.14159:2*3.14159.
+  const VariableStore &store = globalVariableStore();
+  double from = 0.0;
+  double to = 0.0;
+  SampledCurve curve;
+  try {
+    from = evaluateExpression(range.substr(equals + 1, colon - equals - 1),
+                              store.variables());
+    to = evaluateExpression(range.substr(colon + 1), store.variables());
+    curve = sampleExpression(tokens.front(), variable, from, to, samples,
+                             store.variables());
+  } catch (const std::exception &ex) {
+    return reportError(ex.what(), 1);
+  }
+
+  std::string pngError;
+  if (!generateFunctionPlotPng(curve.xs, curve.ys, outputPath, pngError)) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Failed to create PNG: " << RESET << pngError
+                << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "plot", pngError);
+    }
+    return 1;
+  }
+
+  if (outputFormat == OutputFormat::Text) {
+    std::cout << GREEN << "Sampled " << curve.xs.size() << " points for "
+              << variable << " in [" << from << ", " << to << "]." << RESET
+              << '\n';
+    std::cout << GREEN << "Saved graph to '" << outputPath << "'." << RESET
+              << '\n';
+    return 0;
+  }
+  std::ostringstream jsonPayload;
+  jsonPayload << "\"expression\":\"" << jsonEscape(tokens.front())
+              << "\",\"variable\":\"" << jsonEscape(variable)
+              << "\",\"from\":" << from << ",\"to\":" << to
+              << ",\"samples\":" << curve.xs.size() << ",\"output\":\""
+              << jsonEscape(outputPath) << '"';
+  std::ostringstream xmlPayload;
+  xmlPayload << "<expression>" << xmlEscape(tokens.front())
+             << "</expression><variable>" << xmlEscape(variable)
+             << "</variable><from>" << from << "</from><to>" << to
+             << "</to><samples>" << curve.xs.size() << "</samples><output>"
+             << xmlEscape(outputPath) << "</output>";
+  std::ostringstream yamlPayload;
+  yamlPayload << "expression: " << yamlEscape(tokens.front()) << '\n'
+              << "variable: " << yamlEscape(variable) << '\n'
+              << "from: " << from << '\n'
+              << "to: " << to << '\n'
+              << "samples: " << curve.xs.size() << '\n'
+              << "output: " << yamlEscape(outputPath);
+  printStructuredSuccess(std::cout, outputFormat, "plot", jsonPayload.str(),
+                         xmlPayload.str(), yamlPayload.str());
+  return 0;
+}
+
+int runIntegrate(const std::vector<std::string> &tokens,
+                 OutputFormat outputFormat) {
+  auto reportError = [outputFormat](const std::string &message, int code) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Error: " << message << RESET << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "integrate", message);
+    }
+    return code;
+  };
+  const std::string usage =
+      "usage: --integrate <expression> <variable> <a> <b> [--tol eps]";
+
+  std::vector<std::string> positional;
+  double tolerance = DefaultIntegrationTolerance;
+  for (std::size_t idx = 0; idx < tokens.size(); ++idx) {
+    const std::string &token = tokens[idx];
+    std::string value;
+    if (token.rfind("--tol=", 0) == 0) {
+      value = token.substr(6);
+    } else if (token == "--tol") {
+      if (idx + 1 >= tokens.size()) {
+        return reportError("missing value after --tol", 1);
+      }
+      value = tokens[++idx];
+    } else {
+      positional.push_back(token);
+      continue;
+    }
+    try {
+      std::size_t used = 0;
+      tolerance = std::stod(value, &used);
+      if (used != value.size() || !(tolerance > 0.0)) {
+        throw std::invalid_argument(value);
+      }
+    } catch (const std::exception &) {
+      return reportError("tolerance must be a positive number", 1);
+    }
+  }
+  if (positional.size() != 4) {
+    return reportError(usage, 2);
+  }
+  const std::string &expression = positional[0];
+  const std::string &variable = positional[1];
+
+  // The limits may be expressions themselves, e.g. 2^-3.
+  const VariableStore &store = globalVariableStore();
+  double from = 0.0;
+  double to = 0.0;
+  IntegrationResult result;
+  try {
+    from = evaluateExpression(positional[2], store.variables());
+    to = evaluateExpression(positional[3], store.variables());
+    result = integrateExpression(expression, variable, from, to, tolerance,
+                                 store.variables());
+  } catch (const std::exception &ex) {
+    return reportError(ex.what(), 1);
+  }
+
+  if (outputFormat == OutputFormat::Text) {
+    std::ostringstream value;
+    value << std::setprecision(15) << result.value;
+    std::ostringstream error;
+    error << std::setprecision(3) << result.error;
+    std::cout << GREEN << "Result: " << RESET << value.str() << '\n';
+    std::cout << "Estimated error: " << error.str() << " ("
+              << result.evaluations << " evaluations)" << '\n';
+    if (!result.converged) {
+      std::cout << YELLOW
+                << "Warning: the requested tolerance was not reached."
+                << RESET << '\n';
+    }
+    return 0;
+  }
+  std::ostringstream jsonPayload;
+  jsonPayload << std::setprecision(15) << "\"expression\":\""
+              << jsonEscape(expression) << "\",\"variable\":\""
+              << jsonEscape(variable) << "\",\"from\":" << from
+              << ",\"to\":" << to << ",\"value\":" << result.value
+              << ",\"error\":" << result.error
+              << ",\"evaluations\":" << result.evaluations
+              << ",\"converged\":" << (result.converged ? "true" : "false");
+  std::ostringstream xmlPayload;
+  xmlPayload << std::setprecision(15) << "<expression>"
+             << xmlEscape(expression) << "</expression><variable>"
+             << xmlEscape(variable) << "</variable><from>" << from
+             << "</from><to>" << to << "</to><value>" << result.value
+             << "</value><error>" << result.error << "</error><evaluations>"
+             << result.evaluations << "</evaluations><converged>"
+             << (result.converged ? "true" : "false") << "</converged>";
+  std::ostringstream yamlPayload;
+  yamlPayload << std::setprecision(15)
+              << "expression: " << yamlEscape(expression) << '\n'
+              << "variable: " << yamlEscape(variable) << '\n'
+              << "from: " << from << '\n'
+              << "to: " << to << '\n'
+              << "value: " << result.value << '\n'
+              << "error: " << result.error << '\n'
+              << "evaluations: " << result.evaluations << '\n'
+              << "converged: " << (result.converged ? "true" : "false");
+  printStructuredSuccess(std::cout, outputFormat, "integrate",
+                         jsonPayload.str(), xmlPayload.str(),
+                         yamlPayload.str());
+  return 0;
+}
+
+int runSolve(const std::vector<std::string> &tokens,
+             OutputFormat outputFormat) {
+  auto reportError = [outputFormat](const std::string &message, int code) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Error: " << message << RESET << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "solve", message);
+    }
+    return code;
+  };
+  if (tokens.size() != 2 && tokens.size() != 4) {
+    return reportError("usage: --solve <expression> <variable> [a b]", 2);
+  }
+  const std::string &expression = tokens[0];
+  const std::string &variable = tokens[1];
+
+  const VariableStore &store = globalVariableStore();
+  double from = -DefaultRootBound;
+  double to = DefaultRootBound;
+  std::vector<double> roots;
+  try {
+    if (tokens.size() == 4) {
+      from = evaluateExpression(tokens[2], store.variables());
+      to = evaluateExpression(tokens[3], store.variables());
+    }
+    roots = findRoots(expression, variable, from, to, store.variables());
+  } catch (const std::exception &ex) {
+    return reportError(ex.what(), 1);
+  }
+
+  auto formatRoot = [](double root) {
+    std::ostringstream out;
+    out << std::setprecision(15) << root;
+    return out.str();
+  };
+  if (outputFormat == OutputFormat::Text) {
+    if (roots.empty()) {
+      std::cout << YELLOW << "No roots found for " << variable << " in ["
+                << from << ", " << to << "]." << RESET << '\n';
+      return 0;
+    }
+    std::cout << GREEN << "Roots:" << RESET << '\n';
+    for (double root : roots) {
+      std::cout << variable << " = " << formatRoot(root) << '\n';
+    }
+    return 0;
+  }
+  std::ostringstream jsonPayload;
+  jsonPayload << "\"expression\":\"" << jsonEscape(expression)
+              << "\",\"variable\":\"" << jsonEscape(variable)
+              << "\",\"from\":" << from << ",\"to\":" << to
+              << ",\"roots\":[";
+  std::ostringstream xmlPayload;
+  xmlPayload << "<expression>" << xmlEscape(expression)
+             << "</expression><variable>" << xmlEscape(variable)
+             << "</variable><from>" << from << "</from><to>" << to
+             << "</to><roots>";
+  std::ostringstream yamlPayload;
+  yamlPayload << "expression: " << yamlEscape(expression) << '\n'
+              << "variable: " << yamlEscape(variable) << '\n'
+              << "from: " << from << '\n'
+              << "to: " << to << '\n'
+              << "roots:";
+  for (std::size_t idx = 0; idx < roots.size(); ++idx) {
+    jsonPayload << (idx > 0 ? "," : "") << formatRoot(roots[idx]);
+    xmlPayload << "<root>" << formatRoot(roots[idx]) << "</root>";
+    yamlPayload << "\n  - " << formatRoot(roots[idx]);
+  }
+  if (roots.empty()) {
+    yamlPayload << " []";
+  }
+  jsonPayload << ']';
+  xmlPayload << "</roots>";
+  printStructuredSuccess(std::cout, outputFormat, "solve", jsonPayload.str(),
+                         xmlPayload.str(), yamlPayload.str());
+  return 0;
+}
+
 int runGraphCsv(const std::vector<std::string> &tokens,
                 OutputFormat outputFormat) {
   if (tokens.size() < 3) {
@@ -1490,138 +2353,18 @@ int runGraphCsv(const std::vector<std::string> &tokens,
     }
   }
 
-  std::ifstream input(csvPath);
-  if (!input) {
-    std::string message = "unable to open '" + csvPath + "'.";
-    if (outputFormat == OutputFormat::Text) {
-      std::cerr << RED << "Error: " << message << RESET << '\n';
-    } else {
-      printStructuredError(std::cerr, outputFormat, "graph-csv", message);
-    }
-    return 1;
-  }
-
-  std::vector<std::vector<std::string>> rows;
-  std::string line;
-  while (std::getline(input, line)) {
-    if (!line.empty() && line.back() == '\r') {
-      line.pop_back();
-    }
-    rows.push_back(parseCsvLine(line));
-  }
-  if (rows.empty()) {
-    std::string message = "CSV file is empty.";
-    if (outputFormat == OutputFormat::Text) {
-      std::cerr << RED << "Error: " << message << RESET << '\n';
-    } else {
-      printStructuredError(std::cerr, outputFormat, "graph-csv", message);
-    }
-    return 1;
-  }
-
-  std::vector<std::string> headers;
-  std::size_t dataStartIndex = 0;
-  if (hasHeaders) {
-    headers = rows.front();
-    dataStartIndex = 1;
-    if (headers.empty()) {
-      std::string message = "header row does not contain any columns.";
-      if (outputFormat == OutputFormat::Text) {
-        std::cerr << RED << "Error: " << message << RESET << '\n';
-      } else {
-        printStructuredError(std::cerr, outputFormat, "graph-csv", message);
-      }
-      return 1;
-    }
-    for (std::size_t idx = 0; idx < headers.size(); ++idx) {
-      if (trimCopy(headers[idx]).empty()) {
-        std::ostringstream fallback;
-        fallback << "Column " << (idx + 1);
-        headers[idx] = fallback.str();
-      }
-    }
-  } else {
-    if (rows.front().empty()) {
-      std::string message = "unable to determine column count from first row.";
-      if (outputFormat == OutputFormat::Text) {
-        std::cerr << RED << "Error: " << message << RESET << '\n';
-      } else {
-        printStructuredError(std::cerr, outputFormat, "graph-csv", message);
-      }
-      return 1;
-    }
-    headers.resize(rows.front().size());
-    for (std::size_t idx = 0; idx < rows.front().size(); ++idx) {
-      std::ostringstream fallback;
-      fallback << "Column " << (idx + 1);
-      headers[idx] = fallback.str();
-    }
-  }
-
-  std::size_t columnIndex = 0;
-  bool matched = false;
-  try {
-    long long idx = std::stoll(columnSpec);
-    if (idx >= 1 && static_cast<std::size_t>(idx) <= headers.size()) {
-      columnIndex = static_cast<std::size_t>(idx - 1);
-      matched = true;
-    }
-  } catch (const std::exception &) {
-  }
-  if (!matched) {
-    std::string lowered = toLowerCopy(columnSpec);
-    for (std::size_t idx = 0; idx < headers.size(); ++idx) {
-      if (toLowerCopy(headers[idx]) == lowered) {
-        columnIndex = idx;
-        matched = true;
-        break;
-      }
-    }
-  }
-  if (!matched) {
-    std::string message = "unable to match column selection.";
+  CsvColumn column;
+  if (!readCsvColumn(csvPath, columnSpec, hasHeaders, column, error)) {
     if (outputFormat == OutputFormat::Text) {
-      std::cerr << RED << "Error: " << message << RESET << '\n';
-    } else {
-      printStructuredError(std::cerr, outputFormat, "graph-csv", message);
-    }
-    return 1;
-  }
-
-  std::vector<double> values;
-  std::size_t skippedMissing = 0;
-  std::size_t skippedInvalid = 0;
-  for (std::size_t idx = dataStartIndex; idx < rows.size(); ++idx) {
-    if (columnIndex >= rows[idx].size()) {
-      ++skippedMissing;
-      continue;
-    }
-    std::string cell = trimCopy(rows[idx][columnIndex]);
-    if (cell.empty()) {
-      ++skippedMissing;
-      continue;
-    }
-    try {
-      std::size_t processed = 0;
-      double parsed = std::stod(cell, &processed);
-      if (processed != cell.size()) {
-        ++skippedInvalid;
-        continue;
-      }
-      values.push_back(parsed);
-    } catch (const std::exception &) {
-      ++skippedInvalid;
-    }
-  }
-  if (values.empty()) {
-    std::string message = "no numeric values found in selected column.";
-    if (outputFormat == OutputFormat::Text) {
-      std::cerr << RED << "Error: " << message << RESET << '\n';
+      std::cerr << RED << "Error: " << error << RESET << '\n';
     } else {
-      printStructuredError(std::cerr, outputFormat, "graph-csv", message);
+      printStructuredError(std::cerr, outputFormat, "graph-csv", error);
     }
     return 1;
   }
+  const std::vector<double> &values = column.values;
+  std::size_t skippedMissing = column.skippedMissing;
+  std::size_t skippedInvalid = column.skippedInvalid;
 
   std::vector<std::string> preview = buildAsciiGraph(values, height);
   std::string pngError;
@@ -1689,6 +2432,225 @@ int runGraphCsv(const std::vector<std::string> &tokens,
   return 0;
 }
 
+int runEvalColumn(const std::vector<std::string> &tokens,
+                  OutputFormat outputFormat) {
+  if (tokens.size() < 3) {
+    std::string message = "usage: --eval-column <expression> <csv-path> "
+                          "<column> [--var NAME] [--no-headers]";
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Error: " << message << RESET << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "eval-column", message);
+    }
+    return 2;
+  }
+
+  const std::string &expression = tokens[0];
+  const std::string &csvPath = tokens[1];
+  const std::string &columnSpec = tokens[2];
+  std::string variableName = "x";
+  bool hasHeaders = true;
+  for (std::size_t idx = 3; idx < tokens.size(); ++idx) {
+    const std::string &token = tokens[idx];
+    if (token == "--no-headers") {
+      hasHeaders = false;
+    } else if (token == "--headers") {
+      hasHeaders = true;
+    } else if (token.rfind("--var=", 0) == 0) {
+      variableName = token.substr(6);
+    } else if (token == "--var" && idx + 1 < tokens.size()) {
+      variableName = tokens[++idx];
+    } else {
+      std::string message = "unexpected argument: " + token;
+      if (outputFormat == OutputFormat::Text) {
+        std::cerr << RED << "Error: " << message << RESET << '\n';
+      } else {
+        printStructuredError(std::cerr, outputFormat, "eval-column", message);
+      }
+      return 2;
+    }
+  }
+  if (!VariableStore::isValidName(variableName)) {
+    std::string message = "invalid variable name: " + variableName;
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Error: " << message << RESET << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "eval-column", message);
+    }
+    return 1;
+  }
+
+  CsvColumn column;
+  std::string error;
+  if (!readCsvColumn(csvPath, columnSpec, hasHeaders, column, error)) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Error: " << error << RESET << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "eval-column", error);
+    }
+    return 1;
+  }
+
+  std::vector<EvalResult> results;
+  try {
+    CompiledExpression compiled(expression);
+    std::string columnVariable = toLowerCopy(variableName);
+    const auto &stored = globalVariableStore().variables();
+    std::vector<std::vector<double>> columns;
+    for (const std::string &name : compiled.variableNames()) {
+      if (name == columnVariable) {
+        columns.push_back(column.values);
+        continue;
+      }
+      auto found = stored.find(name);
+      if (found == stored.end()) {
+        throw std::invalid_argument("Unknown variable: " + name);
+      }
+      columns.push_back({found->second});
+    }
+    results = compiled.tryEvaluateColumns(columns, column.values.size());
+  } catch (const std::exception &ex) {
+    if (outputFormat == OutputFormat::Text) {
+      std::cerr << RED << "Error: " << RESET << ex.what() << '\n';
+    } else {
+      printStructuredError(std::cerr, outputFormat, "eval-column", ex.what());
+    }
+    return 1;
+  }
+
+  // One entry per data row, so the output lines up with the CSV: rows that
+  // were skipped or failed to evaluate carry a note instead of a value.
+  struct RowOutcome {
+    bool ok = false;
+    double value = 0.0;
+    std::string note;
+  };
+  std::vector<RowOutcome> outcomes;
+  outcomes.reserve(column.cells.size());
+  std::size_t failed = 0;
+  auto nextResult = results.begin();
+  for (CsvCell cell : column.cells) {
+    RowOutcome outcome;
+    if (cell == CsvCell::Missing) {
+      outcome.note = "skipped: missing value";
+    } else if (cell == CsvCell::Invalid) {
+      outcome.note = "skipped: invalid number";
+    } else if (nextResult->ok()) {
+      outcome.ok = true;
+      outcome.value = nextResult->value;
+    } else {
+      outcome.note = "error: " + nextResult->message;
+      ++failed;
+    }
+    if (cell == CsvCell::Value) {
+      ++nextResult;
+    }
+    outcomes.push_back(std::move(outcome));
+  }
+
+  if (outputFormat == OutputFormat::Text) {
+    if (column.skippedMissing > 0 || column.skippedInvalid > 0) {
+      std::cout << YELLOW << "Skipped " << column.skippedMissing
+                << " row(s) with missing values and " << column.skippedInvalid
+                << " row(s) with invalid numbers." << RESET << '\n';
+    }
+    if (failed > 0) {
+      std::cout << YELLOW << failed << " row(s) failed to evaluate." << RESET
+                << '\n';
+    }
+    std::cout << GREEN << "Results:" << RESET << '\n';
+    for (const RowOutcome &outcome : outcomes) {
+      if (outcome.ok) {
+        std::cout << outcome.value << '\n';
+      } else {
+        std::cout << YELLOW << outcome.note << RESET << '\n';
+      }
+    }
+  } else {
+    // Rows without a value are null in the results, with their note under
+    // `notes` keyed by the 1-based data row.
+    std::ostringstream jsonPayload;
+    jsonPayload << "\"expression\":\"" << jsonEscape(expression)
+                << "\",\"results\":[";
+    for (std::size_t idx = 0; idx < outcomes.size(); ++idx) {
+      if (idx > 0) {
+        jsonPayload << ',';
+      }
+      if (outcomes[idx].ok) {
+        jsonPayload << outcomes[idx].value;
+      } else {
+        jsonPayload << "null";
+      }
+    }
+    jsonPayload << "],\"notes\":[";
+    bool firstNote = true;
+    for (std::size_t idx = 0; idx < outcomes.size(); ++idx) {
+      if (outcomes[idx].ok) {
+        continue;
+      }
+      if (!firstNote) {
+        jsonPayload << ',';
+      }
+      firstNote = false;
+      jsonPayload << "{\"row\":" << idx + 1 << ",\"message\":\""
+                  << jsonEscape(outcomes[idx].note) << "\"}";
+    }
+    jsonPayload << "],\"skippedMissing\":" << column.skippedMissing
+                << ",\"skippedInvalid\":" << column.skippedInvalid
+                << ",\"failed\":" << failed;
+
+    std::ostringstream xmlPayload;
+    xmlPayload << "<expression>" << xmlEscape(expression)
+               << "</expression><results>";
+    for (const RowOutcome &outcome : outcomes) {
+      if (outcome.ok) {
+        xmlPayload << "<value>" << outcome.value << "</value>";
+      } else {
+        xmlPayload << "<value/>";
+      }
+    }
+    xmlPayload << "</results><notes>";
+    for (std::size_t idx = 0; idx < outcomes.size(); ++idx) {
+      if (!outcomes[idx].ok) {
+        xmlPayload << "<note row=\"" << idx + 1 << "\">"
+                   << xmlEscape(outcomes[idx].note) << "</note>";
+      }
+    }
+    xmlPayload << "</notes><skippedMissing>" << column.skippedMissing
+               << "</skippedMissing><skippedInvalid>" << column.skippedInvalid
+               << "</skippedInvalid><failed>" << failed << "</failed>";
+
+    std::ostringstream yamlPayload;
+    yamlPayload << "expression: " << yamlEscape(expression) << "\nresults:";
+    for (const RowOutcome &outcome : outcomes) {
+      yamlPayload << "\n  - ";
+      if (outcome.ok) {
+        yamlPayload << outcome.value;
+      } else {
+        yamlPayload << "null";
+      }
+    }
+    yamlPayload << "\nnotes:";
+    if (failed + column.skippedMissing + column.skippedInvalid == 0) {
+      yamlPayload << " []";
+    }
+    for (std::size_t idx = 0; idx < outcomes.size(); ++idx) {
+      if (!outcomes[idx].ok) {
+        yamlPayload << "\n  - row: " << idx + 1
+                    << "\n    message: " << yamlEscape(outcomes[idx].note);
+      }
+    }
+    yamlPayload << "\nskippedMissing: " << column.skippedMissing
+                << "\nskippedInvalid: " << column.skippedInvalid
+                << "\nfailed: " << failed;
+
+    printStructuredSuccess(std::cout, outputFormat, "eval-column",
+                           jsonPayload.str(), xmlPayload.str(),
+                           yamlPayload.str());
+  }
+  return 0;
+}
+
 int runSetVariable(const std::string &name, const std::string &valueStr,
                    OutputFormat outputFormat) {
   if (!VariableStore::isValidName(name)) {
@@ -1820,17 +2782,42 @@ int runHelp(OutputFormat outputFormat) {
       "arbitrary-precision integers (integers only).\n"
       "  --bigdouble                   Evaluate expressions using "
       "arbitrary-precision decimals.\n"
+      "  --adaptive                    Evaluate in double precision, falling "
+      "back to --bigdouble when rounding makes the result unreliable.\n"
+      "  --eval-interval <expression>  Evaluate with interval arithmetic and "
+      "print guaranteed bounds.\n"
+      "  --eval-grad <expression> <x,y,...>  Evaluate the expression and "
+      "its partial derivatives at the stored variable values.\n"
+      "  --eval-cache <N>              Remember up to N evaluation results "
+      "until a variable changes.\n"
+      "  --eval-engine=<interp|threaded>  Choose how compiled expressions "
+      "run (default interp).\n"
+      "  --factorial-limit <N>         Largest n accepted by n! in --bigint "
+      "and --bigdouble modes (default 100000).\n"
+      "  --power-limit <bits>          Largest ^ result in --bigint mode "
+      "(default 1048576 bits).\n"
+      "  --precision <digits>          Significant digits printed in "
+      "--bigdouble mode, 1 to 1000 (default 50).\n"
+      "  --factor-time <seconds>       Time --prime-factorization may spend "
+      "on rho and ECM for large numbers (default 30).\n"
       "  --repl                        Start the interactive REPL with "
       "arrow-key history + CLI flag support.\n"
       "  -sqrt, --square-root <value>  Calculate the square root of the given "
       "value.\n"
       "  -d, --divisors <number>       Calculate and display the divisors of "
       "the given number.\n"
+      "  --divisor-summary <number>    Count and sum the divisors without "
+      "listing them.\n"
       "  -c, --convert <from> <to> <value>  Convert value from one base to "
       "another (bases: 2, 10, 16).\n"
       "  --unit-convert <category> <from> <to> <value>  Convert measurement "
       "units (length, mass, volume, temperature).\n"
-      "  -pf, --prime-factorization <value>  Factorize a number into primes.\n"
+      "  -pf, --prime-factorization <value>  Factorize a number into primes "
+      "(any size; big values may be bigint expressions).\n"
+      "  --primes <a> <b>              List the primes in [a, b], streamed "
+      "from a segmented sieve.\n"
+      "  --prime-count <a> <b>         Count the primes in [a, b] without "
+      "listing them.\n"
       "  --solve-linear <a> <b>        Solve a linear equation a*x + b = 0.\n"
       "  --solve-quadratic <a> <b> <c> Solve a quadratic equation "
       "a*x^2 + b*x + c = 0.\n"
@@ -1842,10 +2829,18 @@ int runHelp(OutputFormat outputFormat) {
       "',' or spaces).\n"
       "  --stats, --statistics <values...>  Compute summary statistics for a "
       "list.\n"
+      "  --plot <expression> <x=a:b> [--samples N] <output.png>  Plot the "
+      "expression over a range, adding samples where the curve bends.\n"
+      "  --solve <expression> <x> [a b]  Find the roots of the expression "
+      "in [a, b] (default [-100, 100]).\n"
+      "  --integrate <expression> <x> <a> <b> [--tol eps]  Integrate the "
+      "expression over x from a to b.\n"
       "  --graph-values <output.png> <values...> [--height N]  Render values "
       "to a PNG graph.\n"
       "  --graph-csv <output.png> <csv> <column> [--height N] [--no-headers]  "
       "Render CSV column to a PNG graph.\n"
+      "  --eval-column <expr> <csv> <column> [--var NAME] [--no-headers]  "
+      "Evaluate an expression for every row of a CSV column (bound to x).\n"
       "  -v, --version                 Print the application version.\n"
       "  --variables, --list-variables List persisted variables.\n"
       "  --set-variable <name> <value> Set or update a stored variable.\n"
@@ -1868,18 +2863,45 @@ int runHelp(OutputFormat outputFormat) {
                  "arbitrary-precision integers (integers only).\n";
     std::cout << "  --bigdouble                   Evaluate expressions using "
                  "arbitrary-precision decimals.\n";
+    std::cout << "  --adaptive                    Evaluate in double "
+                 "precision, falling back to --bigdouble when rounding makes "
+                 "the result unreliable.\n";
+    std::cout << "  --eval-interval <expression>  Evaluate with interval "
+                 "arithmetic and print guaranteed bounds.\n";
+    std::cout << "  --eval-grad <expression> <x,y,...>  Evaluate the "
+                 "expression and its partial derivatives at the stored "
+                 "variable values.\n";
+    std::cout << "  --eval-cache <N>              Remember up to N evaluation "
+                 "results until a variable changes.\n";
+    std::cout << "  --eval-engine=<interp|threaded>  Choose how compiled "
+                 "expressions run (default interp).\n";
+    std::cout << "  --factorial-limit <N>         Largest n accepted by n! in "
+                 "--bigint and --bigdouble modes (default 100000).\n";
+    std::cout << "  --power-limit <bits>          Largest ^ result in --bigint "
+                 "mode (default 1048576 bits).\n";
+    std::cout << "  --precision <digits>          Significant digits printed "
+                 "in --bigdouble mode, 1 to 1000 (default 50).\n";
+    std::cout << "  --factor-time <seconds>       Time --prime-factorization "
+                 "may spend on rho and ECM for large numbers (default 30).\n";
     std::cout << "  --repl                        Start the interactive REPL "
                  "with arrow-key history + CLI flag support.\n";
     std::cout << "  -sqrt, --square-root <value>  Calculate the square root of "
                  "the given value.\n";
     std::cout << "  -d, --divisors <number>       Calculate and display the "
                  "divisors of the given number.\n";
+    std::cout << "  --divisor-summary <number>    Count and sum the divisors "
+                 "without listing them.\n";
     std::cout << "  -c, --convert <from> <to> <value>  Convert value from one "
                  "base to another (bases: 2, 10, 16).\n";
     std::cout << "  --unit-convert <category> <from> <to> <value>  Convert "
                  "measurement units (length, mass, volume, temperature).\n";
     std::cout << "  -pf, --prime-factorization <value>  Factorize a number "
-                 "into primes.\n";
+                 "into primes (any size; big values may be bigint "
+                 "expressions).\n";
+    std::cout << "  --primes <a> <b>              List the primes in [a, b], "
+                 "streamed from a segmented sieve.\n";
+    std::cout << "  --prime-count <a> <b>         Count the primes in [a, b] "
+                 "without listing them.\n";
     std::cout << "  --solve-linear <a> <b>        Solve a linear equation "
                  "a*x + b = 0.\n";
     std::cout << "  --solve-quadratic <a> <b> <c> Solve a quadratic equation "
@@ -1892,10 +2914,20 @@ int runHelp(OutputFormat outputFormat) {
                  "columns ',' or spaces).\n";
     std::cout << "  --stats, --statistics <values...>  Compute summary "
                  "statistics for a list.\n";
+    std::cout << "  --plot <expression> <x=a:b> [--samples N] <output.png>  "
+                 "Plot the expression over a range, adding samples where the "
+                 "curve bends.\n";
+    std::cout << "  --solve <expression> <x> [a b]  Find the roots of the "
+                 "expression in [a, b] (default [-100, 100]).\n";
+    std::cout << "  --integrate <expression> <x> <a> <b> [--tol eps]  "
+                 "Integrate the expression over x from a to b.\n";
     std::cout << "  --graph-values <output.png> <values...> [--height N]  "
                  "Render values to a PNG graph.\n";
     std::cout << "  --graph-csv <output.png> <csv> <column> [--height N] "
                  "[--no-headers]  Render CSV column to a PNG graph.\n";
+    std::cout << "  --eval-column <expr> <csv> <column> [--var NAME] "
+                 "[--no-headers]  Evaluate an expression for every row of a "
+                 "CSV column (bound to x).\n";
     std::cout
         << "  -v, --version                 Print the application version.\n";
     std::cout << "  --variables, --list-variables List persisted variables.\n";
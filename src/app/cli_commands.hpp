@@ -8,16 +8,25 @@
 
 int runEval(const std::string &expression, OutputFormat outputFormat,
             std::optional<double> *lastResult = nullptr,
-            bool useBigInt = false, bool useBigDouble = false);
+            bool useBigInt = false, bool useBigDouble = false,
+            bool useAdaptive = false);
+int runEvalInterval(const std::string &expression, OutputFormat outputFormat);
+int runEvalGradient(const std::string &expression,
+                    const std::string &variableList, OutputFormat outputFormat);
 int runSquareRoot(const std::string &number, OutputFormat outputFormat,
                   std::optional<double> *lastResult = nullptr);
 int runDivisors(const std::string &input, OutputFormat outputFormat);
+int runDivisorSummary(const std::string &input, OutputFormat outputFormat);
 int runConvert(const std::string &fromBaseStr, const std::string &toBaseStr,
                const std::string &valueStr, OutputFormat outputFormat);
 int runUnitConvert(const std::string &category, const std::string &fromUnit,
                    const std::string &toUnit, const std::string &valueStr,
                    OutputFormat outputFormat);
 int runPrimeFactorization(const std::string &input, OutputFormat outputFormat);
+int runPrimes(const std::string &fromStr, const std::string &toStr,
+              OutputFormat outputFormat);
+int runPrimeCount(const std::string &fromStr, const std::string &toStr,
+                  OutputFormat outputFormat);
 int runSolveLinear(const std::string &aStr, const std::string &bStr,
                    OutputFormat outputFormat);
 int runSolveQuadratic(const std::string &aStr, const std::string &bStr,
@@ -32,8 +41,16 @@ int runStatistics(const std::vector<std::string> &tokens,
                   OutputFormat outputFormat);
 int runGraphValues(const std::vector<std::string> &tokens,
                    OutputFormat outputFormat);
+int runPlot(const std::vector<std::string> &tokens,
+            OutputFormat outputFormat);
+int runIntegrate(const std::vector<std::string> &tokens,
+                 OutputFormat outputFormat);
+int runSolve(const std::vector<std::string> &tokens,
+             OutputFormat outputFormat);
 int runGraphCsv(const std::vector<std::string> &tokens,
                 OutputFormat outputFormat);
+int runEvalColumn(const std::vector<std::string> &tokens,
+                  OutputFormat outputFormat);
 int runVersion(OutputFormat outputFormat);
 int runListVariables(OutputFormat outputFormat);
 int runSetVariable(const std::string &name, const std::string &valueStr,
@@ -171,6 +171,39 @@ void printStructuredSuccess(std::ostream &os, OutputFormat format,
   }
 }
 
+void beginStructuredSuccess(std::ostream &os, OutputFormat format,
+                            const std::string &action) {
+  switch (format) {
+  case OutputFormat::Json:
+    os << "{\"action\":\"" << action << "\",\"status\":\"ok\"";
+    break;
+  case OutputFormat::Xml:
+    os << "<response action=\"" << xmlEscape(action) << "\" status=\"ok\">";
+    break;
+  case OutputFormat::Yaml:
+    os << "action: " << yamlEscape(action) << "\nstatus: ok";
+    break;
+  case OutputFormat::Text:
+    break;
+  }
+}
+
+void endStructuredSuccess(std::ostream &os, OutputFormat format) {
+  switch (format) {
+  case OutputFormat::Json:
+    os << "}\n";
+    break;
+  case OutputFormat::Xml:
+    os << "</response>\n";
+    break;
+  case OutputFormat::Yaml:
+    os << '\n';
+    break;
+  case OutputFormat::Text:
+    break;
+  }
+}
+
 void printStructuredError(std::ostream &os, OutputFormat format,
                           const std::string &action,
                           const std::string &message) {
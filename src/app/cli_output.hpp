@@ -26,6 +26,13 @@ void printStructuredSuccess(std::ostream &os, OutputFormat format,
                             const std::string &jsonPayload,
                             const std::string &xmlPayload,
                             const std::string &yamlPayload);
+// For payloads too large to build in memory: the opening and closing of a
+// success response, with the payload streamed in between. Each streamed
+// JSON field starts with ',' and each YAML line with '\n', so the output
+// matches printStructuredSuccess given the same payload.
+void beginStructuredSuccess(std::ostream &os, OutputFormat format,
+                            const std::string &action);
+void endStructuredSuccess(std::ostream &os, OutputFormat format);
 void printStructuredError(std::ostream &os, OutputFormat format,
                           const std::string &action,
                           const std::string &message);
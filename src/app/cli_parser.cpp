@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cctype>
 #include <iterator>
+#include <stdexcept>
 #include <string>
 #include <utility>
 
@@ -37,6 +38,36 @@ bool parseOutputFormatToken(const std::string &token, OutputFormat &format) {
   return false;
 }
 
+// Accepts plain decimal digits only, so "-1" or "1e3" are rejected rather
+// than wrapped or truncated.
+bool parseCountToken(const std::string &token, unsigned long long &value) {
+  if (token.empty() ||
+      !std::all_of(token.begin(), token.end(),
+                   [](unsigned char ch) { return std::isdigit(ch); })) {
+    return false;
+  }
+  try {
+    value = std::stoull(token);
+  } catch (const std::exception &) {
+    return false;
+  }
+  return true;
+}
+
+constexpr const char *EvalEnginePrefix = "--eval-engine=";
+
+bool parseEvalEngineToken(const std::string &token, EvalEngine &engine) {
+  if (token == "interp") {
+    engine = EvalEngine::Interpreter;
+    return true;
+  }
+  if (token == "threaded") {
+    engine = EvalEngine::Threaded;
+    return true;
+  }
+  return false;
+}
+
 CliParseError makeError(std::string message, std::string actionId,
                         int exitCode) {
   return CliParseError{std::move(message), std::move(actionId), exitCode};
@@ -67,6 +98,11 @@ CliParser::parse(int argc, char **argv) const {
                 makeError("cannot combine --bigint and --bigdouble.",
                           "bigint", 1)};
       }
+      if (result.useAdaptive) {
+        return {result,
+                makeError("cannot combine --adaptive and --bigint.",
+                          "bigint", 1)};
+      }
       result.useBigInt = true;
       result.sawNonColorArgument = true;
       continue;
@@ -77,10 +113,137 @@ CliParser::parse(int argc, char **argv) const {
                 makeError("cannot combine --bigint and --bigdouble.",
                           "bigdouble", 1)};
       }
+      if (result.useAdaptive) {
+        return {result,
+                makeError("cannot combine --adaptive and --bigdouble.",
+                          "bigdouble", 1)};
+      }
       result.useBigDouble = true;
       result.sawNonColorArgument = true;
       continue;
     }
+    if (arg == "--adaptive") {
+      if (result.useBigInt || result.useBigDouble) {
+        std::string other = result.useBigInt ? "--bigint" : "--bigdouble";
+        return {result,
+                makeError("cannot combine --adaptive and " + other + '.',
+                          "adaptive", 1)};
+      }
+      result.useAdaptive = true;
+      result.sawNonColorArgument = true;
+      continue;
+    }
+    if (arg == "--eval-cache") {
+      result.sawNonColorArgument = true;
+      if (i + 1 >= argc) {
+        return {result, makeError("missing capacity after --eval-cache.",
+                                  "eval-cache", 1)};
+      }
+      std::string capacityToken(argv[i + 1]);
+      unsigned long long capacity = 0;
+      if (!parseCountToken(capacityToken, capacity)) {
+        return {result,
+                makeError("invalid capacity after --eval-cache: " +
+                              capacityToken + '.',
+                          "eval-cache", 1)};
+      }
+      result.evalCacheCapacity = static_cast<std::size_t>(capacity);
+      ++i;
+      continue;
+    }
+    if (arg == "--factorial-limit") {
+      result.sawNonColorArgument = true;
+      if (i + 1 >= argc) {
+        return {result, makeError("missing limit after --factorial-limit.",
+                                  "factorial-limit", 1)};
+      }
+      std::string limitToken(argv[i + 1]);
+      unsigned long long limit = 0;
+      if (!parseCountToken(limitToken, limit)) {
+        return {result,
+                makeError("invalid limit after --factorial-limit: " +
+                              limitToken + '.',
+                          "factorial-limit", 1)};
+      }
+      result.factorialLimit = limit;
+      ++i;
+      continue;
+    }
+    if (arg == "--power-limit") {
+      result.sawNonColorArgument = true;
+      if (i + 1 >= argc) {
+        return {result, makeError("missing bit count after --power-limit.",
+                                  "power-limit", 1)};
+      }
+      std::string limitToken(argv[i + 1]);
+      unsigned long long limit = 0;
+      if (!parseCountToken(limitToken, limit) || limit == 0) {
+        return {result,
+                makeError("invalid bit count after --power-limit: " +
+                              limitToken + '.',
+                          "power-limit", 1)};
+      }
+      result.powerResultLimit = static_cast<std::size_t>(limit);
+      ++i;
+      continue;
+    }
+    if (arg == "--precision") {
+      result.sawNonColorArgument = true;
+      if (i + 1 >= argc) {
+        return {result, makeError("missing digit count after --precision.",
+                                  "precision", 1)};
+      }
+      std::string digitsToken(argv[i + 1]);
+      unsigned long long digits = 0;
+      if (!parseCountToken(digitsToken, digits) || digits == 0 ||
+          digits > MaxBigDoublePrecision) {
+        return {result,
+                makeError("invalid digit count after --precision: " +
+                              digitsToken + " (expected 1 to " +
+                              std::to_string(MaxBigDoublePrecision) + ").",
+                          "precision", 1)};
+      }
+      result.bigDoublePrecision = static_cast<std::size_t>(digits);
+      ++i;
+      continue;
+    }
+    if (arg == "--factor-time") {
+      result.sawNonColorArgument = true;
+      if (i + 1 >= argc) {
+        return {result, makeError("missing seconds after --factor-time.",
+                                  "factor-time", 1)};
+      }
+      std::string secondsToken(argv[i + 1]);
+      unsigned long long seconds = 0;
+      if (!parseCountToken(secondsToken, seconds)) {
+        return {result,
+                makeError("invalid seconds after --factor-time: " +
+                              secondsToken + '.',
+                          "factor-time", 1)};
+      }
+      result.factorTimeLimit = seconds;
+      ++i;
+      continue;
+    }
+    if (arg == "--eval-engine" || arg.rfind(EvalEnginePrefix, 0) == 0) {
+      result.sawNonColorArgument = true;
+      std::string engineToken;
+      if (arg != "--eval-engine") {
+        engineToken = arg.substr(std::string(EvalEnginePrefix).size());
+      } else if (i + 1 < argc) {
+        engineToken = argv[++i];
+      } else {
+        return {result, makeError("missing engine after --eval-engine.",
+                                  "eval-engine", 1)};
+      }
+      if (!parseEvalEngineToken(engineToken, result.evalEngine)) {
+        return {result,
+                makeError("unsupported evaluation engine: " + engineToken +
+                              " (expected interp or threaded).",
+                          "eval-engine", 1)};
+      }
+      continue;
+    }
     if (arg == "--output") {
       result.sawNonColorArgument = true;
       if (i + 1 >= argc) {
@@ -109,13 +272,19 @@ CliParser::parse(int argc, char **argv) const {
     if (arg == "--bigint") {
       continue;
     }
-    if (arg == "--bigdouble") {
+    if (arg == "--bigdouble" || arg == "--adaptive") {
       continue;
     }
-    if (arg == "--output") {
+    if (arg == "--output" || arg == "--eval-cache" ||
+        arg == "--eval-engine" || arg == "--factorial-limit" ||
+        arg == "--power-limit" || arg == "--precision" ||
+        arg == "--factor-time") {
       ++i;
       continue;
     }
+    if (arg.rfind(EvalEnginePrefix, 0) == 0) {
+      continue;
+    }
 
     result.sawNonColorArgument = true;
 
@@ -143,6 +312,28 @@ CliParser::parse(int argc, char **argv) const {
       break;
     }
 
+    if (arg == "--eval-interval") {
+      if (i + 1 >= argc) {
+        return {result, makeError("missing expression after --eval-interval",
+                                  "eval-interval", 1)};
+      }
+      result.action = makeAction(CliActionType::EvalInterval,
+                                 {std::string(argv[i + 1])});
+      break;
+    }
+
+    if (arg == "--eval-grad") {
+      if (i + 2 >= argc) {
+        return {result,
+                makeError("missing expression or variables after --eval-grad",
+                          "eval-grad", 1)};
+      }
+      result.action =
+          makeAction(CliActionType::EvalGradient,
+                     {std::string(argv[i + 1]), std::string(argv[i + 2])});
+      break;
+    }
+
     if (arg == "--square-root" || arg == "-sqrt") {
       if (i + 1 >= argc) {
         std::string message = "missing value after " + arg;
@@ -163,6 +354,16 @@ CliParser::parse(int argc, char **argv) const {
       break;
     }
 
+    if (arg == "--divisor-summary") {
+      if (i + 1 >= argc) {
+        return {result, makeError("missing value after --divisor-summary",
+                                  "divisor-summary", 2)};
+      }
+      result.action = makeAction(CliActionType::DivisorSummary,
+                                 {std::string(argv[i + 1])});
+      break;
+    }
+
     if (arg == "--convert" || arg == "-c") {
       if (i + 3 >= argc) {
         std::string message = "missing arguments after " + arg;
@@ -198,6 +399,19 @@ CliParser::parse(int argc, char **argv) const {
       break;
     }
 
+    if (arg == "--primes" || arg == "--prime-count") {
+      const std::string actionId = arg.substr(2);
+      if (i + 2 >= argc) {
+        std::string message = "missing arguments after " + arg;
+        return {result, makeError(message, actionId, 2)};
+      }
+      result.action = makeAction(arg == "--primes" ? CliActionType::Primes
+                                                   : CliActionType::PrimeCount,
+                                 {std::string(argv[i + 1]),
+                                  std::string(argv[i + 2])});
+      break;
+    }
+
     if (arg == "--solve-linear") {
       if (i + 2 >= argc) {
         std::string message = "missing arguments after " + arg;
@@ -280,6 +494,45 @@ CliParser::parse(int argc, char **argv) const {
       break;
     }
 
+    if (arg == "--plot") {
+      std::vector<std::string> params;
+      for (int j = i + 1; j < argc; ++j) {
+        std::string token(argv[j]);
+        if (token == "--output" || isNoColorFlag(token)) {
+          break;
+        }
+        params.emplace_back(std::move(token));
+      }
+      result.action = makeAction(CliActionType::Plot, params);
+      break;
+    }
+
+    if (arg == "--integrate") {
+      std::vector<std::string> params;
+      for (int j = i + 1; j < argc; ++j) {
+        std::string token(argv[j]);
+        if (token == "--output" || isNoColorFlag(token)) {
+          break;
+        }
+        params.emplace_back(std::move(token));
+      }
+      result.action = makeAction(CliActionType::Integrate, params);
+      break;
+    }
+
+    if (arg == "--solve") {
+      std::vector<std::string> params;
+      for (int j = i + 1; j < argc; ++j) {
+        std::string token(argv[j]);
+        if (token == "--output" || isNoColorFlag(token)) {
+          break;
+        }
+        params.emplace_back(std::move(token));
+      }
+      result.action = makeAction(CliActionType::Solve, params);
+      break;
+    }
+
     if (arg == "--graph-csv") {
       std::vector<std::string> params;
       for (int j = i + 1; j < argc; ++j) {
@@ -293,6 +546,19 @@ CliParser::parse(int argc, char **argv) const {
       break;
     }
 
+    if (arg == "--eval-column") {
+      std::vector<std::string> params;
+      for (int j = i + 1; j < argc; ++j) {
+        std::string token(argv[j]);
+        if (token == "--output" || isNoColorFlag(token)) {
+          break;
+        }
+        params.emplace_back(std::move(token));
+      }
+      result.action = makeAction(CliActionType::EvalColumn, params);
+      break;
+    }
+
     if (arg == "--version" || arg == "-v") {
       result.action = makeAction(CliActionType::Version);
       break;
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "cli_output.hpp"
+#include "core/big_factorization.hpp"
+#include "core/expression.hpp"
 
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <utility>
@@ -10,11 +13,16 @@
 enum class CliActionType {
   None,
   Eval,
+  EvalInterval,
+  EvalGradient,
   SquareRoot,
   Divisors,
+  DivisorSummary,
   Convert,
   UnitConvert,
   PrimeFactorization,
+  Primes,
+  PrimeCount,
   SolveLinear,
   SolveQuadratic,
   MatrixAdd,
@@ -22,7 +30,11 @@ enum class CliActionType {
   MatrixMultiply,
   Statistics,
   GraphValues,
+  Plot,
+  Integrate,
+  Solve,
   GraphCsv,
+  EvalColumn,
   Version,
   Variables,
   SetVariable,
@@ -44,6 +56,13 @@ struct CliParseResult {
   bool sawNonColorArgument = false;
   bool useBigInt = false;
   bool useBigDouble = false;
+  bool useAdaptive = false;
+  std::size_t evalCacheCapacity = 0;
+  EvalEngine evalEngine = EvalEngine::Interpreter;
+  std::uint64_t factorialLimit = DefaultFactorialLimit;
+  std::size_t powerResultLimit = DefaultPowerResultLimit;
+  std::size_t bigDoublePrecision = DefaultBigDoublePrecision;
+  std::uint64_t factorTimeLimit = DefaultFactorTimeLimit;
   std::optional<CliAction> action;
 };
 
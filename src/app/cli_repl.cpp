@@ -3,6 +3,7 @@
 #include "ansi_colors.hpp"
 #include "cli_batch.hpp"
 #include "cli_commands.hpp"
+#include "core/expression_cache.hpp"
 
 #include <algorithm>
 #include <cctype>
@@ -65,6 +66,7 @@ enum class CommandOrigin { Colon, LongOption, ShortOption };
 enum class CommandKind {
   ReplHelp,
   History,
+  CacheStats,
   CliHelp,
   Eval,
   SquareRoot,
@@ -316,6 +318,12 @@ std::optional<ParsedCommand> interpretCommand(const RawCommand &raw) {
       parsed.args.clear();
       return parsed;
     }
+    if (canonical == "cache") {
+      parsed.kind = CommandKind::CacheStats;
+      parsed.textArgument.clear();
+      parsed.args.clear();
+      return parsed;
+    }
     if (canonical == "cli-help" || canonical == "clihelp" ||
         canonical == "commands") {
       parsed.kind = CommandKind::CliHelp;
@@ -532,12 +540,27 @@ recallHistoryEntry(const std::vector<std::string> &history,
   return history[static_cast<std::size_t>(index - 1)];
 }
 
+void printCacheStats() {
+  const ExpressionCache &cache = globalExpressionCache();
+  if (cache.capacity() == 0) {
+    std::cout << YELLOW
+              << "Expression cache is disabled (start with --eval-cache N)."
+              << RESET << '\n';
+    return;
+  }
+  std::cout << CYAN << "Expression cache: " << RESET << cache.size() << '/'
+            << cache.capacity() << " entries, " << cache.hits() << " hits, "
+            << cache.misses() << " misses\n";
+}
+
 void printHelp() {
   std::cout << CYAN << "REPL commands:" << RESET << '\n';
   std::cout << "  Type expressions directly (or use ':eval <expr>'/--eval) to "
                "evaluate them.\n";
   std::cout << "  ':history' shows stored entries, '!<n>' replays a line, "
                "'exit'/'quit' leaves the REPL.\n";
+  std::cout << "  ':cache' shows expression cache hits and misses when "
+               "--eval-cache is set.\n";
   std::cout << "  Use the Up/Down arrow keys to browse command history just "
                "like in Bash.\n";
   std::cout << "  Every CLI flag works here via ':command' or '--command' "
@@ -610,6 +633,9 @@ int runRepl(OutputFormat outputFormat) {
         case CommandKind::History:
           printHistory(history);
           break;
+        case CommandKind::CacheStats:
+          printCacheStats();
+          break;
         case CommandKind::CliHelp:
           runHelp(OutputFormat::Text);
           break;
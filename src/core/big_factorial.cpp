@@ -0,0 +1,24 @@
+#include "big_factorial.hpp"
+
+#include "expression.hpp"
+
+#include <atomic>
+
+namespace {
+std::atomic<std::uint64_t> limit{DefaultFactorialLimit};
+} // namespace
+
+std::uint64_t factorialLimit() {
+  return limit.load(std::memory_order_relaxed);
+}
+
+void setFactorialLimit(std::uint64_t value) {
+  limit.store(value, std::memory_order_relaxed);
+}
+
+boost::multiprecision::cpp_int bigIntFactorial(std::uint64_t n) {
+  boost::multiprecision::cpp_int result =
+      big_factorial::oddFactorial<boost::multiprecision::cpp_int>(n);
+  result <<= big_factorial::twoExponent(n);
+  return result;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <boost/multiprecision/cpp_int.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Factorials for the arbitrary-precision modes. n! is split into its odd
+// part and a power of two,
+//
+//   n! = 2^(n - popcount(n)) * prod_{i >= 0} oddUpTo(n >> i)
+//
+// where oddUpTo(m) is the product of the odd numbers up to m. oddFactorial
+// builds each oddUpTo(n >> i) from the previous one by multiplying in the
+// odd numbers in (n >> (i + 1), n >> i], so that range ends up raised to
+// the power i + 1; each range is multiplied as a balanced tree over
+// word-sized leaves. Every large multiplication then has operands of
+// similar size, which is what lets the underlying multiplication run
+// subquadratically; multiplying an accumulator by 2, 3, 4, ... in turn
+// never does.
+namespace big_factorial {
+// Odd numbers multiplied into one machine word before touching Number.
+constexpr std::uint64_t LeafSize = 16;
+
+// Product of the odd numbers in [first, last]; both must be odd.
+template <typename Number>
+Number oddRangeProduct(std::uint64_t first, std::uint64_t last) {
+  if (first > last) {
+    return Number(1);
+  }
+  const std::uint64_t count = (last - first) / 2 + 1;
+  if (count > LeafSize) {
+    const std::uint64_t upper = first + 2 * (count / 2);
+    return oddRangeProduct<Number>(first, upper - 2) *
+           oddRangeProduct<Number>(upper, last);
+  }
+
+  Number result(1);
+  std::uint64_t word = 1;
+  for (std::uint64_t factor = first; factor <= last; factor += 2) {
+    if (word > std::numeric_limits<std::uint64_t>::max() / factor) {
+      result *= word;
+      word = 1;
+    }
+    word *= factor;
+  }
+  result *= word;
+  return result;
+}
+
+// The odd part of n!, i.e. n! with every factor of two removed.
+template <typename Number> Number oddFactorial(std::uint64_t n) {
+  int bits = 0;
+  while (bits < 64 && (n >> bits) != 0) {
+    ++bits;
+  }
+
+  Number result(1);
+  Number partial(1); // product of the odd numbers up to n >> shift
+  for (int shift = bits - 1; shift >= 0; --shift) {
+    const std::uint64_t low = n >> (shift + 1);
+    const std::uint64_t high = n >> shift;
+    const std::uint64_t first = (low + 1) | 1;
+    const std::uint64_t last = (high - 1) | 1;
+    if (first <= last) {
+      partial *= oddRangeProduct<Number>(first, last);
+    }
+    result *= partial;
+  }
+  return result;
+}
+
+// Exponent of two in n! (Legendre's formula).
+inline std::uint64_t twoExponent(std::uint64_t n) {
+  std::uint64_t ones = 0;
+  for (std::uint64_t rest = n; rest != 0; rest &= rest - 1) {
+    ++ones;
+  }
+  return n - ones;
+}
+} // namespace big_factorial
+
+// n! as an exact integer.
+boost::multiprecision::cpp_int bigIntFactorial(std::uint64_t n);
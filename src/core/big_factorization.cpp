@@ -0,0 +1,667 @@
+#include "big_factorization.hpp"
+
+#include "parallel.hpp"
+#include "prime_factors.hpp"
+#include "prime_sieve.hpp"
+
+#include <boost/multiprecision/miller_rabin.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+namespace {
+using boost::multiprecision::cpp_int;
+using u64 = std::uint64_t;
+using Clock = std::chrono::steady_clock;
+
+std::atomic<u64> timeLimit{DefaultFactorTimeLimit};
+
+// Trial division removes every prime below this bound.
+constexpr u64 TrialDivisionBound = u64(1) << 16;
+// Pollard's rho needs about sqrt(p) steps to find p, so this many steps
+// catch factors up to roughly 2^34 before ECM takes over.
+constexpr u64 RhoSteps = u64(1) << 17;
+constexpr u64 RhoBatchSize = 128;
+constexpr unsigned MillerRabinRounds = 25;
+
+// Stage 1 bounds and curve counts aimed at factors of about 15, 20, 25, 30
+// and 35 digits, after the table GMP-ECM recommends. The last level repeats
+// until the time budget is spent.
+struct EcmLevel {
+  u64 b1;
+  std::size_t curves;
+};
+constexpr std::array<EcmLevel, 5> EcmLevels = {
+    {{2000, 25}, {11000, 90}, {50000, 300}, {250000, 700}, {1000000, 1800}}};
+// Stage 2 covers the primes in (B1, Stage2Multiplier * B1].
+constexpr u64 Stage2Multiplier = 100;
+// Stage 2 writes each prime as m * D +- j with 0 < j < D / 2 and j coprime
+// to D, so one giant step serves every baby step j.
+constexpr u64 BabyStepRange = 2310; // 2 * 3 * 5 * 7 * 11
+
+class Deadline {
+public:
+  // Budgets beyond a year are treated as a year so the end point cannot
+  // overflow the clock.
+  explicit Deadline(std::chrono::seconds budget)
+      : end_(Clock::now() + std::min<std::chrono::seconds>(
+                                budget, std::chrono::hours(24 * 365))) {}
+
+  bool passed() const {
+    return Clock::now() >= end_;
+  }
+
+private:
+  Clock::time_point end_;
+};
+
+const std::vector<u64> &trialPrimes() {
+  static const std::vector<u64> primes = primesUpTo(TrialDivisionBound - 1);
+  return primes;
+}
+
+// Removes the primes below TrialDivisionBound from n. Primes are grouped
+// into products below 2^64, so one multi-word division per group tells
+// which of its primes divide n.
+void divideOutSmallPrimes(cpp_int &n,
+                          std::vector<std::pair<cpp_int, int>> &primes) {
+  const std::vector<u64> &table = trialPrimes();
+  std::size_t idx = 0;
+  while (idx < table.size() && cpp_int(table[idx]) * table[idx] <= n) {
+    u64 product = 1;
+    std::size_t end = idx;
+    while (end < table.size() &&
+           product <= std::numeric_limits<u64>::max() / table[end]) {
+      product *= table[end++];
+    }
+    const u64 residue = static_cast<u64>(n % product);
+    for (; idx < end; ++idx) {
+      const u64 prime = table[idx];
+      if (residue % prime != 0) {
+        continue;
+      }
+      int exponent = 0;
+      while (n % prime == 0) {
+        n /= prime;
+        ++exponent;
+      }
+      primes.emplace_back(prime, exponent);
+    }
+  }
+}
+
+// Arithmetic modulo an odd n > 1 in Montgomery form with R = 2^bits, the
+// cpp_int counterpart of the class in prime_factors.cpp. Reducing with two
+// multiplications, masks and a shift is about twice as fast as a long
+// division from 40 to 200 digits. The scratch values make an instance
+// unsafe to share; every curve works on its own copy.
+class Residues {
+public:
+  explicit Residues(const cpp_int &modulus)
+      : n_(modulus), bits_(static_cast<unsigned>(msb(modulus)) + 1) {
+    const cpp_int r = cpp_int(1) << bits_;
+    mask_ = r - 1;
+    // n * n = 1 (mod 8) for odd n, and every Newton step doubles the
+    // correct low bits of n^-1 mod R.
+    cpp_int inverse = n_;
+    for (unsigned correct = 3; correct < bits_; correct *= 2) {
+      cpp_int product = (n_ * inverse) & mask_;
+      inverse = (inverse * ((r + 2 - product) & mask_)) & mask_;
+    }
+    negatedInverse_ = r - inverse;
+    one_ = r % n_;
+    squaredR_ = (r * r) % n_;
+  }
+
+  const cpp_int &one() const {
+    return one_;
+  }
+
+  cpp_int toResidue(const cpp_int &value) {
+    cpp_int residue = value % n_;
+    multiply(residue, residue, squaredR_);
+    return residue;
+  }
+
+  void add(cpp_int &out, const cpp_int &a, const cpp_int &b) const {
+    out = a + b;
+    if (out >= n_) {
+      out -= n_;
+    }
+  }
+  void subtract(cpp_int &out, const cpp_int &a, const cpp_int &b) const {
+    if (a >= b) {
+      out = a - b;
+    } else {
+      out = a + n_;
+      out -= b;
+    }
+  }
+  void multiply(cpp_int &out, const cpp_int &a, const cpp_int &b) {
+    product_ = a * b;
+    // product / R mod n: adding m * n, with m = -product * n^-1 mod R,
+    // clears the low bits so the division by R is a shift.
+    scratch_ = product_ & mask_;
+    scratch_ *= negatedInverse_;
+    scratch_ &= mask_;
+    scratch_ *= n_;
+    product_ += scratch_;
+    product_ >>= bits_;
+    if (product_ >= n_) {
+      product_ -= n_;
+    }
+    out.swap(product_);
+  }
+
+private:
+  cpp_int n_;
+  unsigned bits_;
+  cpp_int mask_;
+  cpp_int negatedInverse_;
+  cpp_int one_;
+  cpp_int squaredR_;
+  cpp_int product_;
+  cpp_int scratch_;
+};
+
+// Brent's variant of Pollard's rho, as in prime_factors.cpp but bounded:
+// returns 0 when RhoSteps steps or the time budget pass without a factor.
+cpp_int pollardRho(const cpp_int &n, const Deadline &deadline) {
+  Residues mod(n);
+  const cpp_int c = mod.toResidue(1);
+  auto next = [&](cpp_int &x) {
+    mod.multiply(x, x, x);
+    mod.add(x, x, c);
+  };
+
+  cpp_int y = mod.toResidue(2);
+  cpp_int x;
+  cpp_int saved;
+  cpp_int difference;
+  cpp_int product = mod.one();
+  cpp_int divisor = 1;
+  u64 steps = 0;
+  for (u64 length = 1; divisor == 1; length *= 2) {
+    x = y;
+    for (u64 step = 0; step < length; ++step) {
+      next(y);
+    }
+    for (u64 done = 0; done < length && divisor == 1; done += RhoBatchSize) {
+      if (steps >= RhoSteps || deadline.passed()) {
+        return 0;
+      }
+      saved = y;
+      const u64 batch = std::min(RhoBatchSize, length - done);
+      for (u64 step = 0; step < batch; ++step) {
+        next(y);
+        mod.subtract(difference, x, y);
+        mod.multiply(product, product, difference);
+      }
+      steps += batch;
+      divisor = gcd(product, n);
+    }
+  }
+  if (divisor == n) {
+    do {
+      next(saved);
+      mod.subtract(difference, x, saved);
+      divisor = gcd(difference, n);
+    } while (divisor == 1);
+  }
+  return divisor == n ? cpp_int(0) : divisor;
+}
+
+// Sets `inverse` to a^-1 mod n and returns 1, or returns gcd(a, n) when it
+// is not 1.
+cpp_int invert(const cpp_int &a, const cpp_int &n, cpp_int &inverse) {
+  cpp_int r0 = n;
+  cpp_int r1 = a % n;
+  cpp_int t0 = 0;
+  cpp_int t1 = 1;
+  while (r1 != 0) {
+    const cpp_int quotient = r0 / r1;
+    r0 -= quotient * r1;
+    r0.swap(r1);
+    t0 -= quotient * t1;
+    t0.swap(t1);
+  }
+  if (r0 != 1) {
+    return r0;
+  }
+  inverse = t0 < 0 ? cpp_int(t0 + n) : t0;
+  return 1;
+}
+
+struct Point {
+  cpp_int x;
+  cpp_int z;
+};
+
+// The Montgomery curve B y^2 = x^3 + A x^2 + x over Z/n, in x/z
+// coordinates with a24 = (A + 2) / 4. Every value is a Montgomery residue.
+class Curve {
+public:
+  Curve(Residues residues, cpp_int a24)
+      : mod_(std::move(residues)), a24_(std::move(a24)) {}
+
+  Residues &residues() {
+    return mod_;
+  }
+
+  // out = 2p; out may alias p.
+  void doubled(Point &out, const Point &p) {
+    mod_.add(s_, p.x, p.z);
+    mod_.multiply(s_, s_, s_);
+    mod_.subtract(d_, p.x, p.z);
+    mod_.multiply(d_, d_, d_);
+    mod_.subtract(t_, s_, d_);
+    mod_.multiply(out.x, s_, d_);
+    mod_.multiply(u_, a24_, t_);
+    mod_.add(u_, u_, d_);
+    mod_.multiply(out.z, t_, u_);
+  }
+
+  // out = p + q given difference = p - q; out may alias p or q but not
+  // difference.
+  void sum(Point &out, const Point &p, const Point &q,
+           const Point &difference) {
+    mod_.subtract(s_, p.x, p.z);
+    mod_.add(t_, q.x, q.z);
+    mod_.multiply(s_, s_, t_);
+    mod_.add(d_, p.x, p.z);
+    mod_.subtract(t_, q.x, q.z);
+    mod_.multiply(d_, d_, t_);
+    mod_.add(t_, s_, d_);
+    mod_.multiply(t_, t_, t_);
+    mod_.subtract(u_, s_, d_);
+    mod_.multiply(u_, u_, u_);
+    mod_.multiply(out.x, difference.z, t_);
+    mod_.multiply(out.z, difference.x, u_);
+  }
+
+  // out = k p for k >= 1 by the Montgomery ladder, which keeps the
+  // difference of its two points equal to p.
+  void multiply(Point &out, const Point &p, u64 k) {
+    base_ = p;
+    low_ = p;
+    doubled(high_, p);
+    int bit = 63;
+    while (bit > 0 && ((k >> bit) & 1) == 0) {
+      --bit;
+    }
+    for (--bit; bit >= 0; --bit) {
+      if ((k >> bit) & 1) {
+        sum(low_, low_, high_, base_);
+        doubled(high_, high_);
+      } else {
+        sum(high_, low_, high_, base_);
+        doubled(low_, low_);
+      }
+    }
+    out = low_;
+  }
+
+private:
+  Residues mod_;
+  cpp_int a24_;
+  cpp_int s_;
+  cpp_int d_;
+  cpp_int t_;
+  cpp_int u_;
+  Point base_;
+  Point low_;
+  Point high_;
+};
+
+// What one ECM level shares across its curves.
+struct EcmTables {
+  u64 b1;
+  u64 b2;
+  std::vector<u64> stage1Primes; // the primes up to b1
+  std::vector<bool> stage2Primes; // whether b1 + 1 + i is prime, up to b2
+};
+
+// Runs one curve of Suyama's family, whose group orders are divisible by
+// 12, through both stages. Returns a proper factor of n, or 0 when the
+// curve finds none or `stop` or the deadline cut it short.
+cpp_int runCurve(const cpp_int &n, u64 sigma, const EcmTables &tables,
+                 const std::atomic<bool> &stop, const Deadline &deadline) {
+  auto proper = [&](const cpp_int &divisor) {
+    return divisor != 1 && divisor != n ? divisor : cpp_int(0);
+  };
+  auto reduce = [&](const cpp_int &value) {
+    cpp_int result = value % n;
+    return result < 0 ? cpp_int(result + n) : result;
+  };
+
+  const cpp_int s(sigma);
+  const cpp_int u = reduce(s * s - 5);
+  const cpp_int v = reduce(4 * s);
+  const cpp_int u3 = reduce(u * u * u);
+  const cpp_int v3 = reduce(v * v * v);
+  const cpp_int vMinusU = reduce(v - u);
+  // a24 = (v - u)^3 (3u + v) / (16 u^3 v); a failed inversion is a factor.
+  cpp_int inverse;
+  const cpp_int common = invert(reduce(16 * u3 * v), n, inverse);
+  if (common != 1) {
+    return proper(common);
+  }
+  Residues mod(n);
+  const cpp_int a24 = reduce(vMinusU * vMinusU * vMinusU * (3 * u + v));
+  Point q{mod.toResidue(u3), mod.toResidue(v3)};
+  Curve curve(mod, mod.toResidue(reduce(a24 * inverse)));
+  Residues &arithmetic = curve.residues();
+  auto interrupted = [&] {
+    return stop.load(std::memory_order_relaxed) || deadline.passed();
+  };
+
+  // Stage 1: multiply by every prime power up to B1, packed into words so
+  // that each ladder covers many primes.
+  u64 chunk = 1;
+  for (u64 prime : tables.stage1Primes) {
+    u64 power = prime;
+    while (power <= tables.b1 / prime) {
+      power *= prime;
+    }
+    if (chunk > std::numeric_limits<u64>::max() / power) {
+      curve.multiply(q, q, chunk);
+      chunk = 1;
+      if (interrupted()) {
+        return 0;
+      }
+    }
+    chunk *= power;
+  }
+  curve.multiply(q, q, chunk);
+  cpp_int divisor = gcd(q.z, n);
+  if (divisor != 1) {
+    return proper(divisor);
+  }
+
+  // Stage 2 catches a group order with one prime p in (B1, B2] left over:
+  // with p = m D +- j, x(m D q) = x(j q) mod that factor, so the product of
+  // the cross differences x(m D q) z(j q) - x(j q) z(m D q) shares it
+  // with n.
+  constexpr u64 D = BabyStepRange;
+  std::vector<Point> babies;
+  std::vector<cpp_int> babyProducts;
+  std::vector<u64> babySteps;
+  Point twice;
+  curve.doubled(twice, q);
+  Point previous = q;
+  Point current = q;
+  Point next;
+  for (u64 j = 1; j < D / 2; j += 2) {
+    if (std::gcd(j, D) == 1) {
+      cpp_int product;
+      arithmetic.multiply(product, current.x, current.z);
+      babies.push_back(current);
+      babyProducts.push_back(std::move(product));
+      babySteps.push_back(j);
+    }
+    if (j == 1) {
+      curve.sum(next, twice, q, q);
+    } else {
+      curve.sum(next, current, twice, previous);
+    }
+    previous = std::move(current);
+    current = std::move(next);
+  }
+
+  const u64 first = std::max<u64>(1, tables.b1 / D);
+  const u64 last = (tables.b2 + D / 2) / D;
+  Point step;
+  Point giant;
+  Point following;
+  Point after;
+  curve.multiply(step, q, D);
+  curve.multiply(giant, q, first * D);
+  curve.multiply(following, q, (first + 1) * D);
+  cpp_int accumulator = arithmetic.one();
+  cpp_int giantProduct;
+  cpp_int term;
+  cpp_int other;
+  auto inStage2 = [&](u64 value) {
+    return value > tables.b1 && value <= tables.b2 &&
+           tables.stage2Primes[value - tables.b1 - 1];
+  };
+  for (u64 m = first; m <= last; ++m) {
+    if (interrupted()) {
+      return 0;
+    }
+    // x_g z_j - x_j z_g = (x_g - x_j)(z_g + z_j) - x_g z_g + x_j z_j,
+    // one multiplication per pair once the x z products are known.
+    arithmetic.multiply(giantProduct, giant.x, giant.z);
+    const u64 centre = m * D;
+    for (std::size_t idx = 0; idx < babies.size(); ++idx) {
+      if (!inStage2(centre - babySteps[idx]) &&
+          !inStage2(centre + babySteps[idx])) {
+        continue;
+      }
+      arithmetic.subtract(term, giant.x, babies[idx].x);
+      arithmetic.add(other, giant.z, babies[idx].z);
+      arithmetic.multiply(term, term, other);
+      arithmetic.subtract(term, term, giantProduct);
+      arithmetic.add(term, term, babyProducts[idx]);
+      arithmetic.multiply(accumulator, accumulator, term);
+    }
+    curve.sum(after, following, step, giant);
+    giant = std::move(following);
+    following = std::move(after);
+  }
+  return proper(gcd(accumulator, n));
+}
+
+// Floor of the k-th root of n, by Newton's iteration from above.
+cpp_int integerRoot(const cpp_int &n, unsigned k) {
+  cpp_int x = cpp_int(1) << (static_cast<unsigned>(msb(n)) / k + 1);
+  for (;;) {
+    cpp_int y = ((k - 1) * x + n / pow(x, k - 1)) / k;
+    if (y >= x) {
+      return x;
+    }
+    x = std::move(y);
+  }
+}
+
+// A part of n still to be factored, with how far the search has gone.
+struct Part {
+  cpp_int value;
+  int exponent;
+  std::size_t level; // first ECM level still to run
+  bool rhoDone;
+};
+
+class Factorizer {
+public:
+  explicit Factorizer(const Deadline &deadline) : deadline_(deadline) {}
+
+  BigFactorization run(const cpp_int &n) {
+    std::vector<std::pair<cpp_int, int>> primes;
+    std::vector<std::pair<cpp_int, int>> composites;
+    cpp_int remaining = n;
+    divideOutSmallPrimes(remaining, primes);
+
+    std::vector<Part> pending;
+    if (remaining > 1) {
+      pending.push_back({remaining, 1, 0, false});
+    }
+    while (!pending.empty()) {
+      Part part = std::move(pending.back());
+      pending.pop_back();
+      if (part.value <= std::numeric_limits<long long>::max()) {
+        for (const auto &factor :
+             calculatePrimeFactors(part.value.convert_to<long long>())) {
+          primes.emplace_back(factor.first, factor.second * part.exponent);
+        }
+        continue;
+      }
+      if (isProbablePrime(part.value)) {
+        primes.emplace_back(part.value, part.exponent);
+        continue;
+      }
+      cpp_int root;
+      unsigned power = 0;
+      if (perfectPower(part.value, root, power)) {
+        pending.push_back({root, part.exponent * static_cast<int>(power),
+                           part.level, part.rhoDone});
+        continue;
+      }
+
+      cpp_int factor;
+      if (!part.rhoDone) {
+        factor = pollardRho(part.value, deadline_);
+      }
+      bool byRho = factor != 0;
+      if (!byRho) {
+        factor = ecm(part.value, part.level);
+      }
+      if (factor == 0) {
+        composites.emplace_back(part.value, part.exponent);
+        continue;
+      }
+      // Cofactors of a rho split may hold further small factors; ECM has
+      // already been past rho's range.
+      bool rhoDone = !byRho;
+      cpp_int cofactor = part.value / factor;
+      pending.push_back(
+          {std::move(factor), part.exponent, part.level, rhoDone});
+      pending.push_back(
+          {std::move(cofactor), part.exponent, part.level, rhoDone});
+    }
+
+    BigFactorization result;
+    result.factors = combine(std::move(primes));
+    result.composites = combine(std::move(composites));
+    return result;
+  }
+
+private:
+  bool isProbablePrime(const cpp_int &n) {
+    if (n <= std::numeric_limits<u64>::max()) {
+      return isPrime(n.convert_to<u64>());
+    }
+    return boost::multiprecision::miller_rabin_test(n, MillerRabinRounds,
+                                                    random_);
+  }
+
+  // Finds n = root^power with power >= 2 prime. n has no factor below
+  // TrialDivisionBound = 2^16, so power can be at most bits(n) / 16.
+  static bool perfectPower(const cpp_int &n, cpp_int &root,
+                           unsigned &power) {
+    const unsigned bits = static_cast<unsigned>(msb(n)) + 1;
+    for (unsigned k = 2; k <= bits / 16; ++k) {
+      if (!isPrime(k)) {
+        continue;
+      }
+      cpp_int candidate = integerRoot(n, k);
+      if (pow(candidate, k) == n) {
+        root = std::move(candidate);
+        power = k;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const EcmTables &tables(std::size_t level) {
+    while (tables_.size() <= level) {
+      const u64 b1 = EcmLevels[tables_.size()].b1;
+      auto built = std::make_unique<EcmTables>();
+      built->b1 = b1;
+      built->b2 = b1 * Stage2Multiplier;
+      built->stage1Primes = primesUpTo(b1);
+      built->stage2Primes.assign(built->b2 - b1, false);
+      streamPrimes(b1 + 1, built->b2, [&](const std::vector<u64> &primes) {
+        for (u64 prime : primes) {
+          built->stage2Primes[prime - b1 - 1] = true;
+        }
+      });
+      tables_.push_back(std::move(built));
+    }
+    return *tables_[level];
+  }
+
+  // Runs batches of one curve per worker, from `level` upwards, until a
+  // curve finds a factor or the time budget runs out; returns 0 then.
+  // `level` is left where the search stopped for the cofactors to resume.
+  cpp_int ecm(const cpp_int &n, std::size_t &level) {
+    const std::size_t batch = std::max<std::size_t>(1, parallelWorkerCount());
+    while (!deadline_.passed()) {
+      const EcmTables &table = tables(level);
+      const std::size_t curves = EcmLevels[level].curves;
+      for (std::size_t done = 0; done < curves && !deadline_.passed();
+           done += batch) {
+        const std::size_t count = std::min(batch, curves - done);
+        const u64 firstSigma = nextSigma_;
+        nextSigma_ += count;
+        std::vector<cpp_int> found(count);
+        std::atomic<bool> stop{false};
+        parallelFor(count, [&](std::size_t idx) {
+          found[idx] = runCurve(n, firstSigma + idx, table, stop, deadline_);
+          if (found[idx] != 0) {
+            stop.store(true, std::memory_order_relaxed);
+          }
+        });
+        for (cpp_int &factor : found) {
+          if (factor != 0) {
+            return std::move(factor);
+          }
+        }
+      }
+      if (level + 1 < EcmLevels.size()) {
+        ++level;
+      }
+    }
+    return 0;
+  }
+
+  static std::vector<std::pair<cpp_int, int>>
+  combine(std::vector<std::pair<cpp_int, int>> parts) {
+    std::sort(parts.begin(), parts.end(),
+              [](const auto &lhs, const auto &rhs) {
+                return lhs.first < rhs.first;
+              });
+    std::vector<std::pair<cpp_int, int>> combined;
+    for (auto &part : parts) {
+      if (!combined.empty() && combined.back().first == part.first) {
+        combined.back().second += part.second;
+      } else {
+        combined.push_back(std::move(part));
+      }
+    }
+    return combined;
+  }
+
+  const Deadline &deadline_;
+  std::vector<std::unique_ptr<EcmTables>> tables_;
+  // Suyama's parametrisation needs sigma >= 6; every curve gets its own.
+  u64 nextSigma_ = 6;
+  std::mt19937 random_;
+};
+} // namespace
+
+std::uint64_t factorTimeLimit() {
+  return timeLimit.load(std::memory_order_relaxed);
+}
+
+void setFactorTimeLimit(std::uint64_t seconds) {
+  timeLimit.store(seconds, std::memory_order_relaxed);
+}
+
+BigFactorization factorBigInteger(const cpp_int &n) {
+  if (n <= 0) {
+    throw std::invalid_argument(
+        "Prime factorization defined only for positive integers.");
+  }
+  const Deadline deadline{std::chrono::seconds(factorTimeLimit())};
+  return Factorizer(deadline).run(n);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <boost/multiprecision/cpp_int.hpp>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Factorization of the arbitrary-precision integers the bigint mode works
+// with. Primes below 2^16 come out by trial division; parts that fit in a
+// long long go to calculatePrimeFactors; larger composites are split by a
+// short run of Pollard's rho and then by Lenstra's elliptic curve method
+// (ECM), whose curves run in parallel through parallelFor.
+struct BigFactorization {
+  // Prime factors in ascending order with their exponents. Factors above
+  // 2^63 are probable primes (25 rounds of Miller-Rabin).
+  std::vector<std::pair<boost::multiprecision::cpp_int, int>> factors;
+  // Composite parts, with their exponents, still unsplit when the time
+  // budget ran out; empty when the factorization is complete.
+  std::vector<std::pair<boost::multiprecision::cpp_int, int>> composites;
+};
+
+// Seconds factorBigInteger may spend on rho and ECM before it gives up on
+// the parts that are still composite. Defaults to DefaultFactorTimeLimit; 0
+// leaves every part that trial division cannot split.
+constexpr std::uint64_t DefaultFactorTimeLimit = 30;
+std::uint64_t factorTimeLimit();
+void setFactorTimeLimit(std::uint64_t seconds);
+
+// Throws std::invalid_argument if n is less than or equal to zero.
+BigFactorization factorBigInteger(const boost::multiprecision::cpp_int &n);
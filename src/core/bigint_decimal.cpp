@@ -0,0 +1,205 @@
+#include "bigint_decimal.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+using boost::multiprecision::cpp_int;
+
+// Digits handled by the word-at-a-time conversions; also the exponent of
+// the smallest power of ten in the split tree.
+constexpr std::size_t LeafDigits = 4096;
+constexpr std::size_t ChunkDigits = 18;
+constexpr std::uint64_t ChunkBase = 1000000000000000000ULL;
+// Divisors up to this many bits go through Boost's own division, which is
+// faster than Newton + Barrett at that size.
+constexpr std::size_t ReciprocalCutoffBits = 8192;
+
+std::uint64_t parseChunk(std::string_view digits) {
+  std::uint64_t value = 0;
+  for (char c : digits) {
+    if (c < '0' || c > '9') {
+      throw std::invalid_argument("Invalid integer literal.");
+    }
+    value = value * 10 + static_cast<std::uint64_t>(c - '0');
+  }
+  return value;
+}
+
+// Quadratic, but only ever called on at most LeafDigits digits.
+cpp_int parseLeaf(std::string_view digits) {
+  std::size_t head = digits.size() % ChunkDigits;
+  if (head == 0) {
+    head = ChunkDigits;
+  }
+  cpp_int value = parseChunk(digits.substr(0, head));
+  for (std::size_t pos = head; pos < digits.size(); pos += ChunkDigits) {
+    value *= ChunkBase;
+    value += parseChunk(digits.substr(pos, ChunkDigits));
+  }
+  return value;
+}
+
+std::size_t bitLength(const cpp_int &value) {
+  return value == 0 ? 0 : boost::multiprecision::msb(value) + 1;
+}
+
+// floor(2^(2n) / d) for a divisor d of exactly n bits. Each level halves
+// the precision, recurses, and recovers it with one Newton step, so the
+// total cost is a constant number of n-bit multiplications.
+cpp_int reciprocalOf(const cpp_int &divisor, std::size_t bits) {
+  if (bits <= ReciprocalCutoffBits) {
+    return (cpp_int(1) << (2 * bits)) / divisor;
+  }
+  const std::size_t half = bits / 2 + 1;
+  cpp_int estimate = reciprocalOf(divisor >> (bits - half), half)
+                     << (bits - half);
+
+  // x += x * (2^(2n) - d * x) / 2^(2n)
+  const cpp_int one = cpp_int(1) << (2 * bits);
+  cpp_int error = one - divisor * estimate;
+  if (error >= 0) {
+    estimate += (estimate * error) >> (2 * bits);
+  } else {
+    error = -error;
+    estimate -= (estimate * error) >> (2 * bits);
+  }
+
+  // The step leaves the estimate within a few units; settle them exactly.
+  cpp_int product = divisor * estimate;
+  while (product > one) {
+    --estimate;
+    product -= divisor;
+  }
+  product += divisor;
+  while (product <= one) {
+    ++estimate;
+    product += divisor;
+  }
+  return estimate;
+}
+
+// The powers 10^(LeafDigits * 2^level), each the square of the previous,
+// built on first use together with the reciprocals used to divide by them.
+class PowersOfTen {
+public:
+  static std::size_t digits(std::size_t level) {
+    return LeafDigits << level;
+  }
+
+  const cpp_int &power(std::size_t level) {
+    while (powers_.size() <= level) {
+      if (powers_.empty()) {
+        powers_.push_back(boost::multiprecision::pow(
+            cpp_int(10), static_cast<unsigned>(LeafDigits)));
+      } else {
+        powers_.push_back(powers_.back() * powers_.back());
+      }
+      reciprocals_.emplace_back();
+    }
+    return powers_[level];
+  }
+
+  // Quotient and remainder of value / 10^digits(level), for
+  // value < 10^(2 * digits(level)).
+  void divide(const cpp_int &value, std::size_t level, cpp_int &quotient,
+              cpp_int &remainder) {
+    const cpp_int &divisor = power(level);
+    const std::size_t bits = bitLength(divisor);
+    if (bits <= ReciprocalCutoffBits) {
+      boost::multiprecision::divide_qr(value, divisor, quotient, remainder);
+      return;
+    }
+    cpp_int &reciprocal = reciprocals_[level];
+    if (reciprocal == 0) {
+      reciprocal = reciprocalOf(divisor, bits);
+    }
+    // Barrett reduction: value < 2^(2 * bits), so the estimate is at most
+    // two below the true quotient.
+    quotient = (value * reciprocal) >> (2 * bits);
+    remainder = value - quotient * divisor;
+    while (remainder >= divisor) {
+      remainder -= divisor;
+      ++quotient;
+    }
+  }
+
+private:
+  std::vector<cpp_int> powers_;
+  std::vector<cpp_int> reciprocals_; // 0 until first needed
+};
+
+cpp_int parseDigits(std::string_view digits, PowersOfTen &powers) {
+  if (digits.size() <= LeafDigits) {
+    return parseLeaf(digits);
+  }
+  // Split off the largest tree power that leaves a non-empty high part;
+  // it covers at least half of the digits, so the halves stay balanced.
+  std::size_t level = 0;
+  while (PowersOfTen::digits(level + 1) < digits.size()) {
+    ++level;
+  }
+  const std::size_t split = digits.size() - PowersOfTen::digits(level);
+  cpp_int value = parseDigits(digits.substr(0, split), powers);
+  value *= powers.power(level);
+  value += parseDigits(digits.substr(split), powers);
+  return value;
+}
+
+// Appends the digits of value < 10^(2 * digits(level)); for level -1,
+// value < 10^LeafDigits. A non-zero `width` left-pads with zeros to exactly
+// that many digits, as needed for the low half of a split.
+void appendDigits(const cpp_int &value, std::ptrdiff_t level,
+                  std::size_t width, PowersOfTen &powers, std::string &out) {
+  if (level < 0) {
+    std::string text = value.convert_to<std::string>();
+    if (width > text.size()) {
+      out.append(width - text.size(), '0');
+    }
+    out += text;
+    return;
+  }
+  const std::size_t levelIndex = static_cast<std::size_t>(level);
+  if (width == 0 && value < powers.power(levelIndex)) {
+    // The high half would be zero; without padding it must not be printed.
+    appendDigits(value, level - 1, 0, powers, out);
+    return;
+  }
+  const std::size_t lowDigits = PowersOfTen::digits(levelIndex);
+  cpp_int quotient;
+  cpp_int remainder;
+  powers.divide(value, levelIndex, quotient, remainder);
+  appendDigits(quotient, level - 1, width == 0 ? 0 : width - lowDigits,
+               powers, out);
+  appendDigits(remainder, level - 1, lowDigits, powers, out);
+}
+} // namespace
+
+cpp_int parseDecimalInteger(std::string_view digits) {
+  if (digits.empty()) {
+    throw std::invalid_argument("Empty integer literal.");
+  }
+  PowersOfTen powers;
+  return parseDigits(digits, powers);
+}
+
+std::string toDecimalString(const cpp_int &value) {
+  if (value < 0) {
+    return '-' + toDecimalString(-value);
+  }
+  PowersOfTen powers;
+  if (value < powers.power(0)) {
+    return value.convert_to<std::string>();
+  }
+  // Smallest level whose squared power exceeds the value.
+  std::size_t level = 0;
+  while (powers.power(level + 1) <= value) {
+    ++level;
+  }
+  std::string out;
+  out.reserve(PowersOfTen::digits(level) * 2);
+  appendDigits(value, static_cast<std::ptrdiff_t>(level), 0, powers, out);
+  return out;
+}
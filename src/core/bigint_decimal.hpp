@@ -0,0 +1,21 @@
+#pragma once
+
+#include <boost/multiprecision/cpp_int.hpp>
+
+#include <string>
+#include <string_view>
+
+// Decimal conversions for cpp_int that stay subquadratic in the number of
+// digits. Both directions split the number around powers of ten
+// 10^(LeafDigits * 2^j): parsing joins the halves as high * 10^k + low, so
+// it only multiplies; printing divides by 10^k using a reciprocal computed
+// by Newton iteration, so it too only multiplies. Pieces of up to
+// LeafDigits digits go through the simple word-at-a-time conversions.
+
+// Parses a non-empty run of decimal digits, without sign. Throws
+// std::invalid_argument for any other character.
+boost::multiprecision::cpp_int parseDecimalInteger(std::string_view digits);
+
+// Formats `value` in decimal, with a leading '-' when negative; the same
+// text as value.convert_to<std::string>().
+std::string toDecimalString(const boost::multiprecision::cpp_int &value);
@@ -1,6 +1,21 @@
 #pragma once
+#include <boost/multiprecision/cpp_int.hpp>
+
 #include <vector>
 
+// The functions below work from the prime factorization of |n| instead of
+// trial division, so they cost about as much as factoring n. Each throws
+// std::invalid_argument if n is zero and std::out_of_range for
+// LLONG_MIN, whose magnitude does not fit in a long long.
+
 // Returns the positive divisors of the absolute value of n in ascending order.
-// Throws std::invalid_argument if n is zero.
 std::vector<long long> calculateDivisors(long long n);
+
+// Number of positive divisors of |n|, the product of (exponent + 1) over its
+// prime factors; no divisor list is built.
+long long countDivisors(long long n);
+
+// Sum of the positive divisors of |n|, the product of
+// (p^(e + 1) - 1) / (p - 1) over its prime powers p^e. It can exceed the
+// range of a long long, hence the cpp_int.
+boost::multiprecision::cpp_int sumDivisors(long long n);
@@ -1,25 +1,62 @@
 #include "divisors.hpp"
+#include "prime_factors.hpp"
 #include <algorithm>
+#include <limits>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
-std::vector<long long> calculateDivisors(long long n) {
+namespace {
+std::vector<std::pair<long long, int>> factorMagnitude(long long n) {
   if (n == 0) {
     throw std::invalid_argument("Zero has infinitely many divisors.");
   }
+  if (n == std::numeric_limits<long long>::min()) {
+    throw std::out_of_range("The magnitude of the number is too large.");
+  }
+  return calculatePrimeFactors(n < 0 ? -n : n);
+}
+} // namespace
 
-  long long absN = n < 0 ? -n : n;
-  std::vector<long long> divisors;
-
-  for (long long i = 1; i * i <= absN; ++i) {
-    if (absN % i == 0) {
-      divisors.push_back(i);
-      if (i != absN / i) {
-        divisors.push_back(absN / i);
+std::vector<long long> calculateDivisors(long long n) {
+  // Each prime power p^e multiplies the divisors found so far by p^0 .. p^e.
+  // Every one of those runs is sorted, so merging them in turn keeps the
+  // list sorted without a final sort.
+  std::vector<long long> divisors{1};
+  std::vector<long long> run;
+  std::vector<long long> merged;
+  for (const auto &factor : factorMagnitude(n)) {
+    run = divisors;
+    for (int power = 1; power <= factor.second; ++power) {
+      for (long long &value : run) {
+        value *= factor.first;
       }
+      merged.resize(divisors.size() + run.size());
+      std::merge(divisors.begin(), divisors.end(), run.begin(), run.end(),
+                 merged.begin());
+      divisors.swap(merged);
     }
   }
-
-  std::sort(divisors.begin(), divisors.end());
   return divisors;
 }
+
+long long countDivisors(long long n) {
+  long long count = 1;
+  for (const auto &factor : factorMagnitude(n)) {
+    count *= factor.second + 1;
+  }
+  return count;
+}
+
+boost::multiprecision::cpp_int sumDivisors(long long n) {
+  boost::multiprecision::cpp_int sum = 1;
+  for (const auto &factor : factorMagnitude(n)) {
+    // 1 + p + ... + p^e, accumulated by Horner's rule.
+    boost::multiprecision::cpp_int term = 1;
+    for (int power = 0; power < factor.second; ++power) {
+      term = term * factor.first + 1;
+    }
+    sum *= term;
+  }
+  return sum;
+}
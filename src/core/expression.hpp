@@ -1,13 +1,355 @@
 #pragma once
+#include "expression_program.hpp"
+
+#include <cstddef>
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
+
+namespace expression_detail {
+template <typename Value> class ThreadedProgram;
+} // namespace expression_detail
+
+// Failure categories reported by the non-throwing evaluation API. Each one
+// corresponds to the exception type the throwing API raises.
+enum class EvalErrorCode : std::uint8_t {
+  None,
+  InvalidExpression, // std::invalid_argument: malformed input
+  UnknownVariable,   // std::invalid_argument
+  InvalidOperand,    // std::invalid_argument: e.g. factorial of 2.5
+  DivisionByZero,    // std::runtime_error
+  DomainError,       // std::domain_error: e.g. log(0)
+  Overflow,          // std::overflow_error
+  OutOfRange         // std::out_of_range: literal does not fit a double
+};
+
+struct EvalResult {
+  double value = 0.0;
+  EvalErrorCode error = EvalErrorCode::None;
+  // Offset in the expression of the token that failed. Evaluation errors
+  // always carry it; for InvalidExpression it is 0.
+  std::size_t position = 0;
+  std::string message; // empty on success
+
+  bool ok() const {
+    return error == EvalErrorCode::None;
+  }
+};
+
+// Strategy CompiledExpression uses to run its program. Both produce the same
+// results and errors; they differ only in speed.
+enum class EvalEngine : std::uint8_t {
+  Interpreter, // opcode switch over the flat postfix program
+  Threaded     // handlers specialized per operation, chained by tail calls
+};
+
+// Engine used by expressions compiled without an explicit choice, including
+// the one-shot evaluateExpression(). Defaults to EvalEngine::Interpreter.
+EvalEngine defaultEvalEngine();
+void setDefaultEvalEngine(EvalEngine engine);
+
+// Largest operand accepted by ! in the bigint and bigdouble modes; larger
+// operands fail with EvalErrorCode::Overflow. Defaults to
+// DefaultFactorialLimit. Double mode is always limited to 170!.
+constexpr std::uint64_t DefaultFactorialLimit = 100000;
+std::uint64_t factorialLimit();
+void setFactorialLimit(std::uint64_t limit);
+
+// Upper bound, in bits, on the result of ^ in bigint mode, so a typo such as
+// 10^10^10 fails fast with EvalErrorCode::Overflow instead of exhausting
+// memory. powmod and (a ^ b) mod m are exempt: they never build the power.
+constexpr std::size_t DefaultPowerResultLimit = std::size_t(1) << 20;
+std::size_t powerResultLimit();
+void setPowerResultLimit(std::size_t bits);
+
+// Significant digits printed by evaluateExpressionBigDouble, at most
+// MaxBigDoublePrecision. The value is computed on the smallest precompiled
+// binary precision (30, 50, 100, 250 or 1000 digits) that covers it, so
+// fewer digits also run faster. setBigDoublePrecision throws
+// std::out_of_range for 0 or anything above the maximum.
+constexpr std::size_t DefaultBigDoublePrecision = 50;
+constexpr std::size_t MaxBigDoublePrecision = 1000;
+std::size_t bigDoublePrecision();
+void setBigDoublePrecision(std::size_t digits);
+
+// Throws the exception the throwing API uses for a failed result.
+[[noreturn]] void throwEvalError(const EvalResult &result);
 
 // Parses and evaluates a mathematical expression in infix notation.
 double evaluateExpression(const std::string &expression,
                           const std::map<std::string, double> &variables = {});
+// Like evaluateExpression, but reports every failure, including malformed
+// input, through the returned value instead of throwing. Only a failed
+// allocation of the error message can still throw.
+EvalResult tryEvaluateExpression(
+    const std::string &expression,
+    const std::map<std::string, double> &variables = {});
 std::string evaluateExpressionBigInt(
     const std::string &expression,
     const std::map<std::string, double> &variables = {});
 std::string evaluateExpressionBigDouble(
     const std::string &expression,
     const std::map<std::string, double> &variables = {});
+
+// Which evaluator produced an adaptive result.
+enum class EvalPath : std::uint8_t {
+  Double,   // double arithmetic with a tracked error bound
+  BigDouble // escalated to evaluateExpressionBigDouble
+};
+
+// Significant digits an adaptive result must be correct to before the
+// double path is trusted; double-path results print this many digits.
+constexpr int AdaptiveDigits = 12;
+
+struct AdaptiveResult {
+  std::string text;  // the result as printed
+  double value = 0.0; // `text` rounded to a double
+  EvalPath path = EvalPath::Double;
+};
+
+// Evaluates in double precision while bounding the accumulated rounding
+// error, and falls back to bigdouble mode when cancellation, overflow or a
+// failure leaves fewer than AdaptiveDigits digits trustworthy. The fallback
+// runs at two precisions and prints only the digits they agree on. Throws
+// the same exceptions as evaluateExpressionBigDouble, and
+// std::domain_error when not even the first digit is stable.
+AdaptiveResult evaluateExpressionAdaptive(
+    const std::string &expression,
+    const std::map<std::string, double> &variables = {});
+
+// A closed range of doubles. Infinite ends stand for unbounded ranges.
+struct Interval {
+  double lo = 0.0;
+  double hi = 0.0;
+
+  bool contains(double value) const {
+    return lo <= value && value <= hi;
+  }
+};
+
+// Evaluates with interval arithmetic and outward rounding, returning bounds
+// guaranteed to contain the exact value of the expression (literals are
+// read as the decimal numbers they spell). Throws the same exceptions as
+// evaluateExpression.
+Interval evaluateExpressionInterval(
+    const std::string &expression,
+    const std::map<std::string, double> &variables = {});
+
+struct IntervalResult {
+  Interval bounds;
+  EvalResult status; // error, position and message; value is unused
+
+  bool ok() const {
+    return status.ok();
+  }
+};
+
+// An expression compiled for interval arithmetic, for evaluating over
+// ranges of its variables. The bounds hold the value at every point of the
+// given ranges, so a caller can rule out a whole region, e.g. one that
+// cannot contain a zero, from a single evaluation. Where a range leaves a
+// function's domain only the part inside it counts; a range entirely
+// outside fails like the point evaluation does.
+class IntervalExpression {
+public:
+  explicit IntervalExpression(const std::string &expression);
+
+  // Names of the referenced variables, in slot order.
+  const std::vector<std::string> &variableNames() const;
+
+  // Throws std::invalid_argument for a missing variable and the usual
+  // evaluation exceptions otherwise.
+  Interval evaluate(const std::map<std::string, Interval> &variables) const;
+  // Resolves every referenced variable into a dense slot array of point
+  // intervals, for a caller that then widens some slots to ranges. Throws
+  // std::invalid_argument if a variable is missing.
+  std::vector<Interval>
+  bindVariables(const std::map<std::string, double> &variables) const;
+  // Reads variable ranges by slot and reports failures in the result.
+  IntervalResult tryEvaluateSlots(const Interval *slots) const;
+
+private:
+  expression_detail::Program<Interval> program_;
+};
+
+// Largest number of variables evaluateGradient differentiates at once.
+constexpr std::size_t MaxGradientVariables = 16;
+
+struct GradientResult {
+  double value = 0.0;
+  std::vector<double> gradient; // one partial derivative per `wrt` entry
+};
+
+// Evaluates the expression and its partial derivatives with respect to the
+// variables named in `wrt` in a single pass, using forward-mode automatic
+// differentiation. The value agrees with evaluateExpression and failures
+// throw the same exceptions; a `wrt` variable the expression does not use
+// gets a zero derivative. n! is differentiated through the gamma function
+// and mod as x - floor(x / m) * m.
+GradientResult
+evaluateGradient(const std::string &expression,
+                 const std::vector<std::string> &wrt,
+                 const std::map<std::string, double> &variables = {});
+
+// An expression compiled once for gradient evaluation with respect to a
+// fixed list of variables, for callers such as Newton iterations that
+// differentiate the same expression many times. Construction throws like
+// evaluateGradient does for malformed input or a bad `wrt` list.
+class GradientExpression {
+public:
+  GradientExpression(const std::string &expression,
+                     const std::vector<std::string> &wrt);
+
+  // Names of the referenced variables, in slot order.
+  const std::vector<std::string> &variableNames() const;
+
+  GradientResult
+  evaluate(const std::map<std::string, double> &variables = {}) const;
+  // Reads variable values by slot. Failures are reported in the returned
+  // result, and `result` is only written on success.
+  EvalResult tryEvaluateSlots(const double *slots,
+                              GradientResult &result) const;
+
+private:
+  struct Compiled;
+  std::shared_ptr<const Compiled> compiled_;
+};
+
+// An expression parsed once into a flat postfix program. Construction throws
+// the same exceptions as evaluateExpression for malformed input; evaluate()
+// can then be called any number of times without re-parsing and without heap
+// allocation for expressions of ordinary nesting depth.
+class CompiledExpression {
+public:
+  explicit CompiledExpression(const std::string &expression,
+                              EvalEngine engine = defaultEvalEngine());
+
+  // The engine actually in use. Expressions too long for the threaded
+  // engine fall back to the interpreter.
+  EvalEngine engine() const;
+
+  double evaluate(const std::map<std::string, double> &variables = {}) const;
+
+  // Non-throwing evaluation. Runtime failures such as division by zero or a
+  // missing variable come back as an error code with the source position,
+  // so a failing row costs no more than a successful one. Building the
+  // error message allocates, so these may still throw std::bad_alloc.
+  EvalResult
+  tryEvaluate(const std::map<std::string, double> &variables = {}) const;
+
+  // Names of the variables referenced by the expression. The position of a
+  // name is its slot number in the arrays used by evaluateSlots().
+  const std::vector<std::string> &variableNames() const;
+
+  // Resolves every referenced variable once into a dense slot array.
+  // Throws std::invalid_argument if a variable is missing.
+  std::vector<double>
+  bindVariables(const std::map<std::string, double> &variables) const;
+
+  // Evaluates with variable values read by slot index from `slots`, which
+  // must hold variableNames().size() entries.
+  double evaluateSlots(const double *slots) const;
+  EvalResult tryEvaluateSlots(const double *slots) const;
+
+  // Evaluates the expression for `rows` rows at once. columns[slot] holds the
+  // values of variable `slot`, either one per row or a single value that is
+  // broadcast to every row. Rows are processed in blocks, one instruction at
+  // a time, so the arithmetic loops vectorize.
+  // Throws std::invalid_argument if the columns do not match the variables
+  // or the row count, and the usual evaluation exceptions if any row fails.
+  std::vector<double>
+  evaluateColumns(const std::vector<std::vector<double>> &columns,
+                  std::size_t rows) const;
+  // Like evaluateColumns, but a failing row, such as log(x) where x is 0,
+  // only fails its own entry of the result; every other row is evaluated.
+  // Still throws for mismatched columns.
+  std::vector<EvalResult>
+  tryEvaluateColumns(const std::vector<std::vector<double>> &columns,
+                     std::size_t rows) const;
+
+private:
+  // Throws std::invalid_argument unless there is one column per variable
+  // with either one value or `rows` values.
+  void checkColumns(const std::vector<std::vector<double>> &columns,
+                    std::size_t rows) const;
+  // Returns the slot of the first missing variable, or the slot count.
+  std::size_t bindInto(const std::map<std::string, double> &variables,
+                       double *slots) const;
+  EvalResult unknownVariable(std::size_t slot) const;
+
+  expression_detail::Program<double> program_;
+  // Set when running on EvalEngine::Threaded; shared between copies.
+  std::shared_ptr<const expression_detail::ThreadedProgram<double>> threaded_;
+};
+
+// Largest initial sample count accepted by sampleExpression.
+constexpr std::size_t MaxPlotSamples = 100000;
+constexpr std::size_t DefaultPlotSamples = 100;
+
+struct SampledCurve {
+  std::vector<double> xs; // ascending, from the start to the end of the range
+  std::vector<double> ys; // NaN where the expression is undefined
+};
+
+// Samples the expression as a function of `variable` over [from, to]. The
+// expression is compiled once and evaluated in batches: first at `samples`
+// evenly spaced points, then at the midpoints of segments where the curve
+// bends or stops being defined, for a bounded number of rounds. A bending
+// segment is skipped when its interval enclosure proves the curve stays
+// within the bend tolerance there. Smooth stretches keep the initial
+// spacing while sharp features get up to 2^10 times finer. Other variables
+// are read from `variables`; compile errors, a missing variable or a range
+// where every sample fails throw the usual evaluation exceptions.
+SampledCurve
+sampleExpression(const std::string &expression, const std::string &variable,
+                 double from, double to,
+                 std::size_t samples = DefaultPlotSamples,
+                 const std::map<std::string, double> &variables = {});
+
+constexpr double DefaultIntegrationTolerance = 1e-10;
+
+struct IntegrationResult {
+  double value = 0.0;
+  double error = 0.0;          // estimated absolute error
+  std::size_t evaluations = 0; // points at which the expression was evaluated
+  std::size_t segments = 0;    // subintervals in the final partition
+  bool converged = false;      // false if refinement stopped short of the
+                               // tolerance; value is then the best estimate
+};
+
+// Integrates the expression over `variable` from `from` to `to` with
+// adaptive 15-point Gauss-Kronrod quadrature. Subintervals whose error
+// estimate exceeds their share of the budget are bisected, and every round
+// of new subintervals is evaluated in parallel. Refinement stops once the
+// estimated error is within tolerance * max(1, |value|). Other variables
+// are read from `variables`; an evaluation failure anywhere in the range
+// throws the usual evaluation exceptions, and an estimate that stops being
+// finite, as for a divergent integral such as 1/x over [-1, 1], throws
+// std::overflow_error.
+IntegrationResult
+integrateExpression(const std::string &expression, const std::string &variable,
+                    double from, double to,
+                    double tolerance = DefaultIntegrationTolerance,
+                    const std::map<std::string, double> &variables = {});
+
+// Bounds of the range findRoots searches when the caller gives none.
+constexpr double DefaultRootBound = 100.0;
+
+// Finds the points in [from, to] where the expression, as a function of
+// `variable`, is zero. A vectorized scan through sampleExpression splits
+// the range into segments, and those whose interval enclosure excludes
+// zero are dropped. Sign changes on the rest are refined in parallel by
+// Newton's method on forward-mode derivatives, safeguarded by bisection,
+// with Brent's method where the derivative cannot be evaluated; sign
+// changes across poles are discarded. A segment that may vanish without a
+// sign change is searched for a root where the expression touches zero,
+// such as (x - 1)^2 at 1, at the sign change of the derivative. Two roots
+// closer together than the scan spacing, about (to - from) / 1000, can
+// still cancel out. Returns the roots in ascending order; errors are
+// reported as by sampleExpression.
+std::vector<double>
+findRoots(const std::string &expression, const std::string &variable,
+          double from = -DefaultRootBound, double to = DefaultRootBound,
+          const std::map<std::string, double> &variables = {});
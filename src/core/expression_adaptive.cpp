@@ -0,0 +1,333 @@
+#include "expression.hpp"
+
+#include "expression_double.hpp"
+#include "expression_engine.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+using expression_detail::EvalStatus;
+using expression_detail::floorMod;
+
+// A double together with a bound on its distance from the exact value of
+// the subexpression it came from. Rounding errors of + - * / are measured
+// exactly with error-free transformations; pow, the functions and input
+// errors are propagated to first order through the derivative.
+struct Bounded {
+  double value = 0.0;
+  double error = 0.0;
+};
+
+constexpr double Unit = std::numeric_limits<double>::epsilon() / 2;
+// Every integer of smaller magnitude is a double. 2^53 itself is too, but
+// so is the rounding of 2^53 + 1, so a value equal to the limit may not be
+// the integer that was written.
+constexpr double ExactIntegerLimit = 9007199254740992.0; // 2^53
+
+// The adaptive path never reports an error itself: anything it cannot
+// vouch for, failures included, is recomputed in bigdouble mode, which
+// raises the proper error if there is one.
+Bounded escalate(EvalStatus &status) {
+  status.code = EvalErrorCode::InvalidOperand;
+  status.message = "Double result is not trustworthy.";
+  return {};
+}
+
+// Error of a library function result: up to one ulp of the result.
+double libraryError(double value) {
+  return 2 * Unit * std::fabs(value);
+}
+
+bool isWhole(const Bounded &operand) {
+  return operand.error == 0.0 &&
+         expression_detail::isWholeNumber(operand.value);
+}
+
+// A literal is exact when it is an integer a double can hold; anything
+// else is off by at most half an ulp.
+Bounded parseBounded(std::string_view digits, bool negative) {
+  const double value = expression_detail::parseDoubleLiteral(digits);
+  std::string_view fraction;
+  if (std::size_t point = digits.find('.'); point != std::string_view::npos) {
+    fraction = digits.substr(point + 1);
+  }
+  const bool exact =
+      fraction.find_first_not_of('0') == std::string_view::npos &&
+      value < ExactIntegerLimit;
+  return {negative ? -value : value, exact ? 0.0 : Unit * value};
+}
+
+Bounded sum(double lhs, double lhsError, double rhs, double rhsError) {
+  // TwoSum: `rounding` is exactly the error of the addition.
+  const double value = lhs + rhs;
+  const double rhsPart = value - lhs;
+  const double rounding = (lhs - (value - rhsPart)) + (rhs - rhsPart);
+  return {value, lhsError + rhsError + std::fabs(rounding)};
+}
+
+Bounded product(const Bounded &lhs, const Bounded &rhs) {
+  const double value = lhs.value * rhs.value;
+  const double rounding = std::fma(lhs.value, rhs.value, -value);
+  return {value, std::fabs(lhs.value) * rhs.error +
+                     std::fabs(rhs.value) * lhs.error +
+                     lhs.error * rhs.error + std::fabs(rounding)};
+}
+
+Bounded quotient(const Bounded &lhs, const Bounded &rhs,
+                 EvalStatus &status) {
+  const double divisor = std::fabs(rhs.value);
+  if (divisor <= rhs.error) {
+    return escalate(status); // the exact divisor may be zero
+  }
+  const double value = lhs.value / rhs.value;
+  const double remainder = std::fma(-value, rhs.value, lhs.value);
+  return {value, (lhs.error + std::fabs(value) * rhs.error) /
+                         (divisor - rhs.error) +
+                     std::fabs(remainder / rhs.value)};
+}
+
+Bounded powerOf(const Bounded &base, const Bounded &exponent,
+                EvalStatus &status) {
+  const double value = std::pow(base.value, exponent.value);
+  if (std::isnan(value)) {
+    return escalate(status);
+  }
+  if (base.error == 0.0 && exponent.error == 0.0) {
+    return {value, libraryError(value)};
+  }
+  // d/dx x^y = y x^(y-1); d/dy x^y = x^y ln x.
+  if (base.value <= base.error ||
+      (base.value <= 0.0 && exponent.error != 0.0)) {
+    return escalate(status);
+  }
+  return {value, std::fabs(exponent.value * value / base.value) * base.error +
+                     std::fabs(value * std::log(base.value)) *
+                         exponent.error +
+                     libraryError(value)};
+}
+
+Bounded moduloOf(const Bounded &value, const Bounded &modulus,
+                 EvalStatus &status) {
+  if (value.error != 0.0 || modulus.error != 0.0 || modulus.value == 0.0) {
+    // Near a multiple of the modulus the result jumps, so inexact operands
+    // are never trusted.
+    return escalate(status);
+  }
+  // fmod is exact; only the sign correction can round.
+  const double result = floorMod(value.value, modulus.value);
+  return {result, Unit * std::fabs(result)};
+}
+
+Bounded powerModOf(const Bounded &base, const Bounded &exponent,
+                   const Bounded &modulus, EvalStatus &status) {
+  const double size = std::fabs(modulus.value);
+  if (!isWhole(base) || !isWhole(exponent) || !isWhole(modulus) ||
+      exponent.value < 0.0 || size == 0.0 ||
+      size > expression_detail::MaxExactPowModModulus) {
+    return escalate(status);
+  }
+  return {expression_detail::wholePowerMod(base.value, exponent.value,
+                                           modulus.value),
+          0.0};
+}
+
+Bounded factorialOf(const Bounded &operand, EvalStatus &status) {
+  if (!isWhole(operand) || operand.value < 0.0 || operand.value > 170.0) {
+    return escalate(status);
+  }
+  // The long double product is exact up to 20!, and its rounding stays
+  // far below an ulp of the double result up to 170!.
+  long double result = 1.0L;
+  for (int factor = 2; factor <= static_cast<int>(operand.value); ++factor) {
+    result *= factor;
+  }
+  const double value = static_cast<double>(result);
+  return {value, value < ExactIntegerLimit ? 0.0 : libraryError(value)};
+}
+
+Bounded functionOf(expression_detail::FunctionId id, const Bounded &operand,
+                   EvalStatus &status) {
+  using expression_detail::FunctionId;
+  const double x = operand.value;
+  const double e = operand.error;
+  double value = 0.0;
+  double slope = 0.0; // |f'(x)|
+  switch (id) {
+  case FunctionId::Sin:
+    value = std::sin(x);
+    slope = std::fabs(std::cos(x));
+    break;
+  case FunctionId::Cos:
+    value = std::cos(x);
+    slope = std::fabs(std::sin(x));
+    break;
+  case FunctionId::Tan:
+    value = std::tan(x);
+    slope = 1.0 + value * value;
+    break;
+  case FunctionId::Cot: {
+    const double tangent = std::tan(x);
+    if (std::fabs(tangent) <= 1e-9) {
+      return escalate(status);
+    }
+    value = 1.0 / tangent;
+    slope = 1.0 + value * value;
+    break;
+  }
+  case FunctionId::Asin:
+  case FunctionId::Acos:
+    if (std::fabs(x) + e >= 1.0) {
+      return escalate(status); // edge of the domain, where f' is unbounded
+    }
+    value = id == FunctionId::Asin ? std::asin(x) : std::acos(x);
+    slope = 1.0 / std::sqrt(1.0 - x * x);
+    break;
+  case FunctionId::Atan:
+    value = std::atan(x);
+    slope = 1.0 / (1.0 + x * x);
+    break;
+  case FunctionId::Sinh:
+    value = std::sinh(x);
+    slope = std::cosh(x);
+    break;
+  case FunctionId::Log:
+    if (x <= e) {
+      return escalate(status);
+    }
+    value = std::log(x);
+    slope = 1.0 / x;
+    break;
+  case FunctionId::Exp:
+    value = std::exp(x);
+    slope = value;
+    break;
+  case FunctionId::Sqrt:
+    if (x < 0.0 || (x <= e && e != 0.0)) {
+      return escalate(status);
+    }
+    value = std::sqrt(x);
+    slope = e == 0.0 ? 0.0 : 0.5 / value;
+    break;
+  default:
+    return escalate(status);
+  }
+  return {value, slope * e + libraryError(value)};
+}
+
+// Numeric policy for the double half of adaptive mode.
+struct BoundedTraits {
+  using Value = Bounded;
+  static constexpr expression_detail::NumberSyntax Syntax =
+      expression_detail::NumberSyntax::Decimal;
+  static constexpr bool FallibleArithmetic = false;
+
+  static Bounded parseLiteral(std::string_view digits, bool negative) {
+    return parseBounded(digits, negative);
+  }
+  static Bounded fromVariable(const std::string &, double value) {
+    return {value, 0.0};
+  }
+  static Bounded add(const Bounded &lhs, const Bounded &rhs, EvalStatus &) {
+    return sum(lhs.value, lhs.error, rhs.value, rhs.error);
+  }
+  static Bounded subtract(const Bounded &lhs, const Bounded &rhs,
+                          EvalStatus &) {
+    return sum(lhs.value, lhs.error, -rhs.value, rhs.error);
+  }
+  static Bounded multiply(const Bounded &lhs, const Bounded &rhs,
+                          EvalStatus &) {
+    return product(lhs, rhs);
+  }
+  static Bounded divide(const Bounded &lhs, const Bounded &rhs,
+                        EvalStatus &status) {
+    return quotient(lhs, rhs, status);
+  }
+  static Bounded modulo(const Bounded &lhs, const Bounded &rhs,
+                        EvalStatus &status) {
+    return moduloOf(lhs, rhs, status);
+  }
+  static Bounded power(const Bounded &lhs, const Bounded &rhs,
+                       EvalStatus &status) {
+    return powerOf(lhs, rhs, status);
+  }
+  static Bounded powerMod(const Bounded &base, const Bounded &exponent,
+                          const Bounded &modulus, EvalStatus &status) {
+    return powerModOf(base, exponent, modulus, status);
+  }
+  static Bounded square(const Bounded &value, EvalStatus &) {
+    return product(value, value);
+  }
+  static Bounded factorial(const Bounded &value, EvalStatus &status) {
+    return factorialOf(value, status);
+  }
+  static Bounded function(expression_detail::FunctionId id,
+                          const Bounded &value, EvalStatus &status) {
+    return functionOf(id, value, status);
+  }
+  // Only exact constants are identities.
+  static bool isOne(const Bounded &value) {
+    return value.value == 1.0 && value.error == 0.0;
+  }
+  static bool isTwo(const Bounded &value) {
+    return value.value == 2.0 && value.error == 0.0;
+  }
+  static bool isNeutralAddend(const Bounded &value) {
+    return value.value == 0.0 && value.error == 0.0 &&
+           std::signbit(value.value);
+  }
+  static bool isNeutralSubtrahend(const Bounded &value) {
+    return value.value == 0.0 && value.error == 0.0 &&
+           !std::signbit(value.value);
+  }
+};
+
+// True when every printed digit of `result` is backed by its error bound.
+bool isTrustworthy(const Bounded &result) {
+  return std::isfinite(result.value) &&
+         result.error <= 0.5 * std::pow(10.0, -AdaptiveDigits) *
+                             std::fabs(result.value);
+}
+} // namespace
+
+AdaptiveResult evaluateExpressionAdaptive(
+    const std::string &expression,
+    const std::map<std::string, double> &variables) {
+  expression_detail::Program<Bounded> program =
+      expression_detail::compileProgram<BoundedTraits>(expression);
+  std::vector<Bounded> slots(program.variables.size());
+  std::size_t missing = expression_detail::bindProgram<BoundedTraits>(
+      program, variables, slots.data());
+  if (missing < slots.size()) {
+    throw std::invalid_argument("Unknown variable: " +
+                                program.variables[missing]);
+  }
+  std::vector<Bounded> stack(program.maxDepth);
+  EvalStatus status;
+  std::size_t stopped = expression_detail::execute<BoundedTraits>(
+      program.code.data(), program.code.size(), program.constants.data(),
+      slots.data(), stack.data(), status);
+
+  AdaptiveResult result;
+  if (stopped == program.code.size() && isTrustworthy(stack[0])) {
+    std::ostringstream out;
+    out << std::setprecision(AdaptiveDigits) << stack[0].value;
+    result.text = out.str();
+    result.value = stack[0].value;
+    result.path = EvalPath::Double;
+    return result;
+  }
+  result.text =
+      expression_detail::evaluateBigDoubleVerified(expression, variables);
+  result.value = std::strtod(result.text.c_str(), nullptr);
+  result.path = EvalPath::BigDouble;
+  return result;
+}
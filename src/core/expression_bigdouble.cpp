@@ -1,31 +1,57 @@
 #include "expression.hpp"
 
-#include "expression_internal.hpp"
+#include "big_factorial.hpp"
+#include "expression_engine.hpp"
 
-#include <boost/multiprecision/cpp_dec_float.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <boost/multiprecision/cpp_bin_float.hpp>
 #include <cmath>
+#include <cstdint>
 #include <iomanip>
 #include <limits>
 #include <map>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace {
-using BigFloat = boost::multiprecision::cpp_dec_float_50;
+using expression_detail::EvalStatus;
 
-BigFloat parseBigDouble(const std::string &text) {
+// The precisions bigdouble mode is compiled for. A request for N digits
+// runs on the smallest tier that prints at least N; each tier carries ten
+// guard digits beyond that so rounding in the last operations does not show
+// in the output.
+template <unsigned Digits>
+using BinaryFloat = boost::multiprecision::number<
+    boost::multiprecision::cpp_bin_float<Digits + 10>>;
+
+std::atomic<std::size_t> precisionDigits{DefaultBigDoublePrecision};
+
+template <typename BigFloat>
+BigFloat fail(EvalStatus &status, EvalErrorCode code, const char *message) {
+  status.code = code;
+  status.message = message;
+  return 0;
+}
+
+template <typename BigFloat>
+BigFloat parseBigDouble(std::string_view text, bool negative) {
   if (text.empty()) {
     throw std::invalid_argument("Empty decimal literal.");
   }
-  std::string normalized = text;
-  if (normalized[0] == '.') {
-    normalized.insert(normalized.begin(), '0');
-  } else if (normalized.size() > 1 && normalized[0] == '-' &&
-             normalized[1] == '.') {
-    normalized.insert(normalized.begin() + 1, '0');
+  std::string normalized;
+  normalized.reserve(text.size() + 2);
+  if (negative) {
+    normalized.push_back('-');
+  }
+  if (text[0] == '.') {
+    normalized.push_back('0');
   }
+  normalized.append(text);
   try {
     return BigFloat(normalized);
   } catch (const std::exception &) {
@@ -33,191 +59,381 @@ BigFloat parseBigDouble(const std::string &text) {
   }
 }
 
+template <typename BigFloat>
 BigFloat absValue(const BigFloat &value) {
   return value < 0 ? -value : value;
 }
 
-bool isApproximatelyZero(const BigFloat &value,
-                          const BigFloat &epsilon = BigFloat("1e-40")) {
-  return absValue(value) <= epsilon;
+// Ulps of headroom, out of the ten guard digits (about 33 bits), that a
+// cancelled sum may carry and still count as zero.
+constexpr int NoiseBits = 16;
+
+// Binary floats hold decimal fractions such as 0.1 inexactly, so a sum
+// that cancels exactly in decimal, like 0.1 + 0.2 - 0.3, leaves a residue
+// of a few ulps of its operands. A sum or difference that small relative to
+// its larger operand is rounding noise within the guard digits and is
+// rounded to zero; zero tests elsewhere are then exact, and a genuinely
+// small value such as 10^-58 is never mistaken for zero.
+template <typename BigFloat>
+BigFloat cancelNoise(const BigFloat &result, const BigFloat &lhs,
+                     const BigFloat &rhs) {
+  static const BigFloat noise = boost::multiprecision::ldexp(
+      std::numeric_limits<BigFloat>::epsilon(), NoiseBits);
+  const BigFloat scale = std::max(absValue(lhs), absValue(rhs));
+  return result != 0 && absValue(result) <= scale * noise ? BigFloat(0)
+                                                          : result;
 }
 
-BigFloat factorialOfBigDouble(const BigFloat &operand) {
+template <typename BigFloat>
+BigFloat factorialOfBigDouble(const BigFloat &operand, EvalStatus &status) {
   BigFloat rounded = boost::multiprecision::floor(operand + BigFloat("0.5"));
-  if (!isApproximatelyZero(operand - rounded)) {
-    throw std::invalid_argument("Factorial is only defined for integers.");
+  if (cancelNoise<BigFloat>(operand - rounded, operand, rounded) != 0) {
+    return fail<BigFloat>(status, EvalErrorCode::InvalidOperand,
+                          "Factorial is only defined for integers.");
   }
   if (rounded < 0) {
-    throw std::invalid_argument(
-        "Factorial is not defined for negative numbers.");
-  }
-  if (rounded > BigFloat(10000)) {
-    throw std::overflow_error(
-        "Factorial operand is too large for bigdouble mode.");
-  }
-  unsigned int n = rounded.convert_to<unsigned int>();
-  BigFloat result = 1;
-  for (unsigned int i = 2; i <= n; ++i) {
-    result *= i;
-  }
-  return result;
-}
-
-BigFloat applyFunction(const std::string &functionName,
-                       const BigFloat &value) {
-  using boost::multiprecision::acos;
-  using boost::multiprecision::asin;
-  using boost::multiprecision::atan;
-  using boost::multiprecision::cos;
-  using boost::multiprecision::exp;
-  using boost::multiprecision::log;
-  using boost::multiprecision::sin;
-  using boost::multiprecision::sinh;
-  using boost::multiprecision::sqrt;
-  using boost::multiprecision::tan;
-
-  if (functionName == "sin") {
-    return sin(value);
-  }
-  if (functionName == "cos") {
-    return cos(value);
-  }
-  if (functionName == "log") {
-    if (value <= 0) {
-      throw std::domain_error("Logarithm undefined for non-positive values.");
-    }
-    return log(value);
+    return fail<BigFloat>(status, EvalErrorCode::InvalidOperand,
+                          "Factorial is not defined for negative numbers.");
   }
-  if (functionName == "tan") {
-    return tan(value);
+  if (rounded > BigFloat(factorialLimit())) {
+    return fail<BigFloat>(status, EvalErrorCode::Overflow,
+                          "Factorial operand is too large for bigdouble mode.");
   }
-  if (functionName == "sqrt") {
-    if (value < 0) {
-      throw std::domain_error("Square root undefined for negative values.");
-    }
-    return sqrt(value);
+  std::uint64_t n = rounded.template convert_to<std::uint64_t>();
+  if (std::lgamma(static_cast<double>(n) + 1.0) / std::log(10.0) >=
+      std::numeric_limits<BigFloat>::max_exponent10) {
+    return fail<BigFloat>(status, EvalErrorCode::Overflow,
+                          "Factorial result is too large for bigdouble mode.");
   }
-  if (functionName == "exp") {
-    return exp(value);
+  // The balanced product also keeps rounding error growing with log(n)
+  // rather than n.
+  return boost::multiprecision::ldexp(
+      big_factorial::oddFactorial<BigFloat>(n),
+      static_cast<int>(big_factorial::twoExponent(n)));
+}
+
+// Remainder with the sign of the modulus, matching the other modes.
+template <typename BigFloat>
+BigFloat floorMod(const BigFloat &value, const BigFloat &modulus) {
+  BigFloat remainder = boost::multiprecision::fmod(value, modulus);
+  if (remainder != 0 && (remainder < 0) != (modulus < 0)) {
+    remainder += modulus;
   }
-  if (functionName == "cot") {
-    BigFloat tanValue = tan(value);
-    if (isApproximatelyZero(tanValue)) {
-      throw std::domain_error("Cotangent undefined for this value.");
-    }
-    return BigFloat(1) / tanValue;
+  return remainder;
+}
+
+template <typename BigFloat>
+BigFloat moduloOfBigDouble(const BigFloat &value, const BigFloat &modulus,
+                           EvalStatus &status) {
+  if (modulus == 0) {
+    return fail<BigFloat>(status, EvalErrorCode::DivisionByZero,
+                          "Modulo by zero in expression.");
   }
-  if (functionName == "asin") {
-    if (value < -1 || value > 1) {
-      throw std::domain_error("Arcsine undefined for this value.");
-    }
-    return asin(value);
+  return floorMod(value, modulus);
+}
+
+template <typename BigFloat>
+bool isWholeNumber(const BigFloat &value) {
+  return boost::multiprecision::isfinite(value) &&
+         boost::multiprecision::trunc(value) == value;
+}
+
+template <typename BigFloat>
+BigFloat powerModOfBigDouble(const BigFloat &base, const BigFloat &exponent,
+                             const BigFloat &modulus, EvalStatus &status) {
+  if (modulus == 0) {
+    return fail<BigFloat>(status, EvalErrorCode::DivisionByZero,
+                          "Modulo by zero in expression.");
   }
-  if (functionName == "acos") {
-    if (value < -1 || value > 1) {
-      throw std::domain_error("Arccosine undefined for this value.");
+  // Residues below 2^(digits / 2) multiply exactly.
+  BigFloat size = absValue(modulus);
+  if (!isWholeNumber(base) || !isWholeNumber(exponent) || exponent < 0 ||
+      !isWholeNumber(modulus) ||
+      size > boost::multiprecision::ldexp(
+                 BigFloat(1), std::numeric_limits<BigFloat>::digits / 2)) {
+    return floorMod(BigFloat(boost::multiprecision::pow(base, exponent)),
+                    modulus);
+  }
+  BigFloat result = boost::multiprecision::fmod(BigFloat(1), size);
+  BigFloat factor = floorMod(base, size);
+  for (BigFloat rest = exponent; rest > 0;
+       rest = boost::multiprecision::floor(rest / 2)) {
+    if (boost::multiprecision::fmod(rest, BigFloat(2)) == 1) {
+      result = boost::multiprecision::fmod(result * factor, size);
     }
-    return acos(value);
+    factor = boost::multiprecision::fmod(factor * factor, size);
+  }
+  return modulus < 0 && result != 0 ? BigFloat(result + modulus) : result;
+}
+
+template <typename BigFloat>
+BigFloat sinOf(const BigFloat &value, EvalStatus &) {
+  return boost::multiprecision::sin(value);
+}
+
+template <typename BigFloat>
+BigFloat cosOf(const BigFloat &value, EvalStatus &) {
+  return boost::multiprecision::cos(value);
+}
+
+template <typename BigFloat>
+BigFloat tanOf(const BigFloat &value, EvalStatus &) {
+  return boost::multiprecision::tan(value);
+}
+
+template <typename BigFloat>
+BigFloat cotOf(const BigFloat &value, EvalStatus &status) {
+  BigFloat tanValue = boost::multiprecision::tan(value);
+  if (tanValue == 0) {
+    return fail<BigFloat>(status, EvalErrorCode::DomainError,
+                          "Cotangent undefined for this value.");
   }
-  if (functionName == "atan") {
-    return atan(value);
+  return BigFloat(1) / tanValue;
+}
+
+template <typename BigFloat>
+BigFloat asinOf(const BigFloat &value, EvalStatus &status) {
+  if (value < -1 || value > 1) {
+    return fail<BigFloat>(status, EvalErrorCode::DomainError,
+                          "Arcsine undefined for this value.");
   }
-  if (functionName == "sinh") {
-    return sinh(value);
+  return boost::multiprecision::asin(value);
+}
+
+template <typename BigFloat>
+BigFloat acosOf(const BigFloat &value, EvalStatus &status) {
+  if (value < -1 || value > 1) {
+    return fail<BigFloat>(status, EvalErrorCode::DomainError,
+                          "Arccosine undefined for this value.");
   }
-  throw std::invalid_argument("Unknown function: " + functionName);
+  return boost::multiprecision::acos(value);
 }
 
-std::string formatBigFloat(const BigFloat &value) {
+template <typename BigFloat>
+BigFloat atanOf(const BigFloat &value, EvalStatus &) {
+  return boost::multiprecision::atan(value);
+}
+
+template <typename BigFloat>
+BigFloat sinhOf(const BigFloat &value, EvalStatus &) {
+  return boost::multiprecision::sinh(value);
+}
+
+template <typename BigFloat>
+BigFloat logOf(const BigFloat &value, EvalStatus &status) {
+  if (value <= 0) {
+    return fail<BigFloat>(status, EvalErrorCode::DomainError,
+                          "Logarithm undefined for non-positive values.");
+  }
+  return boost::multiprecision::log(value);
+}
+
+template <typename BigFloat>
+BigFloat expOf(const BigFloat &value, EvalStatus &) {
+  return boost::multiprecision::exp(value);
+}
+
+template <typename BigFloat>
+BigFloat sqrtOf(const BigFloat &value, EvalStatus &status) {
+  if (value < 0) {
+    return fail<BigFloat>(status, EvalErrorCode::DomainError,
+                          "Square root undefined for negative values.");
+  }
+  return boost::multiprecision::sqrt(value);
+}
+
+template <typename BigFloat>
+using UnaryFunction = BigFloat (*)(const BigFloat &, EvalStatus &);
+
+// Indexed by expression_detail::FunctionId.
+template <typename BigFloat>
+const std::array<UnaryFunction<BigFloat>,
+                 expression_detail::UnaryFunctionCount>
+    FunctionTable = {sinOf<BigFloat>,  cosOf<BigFloat>,  tanOf<BigFloat>,
+                     cotOf<BigFloat>,  asinOf<BigFloat>, acosOf<BigFloat>,
+                     atanOf<BigFloat>, sinhOf<BigFloat>, logOf<BigFloat>,
+                     expOf<BigFloat>,  sqrtOf<BigFloat>};
+
+// Prints `digits` significant digits, dropping trailing zeros.
+template <typename BigFloat>
+std::string formatBigFloat(const BigFloat &value, std::size_t digits) {
   std::ostringstream out;
-  out << std::setprecision(std::numeric_limits<BigFloat>::digits10) << value;
+  out << std::setprecision(static_cast<int>(digits)) << value;
   return out.str();
 }
+
+// Numeric policy for bigdouble mode at one precision tier.
+template <typename BigFloat> struct BigFloatTraits {
+  using Value = BigFloat;
+  static constexpr expression_detail::NumberSyntax Syntax =
+      expression_detail::NumberSyntax::Decimal;
+  static constexpr bool FallibleArithmetic = false;
+
+  static BigFloat parseLiteral(std::string_view digits, bool negative) {
+    return parseBigDouble<BigFloat>(digits, negative);
+  }
+  static BigFloat fromVariable(const std::string &, double value) {
+    return BigFloat(value);
+  }
+  static BigFloat add(const BigFloat &lhs, const BigFloat &rhs,
+                      EvalStatus &) {
+    return cancelNoise<BigFloat>(lhs + rhs, lhs, rhs);
+  }
+  static BigFloat subtract(const BigFloat &lhs, const BigFloat &rhs,
+                           EvalStatus &) {
+    return cancelNoise<BigFloat>(lhs - rhs, lhs, rhs);
+  }
+  static BigFloat multiply(const BigFloat &lhs, const BigFloat &rhs,
+                           EvalStatus &) {
+    return lhs * rhs;
+  }
+  static BigFloat divide(const BigFloat &lhs, const BigFloat &rhs,
+                         EvalStatus &status) {
+    if (rhs == 0) {
+      return fail<BigFloat>(status, EvalErrorCode::DivisionByZero,
+                            "Division by zero in expression.");
+    }
+    return lhs / rhs;
+  }
+  static BigFloat modulo(const BigFloat &lhs, const BigFloat &rhs,
+                         EvalStatus &status) {
+    return moduloOfBigDouble(lhs, rhs, status);
+  }
+  static BigFloat power(const BigFloat &lhs, const BigFloat &rhs,
+                        EvalStatus &) {
+    return boost::multiprecision::pow(lhs, rhs);
+  }
+  static BigFloat powerMod(const BigFloat &base, const BigFloat &exponent,
+                           const BigFloat &modulus, EvalStatus &status) {
+    return powerModOfBigDouble(base, exponent, modulus, status);
+  }
+  static BigFloat square(const BigFloat &value, EvalStatus &) {
+    return value * value;
+  }
+  static BigFloat factorial(const BigFloat &value, EvalStatus &status) {
+    return factorialOfBigDouble(value, status);
+  }
+  static BigFloat function(expression_detail::FunctionId id,
+                           const BigFloat &value, EvalStatus &status) {
+    return FunctionTable<BigFloat>[static_cast<std::size_t>(id)](value,
+                                                                 status);
+  }
+  static bool isOne(const BigFloat &value) {
+    return value == 1;
+  }
+  static bool isTwo(const BigFloat &value) {
+    return value == 2;
+  }
+  // Signed zeros behave as in IEEE arithmetic, see the double policy.
+  static bool isNeutralAddend(const BigFloat &value) {
+    return value == 0 && boost::multiprecision::signbit(value);
+  }
+  static bool isNeutralSubtrahend(const BigFloat &value) {
+    return value == 0 && !boost::multiprecision::signbit(value);
+  }
+};
+
+template <typename BigFloat>
+BigFloat valueAt(const std::string &expression,
+                 const std::map<std::string, double> &variables) {
+  expression_detail::Program<BigFloat> program =
+      expression_detail::compileProgram<BigFloatTraits<BigFloat>>(expression);
+  return expression_detail::evaluateProgram<BigFloatTraits<BigFloat>>(
+      program, variables);
+}
+
+template <typename BigFloat>
+std::string evaluateAt(const std::string &expression,
+                       const std::map<std::string, double> &variables,
+                       std::size_t digits) {
+  return formatBigFloat(valueAt<BigFloat>(expression, variables), digits);
+}
+
+// The precision the top tier is checked against.
+using VerificationFloat = BinaryFloat<MaxBigDoublePrecision + 250>;
+
+// Evaluates on the tier `Low` and again on the more precise `High`, and
+// prints the `High` value to the digits on which the two agree, at most
+// `digits` of them.
+template <typename Low, typename High>
+std::string verifiedAt(const std::string &expression,
+                       const std::map<std::string, double> &variables,
+                       std::size_t digits) {
+  const High low(valueAt<Low>(expression, variables));
+  const High high = valueAt<High>(expression, variables);
+  if (low == high) {
+    return formatBigFloat(high, digits);
+  }
+  const High spread = absValue(High(low - high));
+  const double agreed =
+      high == 0 ? 0.0
+                : boost::multiprecision::floor(
+                      boost::multiprecision::log10(absValue(high) / spread))
+                      .template convert_to<double>();
+  if (agreed < 1.0) {
+    throw std::domain_error(
+        "The result is indeterminate: no digit is stable at this precision.");
+  }
+  return formatBigFloat(
+      high, std::min(digits, static_cast<std::size_t>(agreed)));
+}
 } // namespace
 
+std::size_t bigDoublePrecision() {
+  return precisionDigits.load(std::memory_order_relaxed);
+}
+
+void setBigDoublePrecision(std::size_t digits) {
+  if (digits == 0 || digits > MaxBigDoublePrecision) {
+    throw std::out_of_range("bigdouble precision must be between 1 and " +
+                            std::to_string(MaxBigDoublePrecision) +
+                            " digits.");
+  }
+  precisionDigits.store(digits, std::memory_order_relaxed);
+}
+
 std::string evaluateExpressionBigDouble(
     const std::string &expression,
     const std::map<std::string, double> &variables) {
-  std::vector<expression_detail::BigFloatToken> tokens =
-      expression_detail::tokenizeExpressionBigDouble(expression);
-  std::vector<expression_detail::BigFloatToken> rpn =
-      expression_detail::toRpnBigDouble(tokens);
-  std::vector<BigFloat> stack;
-
-  for (const expression_detail::BigFloatToken &token : rpn) {
-    switch (token.type) {
-    case expression_detail::BigFloatToken::Type::Number:
-      stack.push_back(parseBigDouble(token.number));
-      break;
-    case expression_detail::BigFloatToken::Type::Operator:
-      if (token.op == '!') {
-        if (stack.empty()) {
-          throw std::invalid_argument("Factorial operator missing operand.");
-        }
-        BigFloat value = stack.back();
-        stack.back() = factorialOfBigDouble(value);
-        break;
-      }
-      if (stack.size() < 2) {
-        throw std::invalid_argument(
-            "Invalid expression: insufficient operands.");
-      }
-      {
-        BigFloat rhs = stack.back();
-        stack.pop_back();
-        BigFloat lhs = stack.back();
-        stack.pop_back();
-        BigFloat result = 0;
-        switch (token.op) {
-        case '+':
-          result = lhs + rhs;
-          break;
-        case '-':
-          result = lhs - rhs;
-          break;
-        case '*':
-          result = lhs * rhs;
-          break;
-        case '/':
-          if (isApproximatelyZero(rhs)) {
-            throw std::runtime_error("Division by zero in expression.");
-          }
-          result = lhs / rhs;
-          break;
-        case '^':
-          result = boost::multiprecision::pow(lhs, rhs);
-          break;
-        default:
-          throw std::invalid_argument("Unknown operator in expression.");
-        }
-        stack.push_back(result);
-      }
-      break;
-    case expression_detail::BigFloatToken::Type::Function:
-      if (stack.empty()) {
-        throw std::invalid_argument("Function missing operand.");
-      }
-      {
-        BigFloat argument = stack.back();
-        stack.back() = applyFunction(token.text, argument);
-      }
-      break;
-    case expression_detail::BigFloatToken::Type::Variable: {
-      auto found = variables.find(token.text);
-      if (found == variables.end()) {
-        throw std::invalid_argument("Unknown variable: " + token.text);
-      }
-      stack.push_back(BigFloat(found->second));
-      break;
-    }
-    default:
-      break;
-    }
+  const std::size_t digits = bigDoublePrecision();
+  if (digits <= 30) {
+    return evaluateAt<BinaryFloat<30>>(expression, variables, digits);
   }
-
-  if (stack.size() != 1) {
-    throw std::invalid_argument("Invalid expression: leftover operands.");
+  if (digits <= 50) {
+    return evaluateAt<BinaryFloat<50>>(expression, variables, digits);
+  }
+  if (digits <= 100) {
+    return evaluateAt<BinaryFloat<100>>(expression, variables, digits);
   }
+  if (digits <= 250) {
+    return evaluateAt<BinaryFloat<250>>(expression, variables, digits);
+  }
+  return evaluateAt<BinaryFloat<MaxBigDoublePrecision>>(expression, variables,
+                                                        digits);
+}
 
-  return formatBigFloat(stack.back());
+namespace expression_detail {
+std::string evaluateBigDoubleVerified(
+    const std::string &expression,
+    const std::map<std::string, double> &variables) {
+  const std::size_t digits = bigDoublePrecision();
+  if (digits <= 30) {
+    return verifiedAt<BinaryFloat<30>, BinaryFloat<50>>(expression, variables,
+                                                        digits);
+  }
+  if (digits <= 50) {
+    return verifiedAt<BinaryFloat<50>, BinaryFloat<100>>(expression,
+                                                         variables, digits);
+  }
+  if (digits <= 100) {
+    return verifiedAt<BinaryFloat<100>, BinaryFloat<250>>(expression,
+                                                          variables, digits);
+  }
+  if (digits <= 250) {
+    return verifiedAt<BinaryFloat<250>, BinaryFloat<MaxBigDoublePrecision>>(
+        expression, variables, digits);
+  }
+  return verifiedAt<BinaryFloat<MaxBigDoublePrecision>, VerificationFloat>(
+      expression, variables, digits);
 }
+} // namespace expression_detail
@@ -1,153 +1,458 @@
 #include "expression.hpp"
 
-#include "expression_internal.hpp"
+#include "big_factorial.hpp"
+#include "bigint_decimal.hpp"
+#include "expression_engine.hpp"
 #include "math_utils.hpp"
 
+#include <atomic>
 #include <boost/multiprecision/cpp_int.hpp>
-#include <cctype>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <map>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace {
 using boost::multiprecision::cpp_int;
+using expression_detail::EvalStatus;
 
-cpp_int parseBigInt(const std::string &text) {
-  if (text.empty()) {
-    throw std::invalid_argument("Empty integer literal.");
-  }
-  bool negative = false;
-  std::size_t index = 0;
-  if (text[0] == '-') {
-    negative = true;
-    index = 1;
-  }
-  if (index >= text.size()) {
-    throw std::invalid_argument("Invalid integer literal.");
-  }
-  cpp_int value = 0;
-  for (; index < text.size(); ++index) {
-    char c = text[index];
-    if (!std::isdigit(static_cast<unsigned char>(c))) {
-      throw std::invalid_argument("Invalid integer literal.");
-    }
-    value *= 10;
-    value += static_cast<unsigned int>(c - '0');
-  }
+cpp_int fail(EvalStatus &status, EvalErrorCode code, const char *message) {
+  status.code = code;
+  status.message = message;
+  return 0;
+}
+
+cpp_int parseBigInt(std::string_view text, bool negative) {
+  cpp_int value = parseDecimalInteger(text);
   return negative ? -value : value;
 }
 
-cpp_int factorialOfBigInt(const cpp_int &operand) {
+cpp_int factorialOfBigInt(const cpp_int &operand, EvalStatus &status) {
   if (operand < 0) {
-    throw std::invalid_argument(
-        "Factorial is not defined for negative numbers.");
-  }
-  if (operand > 10000) {
-    throw std::overflow_error(
-        "Factorial operand is too large for bigint mode.");
+    return fail(status, EvalErrorCode::InvalidOperand,
+                "Factorial is not defined for negative numbers.");
   }
-  cpp_int result = 1;
-  for (cpp_int i = 2; i <= operand; ++i) {
-    result *= i;
+  if (operand > factorialLimit()) {
+    return fail(status, EvalErrorCode::Overflow,
+                "Factorial operand is too large for bigint mode.");
   }
-  return result;
+  return bigIntFactorial(operand.convert_to<std::uint64_t>());
 }
 
-cpp_int resolveBigIntVariable(const std::string &name, double value) {
+long long resolveBigIntVariable(const std::string &name, double value) {
   double rounded = std::round(value);
   if (!isApproximatelyZero(value - rounded)) {
     throw std::invalid_argument("Variable '" + name +
                                 "' must be an integer in bigint mode.");
   }
+  // max() rounds up to 2^63 as a double, which is already out of range.
   if (rounded < static_cast<double>(std::numeric_limits<long long>::min()) ||
-      rounded > static_cast<double>(std::numeric_limits<long long>::max())) {
+      rounded >= static_cast<double>(std::numeric_limits<long long>::max())) {
     throw std::overflow_error("Variable '" + name +
                               "' is out of range for bigint mode.");
   }
-  return cpp_int(static_cast<long long>(rounded));
+  return static_cast<long long>(rounded);
+}
+
+std::atomic<std::size_t> powerLimitBits{DefaultPowerResultLimit};
+
+cpp_int powerOfBigInt(const cpp_int &base, const cpp_int &exponent,
+                      EvalStatus &status) {
+  if (base == 1 || exponent == 0) {
+    return 1;
+  }
+  if (base == -1) {
+    return exponent % 2 == 0 ? 1 : -1;
+  }
+  if (exponent < 0) {
+    return fail(
+        status, EvalErrorCode::DomainError,
+        "Negative exponent results in a non-integer value in bigint mode.");
+  }
+  if (base == 0) {
+    return 0;
+  }
+  // The result has floor(exponent * log2|base|) + 1 bits.
+  cpp_int magnitude = abs(base);
+  std::size_t shift = boost::multiprecision::msb(magnitude);
+  shift = shift > 52 ? shift - 52 : 0;
+  double log2Base =
+      static_cast<double>(shift) +
+      std::log2((magnitude >> shift).convert_to<double>());
+  if (exponent.convert_to<double>() * log2Base >=
+      static_cast<double>(powerResultLimit())) {
+    return fail(status, EvalErrorCode::Overflow,
+                "Power result is too large for bigint mode.");
+  }
+  return boost::multiprecision::pow(base, exponent.convert_to<unsigned>());
+}
+
+// Remainder with the sign of the modulus, matching the other modes.
+cpp_int moduloOfBigInt(const cpp_int &value, const cpp_int &modulus,
+                       EvalStatus &status) {
+  if (modulus == 0) {
+    return fail(status, EvalErrorCode::DivisionByZero,
+                "Modulo by zero in expression.");
+  }
+  cpp_int remainder = value % modulus;
+  if (remainder != 0 && (remainder < 0) != (modulus < 0)) {
+    remainder += modulus;
+  }
+  return remainder;
+}
+
+// base^exponent mod modulus by modular square-and-multiply; intermediate
+// values never exceed modulus^2, so there is no size limit.
+cpp_int powerModOfBigInt(const cpp_int &base, const cpp_int &exponent,
+                         const cpp_int &modulus, EvalStatus &status) {
+  if (modulus == 0) {
+    return fail(status, EvalErrorCode::DivisionByZero,
+                "Modulo by zero in expression.");
+  }
+  if (exponent < 0) {
+    // Only bases of 1 and -1 have integer powers here.
+    cpp_int power = powerOfBigInt(base, exponent, status);
+    if (status.code != EvalErrorCode::None) {
+      return 0;
+    }
+    return moduloOfBigInt(power, modulus, status);
+  }
+  cpp_int size = abs(modulus);
+  cpp_int residue = base % size;
+  if (residue < 0) {
+    residue += size;
+  }
+  cpp_int result = boost::multiprecision::powm(residue, exponent, size);
+  if (modulus < 0 && result != 0) {
+    result += modulus;
+  }
+  return result;
+}
+
+// Numeric policy for bigint mode: exact integers; powmod is the only
+// function.
+struct BigIntTraits {
+  using Value = cpp_int;
+  static constexpr expression_detail::NumberSyntax Syntax =
+      expression_detail::NumberSyntax::Integer;
+  static constexpr bool FallibleArithmetic = false;
+
+  static cpp_int parseLiteral(std::string_view digits, bool negative) {
+    return parseBigInt(digits, negative);
+  }
+  static cpp_int fromVariable(const std::string &name, double value) {
+    return cpp_int(resolveBigIntVariable(name, value));
+  }
+  static cpp_int add(const cpp_int &lhs, const cpp_int &rhs, EvalStatus &) {
+    return lhs + rhs;
+  }
+  static cpp_int subtract(const cpp_int &lhs, const cpp_int &rhs,
+                          EvalStatus &) {
+    return lhs - rhs;
+  }
+  static cpp_int multiply(const cpp_int &lhs, const cpp_int &rhs,
+                          EvalStatus &) {
+    return lhs * rhs;
+  }
+  static cpp_int divide(const cpp_int &lhs, const cpp_int &rhs,
+                        EvalStatus &status) {
+    if (rhs == 0) {
+      return fail(status, EvalErrorCode::DivisionByZero,
+                  "Division by zero in expression.");
+    }
+    if (lhs % rhs != 0) {
+      return fail(status, EvalErrorCode::DomainError,
+                  "Division results in a non-integer value in bigint mode.");
+    }
+    return lhs / rhs;
+  }
+  static cpp_int power(const cpp_int &lhs, const cpp_int &rhs,
+                       EvalStatus &status) {
+    return powerOfBigInt(lhs, rhs, status);
+  }
+  static cpp_int modulo(const cpp_int &lhs, const cpp_int &rhs,
+                        EvalStatus &status) {
+    return moduloOfBigInt(lhs, rhs, status);
+  }
+  static cpp_int powerMod(const cpp_int &base, const cpp_int &exponent,
+                          const cpp_int &modulus, EvalStatus &status) {
+    return powerModOfBigInt(base, exponent, modulus, status);
+  }
+  static cpp_int square(const cpp_int &value, EvalStatus &) {
+    return value * value;
+  }
+  static cpp_int factorial(const cpp_int &value, EvalStatus &status) {
+    return factorialOfBigInt(value, status);
+  }
+  static cpp_int function(expression_detail::FunctionId, const cpp_int &,
+                          EvalStatus &status) {
+    return fail(status, EvalErrorCode::InvalidExpression,
+                "Functions are not supported in bigint mode.");
+  }
+  static bool isOne(const cpp_int &value) {
+    return value == 1;
+  }
+  static bool isTwo(const cpp_int &value) {
+    return value == 2;
+  }
+  static bool isNeutralAddend(const cpp_int &value) {
+    return value == 0;
+  }
+  static bool isNeutralSubtrahend(const cpp_int &value) {
+    return value == 0;
+  }
+};
+
+// The int64 fast path. Most bigint expressions never leave 64 bits, so they
+// are compiled and run on SmallInt with checked arithmetic; an operation
+// whose result does not fit stops the run, and it and everything after it
+// are redone on cpp_int from the values computed so far.
+using SmallInt = std::int64_t;
+
+// Thrown when compiling for the fast path meets a literal that needs more
+// than 64 bits; such expressions go straight to cpp_int.
+struct LiteralTooLarge : std::overflow_error {
+  LiteralTooLarge()
+      : std::overflow_error("Integer literal does not fit in 64 bits.") {}
+};
+
+// Marks an operation the fast path cannot complete. cpp_int redoes it and
+// reports the real error, if there is one.
+SmallInt promote(EvalStatus &status) {
+  status.code = EvalErrorCode::Overflow;
+  status.message = "Result does not fit in 64 bits.";
+  return 0;
+}
+
+SmallInt parseSmallInt(std::string_view digits, bool negative) {
+  if (digits.empty()) {
+    throw std::invalid_argument("Empty integer literal.");
+  }
+  // Accumulating towards the sign keeps INT64_MIN representable.
+  SmallInt value = 0;
+  for (char c : digits) {
+    if (c < '0' || c > '9') {
+      throw std::invalid_argument("Invalid integer literal.");
+    }
+    const SmallInt digit = c - '0';
+    if (__builtin_mul_overflow(value, 10, &value) ||
+        (negative ? __builtin_sub_overflow(value, digit, &value)
+                  : __builtin_add_overflow(value, digit, &value))) {
+      throw LiteralTooLarge();
+    }
+  }
+  return value;
+}
+
+SmallInt powerOfSmallInt(SmallInt base, SmallInt exponent,
+                         EvalStatus &status) {
+  // A limit below 64 bits could reject results that fit; cpp_int applies it.
+  if (exponent < 0 || powerResultLimit() < 64) {
+    return promote(status);
+  }
+  SmallInt result = 1;
+  while (exponent != 0) {
+    if ((exponent & 1) != 0 && __builtin_mul_overflow(result, base, &result)) {
+      return promote(status);
+    }
+    exponent >>= 1;
+    // Once base^(2^k) overflows, so does any result that needs it.
+    if (exponent != 0 && __builtin_mul_overflow(base, base, &base)) {
+      return promote(status);
+    }
+  }
+  return result;
+}
+
+SmallInt moduloOfSmallInt(SmallInt value, SmallInt modulus,
+                          EvalStatus &status) {
+  if (modulus == 0) {
+    return promote(status);
+  }
+  if (modulus == -1) {
+    return 0; // INT64_MIN % -1 is undefined
+  }
+  SmallInt remainder = value % modulus;
+  if (remainder != 0 && (remainder < 0) != (modulus < 0)) {
+    remainder += modulus;
+  }
+  return remainder;
+}
+
+// Moduli up to 2^32 keep every product within 64 bits; larger ones are left
+// to cpp_int.
+SmallInt powerModOfSmallInt(SmallInt base, SmallInt exponent,
+                            SmallInt modulus, EvalStatus &status) {
+  constexpr SmallInt MaxModulus = SmallInt(1) << 32;
+  if (modulus == 0 || exponent < 0 || modulus > MaxModulus ||
+      modulus < -MaxModulus) {
+    return promote(status);
+  }
+  const SmallInt size = modulus < 0 ? -modulus : modulus;
+  SmallInt residue = base % size;
+  if (residue < 0) {
+    residue += size;
+  }
+  std::uint64_t factor = static_cast<std::uint64_t>(residue);
+  std::uint64_t result = 1 % static_cast<std::uint64_t>(size);
+  for (; exponent != 0; exponent >>= 1) {
+    if ((exponent & 1) != 0) {
+      result = result * factor % static_cast<std::uint64_t>(size);
+    }
+    factor = factor * factor % static_cast<std::uint64_t>(size);
+  }
+  SmallInt value = static_cast<SmallInt>(result);
+  return modulus < 0 && value != 0 ? value + modulus : value;
+}
+
+// Numeric policy for the fast path. Anything that does not fit, or that
+// fails for any other reason, is promoted rather than reported.
+struct SmallIntTraits {
+  using Value = SmallInt;
+  static constexpr expression_detail::NumberSyntax Syntax =
+      expression_detail::NumberSyntax::Integer;
+  static constexpr bool FallibleArithmetic = true;
+
+  static SmallInt parseLiteral(std::string_view digits, bool negative) {
+    return parseSmallInt(digits, negative);
+  }
+  static SmallInt fromVariable(const std::string &name, double value) {
+    return resolveBigIntVariable(name, value);
+  }
+  static SmallInt add(SmallInt lhs, SmallInt rhs, EvalStatus &status) {
+    SmallInt sum;
+    return __builtin_add_overflow(lhs, rhs, &sum) ? promote(status) : sum;
+  }
+  static SmallInt subtract(SmallInt lhs, SmallInt rhs, EvalStatus &status) {
+    SmallInt difference;
+    return __builtin_sub_overflow(lhs, rhs, &difference) ? promote(status)
+                                                         : difference;
+  }
+  static SmallInt multiply(SmallInt lhs, SmallInt rhs, EvalStatus &status) {
+    SmallInt product;
+    return __builtin_mul_overflow(lhs, rhs, &product) ? promote(status)
+                                                      : product;
+  }
+  static SmallInt divide(SmallInt lhs, SmallInt rhs, EvalStatus &status) {
+    if (rhs == 0 ||
+        (rhs == -1 && lhs == std::numeric_limits<SmallInt>::min()) ||
+        lhs % rhs != 0) {
+      return promote(status);
+    }
+    return lhs / rhs;
+  }
+  static SmallInt power(SmallInt lhs, SmallInt rhs, EvalStatus &status) {
+    return powerOfSmallInt(lhs, rhs, status);
+  }
+  static SmallInt modulo(SmallInt lhs, SmallInt rhs, EvalStatus &status) {
+    return moduloOfSmallInt(lhs, rhs, status);
+  }
+  static SmallInt powerMod(SmallInt base, SmallInt exponent,
+                           SmallInt modulus, EvalStatus &status) {
+    return powerModOfSmallInt(base, exponent, modulus, status);
+  }
+  static SmallInt square(SmallInt value, EvalStatus &status) {
+    return multiply(value, value, status);
+  }
+  static SmallInt factorial(SmallInt value, EvalStatus &status) {
+    // 21! exceeds 64 bits.
+    if (value < 0 || value > 20 ||
+        static_cast<std::uint64_t>(value) > factorialLimit()) {
+      return promote(status);
+    }
+    SmallInt result = 1;
+    for (SmallInt factor = 2; factor <= value; ++factor) {
+      result *= factor;
+    }
+    return result;
+  }
+  static SmallInt function(expression_detail::FunctionId, SmallInt,
+                           EvalStatus &status) {
+    return promote(status);
+  }
+  static bool isOne(SmallInt value) {
+    return value == 1;
+  }
+  static bool isTwo(SmallInt value) {
+    return value == 2;
+  }
+  static bool isNeutralAddend(SmallInt value) {
+    return value == 0;
+  }
+  static bool isNeutralSubtrahend(SmallInt value) {
+    return value == 0;
+  }
+};
+
+// Finishes a fast-path run that stopped at instruction `resume`: converts
+// its constants, variables and stack to cpp_int and runs the rest there.
+cpp_int resumeOnBigInt(const expression_detail::Program<SmallInt> &program,
+                       const std::vector<SmallInt> &slots,
+                       const std::vector<SmallInt> &stack,
+                       std::size_t resume) {
+  std::vector<cpp_int> constants(program.constants.begin(),
+                                 program.constants.end());
+  std::vector<cpp_int> bigSlots(slots.begin(), slots.end());
+  std::vector<cpp_int> bigStack(program.maxDepth);
+  const std::size_t depth =
+      expression_detail::stackDepth(program.code.data(), resume);
+  for (std::size_t idx = 0; idx < depth; ++idx) {
+    bigStack[idx] = stack[idx];
+  }
+
+  EvalStatus status;
+  const std::size_t count = program.code.size() - resume;
+  std::size_t failed = expression_detail::execute<BigIntTraits>(
+      program.code.data() + resume, count, constants.data(), bigSlots.data(),
+      bigStack.data(), status, depth);
+  if (failed != count) {
+    throwEvalError(
+        expression_detail::failedResult(status, program.code[resume + failed]));
+  }
+  return bigStack[0];
 }
 } // namespace
 
+std::size_t powerResultLimit() {
+  return powerLimitBits.load(std::memory_order_relaxed);
+}
+
+void setPowerResultLimit(std::size_t bits) {
+  powerLimitBits.store(bits, std::memory_order_relaxed);
+}
+
 std::string evaluateExpressionBigInt(
     const std::string &expression,
     const std::map<std::string, double> &variables) {
-  using boost::multiprecision::cpp_int;
-
-  std::vector<expression_detail::BigToken> tokens =
-      expression_detail::tokenizeExpressionBigInt(expression);
-  std::vector<expression_detail::BigToken> rpn =
-      expression_detail::toRpnBigInt(tokens);
-  std::vector<cpp_int> stack;
-
-  for (const expression_detail::BigToken &token : rpn) {
-    switch (token.type) {
-    case expression_detail::BigToken::Type::Number:
-      stack.push_back(parseBigInt(token.number));
-      break;
-    case expression_detail::BigToken::Type::Operator:
-      if (token.op == '!') {
-        if (stack.empty()) {
-          throw std::invalid_argument("Factorial operator missing operand.");
-        }
-        cpp_int value = stack.back();
-        stack.back() = factorialOfBigInt(value);
-        break;
-      }
-      if (stack.size() < 2) {
-        throw std::invalid_argument(
-            "Invalid expression: insufficient operands.");
-      }
-      {
-        cpp_int rhs = stack.back();
-        stack.pop_back();
-        cpp_int lhs = stack.back();
-        stack.pop_back();
-        cpp_int result = 0;
-        switch (token.op) {
-        case '+':
-          result = lhs + rhs;
-          break;
-        case '-':
-          result = lhs - rhs;
-          break;
-        case '*':
-          result = lhs * rhs;
-          break;
-        case '/':
-          if (rhs == 0) {
-            throw std::runtime_error("Division by zero in expression.");
-          }
-          if (lhs % rhs != 0) {
-            throw std::domain_error(
-                "Division results in a non-integer value in bigint mode.");
-          }
-          result = lhs / rhs;
-          break;
-        default:
-          throw std::invalid_argument("Unknown operator in expression.");
-        }
-        stack.push_back(result);
-      }
-      break;
-    case expression_detail::BigToken::Type::Variable: {
-      auto found = variables.find(token.text);
-      if (found == variables.end()) {
-        throw std::invalid_argument("Unknown variable: " + token.text);
-      }
-      stack.push_back(resolveBigIntVariable(token.text, found->second));
-      break;
-    }
-    default:
-      break;
-    }
+  expression_detail::Program<SmallInt> program;
+  try {
+    program = expression_detail::compileProgram<SmallIntTraits>(expression);
+  } catch (const LiteralTooLarge &) {
+    expression_detail::Program<cpp_int> bigProgram =
+        expression_detail::compileProgram<BigIntTraits>(expression);
+    return toDecimalString(
+        expression_detail::evaluateProgram<BigIntTraits>(bigProgram,
+                                                         variables));
   }
 
-  if (stack.size() != 1) {
-    throw std::invalid_argument("Invalid expression: leftover operands.");
+  std::vector<SmallInt> slots(program.variables.size());
+  std::size_t missing = expression_detail::bindProgram<SmallIntTraits>(
+      program, variables, slots.data());
+  if (missing < slots.size()) {
+    throw std::invalid_argument("Unknown variable: " +
+                                program.variables[missing]);
   }
-
-  return stack.back().convert_to<std::string>();
+  std::vector<SmallInt> stack(program.maxDepth);
+  EvalStatus status;
+  std::size_t stopped = expression_detail::execute<SmallIntTraits>(
+      program.code.data(), program.code.size(), program.constants.data(),
+      slots.data(), stack.data(), status);
+  if (stopped == program.code.size()) {
+    return std::to_string(stack[0]);
+  }
+  return toDecimalString(resumeOnBigInt(program, slots, stack, stopped));
 }
@@ -0,0 +1,153 @@
+#include "expression_cache.hpp"
+
+#include <cctype>
+#include <utility>
+
+namespace {
+bool isWordChar(char ch) {
+  return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_' ||
+         ch == '.';
+}
+
+// Builds "<mode>:<version>:<expression>". Whitespace only matters between
+// two word characters ("1 2" is not "12"), where it is kept as one space;
+// names, functions and the x operator are case-insensitive.
+std::string makeKey(char mode, std::uint64_t version,
+                    const std::string &expression) {
+  std::string key;
+  key.reserve(expression.size() + 24);
+  key.push_back(mode);
+  key.push_back(':');
+  key += std::to_string(version);
+  key.push_back(':');
+  const std::size_t start = key.size();
+  bool pendingSpace = false;
+  for (char ch : expression) {
+    if (std::isspace(static_cast<unsigned char>(ch))) {
+      pendingSpace = true;
+      continue;
+    }
+    if (pendingSpace && key.size() > start && isWordChar(key.back()) &&
+        isWordChar(ch)) {
+      key.push_back(' ');
+    }
+    pendingSpace = false;
+    key.push_back(
+        static_cast<char>(std::tolower(static_cast<unsigned char>(ch))));
+  }
+  return key;
+}
+} // namespace
+
+ExpressionCache::ExpressionCache(std::size_t capacity) : capacity_(capacity) {}
+
+void ExpressionCache::setCapacity(std::size_t capacity) {
+  capacity_ = capacity;
+  while (entries_.size() > capacity_) {
+    index_.erase(entries_.back().key);
+    entries_.pop_back();
+  }
+}
+
+std::size_t ExpressionCache::capacity() const {
+  return capacity_;
+}
+
+std::size_t ExpressionCache::size() const {
+  return entries_.size();
+}
+
+std::size_t ExpressionCache::hits() const {
+  return hits_;
+}
+
+std::size_t ExpressionCache::misses() const {
+  return misses_;
+}
+
+void ExpressionCache::clear() {
+  index_.clear();
+  entries_.clear();
+  hits_ = 0;
+  misses_ = 0;
+}
+
+const ExpressionCache::Entry *
+ExpressionCache::lookup(const std::string &key) {
+  auto found = index_.find(key);
+  if (found == index_.end()) {
+    ++misses_;
+    return nullptr;
+  }
+  ++hits_;
+  entries_.splice(entries_.begin(), entries_, found->second);
+  return &entries_.front();
+}
+
+void ExpressionCache::store(std::string key, double value, std::string text) {
+  if (entries_.size() >= capacity_) {
+    index_.erase(entries_.back().key);
+    entries_.pop_back();
+  }
+  entries_.push_front({std::move(key), value, std::move(text)});
+  // The view points into the list node, which never moves.
+  index_.emplace(entries_.front().key, entries_.begin());
+}
+
+EvalResult
+ExpressionCache::evaluate(const std::string &expression,
+                          const std::map<std::string, double> &variables,
+                          std::uint64_t version) {
+  if (capacity_ == 0) {
+    return tryEvaluateExpression(expression, variables);
+  }
+  std::string key = makeKey('d', version, expression);
+  if (const Entry *entry = lookup(key)) {
+    EvalResult result;
+    result.value = entry->value;
+    return result;
+  }
+  EvalResult result = tryEvaluateExpression(expression, variables);
+  if (result.ok()) {
+    store(std::move(key), result.value, {});
+  }
+  return result;
+}
+
+std::string
+ExpressionCache::evaluateBigInt(const std::string &expression,
+                                const std::map<std::string, double> &variables,
+                                std::uint64_t version) {
+  if (capacity_ == 0) {
+    return evaluateExpressionBigInt(expression, variables);
+  }
+  std::string key = makeKey('i', version, expression);
+  if (const Entry *entry = lookup(key)) {
+    return entry->text;
+  }
+  std::string result = evaluateExpressionBigInt(expression, variables);
+  store(std::move(key), 0.0, result);
+  return result;
+}
+
+std::string ExpressionCache::evaluateBigDouble(
+    const std::string &expression,
+    const std::map<std::string, double> &variables, std::uint64_t version) {
+  if (capacity_ == 0) {
+    return evaluateExpressionBigDouble(expression, variables);
+  }
+  // The printed digits depend on the precision as well as the inputs.
+  std::string key = makeKey('f', version, expression);
+  key.insert(1, std::to_string(bigDoublePrecision()));
+  if (const Entry *entry = lookup(key)) {
+    return entry->text;
+  }
+  std::string result = evaluateExpressionBigDouble(expression, variables);
+  store(std::move(key), 0.0, result);
+  return result;
+}
+
+ExpressionCache &globalExpressionCache() {
+  static ExpressionCache cache;
+  return cache;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "expression.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Memoizes successful evaluations, least recently used first out. Entries are
+// keyed by the evaluation mode, the expression with insignificant whitespace
+// and letter case removed, and a caller-supplied version of the variable
+// bindings. Callers must pass a different version whenever the bindings
+// change, e.g. VariableStore::version(). Failures are never cached.
+//
+// A capacity of 0 (the default) disables the cache: every call evaluates
+// and the counters stay at zero.
+class ExpressionCache {
+public:
+  explicit ExpressionCache(std::size_t capacity = 0);
+
+  // Shrinking evicts the least recently used entries.
+  void setCapacity(std::size_t capacity);
+  std::size_t capacity() const;
+  std::size_t size() const;
+  std::size_t hits() const;
+  std::size_t misses() const;
+  // Drops every entry and resets the counters.
+  void clear();
+
+  // Same contracts as tryEvaluateExpression, evaluateExpressionBigInt and
+  // evaluateExpressionBigDouble.
+  EvalResult evaluate(const std::string &expression,
+                      const std::map<std::string, double> &variables,
+                      std::uint64_t version);
+  std::string evaluateBigInt(const std::string &expression,
+                             const std::map<std::string, double> &variables,
+                             std::uint64_t version);
+  std::string evaluateBigDouble(const std::string &expression,
+                                const std::map<std::string, double> &variables,
+                                std::uint64_t version);
+
+private:
+  struct Entry {
+    std::string key;
+    double value;
+    std::string text;
+  };
+
+  const Entry *lookup(const std::string &key);
+  void store(std::string key, double value, std::string text);
+
+  std::size_t capacity_;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+  std::list<Entry> entries_; // most recently used first
+  std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+};
+
+// Shared cache used by the CLI; disabled until given a capacity.
+ExpressionCache &globalExpressionCache();
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+// Building blocks shared by the modes that compute in double precision
+// (double, adaptive, interval and gradient), so that they read literals and
+// reduce remainders identically.
+namespace expression_detail {
+// Parses the digits of a number literal, without its sign. from_chars is
+// locale-independent and does not allocate, unlike stod.
+inline double parseDoubleLiteral(std::string_view digits) {
+  double value = 0.0;
+  auto result =
+      std::from_chars(digits.data(), digits.data() + digits.size(), value);
+  if (result.ec == std::errc::result_out_of_range) {
+    throw std::out_of_range("Number is out of range: " + std::string(digits));
+  }
+  if (result.ec != std::errc() ||
+      result.ptr != digits.data() + digits.size()) {
+    throw std::invalid_argument("Invalid number: " + std::string(digits));
+  }
+  return value;
+}
+
+// Remainder with the sign of the modulus, so x mod m lies in [0, m) for
+// m > 0.
+inline double floorMod(double value, double modulus) {
+  double remainder = std::fmod(value, modulus);
+  if (remainder != 0.0 && (remainder < 0.0) != (modulus < 0.0)) {
+    remainder += modulus;
+  }
+  return remainder;
+}
+
+inline bool isWholeNumber(double value) {
+  return std::isfinite(value) && value == std::floor(value);
+}
+
+// Largest modulus whose residues can be multiplied exactly in a double.
+constexpr double MaxExactPowModModulus = 94906265.0; // floor(sqrt(2^53))
+
+// (base ^ exponent) mod modulus by square-and-multiply on residues, exact
+// where pow() would round. The operands must be whole, the exponent
+// non-negative and the modulus non-zero and at most MaxExactPowModModulus
+// in magnitude.
+inline double wholePowerMod(double base, double exponent, double modulus) {
+  const double size = std::fabs(modulus);
+  double result = std::fmod(1.0, size);
+  double factor = floorMod(base, size);
+  for (double rest = exponent; rest > 0.0; rest = std::floor(rest / 2.0)) {
+    if (std::fmod(rest, 2.0) == 1.0) {
+      result = std::fmod(result * factor, size);
+    }
+    factor = std::fmod(factor * factor, size);
+  }
+  return modulus < 0.0 && result != 0.0 ? result + modulus : result;
+}
+} // namespace expression_detail
@@ -0,0 +1,571 @@
+#pragma once
+
+#include "expression.hpp"
+#include "expression_internal.hpp"
+#include "expression_program.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// The compiler and stack machine shared by every evaluation mode. A mode
+// instantiates them with a policy class describing its number type:
+//
+//   using Value = ...;
+//   static constexpr NumberSyntax Syntax;
+//   static constexpr bool FallibleArithmetic; // see below
+//   static Value parseLiteral(std::string_view digits, bool negative);
+//   static Value fromVariable(const std::string &name, double value);
+//   static Value add/subtract/multiply/divide/modulo/power(
+//       const Value &, const Value &, EvalStatus &);
+//   static Value square(const Value &, EvalStatus &);
+//   static Value powerMod(const Value &base, const Value &exponent,
+//                         const Value &modulus, EvalStatus &);
+//   static Value factorial(const Value &, EvalStatus &);
+//   static Value function(FunctionId, const Value &, EvalStatus &);
+//   static bool isOne(const Value &);
+//   static bool isTwo(const Value &);
+//   static bool isNeutralAddend(const Value &);    // x + c == x for every x
+//   static bool isNeutralSubtrahend(const Value &); // x - c == x for every x
+//
+// add, subtract, multiply and square are only checked for failure when
+// FallibleArithmetic is set, so modes whose arithmetic cannot fail pay
+// nothing for it.
+//
+// modulo takes the sign of the divisor, and powerMod must agree with
+// modulo(power(base, exponent), modulus) wherever that is computable;
+// optimizeProgram relies on it to fuse the two.
+//
+// Operations that can fail record the failure in their EvalStatus instead
+// of throwing, so the interpreter loop never unwinds. Only compilation and
+// variable conversion (fromVariable) report errors by throwing.
+namespace expression_detail {
+// Outcome of one interpreter operation. `message` always points at a string
+// literal, so failing does not allocate.
+struct EvalStatus {
+  EvalErrorCode code = EvalErrorCode::None;
+  const char *message = nullptr;
+};
+
+inline EvalResult failedResult(const EvalStatus &status,
+                               const Instruction &instruction) {
+  EvalResult result;
+  result.error = status.code;
+  result.position = instruction.position;
+  result.message = status.message;
+  return result;
+}
+
+inline std::uint32_t internName(std::vector<std::string> &names,
+                                std::string_view identifier) {
+  std::string name = normalizeIdentifier(identifier);
+  for (std::size_t idx = 0; idx < names.size(); ++idx) {
+    if (names[idx] == name) {
+      return static_cast<std::uint32_t>(idx);
+    }
+  }
+  names.push_back(name);
+  return static_cast<std::uint32_t>(names.size() - 1);
+}
+
+// Runs `count` instructions. `stack` must hold at least the program's
+// maxDepth values, of which the first `top` are already pushed (to resume a
+// partly run program); the result is left in stack[0]. Returns `count` on
+// success, otherwise the index of the failing instruction with `status`
+// describing the failure.
+template <typename Traits>
+std::size_t execute(const Instruction *code, std::size_t count,
+                    const typename Traits::Value *constants,
+                    const typename Traits::Value *slots,
+                    typename Traits::Value *stack, EvalStatus &status,
+                    std::size_t top = 0) {
+  using Value = typename Traits::Value;
+  // Results are stored only once an operation succeeds, so a failing
+  // instruction leaves the stack as it found it.
+
+  for (std::size_t idx = 0; idx < count; ++idx) {
+    const Instruction &instruction = code[idx];
+    switch (instruction.op) {
+    case OpCode::Constant:
+      stack[top++] = constants[instruction.operand];
+      break;
+    case OpCode::Variable:
+      stack[top++] = slots[instruction.operand];
+      break;
+    case OpCode::Add: {
+      Value value = Traits::add(stack[top - 2], stack[top - 1], status);
+      if (Traits::FallibleArithmetic && status.code != EvalErrorCode::None) {
+        return idx;
+      }
+      --top;
+      stack[top - 1] = std::move(value);
+      break;
+    }
+    case OpCode::Subtract: {
+      Value value = Traits::subtract(stack[top - 2], stack[top - 1], status);
+      if (Traits::FallibleArithmetic && status.code != EvalErrorCode::None) {
+        return idx;
+      }
+      --top;
+      stack[top - 1] = std::move(value);
+      break;
+    }
+    case OpCode::Multiply: {
+      Value value = Traits::multiply(stack[top - 2], stack[top - 1], status);
+      if (Traits::FallibleArithmetic && status.code != EvalErrorCode::None) {
+        return idx;
+      }
+      --top;
+      stack[top - 1] = std::move(value);
+      break;
+    }
+    case OpCode::Divide: {
+      Value value = Traits::divide(stack[top - 2], stack[top - 1], status);
+      if (status.code != EvalErrorCode::None) {
+        return idx;
+      }
+      --top;
+      stack[top - 1] = std::move(value);
+      break;
+    }
+    case OpCode::Modulo: {
+      Value value = Traits::modulo(stack[top - 2], stack[top - 1], status);
+      if (status.code != EvalErrorCode::None) {
+        return idx;
+      }
+      --top;
+      stack[top - 1] = std::move(value);
+      break;
+    }
+    case OpCode::Power: {
+      Value value = Traits::power(stack[top - 2], stack[top - 1], status);
+      if (status.code != EvalErrorCode::None) {
+        return idx;
+      }
+      --top;
+      stack[top - 1] = std::move(value);
+      break;
+    }
+    case OpCode::PowMod: {
+      Value value = Traits::powerMod(stack[top - 3], stack[top - 2],
+                                     stack[top - 1], status);
+      if (status.code != EvalErrorCode::None) {
+        return idx;
+      }
+      top -= 2;
+      stack[top - 1] = std::move(value);
+      break;
+    }
+    case OpCode::Square: {
+      Value value = Traits::square(stack[top - 1], status);
+      if (Traits::FallibleArithmetic && status.code != EvalErrorCode::None) {
+        return idx;
+      }
+      stack[top - 1] = std::move(value);
+      break;
+    }
+    case OpCode::Factorial: {
+      Value value = Traits::factorial(stack[top - 1], status);
+      if (status.code != EvalErrorCode::None) {
+        return idx;
+      }
+      stack[top - 1] = std::move(value);
+      break;
+    }
+    case OpCode::Function: {
+      Value value =
+          Traits::function(static_cast<FunctionId>(instruction.operand),
+                           stack[top - 1], status);
+      if (status.code != EvalErrorCode::None) {
+        return idx;
+      }
+      stack[top - 1] = std::move(value);
+      break;
+    }
+    }
+  }
+
+  return count;
+}
+
+// Number of values on the stack after running the first `count`
+// instructions of `code`.
+inline std::size_t stackDepth(const Instruction *code, std::size_t count) {
+  std::size_t depth = 0;
+  for (std::size_t idx = 0; idx < count; ++idx) {
+    switch (code[idx].op) {
+    case OpCode::Constant:
+    case OpCode::Variable:
+      ++depth;
+      break;
+    case OpCode::Add:
+    case OpCode::Subtract:
+    case OpCode::Multiply:
+    case OpCode::Divide:
+    case OpCode::Modulo:
+    case OpCode::Power:
+      --depth;
+      break;
+    case OpCode::PowMod:
+      depth -= 2;
+      break;
+    default:
+      break;
+    }
+  }
+  return depth;
+}
+
+// Re-emits the program while folding constant subtrees, dropping
+// identities the policy reports as exact, and fusing (a ^ b) mod m into one
+// PowMod instruction so the full power is never materialized. A constant
+// subtree whose evaluation fails is left in place so the error still
+// surfaces, with its position, when the program runs.
+template <typename Traits>
+void optimizeProgram(Program<typename Traits::Value> &program) {
+  using Value = typename Traits::Value;
+  struct Operand {
+    std::size_t start; // first instruction producing this operand
+    bool constant;
+    Value value;
+    // Set when `value` was folded from base ^ exponent, kept so a following
+    // mod can still be fused.
+    bool power{};
+    Value base{};
+    Value exponent{};
+  };
+
+  std::vector<Instruction> code;
+  std::vector<Value> constants;
+  std::vector<Operand> operands;
+  code.reserve(program.code.size());
+
+  auto tryFold = [&](std::size_t start) {
+    Value stack[3];
+    EvalStatus status;
+    std::size_t count = code.size() - start;
+    try {
+      if (execute<Traits>(code.data() + start, count, constants.data(),
+                          nullptr, stack, status) != count) {
+        return Operand{start, false, Value()};
+      }
+    } catch (const std::exception &) {
+      return Operand{start, false, Value()};
+    }
+    std::uint32_t position = code.back().position;
+    code.resize(start);
+    constants.push_back(stack[0]);
+    code.push_back({OpCode::Constant,
+                    static_cast<std::uint32_t>(constants.size() - 1),
+                    position});
+    return Operand{start, true, stack[0]};
+  };
+
+  for (const Instruction &instruction : program.code) {
+    switch (instruction.op) {
+    case OpCode::Constant: {
+      const Value &value = program.constants[instruction.operand];
+      constants.push_back(value);
+      operands.push_back({code.size(), true, value});
+      code.push_back({OpCode::Constant,
+                      static_cast<std::uint32_t>(constants.size() - 1),
+                      instruction.position});
+      break;
+    }
+    case OpCode::Variable:
+      operands.push_back({code.size(), false, Value()});
+      code.push_back(instruction);
+      break;
+    case OpCode::Factorial:
+    case OpCode::Square:
+    case OpCode::Function: {
+      Operand operand = operands.back();
+      code.push_back(instruction);
+      operands.back() = operand.constant
+                            ? tryFold(operand.start)
+                            : Operand{operand.start, false, Value()};
+      break;
+    }
+    case OpCode::PowMod: {
+      Operand modulus = operands.back();
+      operands.pop_back();
+      Operand exponent = operands.back();
+      operands.pop_back();
+      Operand base = operands.back();
+      operands.pop_back();
+      code.push_back(instruction);
+      operands.push_back(base.constant && exponent.constant && modulus.constant
+                             ? tryFold(base.start)
+                             : Operand{base.start, false, Value()});
+      break;
+    }
+    default: {
+      Operand rhs = operands.back();
+      operands.pop_back();
+      Operand lhs = operands.back();
+      operands.pop_back();
+
+      if (instruction.op == OpCode::Modulo && lhs.power && rhs.constant) {
+        code.resize(lhs.start);
+        for (const Value &value : {lhs.base, lhs.exponent, rhs.value}) {
+          constants.push_back(value);
+          code.push_back({OpCode::Constant,
+                          static_cast<std::uint32_t>(constants.size() - 1),
+                          instruction.position});
+        }
+        code.push_back({OpCode::PowMod, 0, instruction.position});
+        operands.push_back(tryFold(lhs.start));
+        break;
+      }
+
+      if (lhs.constant && rhs.constant) {
+        code.push_back(instruction);
+        Operand folded = tryFold(lhs.start);
+        if (instruction.op == OpCode::Power && folded.constant) {
+          folded.power = true;
+          folded.base = lhs.value;
+          folded.exponent = rhs.value;
+        }
+        operands.push_back(folded);
+        break;
+      }
+
+      // The left operand of this modulo ends in a power: drop the power and
+      // let one PowMod consume its base, exponent and the modulus.
+      if (instruction.op == OpCode::Modulo &&
+          code[rhs.start - 1].op == OpCode::Power) {
+        code.erase(code.begin() + static_cast<std::ptrdiff_t>(rhs.start) - 1);
+        code.push_back({OpCode::PowMod, 0, instruction.position});
+        // Base and exponent were constants whose power failed to fold,
+        // typically because it was too large; the fused form may fold.
+        bool foldable = rhs.constant && code.size() - lhs.start == 4 &&
+                        code[lhs.start].op == OpCode::Constant &&
+                        code[lhs.start + 1].op == OpCode::Constant;
+        operands.push_back(foldable ? tryFold(lhs.start)
+                                    : Operand{lhs.start, false, Value()});
+        break;
+      }
+
+      bool dropRhs = false;
+      bool dropLhs = false;
+      if (rhs.constant) {
+        dropRhs = ((instruction.op == OpCode::Multiply ||
+                    instruction.op == OpCode::Divide ||
+                    instruction.op == OpCode::Power) &&
+                   Traits::isOne(rhs.value)) ||
+                  (instruction.op == OpCode::Subtract &&
+                   Traits::isNeutralSubtrahend(rhs.value)) ||
+                  (instruction.op == OpCode::Add &&
+                   Traits::isNeutralAddend(rhs.value));
+      }
+      if (lhs.constant) {
+        dropLhs = (instruction.op == OpCode::Multiply &&
+                   Traits::isOne(lhs.value)) ||
+                  (instruction.op == OpCode::Add &&
+                   Traits::isNeutralAddend(lhs.value));
+      }
+
+      if (dropRhs) {
+        code.resize(rhs.start);
+        operands.push_back(lhs);
+      } else if (dropLhs) {
+        code.erase(code.begin() + static_cast<std::ptrdiff_t>(lhs.start),
+                   code.begin() + static_cast<std::ptrdiff_t>(rhs.start));
+        operands.push_back({lhs.start, false, Value()});
+      } else if (instruction.op == OpCode::Power && rhs.constant &&
+                 Traits::isTwo(rhs.value)) {
+        code.resize(rhs.start);
+        code.push_back({OpCode::Square, 0, instruction.position});
+        operands.push_back({lhs.start, false, Value()});
+      } else {
+        code.push_back(instruction);
+        operands.push_back({lhs.start, false, Value()});
+      }
+      break;
+    }
+    }
+  }
+
+  // Compact the constant pool and size the operand stack for the final code.
+  program.code.clear();
+  program.constants.clear();
+  program.maxDepth = 0;
+  std::size_t depth = 0;
+  for (Instruction instruction : code) {
+    switch (instruction.op) {
+    case OpCode::Constant:
+      program.constants.push_back(constants[instruction.operand]);
+      instruction.operand =
+          static_cast<std::uint32_t>(program.constants.size() - 1);
+      ++depth;
+      break;
+    case OpCode::Variable:
+      ++depth;
+      break;
+    case OpCode::Add:
+    case OpCode::Subtract:
+    case OpCode::Multiply:
+    case OpCode::Divide:
+    case OpCode::Modulo:
+    case OpCode::Power:
+      --depth;
+      break;
+    case OpCode::PowMod:
+      depth -= 2;
+      break;
+    default:
+      break;
+    }
+    if (depth > program.maxDepth) {
+      program.maxDepth = depth;
+    }
+    program.code.push_back(instruction);
+  }
+}
+
+// Tokenizes, converts to postfix and lowers `expression` into an optimized
+// program. Throws std::invalid_argument for malformed input.
+template <typename Traits>
+Program<typename Traits::Value> compileProgram(std::string_view expression) {
+  std::vector<Token> rpn =
+      toRpn(tokenizeExpression(expression, Traits::Syntax));
+  Program<typename Traits::Value> program;
+  program.code.reserve(rpn.size());
+  std::size_t depth = 0;
+
+  for (const Token &token : rpn) {
+    auto emit = [&](OpCode op, std::uint32_t operand) {
+      program.code.push_back(
+          {op, operand, static_cast<std::uint32_t>(token.position)});
+    };
+    switch (token.type) {
+    case Token::Type::Number:
+      program.constants.push_back(
+          Traits::parseLiteral(token.text, token.negative));
+      emit(OpCode::Constant,
+           static_cast<std::uint32_t>(program.constants.size() - 1));
+      ++depth;
+      break;
+    case Token::Type::Variable:
+      emit(OpCode::Variable, internName(program.variables, token.text));
+      ++depth;
+      break;
+    case Token::Type::Function:
+      if (depth < functionArity(token.function)) {
+        throw std::invalid_argument("Function missing operand.");
+      }
+      if (token.function == FunctionId::PowMod) {
+        emit(OpCode::PowMod, 0);
+        depth -= 2;
+        break;
+      }
+      emit(OpCode::Function, static_cast<std::uint32_t>(token.function));
+      break;
+    case Token::Type::Operator:
+      if (token.op == '!') {
+        if (depth < 1) {
+          throw std::invalid_argument("Factorial operator missing operand.");
+        }
+        emit(OpCode::Factorial, 0);
+        break;
+      }
+      if (depth < 2) {
+        throw std::invalid_argument(
+            "Invalid expression: insufficient operands.");
+      }
+      switch (token.op) {
+      case '+':
+        emit(OpCode::Add, 0);
+        break;
+      case '-':
+        emit(OpCode::Subtract, 0);
+        break;
+      case '*':
+        emit(OpCode::Multiply, 0);
+        break;
+      case '/':
+        emit(OpCode::Divide, 0);
+        break;
+      case '%':
+        emit(OpCode::Modulo, 0);
+        break;
+      case '^':
+        emit(OpCode::Power, 0);
+        break;
+      default:
+        throw std::invalid_argument("Unknown operator in expression.");
+      }
+      --depth;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (depth != 1) {
+    throw std::invalid_argument("Invalid expression: leftover operands.");
+  }
+
+  optimizeProgram<Traits>(program);
+  return program;
+}
+
+// Resolves every variable the program references into `slots`, which must
+// hold program.variables.size() values. Returns the slot of the first
+// variable missing from `variables`, or the slot count when all are bound.
+template <typename Traits>
+std::size_t bindProgram(const Program<typename Traits::Value> &program,
+                        const std::map<std::string, double> &variables,
+                        typename Traits::Value *slots) {
+  for (std::size_t slot = 0; slot < program.variables.size(); ++slot) {
+    const std::string &name = program.variables[slot];
+    auto found = variables.find(name);
+    if (found == variables.end()) {
+      return slot;
+    }
+    slots[slot] = Traits::fromVariable(name, found->second);
+  }
+  return program.variables.size();
+}
+
+// Offset of the first reference to variable `slot` in the source.
+template <typename Value>
+std::size_t variablePosition(const Program<Value> &program, std::size_t slot) {
+  for (const Instruction &instruction : program.code) {
+    if (instruction.op == OpCode::Variable && instruction.operand == slot) {
+      return instruction.position;
+    }
+  }
+  return 0;
+}
+
+// Binds and runs a program with heap-allocated slots and stack, throwing on
+// failure.
+template <typename Traits>
+typename Traits::Value
+evaluateProgram(const Program<typename Traits::Value> &program,
+                const std::map<std::string, double> &variables) {
+  std::vector<typename Traits::Value> slots(program.variables.size());
+  std::size_t missing = bindProgram<Traits>(program, variables, slots.data());
+  if (missing < slots.size()) {
+    throw std::invalid_argument("Unknown variable: " +
+                                program.variables[missing]);
+  }
+  std::vector<typename Traits::Value> stack(program.maxDepth);
+  EvalStatus status;
+  std::size_t failed =
+      execute<Traits>(program.code.data(), program.code.size(),
+                      program.constants.data(), slots.data(), stack.data(),
+                      status);
+  if (failed != program.code.size()) {
+    throwEvalError(failedResult(status, program.code[failed]));
+  }
+  return stack[0];
+}
+} // namespace expression_detail
@@ -1,29 +1,49 @@
 #include "expression.hpp"
 
-#include "expression_internal.hpp"
+#include "expression_double.hpp"
+#include "expression_engine.hpp"
+#include "expression_threaded.hpp"
 #include "math_utils.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace {
-double factorialOf(double operand) {
+using expression_detail::EvalStatus;
+using expression_detail::floorMod;
+using expression_detail::isWholeNumber;
+
+double fail(EvalStatus &status, EvalErrorCode code, const char *message) {
+  status.code = code;
+  status.message = message;
+  return 0.0;
+}
+
+double factorialOf(double operand, EvalStatus &status) {
   double rounded = std::round(operand);
   if (!isApproximatelyZero(operand - rounded)) {
-    throw std::invalid_argument("Factorial is only defined for integers.");
+    return fail(status, EvalErrorCode::InvalidOperand,
+                "Factorial is only defined for integers.");
   }
 
   long long n = static_cast<long long>(rounded);
   if (n < 0) {
-    throw std::invalid_argument(
-        "Factorial is not defined for negative numbers.");
+    return fail(status, EvalErrorCode::InvalidOperand,
+                "Factorial is not defined for negative numbers.");
   }
   if (n > 170) {
-    throw std::overflow_error(
-        "Factorial result would overflow double precision.");
+    return fail(status, EvalErrorCode::Overflow,
+                "Factorial result would overflow double precision.");
   }
 
   long double result = 1.0L;
@@ -33,141 +53,527 @@ double factorialOf(double operand) {
   return static_cast<double>(result);
 }
 
-double applyFunction(const std::string &functionName, double value) {
-  if (functionName == "sin") {
-    return std::sin(value);
+double moduloOf(double value, double modulus, EvalStatus &status) {
+  if (modulus == 0.0) {
+    return fail(status, EvalErrorCode::DivisionByZero,
+                "Modulo by zero in expression.");
   }
-  if (functionName == "cos") {
-    return std::cos(value);
+  return floorMod(value, modulus);
+}
+
+double powerModOf(double base, double exponent, double modulus,
+                  EvalStatus &status) {
+  if (modulus == 0.0) {
+    return fail(status, EvalErrorCode::DivisionByZero,
+                "Modulo by zero in expression.");
   }
-  if (functionName == "log") {
-    if (value <= 0.0) {
-      throw std::domain_error("Logarithm undefined for non-positive values.");
-    }
-    return std::log(value);
+  if (!isWholeNumber(base) || !isWholeNumber(exponent) || exponent < 0.0 ||
+      !isWholeNumber(modulus) ||
+      std::fabs(modulus) > expression_detail::MaxExactPowModModulus) {
+    return floorMod(std::pow(base, exponent), modulus);
+  }
+  return expression_detail::wholePowerMod(base, exponent, modulus);
+}
+
+double sinOf(double value, EvalStatus &) {
+  return std::sin(value);
+}
+
+double cosOf(double value, EvalStatus &) {
+  return std::cos(value);
+}
+
+double tanOf(double value, EvalStatus &) {
+  return std::tan(value);
+}
+
+double cotOf(double value, EvalStatus &status) {
+  double tanValue = std::tan(value);
+  if (isApproximatelyZero(tanValue)) {
+    return fail(status, EvalErrorCode::DomainError,
+                "Cotangent undefined for this value.");
   }
-  if (functionName == "tan") {
-    return std::tan(value);
+  return 1.0 / tanValue;
+}
+
+double asinOf(double value, EvalStatus &status) {
+  if (value < -1.0 || value > 1.0) {
+    return fail(status, EvalErrorCode::DomainError,
+                "Arcsine undefined for this value.");
   }
-  if (functionName == "sqrt") {
-    if (value < 0.0) {
-      throw std::domain_error("Square root undefined for negative values.");
-    }
-    return std::sqrt(value);
+  return std::asin(value);
+}
+
+double acosOf(double value, EvalStatus &status) {
+  if (value < -1.0 || value > 1.0) {
+    return fail(status, EvalErrorCode::DomainError,
+                "Arccosine undefined for this value.");
   }
-  if (functionName == "exp") {
-    return std::exp(value);
+  return std::acos(value);
+}
+
+double atanOf(double value, EvalStatus &) {
+  return std::atan(value);
+}
+
+double sinhOf(double value, EvalStatus &) {
+  return std::sinh(value);
+}
+
+double logOf(double value, EvalStatus &status) {
+  if (value <= 0.0) {
+    return fail(status, EvalErrorCode::DomainError,
+                "Logarithm undefined for non-positive values.");
   }
-  if (functionName == "cot") {
-    double tanValue = std::tan(value);
-    if (isApproximatelyZero(tanValue)) {
-      throw std::domain_error("Cotangent undefined for this value.");
-    }
-    return 1.0 / tanValue;
+  return std::log(value);
+}
+
+double expOf(double value, EvalStatus &) {
+  return std::exp(value);
+}
+
+double sqrtOf(double value, EvalStatus &status) {
+  if (value < 0.0) {
+    return fail(status, EvalErrorCode::DomainError,
+                "Square root undefined for negative values.");
   }
-  if (functionName == "asin") {
-    if (value < -1.0 || value > 1.0) {
-      throw std::domain_error("Arcsine undefined for this value.");
-    }
-    return std::asin(value);
+  return std::sqrt(value);
+}
+
+using UnaryFunction = double (*)(double, EvalStatus &);
+
+// Indexed by expression_detail::FunctionId.
+constexpr std::array<UnaryFunction, expression_detail::UnaryFunctionCount>
+    FunctionTable = {sinOf,  cosOf,  tanOf, cotOf, asinOf, acosOf,
+                     atanOf, sinhOf, logOf, expOf, sqrtOf};
+
+// Numeric policy for the double-precision mode.
+struct DoubleTraits {
+  using Value = double;
+  static constexpr expression_detail::NumberSyntax Syntax =
+      expression_detail::NumberSyntax::Decimal;
+  static constexpr bool FallibleArithmetic = false;
+
+  static double parseLiteral(std::string_view digits, bool negative) {
+    const double value = expression_detail::parseDoubleLiteral(digits);
+    return negative ? -value : value;
+  }
+  static double fromVariable(const std::string &, double value) {
+    return value;
+  }
+  static double add(double lhs, double rhs, EvalStatus &) {
+    return lhs + rhs;
+  }
+  static double subtract(double lhs, double rhs, EvalStatus &) {
+    return lhs - rhs;
+  }
+  static double multiply(double lhs, double rhs, EvalStatus &) {
+    return lhs * rhs;
   }
-  if (functionName == "acos") {
-    if (value < -1.0 || value > 1.0) {
-      throw std::domain_error("Arccosine undefined for this value.");
+  static double divide(double lhs, double rhs, EvalStatus &status) {
+    if (rhs == 0.0) {
+      return fail(status, EvalErrorCode::DivisionByZero,
+                  "Division by zero in expression.");
     }
-    return std::acos(value);
+    return lhs / rhs;
   }
-  if (functionName == "atan") {
-    return std::atan(value);
+  static double modulo(double lhs, double rhs, EvalStatus &status) {
+    return moduloOf(lhs, rhs, status);
   }
-  if (functionName == "sinh") {
-    return std::sinh(value);
+  static double power(double lhs, double rhs, EvalStatus &) {
+    return std::pow(lhs, rhs);
   }
-  throw std::invalid_argument("Unknown function: " + functionName);
-}
-} // namespace
+  static double powerMod(double base, double exponent, double modulus,
+                         EvalStatus &status) {
+    return powerModOf(base, exponent, modulus, status);
+  }
+  static double square(double value, EvalStatus &) {
+    return value * value;
+  }
+  static double factorial(double value, EvalStatus &status) {
+    return factorialOf(value, status);
+  }
+  static double function(expression_detail::FunctionId id, double value,
+                         EvalStatus &status) {
+    return FunctionTable[static_cast<std::size_t>(id)](value, status);
+  }
+  static bool isOne(double value) {
+    return value == 1.0;
+  }
+  static bool isTwo(double value) {
+    return value == 2.0;
+  }
+  // x+0 is not an identity in IEEE arithmetic because it turns -0 into +0;
+  // only -0 is neutral for addition and only +0 for subtraction.
+  static bool isNeutralAddend(double value) {
+    return value == 0.0 && std::signbit(value);
+  }
+  static bool isNeutralSubtrahend(double value) {
+    return value == 0.0 && !std::signbit(value);
+  }
+};
 
-double evaluateExpression(const std::string &expression,
-                          const std::map<std::string, double> &variables) {
-  std::vector<expression_detail::Token> tokens =
-      expression_detail::tokenizeExpression(expression);
-  std::vector<expression_detail::Token> rpn = expression_detail::toRpn(tokens);
-  std::vector<double> stack;
-
-  for (const expression_detail::Token &token : rpn) {
-    switch (token.type) {
-    case expression_detail::Token::Type::Number:
-      stack.push_back(token.value);
+constexpr std::size_t InlineStackSize = 32;
+constexpr std::size_t ColumnBlockSize = 256;
+
+std::atomic<EvalEngine> defaultEngine{EvalEngine::Interpreter};
+
+// Runs `program` over rows [first, first + count) of `columns`, one
+// instruction at a time, leaving the results at the bottom of `stack`,
+// which holds ColumnBlockSize values per stack level. Returns the index of
+// the instruction at which some row failed, or the program size.
+std::size_t runColumnBlock(const expression_detail::Program<double> &program,
+                           const std::vector<std::vector<double>> &columns,
+                           std::size_t first, std::size_t count,
+                           double *stack, EvalStatus &status) {
+  using expression_detail::Instruction;
+  using expression_detail::OpCode;
+
+  std::size_t top = 0;
+  auto block = [&](std::size_t level) {
+    return stack + level * ColumnBlockSize;
+  };
+
+  for (std::size_t idx = 0; idx < program.code.size(); ++idx) {
+    const Instruction &instruction = program.code[idx];
+    switch (instruction.op) {
+    case OpCode::Constant:
+      std::fill_n(block(top++), count, program.constants[instruction.operand]);
+      break;
+    case OpCode::Variable: {
+      const std::vector<double> &column = columns[instruction.operand];
+      if (column.size() == 1) {
+        std::fill_n(block(top++), count, column.front());
+      } else {
+        std::copy_n(column.data() + first, count, block(top++));
+      }
+      break;
+    }
+    case OpCode::Add: {
+      --top;
+      double *lhs = block(top - 1);
+      const double *rhs = block(top);
+      for (std::size_t row = 0; row < count; ++row) {
+        lhs[row] += rhs[row];
+      }
+      break;
+    }
+    case OpCode::Subtract: {
+      --top;
+      double *lhs = block(top - 1);
+      const double *rhs = block(top);
+      for (std::size_t row = 0; row < count; ++row) {
+        lhs[row] -= rhs[row];
+      }
+      break;
+    }
+    case OpCode::Multiply: {
+      --top;
+      double *lhs = block(top - 1);
+      const double *rhs = block(top);
+      for (std::size_t row = 0; row < count; ++row) {
+        lhs[row] *= rhs[row];
+      }
       break;
-    case expression_detail::Token::Type::Operator:
-      if (token.op == '!') {
-        if (stack.empty()) {
-          throw std::invalid_argument("Factorial operator missing operand.");
-        }
-        double value = stack.back();
-        stack.back() = factorialOf(value);
+    }
+    case OpCode::Divide: {
+      --top;
+      double *lhs = block(top - 1);
+      const double *rhs = block(top);
+      bool zeroDivisor = false;
+      for (std::size_t row = 0; row < count; ++row) {
+        zeroDivisor |= rhs[row] == 0.0;
+      }
+      if (zeroDivisor) {
+        fail(status, EvalErrorCode::DivisionByZero,
+             "Division by zero in expression.");
         break;
       }
-      if (stack.size() < 2) {
-        throw std::invalid_argument(
-            "Invalid expression: insufficient operands.");
+      for (std::size_t row = 0; row < count; ++row) {
+        lhs[row] /= rhs[row];
       }
-      {
-        double rhs = stack.back();
-        stack.pop_back();
-        double lhs = stack.back();
-        stack.pop_back();
-        double result = 0.0;
-        switch (token.op) {
-        case '+':
-          result = lhs + rhs;
-          break;
-        case '-':
-          result = lhs - rhs;
-          break;
-        case '*':
-          result = lhs * rhs;
-          break;
-        case '/':
-          if (rhs == 0.0) {
-            throw std::runtime_error("Division by zero in expression.");
-          }
-          result = lhs / rhs;
-          break;
-        case '^':
-          result = std::pow(lhs, rhs);
-          break;
-        default:
-          throw std::invalid_argument("Unknown operator in expression.");
-        }
-        stack.push_back(result);
+      break;
+    }
+    case OpCode::Modulo: {
+      --top;
+      double *lhs = block(top - 1);
+      const double *rhs = block(top);
+      for (std::size_t row = 0; row < count; ++row) {
+        lhs[row] = moduloOf(lhs[row], rhs[row], status);
       }
       break;
-    case expression_detail::Token::Type::Function:
-      if (stack.empty()) {
-        throw std::invalid_argument("Function missing operand.");
+    }
+    case OpCode::Power: {
+      --top;
+      double *lhs = block(top - 1);
+      const double *rhs = block(top);
+      for (std::size_t row = 0; row < count; ++row) {
+        lhs[row] = std::pow(lhs[row], rhs[row]);
       }
-      {
-        double argument = stack.back();
-        stack.back() = applyFunction(token.text, argument);
+      break;
+    }
+    case OpCode::PowMod: {
+      top -= 2;
+      double *base = block(top - 1);
+      const double *exponent = block(top);
+      const double *modulus = block(top + 1);
+      for (std::size_t row = 0; row < count; ++row) {
+        base[row] = powerModOf(base[row], exponent[row], modulus[row], status);
       }
       break;
-    case expression_detail::Token::Type::Variable: {
-      auto found = variables.find(token.text);
-      if (found == variables.end()) {
-        throw std::invalid_argument("Unknown variable: " + token.text);
+    }
+    case OpCode::Square: {
+      double *values = block(top - 1);
+      for (std::size_t row = 0; row < count; ++row) {
+        values[row] *= values[row];
       }
-      stack.push_back(found->second);
       break;
     }
-    default:
+    case OpCode::Factorial: {
+      double *values = block(top - 1);
+      for (std::size_t row = 0; row < count; ++row) {
+        values[row] = factorialOf(values[row], status);
+      }
       break;
     }
+    case OpCode::Function: {
+      UnaryFunction function = FunctionTable[instruction.operand];
+      double *values = block(top - 1);
+      for (std::size_t row = 0; row < count; ++row) {
+        values[row] = function(values[row], status);
+      }
+      break;
+    }
+    }
+    if (status.code != EvalErrorCode::None) {
+      return idx;
+    }
+  }
+  return program.code.size();
+}
+} // namespace
+
+EvalEngine defaultEvalEngine() {
+  return defaultEngine.load(std::memory_order_relaxed);
+}
+
+void setDefaultEvalEngine(EvalEngine engine) {
+  defaultEngine.store(engine, std::memory_order_relaxed);
+}
+
+void throwEvalError(const EvalResult &result) {
+  switch (result.error) {
+  case EvalErrorCode::DivisionByZero:
+    throw std::runtime_error(result.message);
+  case EvalErrorCode::DomainError:
+    throw std::domain_error(result.message);
+  case EvalErrorCode::Overflow:
+    throw std::overflow_error(result.message);
+  case EvalErrorCode::OutOfRange:
+    throw std::out_of_range(result.message);
+  default:
+    throw std::invalid_argument(result.message);
+  }
+}
+
+CompiledExpression::CompiledExpression(const std::string &expression,
+                                       EvalEngine engine)
+    : program_(expression_detail::compileProgram<DoubleTraits>(expression)) {
+  if (engine == EvalEngine::Threaded) {
+    auto threaded =
+        std::make_shared<expression_detail::ThreadedProgram<double>>();
+    if (threaded->lower<DoubleTraits>(program_)) {
+      threaded_ = std::move(threaded);
+    }
+  }
+}
+
+EvalEngine CompiledExpression::engine() const {
+  return threaded_ ? EvalEngine::Threaded : EvalEngine::Interpreter;
+}
+
+const std::vector<std::string> &CompiledExpression::variableNames() const {
+  return program_.variables;
+}
+
+std::size_t CompiledExpression::bindInto(
+    const std::map<std::string, double> &variables, double *slots) const {
+  return expression_detail::bindProgram<DoubleTraits>(program_, variables,
+                                                      slots);
+}
+
+EvalResult CompiledExpression::unknownVariable(std::size_t slot) const {
+  EvalResult result;
+  result.error = EvalErrorCode::UnknownVariable;
+  result.position = expression_detail::variablePosition(program_, slot);
+  result.message = "Unknown variable: " + program_.variables[slot];
+  return result;
+}
+
+std::vector<double> CompiledExpression::bindVariables(
+    const std::map<std::string, double> &variables) const {
+  std::vector<double> slots(program_.variables.size());
+  std::size_t missing = bindInto(variables, slots.data());
+  if (missing < slots.size()) {
+    throwEvalError(unknownVariable(missing));
   }
+  return slots;
+}
 
-  if (stack.size() != 1) {
-    throw std::invalid_argument("Invalid expression: leftover operands.");
+double CompiledExpression::evaluate(
+    const std::map<std::string, double> &variables) const {
+  EvalResult result = tryEvaluate(variables);
+  if (!result.ok()) {
+    throwEvalError(result);
   }
+  return result.value;
+}
 
-  return stack.back();
+EvalResult CompiledExpression::tryEvaluate(
+    const std::map<std::string, double> &variables) const {
+  double inlineSlots[InlineStackSize];
+  std::vector<double> overflowSlots;
+  double *slots = inlineSlots;
+  if (program_.variables.size() > InlineStackSize) {
+    overflowSlots.resize(program_.variables.size());
+    slots = overflowSlots.data();
+  }
+  std::size_t missing = bindInto(variables, slots);
+  if (missing < program_.variables.size()) {
+    return unknownVariable(missing);
+  }
+  return tryEvaluateSlots(slots);
+}
+
+double CompiledExpression::evaluateSlots(const double *slots) const {
+  EvalResult result = tryEvaluateSlots(slots);
+  if (!result.ok()) {
+    throwEvalError(result);
+  }
+  return result.value;
+}
+
+EvalResult CompiledExpression::tryEvaluateSlots(const double *slots) const {
+  if (threaded_) {
+    double inlineStack[InlineStackSize];
+    std::vector<double> overflowStack;
+    double *stack = inlineStack;
+    if (threaded_->stackSize() > InlineStackSize) {
+      overflowStack.resize(threaded_->stackSize());
+      stack = overflowStack.data();
+    }
+    expression_detail::ThreadedContext<double> context;
+    context.slots = slots;
+    EvalResult result;
+    result.value = threaded_->run(stack, context);
+    if (context.failed != nullptr) {
+      result.value = 0.0;
+      result.error = context.status.code;
+      result.position = context.failed->position;
+      result.message = context.status.message;
+    }
+    return result;
+  }
+
+  double inlineStack[InlineStackSize];
+  std::vector<double> overflowStack;
+  double *stack = inlineStack;
+  if (program_.maxDepth > InlineStackSize) {
+    overflowStack.resize(program_.maxDepth);
+    stack = overflowStack.data();
+  }
+  expression_detail::EvalStatus status;
+  std::size_t failed = expression_detail::execute<DoubleTraits>(
+      program_.code.data(), program_.code.size(), program_.constants.data(),
+      slots, stack, status);
+  if (failed != program_.code.size()) {
+    return expression_detail::failedResult(status, program_.code[failed]);
+  }
+  EvalResult result;
+  result.value = stack[0];
+  return result;
+}
+
+void CompiledExpression::checkColumns(
+    const std::vector<std::vector<double>> &columns, std::size_t rows) const {
+  if (columns.size() != program_.variables.size()) {
+    throw std::invalid_argument("Expected one column per variable.");
+  }
+  for (std::size_t slot = 0; slot < columns.size(); ++slot) {
+    if (columns[slot].size() != 1 && columns[slot].size() != rows) {
+      throw std::invalid_argument("Column for variable '" +
+                                  program_.variables[slot] +
+                                  "' has the wrong number of rows.");
+    }
+  }
+}
+
+std::vector<double> CompiledExpression::evaluateColumns(
+    const std::vector<std::vector<double>> &columns, std::size_t rows) const {
+  checkColumns(columns, rows);
+  std::vector<double> results(rows);
+  std::vector<double> stack(program_.maxDepth * ColumnBlockSize);
+  for (std::size_t first = 0; first < rows; first += ColumnBlockSize) {
+    const std::size_t count = std::min(ColumnBlockSize, rows - first);
+    EvalStatus status;
+    std::size_t failed =
+        runColumnBlock(program_, columns, first, count, stack.data(), status);
+    // Any failing row in the block fails the whole call.
+    if (failed != program_.code.size()) {
+      throwEvalError(
+          expression_detail::failedResult(status, program_.code[failed]));
+    }
+    std::copy_n(stack.data(), count, results.data() + first);
+  }
+  return results;
+}
+
+std::vector<EvalResult> CompiledExpression::tryEvaluateColumns(
+    const std::vector<std::vector<double>> &columns, std::size_t rows) const {
+  checkColumns(columns, rows);
+  std::vector<EvalResult> results(rows);
+  std::vector<double> stack(program_.maxDepth * ColumnBlockSize);
+  std::vector<double> slots(columns.size());
+  for (std::size_t first = 0; first < rows; first += ColumnBlockSize) {
+    const std::size_t count = std::min(ColumnBlockSize, rows - first);
+    EvalStatus status;
+    if (runColumnBlock(program_, columns, first, count, stack.data(),
+                       status) == program_.code.size()) {
+      for (std::size_t row = 0; row < count; ++row) {
+        results[first + row].value = stack[row];
+      }
+      continue;
+    }
+    // Failures are rare, so the block is simply rerun a row at a time to
+    // tell the failing rows from the rest.
+    for (std::size_t row = first; row < first + count; ++row) {
+      for (std::size_t slot = 0; slot < columns.size(); ++slot) {
+        slots[slot] = columns[slot].size() == 1 ? columns[slot].front()
+                                                : columns[slot][row];
+      }
+      results[row] = tryEvaluateSlots(slots.data());
+    }
+  }
+  return results;
+}
+
+double evaluateExpression(const std::string &expression,
+                          const std::map<std::string, double> &variables) {
+  return CompiledExpression(expression).evaluate(variables);
+}
+
+EvalResult
+tryEvaluateExpression(const std::string &expression,
+                      const std::map<std::string, double> &variables) {
+  EvalResult result;
+  try {
+    return CompiledExpression(expression).tryEvaluate(variables);
+  } catch (const std::out_of_range &ex) {
+    result.error = EvalErrorCode::OutOfRange;
+    result.message = ex.what();
+  } catch (const std::exception &ex) {
+    result.error = EvalErrorCode::InvalidExpression;
+    result.message = ex.what();
+  }
+  return result;
 }
@@ -0,0 +1,383 @@
+#include "expression.hpp"
+
+#include "expression_double.hpp"
+#include "expression_engine.hpp"
+#include "math_utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+using expression_detail::EvalStatus;
+using expression_detail::floorMod;
+using expression_detail::isWholeNumber;
+
+// A value with its partial derivatives. Only the first `size` entries of
+// `slope` are meaningful and the rest count as zero, so constants carry no
+// derivative work at all.
+struct Dual {
+  double value = 0.0;
+  std::uint8_t size = 0;
+  std::array<double, MaxGradientVariables> slope;
+};
+
+Dual fail(EvalStatus &status, EvalErrorCode code, const char *message) {
+  status.code = code;
+  status.message = message;
+  return {};
+}
+
+Dual constant(double value) {
+  Dual result;
+  result.value = value;
+  return result;
+}
+
+// f(a) with f'(a) = `derivative`.
+Dual chain(double value, const Dual &a, double derivative) {
+  Dual result;
+  result.value = value;
+  result.size = a.size;
+  for (std::size_t idx = 0; idx < a.size; ++idx) {
+    result.slope[idx] = derivative * a.slope[idx];
+  }
+  return result;
+}
+
+// f(a, b) with partial derivatives `da` and `db`. A partial is only
+// multiplied in where its operand has a derivative, so an infinite or NaN
+// partial towards a constant does not leak into the result.
+Dual chain(double value, const Dual &a, double da, const Dual &b, double db) {
+  Dual result;
+  result.value = value;
+  result.size = std::max(a.size, b.size);
+  for (std::size_t idx = 0; idx < result.size; ++idx) {
+    double slope = 0.0;
+    if (idx < a.size) {
+      slope += da * a.slope[idx];
+    }
+    if (idx < b.size) {
+      slope += db * b.slope[idx];
+    }
+    result.slope[idx] = slope;
+  }
+  return result;
+}
+
+Dual power(const Dual &base, const Dual &exponent) {
+  const double value = std::pow(base.value, exponent.value);
+  // d/dx x^y = y x^(y-1); d/dy x^y = x^y ln x. At a zero base the product
+  // forms turn 0 * inf into NaN where the limits exist: 0^y is flat in y for
+  // y > 0, and x^0 is flat in x.
+  const bool zeroBase = base.value == 0.0;
+  double db = 0.0;
+  if (exponent.size != 0 && !(zeroBase && exponent.value > 0.0)) {
+    db = value * std::log(base.value);
+  }
+  double da = 0.0;
+  if (base.size != 0 && !(zeroBase && exponent.value == 0.0)) {
+    da = exponent.value * std::pow(base.value, exponent.value - 1.0);
+  }
+  return chain(value, base, da, exponent, db);
+}
+
+// x mod m == x - floor(x / m) * m, which is linear between the jumps.
+Dual modulo(const Dual &value, const Dual &modulus, EvalStatus &status) {
+  if (modulus.value == 0.0) {
+    return fail(status, EvalErrorCode::DivisionByZero,
+                "Modulo by zero in expression.");
+  }
+  return chain(floorMod(value.value, modulus.value), value, 1.0, modulus,
+               -std::floor(value.value / modulus.value));
+}
+
+// The value follows double mode; the derivative is that of
+// (base ^ exponent) mod modulus.
+Dual powerMod(const Dual &base, const Dual &exponent, const Dual &modulus,
+              EvalStatus &status) {
+  if (modulus.value == 0.0) {
+    return fail(status, EvalErrorCode::DivisionByZero,
+                "Modulo by zero in expression.");
+  }
+  Dual full = modulo(power(base, exponent), modulus, status);
+  if (!isWholeNumber(base.value) || !isWholeNumber(exponent.value) ||
+      exponent.value < 0.0 || !isWholeNumber(modulus.value) ||
+      std::fabs(modulus.value) > expression_detail::MaxExactPowModModulus) {
+    return full;
+  }
+  full.value = expression_detail::wholePowerMod(base.value, exponent.value,
+                                                modulus.value);
+  return full;
+}
+
+// n! extended through the gamma function: d/dn n! = n! * psi(n + 1), and
+// psi(n + 1) is the harmonic number H(n) minus Euler's constant.
+Dual factorial(const Dual &operand, EvalStatus &status) {
+  double rounded = std::round(operand.value);
+  if (!isApproximatelyZero(operand.value - rounded)) {
+    return fail(status, EvalErrorCode::InvalidOperand,
+                "Factorial is only defined for integers.");
+  }
+  long long n = static_cast<long long>(rounded);
+  if (n < 0) {
+    return fail(status, EvalErrorCode::InvalidOperand,
+                "Factorial is not defined for negative numbers.");
+  }
+  if (n > 170) {
+    return fail(status, EvalErrorCode::Overflow,
+                "Factorial result would overflow double precision.");
+  }
+  long double result = 1.0L;
+  double harmonic = 0.0;
+  for (long long i = 1; i <= n; ++i) {
+    result *= static_cast<long double>(i);
+    harmonic += 1.0 / static_cast<double>(i);
+  }
+  constexpr double EulerGamma = 0.5772156649015329;
+  const double value = static_cast<double>(result);
+  return chain(value, operand, value * (harmonic - EulerGamma));
+}
+
+Dual function(expression_detail::FunctionId id, const Dual &operand,
+               EvalStatus &status) {
+  using expression_detail::FunctionId;
+  const double x = operand.value;
+  switch (id) {
+  case FunctionId::Sin:
+    return chain(std::sin(x), operand, std::cos(x));
+  case FunctionId::Cos:
+    return chain(std::cos(x), operand, -std::sin(x));
+  case FunctionId::Tan: {
+    const double value = std::tan(x);
+    return chain(value, operand, 1.0 + value * value);
+  }
+  case FunctionId::Cot: {
+    const double tangent = std::tan(x);
+    if (isApproximatelyZero(tangent)) {
+      return fail(status, EvalErrorCode::DomainError,
+                  "Cotangent undefined for this value.");
+    }
+    const double value = 1.0 / tangent;
+    return chain(value, operand, -(1.0 + value * value));
+  }
+  case FunctionId::Asin:
+    if (x < -1.0 || x > 1.0) {
+      return fail(status, EvalErrorCode::DomainError,
+                  "Arcsine undefined for this value.");
+    }
+    return chain(std::asin(x), operand, 1.0 / std::sqrt(1.0 - x * x));
+  case FunctionId::Acos:
+    if (x < -1.0 || x > 1.0) {
+      return fail(status, EvalErrorCode::DomainError,
+                  "Arccosine undefined for this value.");
+    }
+    return chain(std::acos(x), operand, -1.0 / std::sqrt(1.0 - x * x));
+  case FunctionId::Atan:
+    return chain(std::atan(x), operand, 1.0 / (1.0 + x * x));
+  case FunctionId::Sinh:
+    return chain(std::sinh(x), operand, std::cosh(x));
+  case FunctionId::Log:
+    if (x <= 0.0) {
+      return fail(status, EvalErrorCode::DomainError,
+                  "Logarithm undefined for non-positive values.");
+    }
+    return chain(std::log(x), operand, 1.0 / x);
+  case FunctionId::Exp: {
+    const double value = std::exp(x);
+    return chain(value, operand, value);
+  }
+  case FunctionId::Sqrt: {
+    if (x < 0.0) {
+      return fail(status, EvalErrorCode::DomainError,
+                  "Square root undefined for negative values.");
+    }
+    const double value = std::sqrt(x);
+    return chain(value, operand, 0.5 / value);
+  }
+  default:
+    return fail(status, EvalErrorCode::InvalidExpression,
+                "Unsupported function.");
+  }
+}
+
+// Numeric policy for forward-mode differentiation. Values agree with double
+// mode, including its errors.
+struct DualTraits {
+  using Value = Dual;
+  static constexpr expression_detail::NumberSyntax Syntax =
+      expression_detail::NumberSyntax::Decimal;
+  static constexpr bool FallibleArithmetic = false;
+
+  static Dual parseLiteral(std::string_view digits, bool negative) {
+    const double value = expression_detail::parseDoubleLiteral(digits);
+    return constant(negative ? -value : value);
+  }
+  static Dual fromVariable(const std::string &, double value) {
+    return constant(value);
+  }
+  static Dual add(const Dual &lhs, const Dual &rhs, EvalStatus &) {
+    return chain(lhs.value + rhs.value, lhs, 1.0, rhs, 1.0);
+  }
+  static Dual subtract(const Dual &lhs, const Dual &rhs, EvalStatus &) {
+    return chain(lhs.value - rhs.value, lhs, 1.0, rhs, -1.0);
+  }
+  static Dual multiply(const Dual &lhs, const Dual &rhs, EvalStatus &) {
+    return chain(lhs.value * rhs.value, lhs, rhs.value, rhs, lhs.value);
+  }
+  static Dual divide(const Dual &lhs, const Dual &rhs, EvalStatus &status) {
+    if (rhs.value == 0.0) {
+      return fail(status, EvalErrorCode::DivisionByZero,
+                  "Division by zero in expression.");
+    }
+    const double value = lhs.value / rhs.value;
+    return chain(value, lhs, 1.0 / rhs.value, rhs, -value / rhs.value);
+  }
+  static Dual modulo(const Dual &lhs, const Dual &rhs, EvalStatus &status) {
+    return ::modulo(lhs, rhs, status);
+  }
+  static Dual power(const Dual &lhs, const Dual &rhs, EvalStatus &) {
+    return ::power(lhs, rhs);
+  }
+  static Dual powerMod(const Dual &base, const Dual &exponent,
+                       const Dual &modulus, EvalStatus &status) {
+    return ::powerMod(base, exponent, modulus, status);
+  }
+  static Dual square(const Dual &value, EvalStatus &) {
+    return chain(value.value * value.value, value, 2.0 * value.value);
+  }
+  static Dual factorial(const Dual &value, EvalStatus &status) {
+    return ::factorial(value, status);
+  }
+  static Dual function(expression_detail::FunctionId id, const Dual &value,
+                       EvalStatus &status) {
+    return ::function(id, value, status);
+  }
+  // Only derivative-free constants take part in folding identities.
+  static bool isOne(const Dual &value) {
+    return value.value == 1.0 && value.size == 0;
+  }
+  static bool isTwo(const Dual &value) {
+    return value.value == 2.0 && value.size == 0;
+  }
+  static bool isNeutralAddend(const Dual &value) {
+    return value.value == 0.0 && std::signbit(value.value) && value.size == 0;
+  }
+  static bool isNeutralSubtrahend(const Dual &value) {
+    return value.value == 0.0 && !std::signbit(value.value) &&
+           value.size == 0;
+  }
+};
+} // namespace
+
+struct GradientExpression::Compiled {
+  expression_detail::Program<Dual> program;
+  // For each slot, one more than the index of its `wrt` entry, or 0 for a
+  // variable that is not differentiated.
+  std::vector<std::uint8_t> seeds;
+  std::size_t directions = 0;
+};
+
+GradientExpression::GradientExpression(const std::string &expression,
+                                       const std::vector<std::string> &wrt) {
+  if (wrt.size() > MaxGradientVariables) {
+    throw std::invalid_argument(
+        "At most " + std::to_string(MaxGradientVariables) +
+        " variables can be differentiated at once.");
+  }
+  std::vector<std::string> names;
+  names.reserve(wrt.size());
+  for (const std::string &name : wrt) {
+    names.push_back(expression_detail::normalizeIdentifier(name));
+  }
+  for (std::size_t idx = 0; idx < names.size(); ++idx) {
+    if (std::find(names.begin(), names.begin() + idx, names[idx]) !=
+        names.begin() + idx) {
+      throw std::invalid_argument("Variable listed twice: " + wrt[idx]);
+    }
+  }
+
+  auto compiled = std::make_shared<Compiled>();
+  compiled->program = expression_detail::compileProgram<DualTraits>(expression);
+  compiled->directions = names.size();
+  compiled->seeds.resize(compiled->program.variables.size());
+  for (std::size_t slot = 0; slot < compiled->seeds.size(); ++slot) {
+    auto found = std::find(names.begin(), names.end(),
+                           compiled->program.variables[slot]);
+    if (found != names.end()) {
+      compiled->seeds[slot] =
+          static_cast<std::uint8_t>(found - names.begin() + 1);
+    }
+  }
+  compiled_ = std::move(compiled);
+}
+
+const std::vector<std::string> &GradientExpression::variableNames() const {
+  return compiled_->program.variables;
+}
+
+GradientResult GradientExpression::evaluate(
+    const std::map<std::string, double> &variables) const {
+  const std::vector<std::string> &names = variableNames();
+  std::vector<double> values(names.size());
+  for (std::size_t slot = 0; slot < names.size(); ++slot) {
+    auto found = variables.find(names[slot]);
+    if (found == variables.end()) {
+      throw std::invalid_argument("Unknown variable: " + names[slot]);
+    }
+    values[slot] = found->second;
+  }
+  GradientResult result;
+  EvalResult status = tryEvaluateSlots(values.data(), result);
+  if (!status.ok()) {
+    throwEvalError(status);
+  }
+  return result;
+}
+
+EvalResult GradientExpression::tryEvaluateSlots(const double *slots,
+                                                GradientResult &result) const {
+  const expression_detail::Program<Dual> &program = compiled_->program;
+  // Seed each differentiated variable with its unit direction.
+  std::vector<Dual> values(program.variables.size());
+  for (std::size_t slot = 0; slot < values.size(); ++slot) {
+    Dual &value = values[slot];
+    value.value = slots[slot];
+    value.size = compiled_->seeds[slot];
+    if (value.size > 0) {
+      std::fill(value.slope.begin(), value.slope.begin() + value.size, 0.0);
+      value.slope[value.size - 1] = 1.0;
+    }
+  }
+
+  std::vector<Dual> stack(program.maxDepth);
+  EvalStatus status;
+  std::size_t failed = expression_detail::execute<DualTraits>(
+      program.code.data(), program.code.size(), program.constants.data(),
+      values.data(), stack.data(), status);
+  if (failed != program.code.size()) {
+    return expression_detail::failedResult(status, program.code[failed]);
+  }
+
+  EvalResult ok;
+  ok.value = stack[0].value;
+  result.value = stack[0].value;
+  result.gradient.assign(compiled_->directions, 0.0);
+  std::copy(stack[0].slope.begin(), stack[0].slope.begin() + stack[0].size,
+            result.gradient.begin());
+  return ok;
+}
+
+GradientResult
+evaluateGradient(const std::string &expression,
+                 const std::vector<std::string> &wrt,
+                 const std::map<std::string, double> &variables) {
+  return GradientExpression(expression, wrt).evaluate(variables);
+}
@@ -0,0 +1,169 @@
+#include "expression.hpp"
+#include "expression_internal.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+// 15-point Kronrod rule with its embedded 7-point Gauss rule on [-1, 1].
+// Only the non-negative nodes are listed; the rules are symmetric, and the
+// Gauss nodes are the odd entries.
+constexpr std::array<double, 8> KronrodNodes = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.0};
+constexpr std::array<double, 8> KronrodWeights = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714};
+constexpr std::array<double, 4> GaussWeights = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327};
+constexpr std::size_t NodesPerSegment = 15;
+
+// The range is first cut into this many equal pieces, enough to keep every
+// worker busy from the start.
+constexpr std::size_t InitialSegments = 16;
+// Refinement gives up, reporting the current estimate as unconverged, once
+// this many segments are live.
+constexpr std::size_t MaxSegments = 20000;
+
+struct Segment {
+  double from = 0.0;
+  double to = 0.0;
+  double value = 0.0;
+  double error = 0.0;
+};
+
+// Applies the rule to `segment`, reading the integration variable from
+// slots[slot]. Evaluation failures throw.
+void applyRule(const CompiledExpression &compiled, std::vector<double> slots,
+               std::size_t slot, Segment &segment) {
+  const double centre = (segment.from + segment.to) / 2.0;
+  const double halfWidth = (segment.to - segment.from) / 2.0;
+  auto at = [&](double x) {
+    if (slot < slots.size()) {
+      slots[slot] = x;
+    }
+    EvalResult result = compiled.tryEvaluateSlots(slots.data());
+    if (!result.ok()) {
+      throwEvalError(result);
+    }
+    return result.value;
+  };
+
+  double centreValue = at(centre);
+  double kronrod = KronrodWeights[7] * centreValue;
+  double gauss = GaussWeights[3] * centreValue;
+  for (std::size_t idx = 0; idx < 7; ++idx) {
+    double offset = halfWidth * KronrodNodes[idx];
+    double pair = at(centre - offset) + at(centre + offset);
+    kronrod += KronrodWeights[idx] * pair;
+    if (idx % 2 == 1) {
+      gauss += GaussWeights[idx / 2] * pair;
+    }
+  }
+  segment.value = kronrod * halfWidth;
+  segment.error = std::fabs((kronrod - gauss) * halfWidth);
+}
+} // namespace
+
+IntegrationResult
+integrateExpression(const std::string &expression, const std::string &variable,
+                    double from, double to, double tolerance,
+                    const std::map<std::string, double> &variables) {
+  if (!std::isfinite(from) || !std::isfinite(to)) {
+    throw std::invalid_argument("Integration limits must be finite.");
+  }
+  if (!(tolerance > 0.0)) {
+    throw std::invalid_argument("The tolerance must be positive.");
+  }
+  const std::string name = expression_detail::normalizeIdentifier(variable);
+
+  CompiledExpression compiled(expression);
+  const std::vector<std::string> &names = compiled.variableNames();
+  std::size_t slot = static_cast<std::size_t>(
+      std::find(names.begin(), names.end(), name) - names.begin());
+  std::map<std::string, double> bindings = variables;
+  bindings[name] = from;
+  const std::vector<double> bound = compiled.bindVariables(bindings);
+
+  IntegrationResult result;
+  if (from == to) {
+    result.converged = true;
+    return result;
+  }
+  const double sign = from < to ? 1.0 : -1.0;
+  if (from > to) {
+    std::swap(from, to);
+  }
+
+  std::vector<Segment> segments(InitialSegments);
+  const double width = (to - from) / static_cast<double>(InitialSegments);
+  for (std::size_t idx = 0; idx < InitialSegments; ++idx) {
+    segments[idx].from = from + width * static_cast<double>(idx);
+    segments[idx].to = idx + 1 == InitialSegments
+                           ? to
+                           : from + width * static_cast<double>(idx + 1);
+  }
+  parallelFor(segments.size(), [&](std::size_t idx) {
+    applyRule(compiled, bound, slot, segments[idx]);
+  });
+  result.evaluations = segments.size() * NodesPerSegment;
+
+  // Each round bisects every segment whose error exceeds its share of the
+  // remaining budget and applies the rule to all the halves in parallel.
+  for (;;) {
+    double value = 0.0;
+    double error = 0.0;
+    for (const Segment &segment : segments) {
+      value += segment.value;
+      error += segment.error;
+    }
+    if (!std::isfinite(value) || !std::isfinite(error)) {
+      throw std::overflow_error(
+          "The integral diverges or is not finite on this range.");
+    }
+    result.value = sign * value;
+    result.error = error;
+    const double target = tolerance * std::max(1.0, std::fabs(value));
+    if (error <= target) {
+      result.converged = true;
+      break;
+    }
+
+    const double share = target / static_cast<double>(segments.size());
+    std::vector<Segment> halves;
+    std::vector<Segment> kept;
+    kept.reserve(segments.size());
+    for (const Segment &segment : segments) {
+      double mid = segment.from + (segment.to - segment.from) / 2.0;
+      if (segment.error > share && mid > segment.from && mid < segment.to) {
+        halves.push_back({segment.from, mid, 0.0, 0.0});
+        halves.push_back({mid, segment.to, 0.0, 0.0});
+      } else {
+        kept.push_back(segment);
+      }
+    }
+    if (halves.empty() || kept.size() + halves.size() > MaxSegments) {
+      break;
+    }
+    parallelFor(halves.size(), [&](std::size_t idx) {
+      applyRule(compiled, bound, slot, halves[idx]);
+    });
+    result.evaluations += halves.size() * NodesPerSegment;
+    kept.insert(kept.end(), halves.begin(), halves.end());
+    segments = std::move(kept);
+  }
+  result.segments = segments.size();
+  return result;
+}
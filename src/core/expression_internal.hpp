@@ -1,50 +1,86 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace expression_detail {
-struct Token {
-  enum class Type {
-    Number,
-    Operator,
-    Function,
-    Variable,
-    LeftParen,
-    RightParen
-  } type;
-  double value{};
-  char op{};
-  std::string text;
+// Built-in functions, resolved once during tokenization. The unary ones come
+// first so evaluators can dispatch them through a table indexed by id.
+enum class FunctionId : std::uint8_t {
+  Sin,
+  Cos,
+  Tan,
+  Cot,
+  Asin,
+  Acos,
+  Atan,
+  Sinh,
+  Log,
+  Exp,
+  Sqrt,
+  PowMod // powmod(base, exponent, modulus); compiled to OpCode::PowMod
 };
 
-struct BigToken {
-  enum class Type { Number, Operator, Variable, LeftParen, RightParen } type;
-  std::string number;
-  char op{};
-  std::string text;
-};
+constexpr std::size_t UnaryFunctionCount =
+    static_cast<std::size_t>(FunctionId::Sqrt) + 1;
+
+// Looks up a function name, ignoring case. Returns false for unknown names.
+bool lookupFunction(std::string_view name, FunctionId &id);
+// Number of comma-separated arguments the function takes.
+std::size_t functionArity(FunctionId id);
+// Whether the function is available under NumberSyntax::Integer.
+bool isIntegerFunction(FunctionId id);
 
-struct BigFloatToken {
+// Identifiers are case-insensitive; this returns the canonical lower-case
+// spelling used as a variable key.
+std::string normalizeIdentifier(std::string_view identifier);
+
+// Literal syntax accepted by the tokenizer. Integer syntax rejects decimal
+// points and every function except the integer ones (powmod).
+enum class NumberSyntax { Decimal, Integer };
+
+// Tokens never own text. `text` is a view into the expression passed to the
+// tokenizer, which must outlive the token: the digits of a number literal
+// (without its sign, see `negative`) or the original spelling of a variable.
+// `position` is the token's offset in that expression. Function tokens keep
+// their spelling in `text` for error messages. The modulo operator, written
+// `mod` or `%`, has op '%'.
+struct Token {
   enum class Type {
     Number,
     Operator,
     Function,
     Variable,
     LeftParen,
-    RightParen
+    RightParen,
+    Comma
   } type;
-  std::string number;
+  std::size_t position{};
   char op{};
-  std::string text;
+  FunctionId function{};
+  bool negative{};
+  std::string_view text{};
 };
 
-std::vector<Token> tokenizeExpression(const std::string &expression);
+std::vector<Token>
+tokenizeExpression(std::string_view expression,
+                   NumberSyntax syntax = NumberSyntax::Decimal);
+// Tokenizes into `tokens`, reusing its capacity; no allocation happens once
+// the buffer is large enough.
+void tokenizeExpression(std::string_view expression, std::vector<Token> &tokens,
+                        NumberSyntax syntax = NumberSyntax::Decimal);
 std::vector<Token> toRpn(const std::vector<Token> &tokens);
-std::vector<BigToken> tokenizeExpressionBigInt(const std::string &expression);
-std::vector<BigToken> toRpnBigInt(const std::vector<BigToken> &tokens);
-std::vector<BigFloatToken>
-tokenizeExpressionBigDouble(const std::string &expression);
-std::vector<BigFloatToken> toRpnBigDouble(
-    const std::vector<BigFloatToken> &tokens);
+
+// Bigdouble evaluation for the adaptive path's fallback. The expression is
+// evaluated at the requested precision and again on the next tier up, and
+// only the significant digits on which the two agree are printed, so noise
+// from cancellation is never reported as a result. Throws like
+// evaluateExpressionBigDouble, and std::domain_error when no digit agrees.
+std::string evaluateBigDoubleVerified(
+    const std::string &expression,
+    const std::map<std::string, double> &variables);
 } // namespace expression_detail
@@ -0,0 +1,607 @@
+#include "expression.hpp"
+
+#include "expression_double.hpp"
+#include "expression_engine.hpp"
+#include "math_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+using expression_detail::EvalStatus;
+
+constexpr double Infinity = std::numeric_limits<double>::infinity();
+constexpr double Largest = std::numeric_limits<double>::max();
+constexpr double Pi = 3.141592653589793;
+// Largest magnitude below which every integer is a double.
+constexpr double ExactIntegerLimit = 9007199254740992.0; // 2^53
+// Beyond this the period of sin and friends is lost in the rounding of x.
+constexpr double PeriodicLimit = 1e9;
+
+const Interval Entire{-Infinity, Infinity};
+
+Interval fail(EvalStatus &status, EvalErrorCode code, const char *message) {
+  status.code = code;
+  status.message = message;
+  return {};
+}
+
+double down(double value) {
+  return std::nextafter(value, -Infinity);
+}
+
+double up(double value) {
+  return std::nextafter(value, Infinity);
+}
+
+bool isPoint(const Interval &value) {
+  return value.lo == value.hi;
+}
+
+bool isWholePoint(const Interval &value) {
+  return isPoint(value) && expression_detail::isWholeNumber(value.lo);
+}
+
+// Library functions are not correctly rounded; two ulps outward covers
+// their documented error.
+Interval widen(double lo, double hi) {
+  return {down(down(lo)), up(up(hi))};
+}
+
+// Bounds of an exact sum, product or quotient given its rounded value and
+// the sign of the rounding error, so no rounding mode has to be switched.
+// A finite result that rounded to infinity keeps the largest double as its
+// inner bound.
+Interval enclose(double rounded, double error) {
+  if (std::isinf(rounded)) {
+    return rounded > 0 ? Interval{Largest, Infinity}
+                       : Interval{-Infinity, -Largest};
+  }
+  return {error < 0 ? down(rounded) : rounded,
+          error > 0 ? up(rounded) : rounded};
+}
+
+Interval sumOf(double lhs, double rhs) {
+  const double value = lhs + rhs;
+  if (!std::isfinite(lhs) || !std::isfinite(rhs)) {
+    return {value, value};
+  }
+  // TwoSum: the exact rounding error of the addition.
+  const double rhsPart = value - lhs;
+  return enclose(value, (lhs - (value - rhsPart)) + (rhs - rhsPart));
+}
+
+Interval productOf(double lhs, double rhs) {
+  if (lhs == 0.0 || rhs == 0.0) {
+    return {0.0, 0.0}; // including 0 * inf at an unbounded end
+  }
+  const double value = lhs * rhs;
+  if (!std::isfinite(lhs) || !std::isfinite(rhs)) {
+    return {value, value};
+  }
+  return enclose(value, std::fma(lhs, rhs, -value));
+}
+
+Interval quotientOf(double lhs, double rhs) {
+  const double value = lhs / rhs;
+  if (!std::isfinite(lhs) || !std::isfinite(rhs)) {
+    return {value, value};
+  }
+  // lhs / rhs == value + remainder / rhs exactly.
+  const double remainder = std::fma(-value, rhs, lhs);
+  return enclose(value, rhs > 0 ? remainder : -remainder);
+}
+
+Interval hull(const Interval &a, const Interval &b) {
+  return {std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+Interval hull(const Interval &a, const Interval &b, const Interval &c,
+              const Interval &d) {
+  return hull(hull(a, b), hull(c, d));
+}
+
+Interval add(const Interval &lhs, const Interval &rhs) {
+  return {sumOf(lhs.lo, rhs.lo).lo, sumOf(lhs.hi, rhs.hi).hi};
+}
+
+Interval subtract(const Interval &lhs, const Interval &rhs) {
+  return {sumOf(lhs.lo, -rhs.hi).lo, sumOf(lhs.hi, -rhs.lo).hi};
+}
+
+Interval multiply(const Interval &lhs, const Interval &rhs) {
+  return hull(productOf(lhs.lo, rhs.lo), productOf(lhs.lo, rhs.hi),
+              productOf(lhs.hi, rhs.lo), productOf(lhs.hi, rhs.hi));
+}
+
+Interval square(const Interval &value) {
+  Interval lo = productOf(value.lo, value.lo);
+  Interval hi = productOf(value.hi, value.hi);
+  Interval result = hull(lo, hi);
+  if (value.contains(0.0)) {
+    result.lo = 0.0;
+  }
+  return result;
+}
+
+Interval divide(const Interval &lhs, const Interval &rhs,
+                EvalStatus &status) {
+  if (rhs.lo == 0.0 && rhs.hi == 0.0) {
+    return fail(status, EvalErrorCode::DivisionByZero,
+                "Division by zero in expression.");
+  }
+  if (rhs.contains(0.0)) {
+    return Entire;
+  }
+  return hull(quotientOf(lhs.lo, rhs.lo), quotientOf(lhs.lo, rhs.hi),
+              quotientOf(lhs.hi, rhs.lo), quotientOf(lhs.hi, rhs.hi));
+}
+
+// Encloses base^exponent for an integer exponent by squaring, which keeps
+// results that are exact in a double exact.
+Interval integerPower(double base, double exponent) {
+  Interval result{1.0, 1.0};
+  Interval factor{base, base};
+  for (double rest = std::fabs(exponent); rest > 0.0;
+       rest = std::floor(rest / 2.0)) {
+    if (std::fmod(rest, 2.0) == 1.0) {
+      result = multiply(result, factor);
+    }
+    factor = square(factor);
+  }
+  return result;
+}
+
+Interval power(const Interval &base, const Interval &exponent,
+               EvalStatus &status) {
+  if (isWholePoint(exponent)) {
+    const double n = exponent.lo;
+    if (n == 0.0) {
+      return {1.0, 1.0};
+    }
+    if (n < 0.0 && base.contains(0.0)) {
+      return Entire;
+    }
+    // x^n is monotonic on either side of zero, so away from zero the
+    // extremes sit at the endpoints.
+    Interval lo = integerPower(base.lo, n);
+    Interval hi = integerPower(base.hi, n);
+    if (n < 0.0) {
+      EvalStatus unused;
+      lo = divide({1.0, 1.0}, lo, unused);
+      hi = divide({1.0, 1.0}, hi, unused);
+    }
+    Interval result = hull(lo, hi);
+    if (std::fmod(n, 2.0) == 0.0 && base.contains(0.0)) {
+      result.lo = 0.0;
+    }
+    return result;
+  }
+  if (base.lo < 0.0) {
+    if (!isPoint(exponent)) {
+      return Entire; // the exponent range may hold integers
+    }
+    if (base.hi < 0.0) {
+      return fail(status, EvalErrorCode::DomainError,
+                  "Power undefined for a negative base and fractional "
+                  "exponent.");
+    }
+  }
+  // For a positive base x^y is monotonic in each argument, so the extremes
+  // sit at the corners.
+  const double lo = std::max(base.lo, 0.0);
+  double values[] = {std::pow(lo, exponent.lo), std::pow(lo, exponent.hi),
+                     std::pow(base.hi, exponent.lo),
+                     std::pow(base.hi, exponent.hi)};
+  Interval result = widen(*std::min_element(values, values + 4),
+                          *std::max_element(values, values + 4));
+  result.lo = std::max(result.lo, 0.0);
+  return result;
+}
+
+// Encloses floorMod(value, modulus) from expression_double.hpp: fmod is
+// exact and only the sign correction can round.
+Interval floorModBounds(double value, double modulus) {
+  double remainder = std::fmod(value, modulus);
+  if (remainder != 0.0 && (remainder < 0.0) != (modulus < 0.0)) {
+    return sumOf(remainder, modulus);
+  }
+  return {remainder, remainder};
+}
+
+// Every possible remainder: [0, m) for m > 0, (m, 0] for m < 0.
+Interval remainderRange(const Interval &modulus) {
+  return {std::min(modulus.lo, 0.0), std::max(modulus.hi, 0.0)};
+}
+
+Interval modulo(const Interval &value, const Interval &modulus,
+                EvalStatus &status) {
+  if (modulus.lo == 0.0 && modulus.hi == 0.0) {
+    return fail(status, EvalErrorCode::DivisionByZero,
+                "Modulo by zero in expression.");
+  }
+  if (!isPoint(modulus) || modulus.contains(0.0) ||
+      !std::isfinite(value.lo) || !std::isfinite(value.hi)) {
+    return remainderRange(modulus);
+  }
+  const double m = modulus.lo;
+  // Within one period x mod m is x minus a constant. Crossing a multiple of
+  // m shows up as the remainders coming out of order.
+  const Interval lo = floorModBounds(value.lo, m);
+  const Interval hi = floorModBounds(value.hi, m);
+  if (!(value.hi - value.lo < std::fabs(m)) || lo.hi > hi.lo) {
+    return remainderRange(modulus);
+  }
+  return {lo.lo, hi.hi};
+}
+
+Interval powerMod(const Interval &base, const Interval &exponent,
+                  const Interval &modulus, EvalStatus &status) {
+  if (modulus.lo == 0.0 && modulus.hi == 0.0) {
+    return fail(status, EvalErrorCode::DivisionByZero,
+                "Modulo by zero in expression.");
+  }
+  if (!isWholePoint(base) || !isWholePoint(exponent) ||
+      !isWholePoint(modulus) || exponent.lo < 0.0 ||
+      std::fabs(modulus.lo) > expression_detail::MaxExactPowModModulus) {
+    return modulo(power(base, exponent, status), modulus, status);
+  }
+  const double result =
+      expression_detail::wholePowerMod(base.lo, exponent.lo, modulus.lo);
+  return {result, result};
+}
+
+Interval factorialValue(double n) {
+  long double result = 1.0L;
+  for (double factor = 2.0; factor <= n; ++factor) {
+    result *= factor;
+  }
+  const double value = static_cast<double>(result);
+  // The long double product is exact while it fits in 64 bits.
+  return value <= ExactIntegerLimit ? Interval{value, value}
+                                    : Interval{down(value), up(value)};
+}
+
+Interval factorial(const Interval &value, EvalStatus &status) {
+  double lo = 0.0;
+  double hi = 0.0;
+  if (isPoint(value)) {
+    lo = hi = std::round(value.lo);
+    if (!isApproximatelyZero(value.lo - lo)) {
+      return fail(status, EvalErrorCode::InvalidOperand,
+                  "Factorial is only defined for integers.");
+    }
+  } else {
+    // n! is non-decreasing over the integers the range contains.
+    lo = std::max(std::ceil(value.lo), 0.0);
+    hi = std::floor(value.hi);
+  }
+  if (hi < 0.0) {
+    return fail(status, EvalErrorCode::InvalidOperand,
+                "Factorial is not defined for negative numbers.");
+  }
+  if (lo > hi) {
+    return fail(status, EvalErrorCode::InvalidOperand,
+                "Factorial is only defined for integers.");
+  }
+  if (lo > 170.0) {
+    return fail(status, EvalErrorCode::Overflow,
+                "Factorial result would overflow double precision.");
+  }
+  return {factorialValue(lo).lo,
+          hi > 170.0 ? Infinity : factorialValue(hi).hi};
+}
+
+// Whether [lo, hi] may contain offset + k * period for an integer k. Errs
+// towards yes, which only loosens the bounds.
+bool mayContain(const Interval &value, double offset, double period) {
+  const double k = std::floor((value.lo - offset) / period);
+  const double slack = 1e-12 * std::max(1.0, std::fabs(value.hi));
+  for (double step = k; step <= k + 2.0; ++step) {
+    const double point = offset + step * period;
+    if (point >= value.lo - slack && point <= value.hi + slack) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool spansPeriod(const Interval &value, double period) {
+  return !(value.hi - value.lo < period) ||
+         std::max(std::fabs(value.lo), std::fabs(value.hi)) > PeriodicLimit;
+}
+
+Interval clampUnit(Interval value) {
+  return {std::max(value.lo, -1.0), std::min(value.hi, 1.0)};
+}
+
+Interval sinOf(const Interval &value, EvalStatus &) {
+  if (spansPeriod(value, 2 * Pi)) {
+    return {-1.0, 1.0};
+  }
+  const double a = std::sin(value.lo);
+  const double b = std::sin(value.hi);
+  Interval result = widen(std::min(a, b), std::max(a, b));
+  if (mayContain(value, Pi / 2, 2 * Pi)) {
+    result.hi = 1.0;
+  }
+  if (mayContain(value, -Pi / 2, 2 * Pi)) {
+    result.lo = -1.0;
+  }
+  return clampUnit(result);
+}
+
+Interval cosOf(const Interval &value, EvalStatus &) {
+  if (spansPeriod(value, 2 * Pi)) {
+    return {-1.0, 1.0};
+  }
+  const double a = std::cos(value.lo);
+  const double b = std::cos(value.hi);
+  Interval result = widen(std::min(a, b), std::max(a, b));
+  if (mayContain(value, 0.0, 2 * Pi)) {
+    result.hi = 1.0;
+  }
+  if (mayContain(value, Pi, 2 * Pi)) {
+    result.lo = -1.0;
+  }
+  return clampUnit(result);
+}
+
+Interval tanOf(const Interval &value, EvalStatus &) {
+  if (spansPeriod(value, Pi) || mayContain(value, Pi / 2, Pi)) {
+    return Entire;
+  }
+  return widen(std::tan(value.lo), std::tan(value.hi));
+}
+
+Interval cotOf(const Interval &value, EvalStatus &status) {
+  if (isPoint(value) && isApproximatelyZero(std::tan(value.lo))) {
+    return fail(status, EvalErrorCode::DomainError,
+                "Cotangent undefined for this value.");
+  }
+  if (spansPeriod(value, Pi) || mayContain(value, 0.0, Pi)) {
+    return Entire;
+  }
+  return widen(1.0 / std::tan(value.hi), 1.0 / std::tan(value.lo));
+}
+
+// Where the argument leaves the domain only the part inside it counts; an
+// argument entirely outside is an error, as in double mode.
+Interval asinOf(const Interval &value, EvalStatus &status) {
+  if (value.hi < -1.0 || value.lo > 1.0) {
+    return fail(status, EvalErrorCode::DomainError,
+                "Arcsine undefined for this value.");
+  }
+  Interval clamped = clampUnit(value);
+  return widen(std::asin(clamped.lo), std::asin(clamped.hi));
+}
+
+Interval acosOf(const Interval &value, EvalStatus &status) {
+  if (value.hi < -1.0 || value.lo > 1.0) {
+    return fail(status, EvalErrorCode::DomainError,
+                "Arccosine undefined for this value.");
+  }
+  Interval clamped = clampUnit(value);
+  return widen(std::acos(clamped.hi), std::acos(clamped.lo));
+}
+
+Interval atanOf(const Interval &value, EvalStatus &) {
+  return widen(std::atan(value.lo), std::atan(value.hi));
+}
+
+Interval sinhOf(const Interval &value, EvalStatus &) {
+  return widen(std::sinh(value.lo), std::sinh(value.hi));
+}
+
+Interval logOf(const Interval &value, EvalStatus &status) {
+  if (value.hi <= 0.0) {
+    return fail(status, EvalErrorCode::DomainError,
+                "Logarithm undefined for non-positive values.");
+  }
+  if (value.lo <= 0.0) {
+    return {-Infinity, up(up(std::log(value.hi)))};
+  }
+  return widen(std::log(value.lo), std::log(value.hi));
+}
+
+Interval expOf(const Interval &value, EvalStatus &) {
+  Interval result = widen(std::exp(value.lo), std::exp(value.hi));
+  result.lo = std::max(result.lo, 0.0);
+  return result;
+}
+
+Interval sqrtOf(const Interval &value, EvalStatus &status) {
+  if (value.hi < 0.0) {
+    return fail(status, EvalErrorCode::DomainError,
+                "Square root undefined for negative values.");
+  }
+  // sqrt is correctly rounded, so one ulp is enough.
+  return {value.lo <= 0.0 ? 0.0 : down(std::sqrt(value.lo)),
+          up(std::sqrt(value.hi))};
+}
+
+using UnaryFunction = Interval (*)(const Interval &, EvalStatus &);
+
+// Indexed by expression_detail::FunctionId.
+constexpr UnaryFunction FunctionTable[expression_detail::UnaryFunctionCount] =
+    {sinOf,  cosOf,  tanOf, cotOf, asinOf, acosOf,
+     atanOf, sinhOf, logOf, expOf, sqrtOf};
+
+// Whether `value`, parsed from the unsigned decimal `digits`, is exactly
+// the number they spell: true when value * 10^k rounds to nothing and gives
+// back the digits as an integer, k being the count of fractional digits.
+bool isExactDecimal(std::string_view digits, double value) {
+  std::uint64_t whole = 0;
+  double scale = 1.0;
+  std::size_t count = 0;
+  bool fraction = false;
+  for (char c : digits) {
+    if (c == '.') {
+      fraction = true;
+      continue;
+    }
+    if (++count > 15) {
+      return false; // may not fit in 53 bits
+    }
+    whole = whole * 10 + static_cast<std::uint64_t>(c - '0');
+    if (fraction) {
+      scale *= 10.0;
+    }
+  }
+  const double scaled = value * scale;
+  return scaled == static_cast<double>(whole) &&
+         std::fma(value, scale, -scaled) == 0.0;
+}
+
+// A literal whose decimal value is not a double lies between the
+// neighbours of the nearest one.
+Interval parseInterval(std::string_view digits, bool negative) {
+  double value = expression_detail::parseDoubleLiteral(digits);
+  const bool exact = isExactDecimal(digits, value);
+  if (negative) {
+    value = -value;
+  }
+  return exact ? Interval{value, value} : Interval{down(value), up(value)};
+}
+
+// Numeric policy for interval mode. Every operation returns an interval
+// that contains the exact result for every point of its operands.
+struct IntervalTraits {
+  using Value = Interval;
+  static constexpr expression_detail::NumberSyntax Syntax =
+      expression_detail::NumberSyntax::Decimal;
+  static constexpr bool FallibleArithmetic = false;
+
+  static Interval parseLiteral(std::string_view digits, bool negative) {
+    return parseInterval(digits, negative);
+  }
+  static Interval fromVariable(const std::string &, double value) {
+    return {value, value};
+  }
+  static Interval add(const Interval &lhs, const Interval &rhs,
+                      EvalStatus &) {
+    return ::add(lhs, rhs);
+  }
+  static Interval subtract(const Interval &lhs, const Interval &rhs,
+                           EvalStatus &) {
+    return ::subtract(lhs, rhs);
+  }
+  static Interval multiply(const Interval &lhs, const Interval &rhs,
+                           EvalStatus &) {
+    return ::multiply(lhs, rhs);
+  }
+  static Interval divide(const Interval &lhs, const Interval &rhs,
+                         EvalStatus &status) {
+    return ::divide(lhs, rhs, status);
+  }
+  static Interval modulo(const Interval &lhs, const Interval &rhs,
+                         EvalStatus &status) {
+    return ::modulo(lhs, rhs, status);
+  }
+  static Interval power(const Interval &lhs, const Interval &rhs,
+                        EvalStatus &status) {
+    return ::power(lhs, rhs, status);
+  }
+  static Interval powerMod(const Interval &base, const Interval &exponent,
+                           const Interval &modulus, EvalStatus &status) {
+    return ::powerMod(base, exponent, modulus, status);
+  }
+  static Interval square(const Interval &value, EvalStatus &) {
+    return ::square(value);
+  }
+  static Interval factorial(const Interval &value, EvalStatus &status) {
+    return ::factorial(value, status);
+  }
+  static Interval function(expression_detail::FunctionId id,
+                           const Interval &value, EvalStatus &status) {
+    return FunctionTable[static_cast<std::size_t>(id)](value, status);
+  }
+  static bool isOne(const Interval &value) {
+    return value.lo == 1.0 && value.hi == 1.0;
+  }
+  static bool isTwo(const Interval &value) {
+    return value.lo == 2.0 && value.hi == 2.0;
+  }
+  // Interval endpoints do not keep the sign of zero, so x + 0 and x - 0
+  // are exact.
+  static bool isNeutralAddend(const Interval &value) {
+    return value.lo == 0.0 && value.hi == 0.0;
+  }
+  static bool isNeutralSubtrahend(const Interval &value) {
+    return value.lo == 0.0 && value.hi == 0.0;
+  }
+};
+} // namespace
+
+Interval evaluateExpressionInterval(
+    const std::string &expression,
+    const std::map<std::string, double> &variables) {
+  expression_detail::Program<Interval> program =
+      expression_detail::compileProgram<IntervalTraits>(expression);
+  return expression_detail::evaluateProgram<IntervalTraits>(program,
+                                                            variables);
+}
+
+IntervalExpression::IntervalExpression(const std::string &expression)
+    : program_(expression_detail::compileProgram<IntervalTraits>(expression)) {}
+
+const std::vector<std::string> &IntervalExpression::variableNames() const {
+  return program_.variables;
+}
+
+Interval IntervalExpression::evaluate(
+    const std::map<std::string, Interval> &variables) const {
+  std::vector<Interval> slots(program_.variables.size());
+  for (std::size_t slot = 0; slot < slots.size(); ++slot) {
+    auto found = variables.find(program_.variables[slot]);
+    if (found == variables.end()) {
+      throw std::invalid_argument("Unknown variable: " +
+                                  program_.variables[slot]);
+    }
+    slots[slot] = found->second;
+  }
+  IntervalResult result = tryEvaluateSlots(slots.data());
+  if (!result.ok()) {
+    throwEvalError(result.status);
+  }
+  return result.bounds;
+}
+
+std::vector<Interval> IntervalExpression::bindVariables(
+    const std::map<std::string, double> &variables) const {
+  std::vector<Interval> slots(program_.variables.size());
+  std::size_t missing = expression_detail::bindProgram<IntervalTraits>(
+      program_, variables, slots.data());
+  if (missing < slots.size()) {
+    throw std::invalid_argument("Unknown variable: " +
+                                program_.variables[missing]);
+  }
+  return slots;
+}
+
+IntervalResult
+IntervalExpression::tryEvaluateSlots(const Interval *slots) const {
+  IntervalResult result;
+  std::vector<Interval> stack(program_.maxDepth);
+  EvalStatus status;
+  std::size_t failed = expression_detail::execute<IntervalTraits>(
+      program_.code.data(), program_.code.size(), program_.constants.data(),
+      slots, stack.data(), status);
+  if (failed != program_.code.size()) {
+    result.status =
+        expression_detail::failedResult(status, program_.code[failed]);
+    return result;
+  }
+  result.bounds = stack[0];
+  if (std::isnan(result.bounds.lo) || std::isnan(result.bounds.hi)) {
+    result.bounds = Entire; // e.g. inf - inf at an unbounded end
+  }
+  return result;
+}
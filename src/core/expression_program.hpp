@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace expression_detail {
+enum class OpCode : std::uint8_t {
+  Constant,
+  Variable,
+  Add,
+  Subtract,
+  Multiply,
+  Divide,
+  Modulo,
+  Power,
+  PowMod, // base exponent modulus -> base^exponent mod modulus
+  Square,
+  Factorial,
+  Function
+};
+
+struct Instruction {
+  OpCode op;
+  std::uint32_t operand;  // constant/variable index or function id
+  std::uint32_t position; // offset of the source token, for error reports
+};
+
+// A flat postfix program over one numeric type. Variables are read by slot,
+// the position of their name in `variables`.
+template <typename Value> struct Program {
+  std::vector<Instruction> code;
+  std::vector<Value> constants;
+  std::vector<std::string> variables;
+  std::size_t maxDepth = 0;
+};
+} // namespace expression_detail
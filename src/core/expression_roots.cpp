@@ -0,0 +1,325 @@
+#include "expression.hpp"
+#include "expression_internal.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+// Initial points of the bracketing scan, 1000 steps so that the centre of a
+// symmetric range is sampled; sampleExpression adds more where the curve
+// bends sharply.
+constexpr std::size_t RootScanSamples = 1001;
+constexpr int MaxIterations = 200;
+constexpr double Epsilon = std::numeric_limits<double>::epsilon();
+
+struct Bracket {
+  double lo;
+  double hi;
+  double flo;
+  double fhi;
+};
+
+// Brent's method on a bracket with f(lo) and f(hi) of opposite signs,
+// converging to within a few ulps. `f` returns NaN where the expression
+// fails, which abandons the bracket.
+template <typename Function>
+double brent(Function &&f, const Bracket &bracket) {
+  double a = bracket.lo;
+  double b = bracket.hi;
+  double fa = bracket.flo;
+  double fb = bracket.fhi;
+  double c = a;
+  double fc = fa;
+  double d = b - a;
+  double e = d;
+  for (int iteration = 0; iteration < MaxIterations; ++iteration) {
+    if ((fb > 0.0) == (fc > 0.0)) {
+      c = a;
+      fc = fa;
+      d = e = b - a;
+    }
+    if (std::fabs(fc) < std::fabs(fb)) {
+      a = b;
+      b = c;
+      c = a;
+      fa = fb;
+      fb = fc;
+      fc = fa;
+    }
+    const double tolerance = 2.0 * Epsilon * std::fabs(b) +
+                             std::numeric_limits<double>::denorm_min();
+    const double middle = (c - b) / 2.0;
+    if (std::fabs(middle) <= tolerance || fb == 0.0) {
+      return b;
+    }
+    if (std::fabs(e) >= tolerance && std::fabs(fa) > std::fabs(fb)) {
+      // Secant step, or inverse quadratic interpolation once three distinct
+      // points are known.
+      double s = fb / fa;
+      double p;
+      double q;
+      if (a == c) {
+        p = 2.0 * middle * s;
+        q = 1.0 - s;
+      } else {
+        double r = fb / fc;
+        q = fa / fc;
+        p = s * (2.0 * middle * q * (q - r) - (b - a) * (r - 1.0));
+        q = (q - 1.0) * (r - 1.0) * (s - 1.0);
+      }
+      if (p > 0.0) {
+        q = -q;
+      } else {
+        p = -p;
+      }
+      if (2.0 * p < std::min(3.0 * middle * q - std::fabs(tolerance * q),
+                             std::fabs(e * q))) {
+        e = d;
+        d = p / q;
+      } else {
+        d = e = middle;
+      }
+    } else {
+      d = e = middle;
+    }
+    a = b;
+    fa = fb;
+    b += std::fabs(d) > tolerance ? d : std::copysign(tolerance, middle);
+    fb = f(b);
+    if (std::isnan(fb)) {
+      return fb;
+    }
+  }
+  return b;
+}
+
+// Newton's method safeguarded by bisection, so it never leaves the bracket.
+// `fdf` stores f and f' and returns false where either is unavailable, in
+// which case this returns false and the caller falls back to Brent.
+template <typename Function>
+bool newton(Function &&fdf, const Bracket &bracket, double &root) {
+  // Orient the bracket so that f(low) < 0 < f(high).
+  double low = bracket.flo < 0.0 ? bracket.lo : bracket.hi;
+  double high = bracket.flo < 0.0 ? bracket.hi : bracket.lo;
+  double x = (bracket.lo + bracket.hi) / 2.0;
+  double step = std::fabs(bracket.hi - bracket.lo);
+  double previousStep = step;
+  double f = 0.0;
+  double df = 0.0;
+  if (!fdf(x, f, df)) {
+    return false;
+  }
+  for (int iteration = 0; iteration < MaxIterations; ++iteration) {
+    if (f == 0.0) {
+      break;
+    }
+    if (!std::isfinite(df)) {
+      return false;
+    }
+    // Bisect when the Newton step would leave the bracket or is not
+    // shrinking fast enough.
+    if (((x - high) * df - f) * ((x - low) * df - f) > 0.0 ||
+        std::fabs(2.0 * f) > std::fabs(previousStep * df)) {
+      previousStep = step;
+      step = (high - low) / 2.0;
+      x = low + step;
+      if (x == low) {
+        break;
+      }
+    } else {
+      previousStep = step;
+      step = f / df;
+      double before = x;
+      x -= step;
+      if (x == before) {
+        break;
+      }
+    }
+    if (std::fabs(step) <= 2.0 * Epsilon * std::fabs(x)) {
+      break;
+    }
+    if (!fdf(x, f, df)) {
+      return false;
+    }
+    if (f < 0.0) {
+      low = x;
+    } else {
+      high = x;
+    }
+  }
+  root = x;
+  return true;
+}
+
+// Looks for a root where the curve touches zero without crossing it, on a
+// bracket whose ends have the same sign. Such a root is an extremum, so the
+// derivative changes sign across the bracket; its zero is found with Brent
+// and kept when no enclosure of f around it can rule out zero. Returns NaN
+// when there is no such root.
+template <typename Function, typename ValueAndSlope, typename Vanishes>
+double touchingRoot(Function &&f, ValueAndSlope &&fdf, Vanishes &&mayVanish,
+                    const Bracket &bracket) {
+  double value = 0.0;
+  double slopeLo = 0.0;
+  double slopeHi = 0.0;
+  const double none = std::numeric_limits<double>::quiet_NaN();
+  if (!fdf(bracket.lo, value, slopeLo) || !fdf(bracket.hi, value, slopeHi) ||
+      slopeLo == 0.0 || slopeHi == 0.0 || (slopeLo < 0.0) == (slopeHi < 0.0)) {
+    return none;
+  }
+  auto slope = [&](double x) {
+    double slopeAt = 0.0;
+    return fdf(x, value, slopeAt) ? slopeAt : none;
+  };
+  const double extremum =
+      brent(slope, {bracket.lo, bracket.hi, slopeLo, slopeHi});
+  if (std::isnan(extremum)) {
+    return none;
+  }
+  const double residual = f(extremum);
+  if (!(std::fabs(residual) <
+        std::min(std::fabs(bracket.flo), std::fabs(bracket.fhi)))) {
+    return none;
+  }
+  // Brent places the extremum within a few ulps.
+  const double spread = 8.0 * Epsilon * std::fabs(extremum) +
+                        std::numeric_limits<double>::denorm_min();
+  if (residual != 0.0 && !mayVanish(extremum - spread, extremum + spread)) {
+    return none;
+  }
+  return extremum;
+}
+} // namespace
+
+std::vector<double>
+findRoots(const std::string &expression, const std::string &variable,
+          double from, double to,
+          const std::map<std::string, double> &variables) {
+  const std::string name = expression_detail::normalizeIdentifier(variable);
+  SampledCurve scan =
+      sampleExpression(expression, name, from, to, RootScanSamples, variables);
+
+  CompiledExpression compiled(expression);
+  GradientExpression derivative(expression, {name});
+  IntervalExpression enclosure(expression);
+  std::map<std::string, double> bindings = variables;
+  bindings[name] = from;
+  // Every mode numbers the variables in order of first appearance, so one
+  // slot layout serves all three compiled forms.
+  const std::vector<double> bound = compiled.bindVariables(bindings);
+  const auto &names = compiled.variableNames();
+  const std::size_t slot = static_cast<std::size_t>(
+      std::find(names.begin(), names.end(), name) - names.begin());
+
+  const std::vector<Interval> pointRanges = enclosure.bindVariables(bindings);
+  // False when the expression provably has no zero on [lo, hi], including
+  // when it is undefined on the whole range. `ranges` is scratch space
+  // holding pointRanges.
+  auto mayVanish = [&](std::vector<Interval> &ranges, double lo, double hi) {
+    if (slot < ranges.size()) {
+      ranges[slot] = {lo, hi};
+    }
+    IntervalResult result = enclosure.tryEvaluateSlots(ranges.data());
+    return result.ok() && result.bounds.contains(0.0);
+  };
+
+  // Segments of the scan whose enclosure excludes zero are dropped before
+  // any refinement. A sign change brackets a crossing; a segment that
+  // keeps its sign yet may vanish can hold a root where the curve only
+  // touches zero, as (x - 1)^2 does at 1, which shows up as a sign change
+  // of the derivative instead.
+  std::vector<double> roots;
+  std::vector<Bracket> brackets;
+  std::vector<Bracket> touching;
+  std::vector<Interval> ranges = pointRanges;
+  for (std::size_t idx = 0; idx < scan.xs.size(); ++idx) {
+    if (scan.ys[idx] == 0.0) {
+      roots.push_back(scan.xs[idx]);
+      continue;
+    }
+    if (idx + 1 == scan.xs.size() || !std::isfinite(scan.ys[idx]) ||
+        !std::isfinite(scan.ys[idx + 1]) || scan.ys[idx + 1] == 0.0 ||
+        !mayVanish(ranges, scan.xs[idx], scan.xs[idx + 1])) {
+      continue;
+    }
+    Bracket bracket{scan.xs[idx], scan.xs[idx + 1], scan.ys[idx],
+                    scan.ys[idx + 1]};
+    if ((scan.ys[idx] < 0.0) != (scan.ys[idx + 1] < 0.0)) {
+      brackets.push_back(bracket);
+    } else {
+      touching.push_back(bracket);
+    }
+  }
+
+  std::vector<double> refined(brackets.size() + touching.size());
+  parallelFor(refined.size(), [&](std::size_t idx) {
+    std::vector<double> slots = bound;
+    auto f = [&](double x) {
+      if (slot < slots.size()) {
+        slots[slot] = x;
+      }
+      EvalResult result = compiled.tryEvaluateSlots(slots.data());
+      return result.ok() ? result.value
+                         : std::numeric_limits<double>::quiet_NaN();
+    };
+    std::vector<double> dualSlots = bound;
+    GradientResult gradient;
+    auto fdf = [&](double x, double &value, double &slope) {
+      if (slot < dualSlots.size()) {
+        dualSlots[slot] = x;
+      }
+      if (!derivative.tryEvaluateSlots(dualSlots.data(), gradient).ok()) {
+        return false;
+      }
+      value = gradient.value;
+      slope = gradient.gradient[0];
+      return true;
+    };
+
+    if (idx >= brackets.size()) {
+      std::vector<Interval> localRanges = pointRanges;
+      refined[idx] = touchingRoot(
+          f, fdf,
+          [&](double lo, double hi) {
+            return mayVanish(localRanges, lo, hi);
+          },
+          touching[idx - brackets.size()]);
+      return;
+    }
+    const Bracket &bracket = brackets[idx];
+    double root = 0.0;
+    if (!newton(fdf, bracket, root)) {
+      root = brent(f, bracket);
+    }
+    // A sign change across a pole, as in 1/x, converges onto the pole; keep
+    // only points where |f| dropped below its value at both ends.
+    double residual = f(root);
+    if (!(std::fabs(residual) <=
+          std::min(std::fabs(bracket.flo), std::fabs(bracket.fhi)))) {
+      root = std::numeric_limits<double>::quiet_NaN();
+    }
+    refined[idx] = root;
+  });
+  for (double root : refined) {
+    if (!std::isnan(root)) {
+      roots.push_back(root);
+    }
+  }
+  std::sort(roots.begin(), roots.end());
+  roots.erase(std::unique(roots.begin(), roots.end(),
+                          [](double lhs, double rhs) {
+                            return rhs - lhs <= 4.0 * Epsilon *
+                                                    std::max(std::fabs(lhs),
+                                                             std::fabs(rhs));
+                          }),
+              roots.end());
+  return roots;
+}
@@ -1,6 +1,7 @@
 #include "expression_internal.hpp"
 
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 namespace {
@@ -8,7 +9,7 @@ int precedence(char op) {
   if (op == '+' || op == '-') {
     return 1;
   }
-  if (op == '*' || op == '/') {
+  if (op == '*' || op == '/' || op == '%') {
     return 2;
   }
   if (op == '^') {
@@ -23,12 +24,24 @@ int precedence(char op) {
 bool isRightAssociative(char op) {
   return op == '^';
 }
+
+void checkArity(const expression_detail::Token &function,
+                std::size_t arguments) {
+  std::size_t arity = expression_detail::functionArity(function.function);
+  if (arguments != arity) {
+    throw std::invalid_argument(
+        "Function '" + std::string(function.text) + "' expects " +
+        std::to_string(arity) + (arity == 1 ? " argument." : " arguments."));
+  }
+}
 } // namespace
 
 namespace expression_detail {
 std::vector<Token> toRpn(const std::vector<Token> &tokens) {
   std::vector<Token> output;
   std::vector<Token> stack;
+  // Commas seen so far inside each open parenthesis.
+  std::vector<std::size_t> commas;
 
   for (const Token &token : tokens) {
     switch (token.type) {
@@ -58,142 +71,42 @@ std::vector<Token> toRpn(const std::vector<Token> &tokens) {
       break;
     case Token::Type::LeftParen:
       stack.push_back(token);
+      commas.push_back(0);
       break;
-    case Token::Type::RightParen:
+    case Token::Type::Comma:
       while (!stack.empty() && stack.back().type != Token::Type::LeftParen) {
         output.push_back(stack.back());
         stack.pop_back();
       }
-      if (stack.empty() || stack.back().type != Token::Type::LeftParen) {
-        throw std::invalid_argument("Mismatched parentheses in expression.");
-      }
-      stack.pop_back();
-      if (!stack.empty() && stack.back().type == Token::Type::Function) {
-        output.push_back(stack.back());
-        stack.pop_back();
-      }
-      break;
-    }
-  }
-
-  while (!stack.empty()) {
-    if (stack.back().type == Token::Type::LeftParen ||
-        stack.back().type == Token::Type::RightParen) {
-      throw std::invalid_argument("Mismatched parentheses in expression.");
-    }
-    output.push_back(stack.back());
-    stack.pop_back();
-  }
-
-  return output;
-}
-
-std::vector<BigToken> toRpnBigInt(const std::vector<BigToken> &tokens) {
-  std::vector<BigToken> output;
-  std::vector<BigToken> stack;
-
-  for (const BigToken &token : tokens) {
-    switch (token.type) {
-    case BigToken::Type::Number:
-      output.push_back(token);
-      break;
-    case BigToken::Type::Variable:
-      output.push_back(token);
-      break;
-    case BigToken::Type::Operator:
-      while (!stack.empty() && stack.back().type == BigToken::Type::Operator &&
-             precedence(stack.back().op) >= precedence(token.op)) {
-        output.push_back(stack.back());
-        stack.pop_back();
-      }
-      stack.push_back(token);
-      break;
-    case BigToken::Type::LeftParen:
-      stack.push_back(token);
-      break;
-    case BigToken::Type::RightParen:
-      while (!stack.empty() &&
-             stack.back().type != BigToken::Type::LeftParen) {
-        output.push_back(stack.back());
-        stack.pop_back();
-      }
-      if (stack.empty() || stack.back().type != BigToken::Type::LeftParen) {
-        throw std::invalid_argument("Mismatched parentheses in expression.");
-      }
-      stack.pop_back();
-      break;
-    }
-  }
-
-  while (!stack.empty()) {
-    if (stack.back().type == BigToken::Type::LeftParen ||
-        stack.back().type == BigToken::Type::RightParen) {
-      throw std::invalid_argument("Mismatched parentheses in expression.");
-    }
-    output.push_back(stack.back());
-    stack.pop_back();
-  }
-
-  return output;
-}
-
-std::vector<BigFloatToken>
-toRpnBigDouble(const std::vector<BigFloatToken> &tokens) {
-  std::vector<BigFloatToken> output;
-  std::vector<BigFloatToken> stack;
-
-  for (const BigFloatToken &token : tokens) {
-    switch (token.type) {
-    case BigFloatToken::Type::Number:
-      output.push_back(token);
-      break;
-    case BigFloatToken::Type::Variable:
-      output.push_back(token);
-      break;
-    case BigFloatToken::Type::Function:
-      stack.push_back(token);
-      break;
-    case BigFloatToken::Type::Operator:
-      while (!stack.empty() &&
-             stack.back().type == BigFloatToken::Type::Operator) {
-        int stackPrecedence = precedence(stack.back().op);
-        int tokenPrecedence = precedence(token.op);
-        bool shouldPop = isRightAssociative(token.op)
-                             ? stackPrecedence > tokenPrecedence
-                             : stackPrecedence >= tokenPrecedence;
-        if (!shouldPop) {
-          break;
-        }
-        output.push_back(stack.back());
-        stack.pop_back();
+      if (stack.size() < 2 ||
+          stack[stack.size() - 2].type != Token::Type::Function) {
+        throw std::invalid_argument(
+            "Unexpected ',' outside a function call.");
       }
-      stack.push_back(token);
+      ++commas.back();
       break;
-    case BigFloatToken::Type::LeftParen:
-      stack.push_back(token);
-      break;
-    case BigFloatToken::Type::RightParen:
-      while (!stack.empty() &&
-             stack.back().type != BigFloatToken::Type::LeftParen) {
+    case Token::Type::RightParen:
+      while (!stack.empty() && stack.back().type != Token::Type::LeftParen) {
         output.push_back(stack.back());
         stack.pop_back();
       }
-      if (stack.empty() ||
-          stack.back().type != BigFloatToken::Type::LeftParen) {
+      if (stack.empty() || stack.back().type != Token::Type::LeftParen) {
         throw std::invalid_argument("Mismatched parentheses in expression.");
       }
       stack.pop_back();
-      if (!stack.empty() && stack.back().type == BigFloatToken::Type::Function) {
+      if (!stack.empty() && stack.back().type == Token::Type::Function) {
+        checkArity(stack.back(), commas.back() + 1);
         output.push_back(stack.back());
         stack.pop_back();
       }
+      commas.pop_back();
       break;
     }
   }
 
   while (!stack.empty()) {
-    if (stack.back().type == BigFloatToken::Type::LeftParen ||
-        stack.back().type == BigFloatToken::Type::RightParen) {
+    if (stack.back().type == Token::Type::LeftParen ||
+        stack.back().type == Token::Type::RightParen) {
       throw std::invalid_argument("Mismatched parentheses in expression.");
     }
     output.push_back(stack.back());
@@ -0,0 +1,204 @@
+#include "expression.hpp"
+#include "expression_internal.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+// A segment is bisected while its midpoint strays further than this
+// fraction of the value range from the chord, about half a pixel on the
+// rendered plot.
+constexpr double BendTolerance = 1.0 / 1024.0;
+// Each round bisects a segment at most once, so this bounds how far below
+// the initial spacing the refinement can go.
+constexpr int MaxRefinementRounds = 10;
+// Refinement stops adding points beyond this multiple of the initial count.
+constexpr std::size_t MaxRefinementFactor = 16;
+
+// Evaluates `compiled` at every entry of `xs` in one batch. Failing samples
+// become NaN; if every sample of the initial batch fails the first error is
+// thrown.
+class SampleEvaluator {
+public:
+  SampleEvaluator(const CompiledExpression &compiled, std::size_t slot,
+                  const std::vector<double> &bound)
+      : compiled_(compiled), slot_(slot) {
+    columns_.reserve(bound.size());
+    for (double value : bound) {
+      columns_.push_back({value});
+    }
+  }
+
+  std::vector<double> operator()(const std::vector<double> &xs) {
+    if (slot_ < columns_.size()) {
+      columns_[slot_] = xs;
+    }
+    std::vector<EvalResult> results =
+        compiled_.tryEvaluateColumns(columns_, xs.size());
+    std::vector<double> ys(xs.size());
+    const EvalResult *firstError = nullptr;
+    bool anyOk = false;
+    for (std::size_t idx = 0; idx < results.size(); ++idx) {
+      if (results[idx].ok()) {
+        ys[idx] = results[idx].value;
+        anyOk = true;
+      } else {
+        ys[idx] = std::numeric_limits<double>::quiet_NaN();
+        if (firstError == nullptr) {
+          firstError = &results[idx];
+        }
+      }
+    }
+    if (!anyOk && firstError != nullptr && !refining_) {
+      throwEvalError(*firstError);
+    }
+    return ys;
+  }
+
+  void startRefining() {
+    refining_ = true;
+  }
+
+private:
+  const CompiledExpression &compiled_;
+  std::size_t slot_;
+  std::vector<std::vector<double>> columns_;
+  bool refining_ = false;
+};
+
+double finiteRange(const std::vector<double> &ys) {
+  double lo = std::numeric_limits<double>::infinity();
+  double hi = -std::numeric_limits<double>::infinity();
+  for (double y : ys) {
+    if (std::isfinite(y)) {
+      lo = std::min(lo, y);
+      hi = std::max(hi, y);
+    }
+  }
+  double range = hi - lo;
+  return std::isfinite(range) && range > 0.0 ? range : 1.0;
+}
+
+// How far ys[idx] lies from the chord through its neighbours.
+double bend(const std::vector<double> &xs, const std::vector<double> &ys,
+            std::size_t idx) {
+  double t = (xs[idx] - xs[idx - 1]) / (xs[idx + 1] - xs[idx - 1]);
+  double chord = ys[idx - 1] + t * (ys[idx + 1] - ys[idx - 1]);
+  return std::fabs(ys[idx] - chord);
+}
+} // namespace
+
+SampledCurve sampleExpression(const std::string &expression,
+                              const std::string &variable, double from,
+                              double to, std::size_t samples,
+                              const std::map<std::string, double> &variables) {
+  if (!std::isfinite(from) || !std::isfinite(to) || !(from < to)) {
+    throw std::invalid_argument(
+        "The sampling range must be finite with its start below its end.");
+  }
+  if (samples < 2 || samples > MaxPlotSamples) {
+    throw std::invalid_argument("The sample count must be between 2 and " +
+                                std::to_string(MaxPlotSamples) + ".");
+  }
+  const std::string name = expression_detail::normalizeIdentifier(variable);
+
+  CompiledExpression compiled(expression);
+  const std::vector<std::string> &names = compiled.variableNames();
+  std::size_t slot = static_cast<std::size_t>(
+      std::find(names.begin(), names.end(), name) - names.begin());
+  std::map<std::string, double> bindings = variables;
+  bindings[name] = from;
+  SampleEvaluator evaluate(compiled, slot, compiled.bindVariables(bindings));
+
+  // Variables share slot numbers across modes, so `slot` also indexes the
+  // interval ranges.
+  IntervalExpression enclosure(expression);
+  std::vector<Interval> ranges = enclosure.bindVariables(bindings);
+  auto bounds = [&](double lo, double hi) {
+    if (slot < ranges.size()) {
+      ranges[slot] = {lo, hi};
+    }
+    return enclosure.tryEvaluateSlots(ranges.data());
+  };
+
+  SampledCurve curve;
+  curve.xs.resize(samples);
+  const double step = (to - from) / static_cast<double>(samples - 1);
+  for (std::size_t idx = 0; idx < samples; ++idx) {
+    curve.xs[idx] = from + step * static_cast<double>(idx);
+  }
+  curve.xs.back() = to;
+  curve.ys = evaluate(curve.xs);
+  evaluate.startRefining();
+
+  // Each round collects every segment that needs bisecting, evaluates all
+  // their midpoints as one batch and merges them in. A segment is split
+  // when a neighbouring sample bends away from its chord, or when exactly
+  // one of its ends is undefined, to find where the function stops.
+  const std::size_t limit = samples * MaxRefinementFactor;
+  for (int round = 0; round < MaxRefinementRounds; ++round) {
+    const std::size_t count = curve.xs.size();
+    const double tolerance = finiteRange(curve.ys) * BendTolerance;
+    std::vector<bool> split(count - 1, false);
+    for (std::size_t idx = 0; idx + 1 < count; ++idx) {
+      if (std::isfinite(curve.ys[idx]) != std::isfinite(curve.ys[idx + 1])) {
+        split[idx] = true;
+      }
+    }
+    std::vector<bool> bends(count - 1, false);
+    for (std::size_t idx = 1; idx + 1 < count; ++idx) {
+      if (std::isfinite(curve.ys[idx - 1]) && std::isfinite(curve.ys[idx]) &&
+          std::isfinite(curve.ys[idx + 1]) &&
+          bend(curve.xs, curve.ys, idx) > tolerance) {
+        bends[idx - 1] = true;
+        bends[idx] = true;
+      }
+    }
+    // Both the curve and the chord across a segment lie within the
+    // interval enclosure of the curve over it, so when the enclosure is no
+    // wider than the tolerance no visible bend can hide inside and the
+    // segment is left alone.
+    for (std::size_t idx = 0; idx + 1 < count; ++idx) {
+      if (bends[idx] && !split[idx]) {
+        IntervalResult enclosed = bounds(curve.xs[idx], curve.xs[idx + 1]);
+        split[idx] = !enclosed.ok() ||
+                     !(enclosed.bounds.hi - enclosed.bounds.lo <= tolerance);
+      }
+    }
+
+    std::vector<double> midpoints;
+    for (std::size_t idx = 0; idx + 1 < count; ++idx) {
+      double mid = curve.xs[idx] + (curve.xs[idx + 1] - curve.xs[idx]) / 2.0;
+      if (split[idx] && mid > curve.xs[idx] && mid < curve.xs[idx + 1]) {
+        midpoints.push_back(mid);
+      }
+    }
+    if (midpoints.empty() || count + midpoints.size() > limit) {
+      break;
+    }
+    std::vector<double> values = evaluate(midpoints);
+
+    SampledCurve merged;
+    merged.xs.reserve(count + midpoints.size());
+    merged.ys.reserve(count + midpoints.size());
+    std::size_t next = 0;
+    for (std::size_t idx = 0; idx < count; ++idx) {
+      merged.xs.push_back(curve.xs[idx]);
+      merged.ys.push_back(curve.ys[idx]);
+      if (next < midpoints.size() && idx + 1 < count &&
+          midpoints[next] < curve.xs[idx + 1]) {
+        merged.xs.push_back(midpoints[next]);
+        merged.ys.push_back(values[next]);
+        ++next;
+      }
+    }
+    curve = std::move(merged);
+  }
+  return curve;
+}
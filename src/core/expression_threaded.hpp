@@ -0,0 +1,357 @@
+#pragma once
+
+#include "expression_engine.hpp"
+#include "expression_program.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The threaded evaluation engine. A postfix program is lowered once into an
+// array of steps, each holding a pointer to a handler specialized for its
+// operation. A handler does its work and then tail-calls the handler of the
+// next step, so control flows from operation to operation without going
+// back through a central opcode switch, and the top of the stack travels in
+// a register instead of memory. A constant or variable followed directly by
+// a binary operator is fused into one step that reads the operand inline.
+namespace expression_detail {
+template <typename Value> struct ThreadedStep;
+
+template <typename Value> struct ThreadedContext {
+  const Value *slots = nullptr;
+  EvalStatus status;
+  const ThreadedStep<Value> *failed = nullptr; // step that set status
+};
+
+template <typename Value> struct ThreadedStep {
+  // Takes the current top of stack and a pointer one past the values below
+  // it; returns the program's result.
+  using Handler = Value (*)(const ThreadedStep *step, Value top, Value *stack,
+                            ThreadedContext<Value> &context);
+
+  Handler run = nullptr;
+  Value constant{};
+  std::uint32_t operand = 0; // variable slot or function id
+  std::uint32_t position = 0;
+};
+
+// Without tail-call optimization (unoptimized builds) every step nests a
+// native stack frame, so longer programs stay on the interpreter.
+constexpr std::size_t MaxThreadedSteps = 4096;
+
+template <typename Value> class ThreadedProgram {
+public:
+  // Returns false, leaving the program empty, if it would need more than
+  // MaxThreadedSteps steps.
+  template <typename Traits> bool lower(const Program<Value> &program);
+
+  // `stack` must hold stackSize() values.
+  Value run(Value *stack, ThreadedContext<Value> &context) const {
+    return steps_.front().run(steps_.data(), Value{}, stack, context);
+  }
+
+  std::size_t stackSize() const {
+    return stackSize_;
+  }
+
+private:
+  std::vector<ThreadedStep<Value>> steps_;
+  std::size_t stackSize_ = 0;
+};
+
+namespace threaded {
+// Where a binary operator finds its right-hand operand.
+enum class RhsKind : std::uint8_t { Stack, Constant, Slot };
+
+struct FromConstant {
+  template <typename Value>
+  static Value get(const ThreadedStep<Value> &step,
+                   const ThreadedContext<Value> &) {
+    return step.constant;
+  }
+};
+
+struct FromSlot {
+  template <typename Value>
+  static Value get(const ThreadedStep<Value> &step,
+                   const ThreadedContext<Value> &context) {
+    return context.slots[step.operand];
+  }
+};
+
+template <typename Traits> struct AddOp {
+  static constexpr bool Fallible = Traits::FallibleArithmetic;
+  using Value = typename Traits::Value;
+  static Value apply(const Value &lhs, const Value &rhs, EvalStatus &status) {
+    return Traits::add(lhs, rhs, status);
+  }
+};
+
+template <typename Traits> struct SubtractOp {
+  static constexpr bool Fallible = Traits::FallibleArithmetic;
+  using Value = typename Traits::Value;
+  static Value apply(const Value &lhs, const Value &rhs, EvalStatus &status) {
+    return Traits::subtract(lhs, rhs, status);
+  }
+};
+
+template <typename Traits> struct MultiplyOp {
+  static constexpr bool Fallible = Traits::FallibleArithmetic;
+  using Value = typename Traits::Value;
+  static Value apply(const Value &lhs, const Value &rhs, EvalStatus &status) {
+    return Traits::multiply(lhs, rhs, status);
+  }
+};
+
+template <typename Traits> struct DivideOp {
+  static constexpr bool Fallible = true;
+  using Value = typename Traits::Value;
+  static Value apply(const Value &lhs, const Value &rhs, EvalStatus &status) {
+    return Traits::divide(lhs, rhs, status);
+  }
+};
+
+template <typename Traits> struct ModuloOp {
+  static constexpr bool Fallible = true;
+  using Value = typename Traits::Value;
+  static Value apply(const Value &lhs, const Value &rhs, EvalStatus &status) {
+    return Traits::modulo(lhs, rhs, status);
+  }
+};
+
+template <typename Traits> struct PowerOp {
+  static constexpr bool Fallible = true;
+  using Value = typename Traits::Value;
+  static Value apply(const Value &lhs, const Value &rhs, EvalStatus &status) {
+    return Traits::power(lhs, rhs, status);
+  }
+};
+
+template <typename Traits> struct SquareOp {
+  static constexpr bool Fallible = Traits::FallibleArithmetic;
+  using Value = typename Traits::Value;
+  static Value apply(const ThreadedStep<Value> &, const Value &value,
+                     EvalStatus &status) {
+    return Traits::square(value, status);
+  }
+};
+
+template <typename Traits> struct FactorialOp {
+  static constexpr bool Fallible = true;
+  using Value = typename Traits::Value;
+  static Value apply(const ThreadedStep<Value> &, const Value &value,
+                     EvalStatus &status) {
+    return Traits::factorial(value, status);
+  }
+};
+
+template <typename Traits> struct FunctionOp {
+  static constexpr bool Fallible = true;
+  using Value = typename Traits::Value;
+  static Value apply(const ThreadedStep<Value> &step, const Value &value,
+                     EvalStatus &status) {
+    return Traits::function(static_cast<FunctionId>(step.operand), value,
+                            status);
+  }
+};
+
+template <typename Value>
+Value runHalt(const ThreadedStep<Value> *, Value top, Value *,
+              ThreadedContext<Value> &) {
+  return top;
+}
+
+// Pushes a constant or variable.
+template <typename Operand, typename Value>
+Value runPush(const ThreadedStep<Value> *step, Value top, Value *stack,
+              ThreadedContext<Value> &context) {
+  *stack = top;
+  return step[1].run(step + 1, Operand::get(*step, context), stack + 1,
+                     context);
+}
+
+// Applies a binary operator to the two topmost values.
+template <typename Op>
+typename Op::Value runBinary(const ThreadedStep<typename Op::Value> *step,
+                             typename Op::Value top,
+                             typename Op::Value *stack,
+                             ThreadedContext<typename Op::Value> &context) {
+  --stack;
+  typename Op::Value value = Op::apply(*stack, top, context.status);
+  if constexpr (Op::Fallible) {
+    if (context.status.code != EvalErrorCode::None) {
+      context.failed = step;
+      return value;
+    }
+  }
+  return step[1].run(step + 1, value, stack, context);
+}
+
+// powmod: the base and exponent are the two values below the top.
+template <typename Traits>
+typename Traits::Value
+runPowerMod(const ThreadedStep<typename Traits::Value> *step,
+            typename Traits::Value top, typename Traits::Value *stack,
+            ThreadedContext<typename Traits::Value> &context) {
+  stack -= 2;
+  typename Traits::Value value =
+      Traits::powerMod(stack[0], stack[1], top, context.status);
+  if (context.status.code != EvalErrorCode::None) {
+    context.failed = step;
+    return value;
+  }
+  return step[1].run(step + 1, value, stack, context);
+}
+
+// Pushes a constant or variable and immediately applies a binary operator
+// to it and the previous top of stack.
+template <typename Op, typename Operand>
+typename Op::Value runFused(const ThreadedStep<typename Op::Value> *step,
+                            typename Op::Value top, typename Op::Value *stack,
+                            ThreadedContext<typename Op::Value> &context) {
+  typename Op::Value value =
+      Op::apply(top, Operand::get(*step, context), context.status);
+  if constexpr (Op::Fallible) {
+    if (context.status.code != EvalErrorCode::None) {
+      context.failed = step;
+      return value;
+    }
+  }
+  return step[1].run(step + 1, value, stack, context);
+}
+
+template <typename Op>
+typename Op::Value runUnary(const ThreadedStep<typename Op::Value> *step,
+                            typename Op::Value top, typename Op::Value *stack,
+                            ThreadedContext<typename Op::Value> &context) {
+  typename Op::Value value = Op::apply(*step, top, context.status);
+  if constexpr (Op::Fallible) {
+    if (context.status.code != EvalErrorCode::None) {
+      context.failed = step;
+      return value;
+    }
+  }
+  return step[1].run(step + 1, value, stack, context);
+}
+
+// Handlers for one binary operator: standalone, and fused with a constant
+// or a variable right-hand operand.
+template <typename Op> struct BinaryHandlers {
+  using Handler = typename ThreadedStep<typename Op::Value>::Handler;
+  static constexpr Handler Standalone = &runBinary<Op>;
+  static constexpr Handler WithConstant = &runFused<Op, FromConstant>;
+  static constexpr Handler WithSlot = &runFused<Op, FromSlot>;
+};
+
+inline bool isBinary(OpCode op) {
+  return op == OpCode::Add || op == OpCode::Subtract ||
+         op == OpCode::Multiply || op == OpCode::Divide ||
+         op == OpCode::Modulo || op == OpCode::Power;
+}
+
+template <typename Traits>
+typename ThreadedStep<typename Traits::Value>::Handler
+binaryHandler(OpCode op, RhsKind rhs) {
+  auto pick = [rhs](auto handlers) {
+    using Handlers = decltype(handlers);
+    switch (rhs) {
+    case RhsKind::Constant:
+      return Handlers::WithConstant;
+    case RhsKind::Slot:
+      return Handlers::WithSlot;
+    case RhsKind::Stack:
+      break;
+    }
+    return Handlers::Standalone;
+  };
+  switch (op) {
+  case OpCode::Add:
+    return pick(BinaryHandlers<AddOp<Traits>>{});
+  case OpCode::Subtract:
+    return pick(BinaryHandlers<SubtractOp<Traits>>{});
+  case OpCode::Multiply:
+    return pick(BinaryHandlers<MultiplyOp<Traits>>{});
+  case OpCode::Divide:
+    return pick(BinaryHandlers<DivideOp<Traits>>{});
+  case OpCode::Modulo:
+    return pick(BinaryHandlers<ModuloOp<Traits>>{});
+  default:
+    return pick(BinaryHandlers<PowerOp<Traits>>{});
+  }
+}
+} // namespace threaded
+
+template <typename Value>
+template <typename Traits>
+bool ThreadedProgram<Value>::lower(const Program<Value> &program) {
+  steps_.clear();
+  stackSize_ = 0;
+  std::vector<ThreadedStep<Value>> steps;
+  steps.reserve(program.code.size() + 1);
+
+  for (std::size_t idx = 0; idx < program.code.size(); ++idx) {
+    const Instruction &instruction = program.code[idx];
+    ThreadedStep<Value> step;
+    step.operand = instruction.operand;
+    step.position = instruction.position;
+    if (instruction.op == OpCode::Constant) {
+      step.constant = program.constants[instruction.operand];
+    }
+
+    switch (instruction.op) {
+    case OpCode::Constant:
+    case OpCode::Variable:
+      if (idx + 1 < program.code.size() &&
+          threaded::isBinary(program.code[idx + 1].op)) {
+        // Errors from the operator are reported at the operator.
+        step.position = program.code[idx + 1].position;
+        step.run = threaded::binaryHandler<Traits>(
+            program.code[idx + 1].op, instruction.op == OpCode::Constant
+                                          ? threaded::RhsKind::Constant
+                                          : threaded::RhsKind::Slot);
+        ++idx;
+      } else if (instruction.op == OpCode::Constant) {
+        step.run = &threaded::runPush<threaded::FromConstant, Value>;
+      } else {
+        step.run = &threaded::runPush<threaded::FromSlot, Value>;
+      }
+      break;
+    case OpCode::Add:
+    case OpCode::Subtract:
+    case OpCode::Multiply:
+    case OpCode::Divide:
+    case OpCode::Modulo:
+    case OpCode::Power:
+      step.run = threaded::binaryHandler<Traits>(instruction.op,
+                                                 threaded::RhsKind::Stack);
+      break;
+    case OpCode::PowMod:
+      step.run = &threaded::runPowerMod<Traits>;
+      break;
+    case OpCode::Square:
+      step.run = &threaded::runUnary<threaded::SquareOp<Traits>>;
+      break;
+    case OpCode::Factorial:
+      step.run = &threaded::runUnary<threaded::FactorialOp<Traits>>;
+      break;
+    case OpCode::Function:
+      step.run = &threaded::runUnary<threaded::FunctionOp<Traits>>;
+      break;
+    }
+    steps.push_back(step);
+  }
+
+  if (steps.size() >= MaxThreadedSteps) {
+    return false;
+  }
+  ThreadedStep<Value> halt;
+  halt.run = &threaded::runHalt<Value>;
+  steps.push_back(halt);
+
+  steps_ = std::move(steps);
+  // The first push spills the initial, meaningless top of stack.
+  stackSize_ = program.maxDepth + 1;
+  return true;
+}
+} // namespace expression_detail
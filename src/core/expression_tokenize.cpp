@@ -1,16 +1,16 @@
 #include "expression_internal.hpp"
 
-#include <algorithm>
 #include <cctype>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace {
 bool isOperatorChar(char ch) {
   ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
   return ch == '+' || ch == '-' || ch == '*' || ch == 'x' || ch == ':' ||
-         ch == '/' || ch == '^';
+         ch == '/' || ch == '^' || ch == '%';
 }
 
 char normalizeOperator(char ch) {
@@ -24,7 +24,9 @@ char normalizeOperator(char ch) {
   return ch;
 }
 
-double parseNumberToken(const std::string &expr, std::size_t &index) {
+// Scans a decimal literal starting at `index` and returns it as a view into
+// `expr`, leaving `index` one past its end.
+std::string_view scanDecimalToken(std::string_view expr, std::size_t &index) {
   std::size_t start = index;
   bool hasDigit = false;
   bool hasDot = false;
@@ -47,194 +49,124 @@ double parseNumberToken(const std::string &expr, std::size_t &index) {
   if (!hasDigit) {
     throw std::invalid_argument("Expected a digit in the number.");
   }
-  return std::stod(expr.substr(start, index - start));
+  return expr.substr(start, index - start);
 }
 
-std::string parseDecimalToken(const std::string &expr, std::size_t &index) {
+std::string_view parseIntegerToken(std::string_view expr, std::size_t &index) {
   std::size_t start = index;
   bool hasDigit = false;
-  bool hasDot = false;
   while (index < expr.size()) {
     char c = expr[index];
     if (std::isdigit(static_cast<unsigned char>(c))) {
       hasDigit = true;
       ++index;
-    } else if (c == '.') {
-      if (hasDot) {
-        throw std::invalid_argument(
-            "Multiple decimal separators found in number.");
-      }
-      hasDot = true;
-      ++index;
     } else {
       break;
     }
   }
   if (!hasDigit) {
-    throw std::invalid_argument("Expected a digit in the number.");
+    throw std::invalid_argument("Expected a digit in the integer.");
+  }
+  if (index < expr.size() && expr[index] == '.') {
+    throw std::invalid_argument(
+        "Bigint mode does not support decimal numbers.");
   }
   return expr.substr(start, index - start);
 }
 
-std::string parseIntegerToken(const std::string &expr, std::size_t &index) {
+std::string_view scanIdentifier(std::string_view expr, std::size_t &index) {
   std::size_t start = index;
-  bool hasDigit = false;
-  while (index < expr.size()) {
-    char c = expr[index];
-    if (std::isdigit(static_cast<unsigned char>(c))) {
-      hasDigit = true;
-      ++index;
-    } else {
-      break;
-    }
-  }
-  if (!hasDigit) {
-    throw std::invalid_argument("Expected a digit in the integer.");
+  ++index;
+  while (index < expr.size() &&
+         (std::isalnum(static_cast<unsigned char>(expr[index])) ||
+          expr[index] == '_')) {
+    ++index;
   }
   return expr.substr(start, index - start);
 }
-} // namespace
-
-namespace expression_detail {
-std::vector<Token> tokenizeExpression(const std::string &expression) {
-  std::vector<Token> tokens;
-  std::size_t i = 0;
-  bool expectValue = true;
-
-  while (i < expression.size()) {
-    char c = expression[i];
-    if (std::isspace(static_cast<unsigned char>(c))) {
-      ++i;
-      continue;
-    }
-
-    if (expectValue) {
-      if (c == '(') {
-        tokens.push_back({Token::Type::LeftParen, 0.0, 0, ""});
-        ++i;
-        continue;
-      }
 
-      int sign = 1;
-      bool sawUnarySign = false;
-      if (c == '+' || c == '-') {
-        sawUnarySign = true;
-        sign = (c == '-') ? -1 : 1;
-        ++i;
-        while (i < expression.size() &&
-               std::isspace(static_cast<unsigned char>(expression[i]))) {
-          ++i;
-        }
-        if (i >= expression.size()) {
-          throw std::invalid_argument(
-              "Expression cannot end with a unary operator.");
-        }
-        c = expression[i];
-        if (c == '(') {
-          if (sign == -1) {
-            tokens.push_back({Token::Type::Number, 0.0, 0, ""});
-            tokens.push_back({Token::Type::Operator, 0.0, '-', ""});
-          }
-          expectValue = true;
-          continue;
-        }
-      } else {
-        sign = 1;
-      }
-
-      if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
-        double number = parseNumberToken(expression, i);
-        tokens.push_back({Token::Type::Number, sign * number, 0, ""});
-        expectValue = false;
-        continue;
-      }
-
-      if (std::isalpha(static_cast<unsigned char>(c))) {
-        std::size_t start = i;
-        ++i;
-        while (i < expression.size() &&
-               (std::isalnum(static_cast<unsigned char>(expression[i])) ||
-                expression[i] == '_')) {
-          ++i;
-        }
-        std::string identifier = expression.substr(start, i - start);
-        std::string lowered = identifier;
-        std::transform(lowered.begin(), lowered.end(), lowered.begin(),
-                       [](unsigned char ch) {
-                         return static_cast<char>(std::tolower(ch));
-                       });
-
-        if (lowered == "sin" || lowered == "cos" || lowered == "log" ||
-            lowered == "tan" || lowered == "sqrt" || lowered == "exp" ||
-            lowered == "cot" || lowered == "asin" || lowered == "acos" ||
-            lowered == "atan" || lowered == "sinh") {
-          if (sawUnarySign && sign == -1) {
-            tokens.push_back({Token::Type::Number, 0.0, 0, ""});
-            tokens.push_back({Token::Type::Operator, 0.0, '-', ""});
-          }
-          tokens.push_back({Token::Type::Function, 0.0, 0, lowered});
-
-          std::size_t lookahead = i;
-          while (
-              lookahead < expression.size() &&
-              std::isspace(static_cast<unsigned char>(expression[lookahead]))) {
-            ++lookahead;
-          }
-          if (lookahead >= expression.size() || expression[lookahead] != '(') {
-            throw std::invalid_argument("Function '" + identifier +
-                                        "' must be followed by parentheses.");
-          }
-          i = lookahead;
-          continue;
-        }
-
-        if (sawUnarySign && sign == -1) {
-          tokens.push_back({Token::Type::Number, 0.0, 0, ""});
-          tokens.push_back({Token::Type::Operator, 0.0, '-', ""});
-        }
-        tokens.push_back({Token::Type::Variable, 0.0, 0, lowered});
-        expectValue = false;
-        continue;
-      }
-
-      throw std::invalid_argument(
-          "Expected a number or '(' in the expression.");
-    } else {
-      if (c == ')') {
-        tokens.push_back({Token::Type::RightParen, 0.0, 0, ""});
-        ++i;
-        continue;
-      }
+char lowerChar(char ch) {
+  return static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+}
 
-      if (c == '!') {
-        tokens.push_back({Token::Type::Operator, 0.0, '!', ""});
-        ++i;
-        continue;
-      }
+struct FunctionEntry {
+  const char *name;
+  expression_detail::FunctionId id;
+  std::size_t arity;
+  bool integer; // available in bigint mode
+};
+
+// Ordered by FunctionId.
+constexpr FunctionEntry FunctionTable[] = {
+    {"sin", expression_detail::FunctionId::Sin, 1, false},
+    {"cos", expression_detail::FunctionId::Cos, 1, false},
+    {"tan", expression_detail::FunctionId::Tan, 1, false},
+    {"cot", expression_detail::FunctionId::Cot, 1, false},
+    {"asin", expression_detail::FunctionId::Asin, 1, false},
+    {"acos", expression_detail::FunctionId::Acos, 1, false},
+    {"atan", expression_detail::FunctionId::Atan, 1, false},
+    {"sinh", expression_detail::FunctionId::Sinh, 1, false},
+    {"log", expression_detail::FunctionId::Log, 1, false},
+    {"exp", expression_detail::FunctionId::Exp, 1, false},
+    {"sqrt", expression_detail::FunctionId::Sqrt, 1, false},
+    {"powmod", expression_detail::FunctionId::PowMod, 3, true},
+};
+
+const FunctionEntry &functionEntry(expression_detail::FunctionId id) {
+  return FunctionTable[static_cast<std::size_t>(id)];
+}
 
-      if (isOperatorChar(c)) {
-        tokens.push_back(
-            {Token::Type::Operator, 0.0, normalizeOperator(c), ""});
-        ++i;
-        expectValue = true;
-        continue;
-      }
+bool equalsIgnoringCase(std::string_view text, std::string_view lowered) {
+  if (text.size() != lowered.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    if (lowerChar(text[i]) != lowered[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
 
-      throw std::invalid_argument(
-          "Expected an operator or ')' in the expression.");
+namespace expression_detail {
+bool lookupFunction(std::string_view name, FunctionId &id) {
+  for (const FunctionEntry &entry : FunctionTable) {
+    if (equalsIgnoringCase(name, entry.name)) {
+      id = entry.id;
+      return true;
     }
   }
+  return false;
+}
 
-  if (expectValue) {
-    throw std::invalid_argument(
-        "Expression ended unexpectedly. Operand missing.");
+std::size_t functionArity(FunctionId id) {
+  return functionEntry(id).arity;
+}
+
+bool isIntegerFunction(FunctionId id) {
+  return functionEntry(id).integer;
+}
+
+std::string normalizeIdentifier(std::string_view identifier) {
+  std::string lowered(identifier);
+  for (char &ch : lowered) {
+    ch = lowerChar(ch);
   }
+  return lowered;
+}
 
+std::vector<Token> tokenizeExpression(std::string_view expression,
+                                      NumberSyntax syntax) {
+  std::vector<Token> tokens;
+  tokenizeExpression(expression, tokens, syntax);
   return tokens;
 }
 
-std::vector<BigToken> tokenizeExpressionBigInt(const std::string &expression) {
-  std::vector<BigToken> tokens;
+void tokenizeExpression(std::string_view expression, std::vector<Token> &tokens,
+                        NumberSyntax syntax) {
+  const bool integerOnly = syntax == NumberSyntax::Integer;
+  tokens.clear();
   std::size_t i = 0;
   bool expectValue = true;
 
@@ -247,13 +179,14 @@ std::vector<BigToken> tokenizeExpressionBigInt(const std::string &expression) {
 
     if (expectValue) {
       if (c == '(') {
-        tokens.push_back({BigToken::Type::LeftParen, "", 0, ""});
+        tokens.push_back({Token::Type::LeftParen, i});
         ++i;
         continue;
       }
 
       int sign = 1;
       bool sawUnarySign = false;
+      std::size_t signPosition = i;
       if (c == '+' || c == '-') {
         sawUnarySign = true;
         sign = (c == '-') ? -1 : 1;
@@ -269,8 +202,9 @@ std::vector<BigToken> tokenizeExpressionBigInt(const std::string &expression) {
         c = expression[i];
         if (c == '(') {
           if (sign == -1) {
-            tokens.push_back({BigToken::Type::Number, "0", 0, ""});
-            tokens.push_back({BigToken::Type::Operator, "", '-', ""});
+            tokens.push_back(
+                {Token::Type::Number, signPosition, 0, {}, false, "0"});
+            tokens.push_back({Token::Type::Operator, signPosition, '-'});
           }
           expectValue = true;
           continue;
@@ -279,172 +213,40 @@ std::vector<BigToken> tokenizeExpressionBigInt(const std::string &expression) {
         sign = 1;
       }
 
-      if (std::isdigit(static_cast<unsigned char>(c))) {
-        std::string number = parseIntegerToken(expression, i);
-        if (sign == -1) {
-          number.insert(number.begin(), '-');
-        }
-        tokens.push_back({BigToken::Type::Number, number, 0, ""});
-        expectValue = false;
-        continue;
-      }
-
-      if (c == '.') {
+      if (integerOnly && c == '.') {
         throw std::invalid_argument(
             "Bigint mode does not support decimal numbers.");
       }
 
-      if (std::isalpha(static_cast<unsigned char>(c))) {
+      if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
         std::size_t start = i;
-        ++i;
-        while (i < expression.size() &&
-               (std::isalnum(static_cast<unsigned char>(expression[i])) ||
-                expression[i] == '_')) {
-          ++i;
-        }
-        std::string identifier = expression.substr(start, i - start);
-        std::string lowered = identifier;
-        std::transform(lowered.begin(), lowered.end(), lowered.begin(),
-                       [](unsigned char ch) {
-                         return static_cast<char>(std::tolower(ch));
-                       });
-
-        if (lowered == "sin" || lowered == "cos" || lowered == "log" ||
-            lowered == "tan" || lowered == "sqrt" || lowered == "exp" ||
-            lowered == "cot" || lowered == "asin" || lowered == "acos" ||
-            lowered == "atan" || lowered == "sinh") {
-          throw std::invalid_argument("Functions are not supported in bigint "
-                                      "mode: " +
-                                      identifier);
-        }
-
-        if (sawUnarySign && sign == -1) {
-          tokens.push_back({BigToken::Type::Number, "0", 0, ""});
-          tokens.push_back({BigToken::Type::Operator, "", '-', ""});
-        }
-        tokens.push_back({BigToken::Type::Variable, "", 0, lowered});
-        expectValue = false;
-        continue;
-      }
-
-      throw std::invalid_argument(
-          "Expected an integer or '(' in the expression.");
-    } else {
-      if (c == ')') {
-        tokens.push_back({BigToken::Type::RightParen, "", 0, ""});
-        ++i;
-        continue;
-      }
-
-      if (c == '!') {
-        tokens.push_back({BigToken::Type::Operator, "", '!', ""});
-        ++i;
-        continue;
-      }
-
-      if (isOperatorChar(c)) {
+        std::string_view number = integerOnly
+                                      ? parseIntegerToken(expression, i)
+                                      : scanDecimalToken(expression, i);
         tokens.push_back(
-            {BigToken::Type::Operator, "", normalizeOperator(c), ""});
-        ++i;
-        expectValue = true;
-        continue;
-      }
-
-      throw std::invalid_argument(
-          "Expected an operator or ')' in the expression.");
-    }
-  }
-
-  if (expectValue) {
-    throw std::invalid_argument(
-        "Expression ended unexpectedly. Operand missing.");
-  }
-
-  return tokens;
-}
-
-std::vector<BigFloatToken>
-tokenizeExpressionBigDouble(const std::string &expression) {
-  std::vector<BigFloatToken> tokens;
-  std::size_t i = 0;
-  bool expectValue = true;
-
-  while (i < expression.size()) {
-    char c = expression[i];
-    if (std::isspace(static_cast<unsigned char>(c))) {
-      ++i;
-      continue;
-    }
-
-    if (expectValue) {
-      if (c == '(') {
-        tokens.push_back({BigFloatToken::Type::LeftParen, "", 0, ""});
-        ++i;
-        continue;
-      }
-
-      int sign = 1;
-      bool sawUnarySign = false;
-      if (c == '+' || c == '-') {
-        sawUnarySign = true;
-        sign = (c == '-') ? -1 : 1;
-        ++i;
-        while (i < expression.size() &&
-               std::isspace(static_cast<unsigned char>(expression[i]))) {
-          ++i;
-        }
-        if (i >= expression.size()) {
-          throw std::invalid_argument(
-              "Expression cannot end with a unary operator.");
-        }
-        c = expression[i];
-        if (c == '(') {
-          if (sign == -1) {
-            tokens.push_back({BigFloatToken::Type::Number, "0", 0, ""});
-            tokens.push_back({BigFloatToken::Type::Operator, "", '-', ""});
-          }
-          expectValue = true;
-          continue;
-        }
-      } else {
-        sign = 1;
-      }
-
-      if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
-        std::string number = parseDecimalToken(expression, i);
-        if (sign == -1) {
-          number.insert(number.begin(), '-');
-        }
-        tokens.push_back({BigFloatToken::Type::Number, number, 0, ""});
+            {Token::Type::Number, start, 0, {}, sign == -1, number});
         expectValue = false;
         continue;
       }
 
       if (std::isalpha(static_cast<unsigned char>(c))) {
         std::size_t start = i;
-        ++i;
-        while (i < expression.size() &&
-               (std::isalnum(static_cast<unsigned char>(expression[i])) ||
-                expression[i] == '_')) {
-          ++i;
-        }
-        std::string identifier = expression.substr(start, i - start);
-        std::string lowered = identifier;
-        std::transform(lowered.begin(), lowered.end(), lowered.begin(),
-                       [](unsigned char ch) {
-                         return static_cast<char>(std::tolower(ch));
-                       });
-
-        if (lowered == "sin" || lowered == "cos" || lowered == "log" ||
-            lowered == "tan" || lowered == "sqrt" || lowered == "exp" ||
-            lowered == "cot" || lowered == "asin" || lowered == "acos" ||
-            lowered == "atan" || lowered == "sinh") {
+        std::string_view identifier = scanIdentifier(expression, i);
+
+        FunctionId function{};
+        if (lookupFunction(identifier, function)) {
+          if (integerOnly && !isIntegerFunction(function)) {
+            throw std::invalid_argument("Functions are not supported in bigint "
+                                        "mode: " +
+                                        std::string(identifier));
+          }
           if (sawUnarySign && sign == -1) {
-            tokens.push_back({BigFloatToken::Type::Number, "0", 0, ""});
-            tokens.push_back({BigFloatToken::Type::Operator, "", '-', ""});
+            tokens.push_back(
+                {Token::Type::Number, signPosition, 0, {}, false, "0"});
+            tokens.push_back({Token::Type::Operator, signPosition, '-'});
           }
           tokens.push_back(
-              {BigFloatToken::Type::Function, "", 0, lowered});
+              {Token::Type::Function, start, 0, function, false, identifier});
 
           std::size_t lookahead = i;
           while (
@@ -453,7 +255,7 @@ tokenizeExpressionBigDouble(const std::string &expression) {
             ++lookahead;
           }
           if (lookahead >= expression.size() || expression[lookahead] != '(') {
-            throw std::invalid_argument("Function '" + identifier +
+            throw std::invalid_argument("Function '" + std::string(identifier) +
                                         "' must be followed by parentheses.");
           }
           i = lookahead;
@@ -461,37 +263,57 @@ tokenizeExpressionBigDouble(const std::string &expression) {
         }
 
         if (sawUnarySign && sign == -1) {
-          tokens.push_back({BigFloatToken::Type::Number, "0", 0, ""});
-          tokens.push_back({BigFloatToken::Type::Operator, "", '-', ""});
+          tokens.push_back(
+              {Token::Type::Number, signPosition, 0, {}, false, "0"});
+          tokens.push_back({Token::Type::Operator, signPosition, '-'});
         }
-        tokens.push_back({BigFloatToken::Type::Variable, "", 0, lowered});
+        tokens.push_back(
+            {Token::Type::Variable, start, 0, {}, false, identifier});
         expectValue = false;
         continue;
       }
 
       throw std::invalid_argument(
-          "Expected a number or '(' in the expression.");
+          integerOnly ? "Expected an integer or '(' in the expression."
+                      : "Expected a number or '(' in the expression.");
     } else {
       if (c == ')') {
-        tokens.push_back({BigFloatToken::Type::RightParen, "", 0, ""});
+        tokens.push_back({Token::Type::RightParen, i});
         ++i;
         continue;
       }
 
       if (c == '!') {
-        tokens.push_back({BigFloatToken::Type::Operator, "", '!', ""});
+        tokens.push_back({Token::Type::Operator, i, '!'});
         ++i;
         continue;
       }
 
+      if (c == ',') {
+        tokens.push_back({Token::Type::Comma, i});
+        ++i;
+        expectValue = true;
+        continue;
+      }
+
       if (isOperatorChar(c)) {
-        tokens.push_back(
-            {BigFloatToken::Type::Operator, "", normalizeOperator(c), ""});
+        tokens.push_back({Token::Type::Operator, i, normalizeOperator(c)});
         ++i;
         expectValue = true;
         continue;
       }
 
+      if (std::isalpha(static_cast<unsigned char>(c))) {
+        std::size_t start = i;
+        std::string_view word = scanIdentifier(expression, i);
+        if (equalsIgnoringCase(word, "mod")) {
+          tokens.push_back({Token::Type::Operator, start, '%'});
+          expectValue = true;
+          continue;
+        }
+        i = start;
+      }
+
       throw std::invalid_argument(
           "Expected an operator or ')' in the expression.");
     }
@@ -501,7 +323,5 @@ tokenizeExpressionBigDouble(const std::string &expression) {
     throw std::invalid_argument(
         "Expression ended unexpectedly. Operand missing.");
   }
-
-  return tokens;
 }
 } // namespace expression_detail
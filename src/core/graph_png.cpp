@@ -283,6 +283,115 @@ bool writePng(const std::string &path, std::size_t width, std::size_t height,
   }
   return true;
 }
+struct PlotArea {
+  int left;
+  int top;
+  int width;
+  int height;
+};
+
+const std::array<std::uint8_t, 4> axisColor = {64, 64, 64, 255};
+const std::array<std::uint8_t, 4> gridColor = {220, 220, 220, 255};
+const std::array<std::uint8_t, 4> lineColor = {31, 119, 180, 255};
+const std::array<std::uint8_t, 4> pointColor = {214, 39, 40, 255};
+const std::array<std::uint8_t, 4> textColor = {20, 20, 20, 255};
+
+constexpr int leftMargin = 60;
+constexpr int rightMargin = 30;
+constexpr int topMargin = 30;
+constexpr int bottomMargin = 50;
+constexpr int horizontalGridLines = 4;
+constexpr int verticalGridLines = 6;
+constexpr int tickLength = 6;
+constexpr int labelPadding = 4;
+
+bool makePlotArea(std::size_t width, std::size_t height, PlotArea &area,
+                  std::string &error) {
+  area = {leftMargin, topMargin,
+          static_cast<int>(width) - leftMargin - rightMargin,
+          static_cast<int>(height) - topMargin - bottomMargin};
+  if (area.width <= 0 || area.height <= 0) {
+    error = "Image dimensions are too small for plotting.";
+    return false;
+  }
+  return true;
+}
+
+// Draws the grid, both axes and the value labels along the y axis.
+void drawPlotFrame(ImageBuffer &image, const PlotArea &area, double minValue,
+                   double maxValue) {
+  double valueRange = maxValue - minValue;
+
+  // Draw grid lines for readability.
+  for (int row = 0; row <= horizontalGridLines; ++row) {
+    double ratio =
+        static_cast<double>(row) / static_cast<double>(horizontalGridLines);
+    int y = area.top + static_cast<int>(std::lround(
+                           ratio * static_cast<double>(area.height)));
+    drawLine(image, area.left, y, area.left + area.width, y, gridColor);
+
+    drawLine(image, area.left - tickLength, y, area.left, y, axisColor);
+    std::string label = formatAxisLabel(maxValue - ratio * valueRange,
+                                        valueRange);
+    int textX = area.left - tickLength - labelPadding - measureTextWidth(label);
+    if (textX < 0) {
+      textX = 0;
+    }
+    int textY = y - FONT_HEIGHT / 2;
+    if (textY < 0) {
+      textY = 0;
+    }
+    drawText(image, textX, textY, label, textColor);
+  }
+  for (int column = 0; column <= verticalGridLines; ++column) {
+    double ratio = static_cast<double>(column) /
+                   static_cast<double>(verticalGridLines);
+    int x = area.left + static_cast<int>(std::lround(
+                            ratio * static_cast<double>(area.width)));
+    drawLine(image, x, area.top, x, area.top + area.height, gridColor);
+  }
+
+  // Draw axes on top of the grid.
+  drawLine(image, area.left, area.top, area.left, area.top + area.height,
+           axisColor);
+  drawLine(image, area.left, area.top + area.height, area.left + area.width,
+           area.top + area.height, axisColor);
+}
+
+// Draws a tick and a centred label below the x axis at pixel column x.
+void drawXAxisLabel(ImageBuffer &image, const PlotArea &area, int x,
+                    const std::string &label) {
+  const int axisY = area.top + area.height;
+  drawLine(image, x, axisY, x, axisY + tickLength, axisColor);
+  int textWidth = measureTextWidth(label);
+  int textX = x - textWidth / 2;
+  if (textX < 0) {
+    textX = 0;
+  }
+  int maxTextX = static_cast<int>(image.width) - textWidth;
+  if (textX > maxTextX) {
+    textX = maxTextX;
+  }
+  int textY = axisY + tickLength + labelPadding;
+  if (textY + FONT_HEIGHT > static_cast<int>(image.height)) {
+    textY = static_cast<int>(image.height) - FONT_HEIGHT;
+  }
+  drawText(image, textX, textY, label, textColor);
+}
+
+int toPixelY(const PlotArea &area, double value, double minValue,
+             double normalizedRange) {
+  double normalized = (value - minValue) / normalizedRange;
+  if (normalized < 0.0) {
+    normalized = 0.0;
+  }
+  if (normalized > 1.0) {
+    normalized = 1.0;
+  }
+  return area.top + area.height -
+         static_cast<int>(
+             std::lround(normalized * static_cast<double>(area.height)));
+}
 } // namespace
 
 bool generateGraphPng(const std::vector<double> &values,
@@ -295,22 +404,8 @@ bool generateGraphPng(const std::vector<double> &values,
   std::size_t width = std::max<std::size_t>(600, values.size() * 40);
   std::size_t height = 400;
   ImageBuffer image(width, height);
-
-  const std::array<std::uint8_t, 4> axisColor = {64, 64, 64, 255};
-  const std::array<std::uint8_t, 4> gridColor = {220, 220, 220, 255};
-  const std::array<std::uint8_t, 4> lineColor = {31, 119, 180, 255};
-  const std::array<std::uint8_t, 4> pointColor = {214, 39, 40, 255};
-
-  const int leftMargin = 60;
-  const int rightMargin = 30;
-  const int topMargin = 30;
-  const int bottomMargin = 50;
-  const int plotWidth =
-      static_cast<int>(width) - leftMargin - rightMargin;
-  const int plotHeight =
-      static_cast<int>(height) - topMargin - bottomMargin;
-  if (plotWidth <= 0 || plotHeight <= 0) {
-    error = "Image dimensions are too small for plotting.";
+  PlotArea area{};
+  if (!makePlotArea(width, height, area, error)) {
     return false;
   }
 
@@ -318,64 +413,24 @@ bool generateGraphPng(const std::vector<double> &values,
       *std::min_element(values.begin(), values.end());
   double maxValue =
       *std::max_element(values.begin(), values.end());
-  double valueRange = maxValue - minValue;
-  double normalizedRange = valueRange;
+  double normalizedRange = maxValue - minValue;
   if (normalizedRange == 0.0) {
     normalizedRange = 1.0;
   }
-
-  // Draw grid lines for readability.
-  constexpr int horizontalGridLines = 4;
-  std::vector<int> horizontalTickYs;
-  std::vector<double> horizontalTickValues;
-  horizontalTickYs.reserve(horizontalGridLines + 1);
-  horizontalTickValues.reserve(horizontalGridLines + 1);
-  for (int row = 0; row <= horizontalGridLines; ++row) {
-    double ratio =
-        static_cast<double>(row) / static_cast<double>(horizontalGridLines);
-    int y = topMargin +
-            static_cast<int>(std::lround(ratio * static_cast<double>(plotHeight)));
-    drawLine(image, leftMargin, y, leftMargin + plotWidth, y, gridColor);
-    horizontalTickYs.push_back(y);
-    double tickValue = maxValue - ratio * valueRange;
-    horizontalTickValues.push_back(tickValue);
-  }
-  constexpr int verticalGridLines = 6;
-  for (int column = 0; column <= verticalGridLines; ++column) {
-    double ratio = static_cast<double>(column) /
-                   static_cast<double>(verticalGridLines);
-    int x = leftMargin +
-            static_cast<int>(std::lround(ratio * static_cast<double>(plotWidth)));
-    drawLine(image, x, topMargin, x, topMargin + plotHeight, gridColor);
-  }
-
-  // Draw axes on top of the grid.
-  drawLine(image, leftMargin, topMargin, leftMargin,
-           topMargin + plotHeight, axisColor);
-  drawLine(image, leftMargin, topMargin + plotHeight,
-           leftMargin + plotWidth, topMargin + plotHeight, axisColor);
+  drawPlotFrame(image, area, minValue, maxValue);
 
   std::vector<std::pair<int, int>> points;
   points.reserve(values.size());
   for (std::size_t idx = 0; idx < values.size(); ++idx) {
-    double normalized = (values[idx] - minValue) / normalizedRange;
-    if (normalized < 0.0) {
-      normalized = 0.0;
-    }
-    if (normalized > 1.0) {
-      normalized = 1.0;
-    }
-    int x = leftMargin;
+    int x = area.left;
     if (values.size() > 1) {
       double ratio = static_cast<double>(idx) /
                      static_cast<double>(values.size() - 1);
       x += static_cast<int>(
-          std::lround(ratio * static_cast<double>(plotWidth)));
+          std::lround(ratio * static_cast<double>(area.width)));
     }
-    int y = topMargin + plotHeight -
-            static_cast<int>(
-                std::lround(normalized * static_cast<double>(plotHeight)));
-    points.emplace_back(x, y);
+    points.emplace_back(
+        x, toPixelY(area, values[idx], minValue, normalizedRange));
   }
 
   if (points.size() == 1) {
@@ -390,28 +445,6 @@ bool generateGraphPng(const std::vector<double> &values,
     }
   }
 
-  const std::array<std::uint8_t, 4> textColor = {20, 20, 20, 255};
-  const int tickLength = 6;
-  const int labelPadding = 4;
-  const int axisY = topMargin + plotHeight;
-
-  for (std::size_t idx = 0; idx < horizontalTickYs.size(); ++idx) {
-    int y = horizontalTickYs[idx];
-    drawLine(image, leftMargin - tickLength, y, leftMargin, y, axisColor);
-    std::string label =
-        formatAxisLabel(horizontalTickValues[idx], valueRange);
-    int textWidth = measureTextWidth(label);
-    int textX = leftMargin - tickLength - labelPadding - textWidth;
-    if (textX < 0) {
-      textX = 0;
-    }
-    int textY = y - FONT_HEIGHT / 2;
-    if (textY < 0) {
-      textY = 0;
-    }
-    drawText(image, textX, textY, label, textColor);
-  }
-
   std::vector<std::size_t> xTickIndices;
   const std::size_t maxTicks = 8;
   if (values.size() <= maxTicks) {
@@ -446,23 +479,79 @@ bool generateGraphPng(const std::vector<double> &values,
                      xTickIndices.end());
 
   for (std::size_t index : xTickIndices) {
-    int x = points[index].first;
-    drawLine(image, x, axisY, x, axisY + tickLength, axisColor);
-    std::string label = std::to_string(index + 1);
-    int textWidth = measureTextWidth(label);
-    int textX = x - textWidth / 2;
-    if (textX < 0) {
-      textX = 0;
+    drawXAxisLabel(image, area, points[index].first,
+                   std::to_string(index + 1));
+  }
+
+  return writePng(outputPath, width, height, image.pixels, error);
+}
+
+bool generateFunctionPlotPng(const std::vector<double> &xs,
+                             const std::vector<double> &ys,
+                             const std::string &outputPath,
+                             std::string &error) {
+  if (xs.empty() || xs.size() != ys.size()) {
+    error = "No data to plot.";
+    return false;
+  }
+  double minValue = std::numeric_limits<double>::infinity();
+  double maxValue = -std::numeric_limits<double>::infinity();
+  for (double y : ys) {
+    if (std::isfinite(y)) {
+      minValue = std::min(minValue, y);
+      maxValue = std::max(maxValue, y);
     }
-    int maxTextX = static_cast<int>(width) - textWidth;
-    if (textX > maxTextX) {
-      textX = maxTextX;
+  }
+  if (minValue > maxValue) {
+    error = "The function has no finite values in the plotted range.";
+    return false;
+  }
+
+  const std::size_t width = 800;
+  const std::size_t height = 400;
+  ImageBuffer image(width, height);
+  PlotArea area{};
+  if (!makePlotArea(width, height, area, error)) {
+    return false;
+  }
+  double normalizedRange = maxValue - minValue;
+  if (normalizedRange == 0.0) {
+    normalizedRange = 1.0;
+  }
+  drawPlotFrame(image, area, minValue, maxValue);
+
+  const double from = xs.front();
+  const double span = xs.back() - from;
+  auto toPixelX = [&](double x) {
+    double ratio = span == 0.0 ? 0.0 : (x - from) / span;
+    return area.left + static_cast<int>(std::lround(
+                           ratio * static_cast<double>(area.width)));
+  };
+
+  // Undefined samples break the curve; a defined sample with no defined
+  // neighbour is drawn as a point so it stays visible.
+  for (std::size_t idx = 0; idx < xs.size(); ++idx) {
+    if (!std::isfinite(ys[idx])) {
+      continue;
     }
-    int textY = axisY + tickLength + labelPadding;
-    if (textY + FONT_HEIGHT > static_cast<int>(height)) {
-      textY = static_cast<int>(height) - FONT_HEIGHT;
+    int x = toPixelX(xs[idx]);
+    int y = toPixelY(area, ys[idx], minValue, normalizedRange);
+    bool joinedLeft = idx > 0 && std::isfinite(ys[idx - 1]);
+    bool joinedRight = idx + 1 < xs.size() && std::isfinite(ys[idx + 1]);
+    if (joinedRight) {
+      drawLine(image, x, y, toPixelX(xs[idx + 1]),
+               toPixelY(area, ys[idx + 1], minValue, normalizedRange),
+               lineColor);
+    } else if (!joinedLeft) {
+      drawPoint(image, x, y, pointColor);
     }
-    drawText(image, textX, textY, label, textColor);
+  }
+
+  for (int column = 0; column <= verticalGridLines; ++column) {
+    double ratio = static_cast<double>(column) /
+                   static_cast<double>(verticalGridLines);
+    drawXAxisLabel(image, area, toPixelX(from + ratio * span),
+                   formatAxisLabel(from + ratio * span, span));
   }
 
   return writePng(outputPath, width, height, image.pixels, error);
@@ -8,3 +8,11 @@
 bool generateGraphPng(const std::vector<double> &values,
                       const std::string &outputPath,
                       std::string &errorMessage);
+
+// Renders the curve through the points (xs[i], ys[i]) into a PNG image at
+// outputPath, with xs ascending and labelled along the x axis. Non-finite
+// ys leave a gap in the curve.
+bool generateFunctionPlotPng(const std::vector<double> &xs,
+                             const std::vector<double> &ys,
+                             const std::string &outputPath,
+                             std::string &errorMessage);
@@ -0,0 +1,167 @@
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+class WorkerPool {
+public:
+  explicit WorkerPool(std::size_t workers) {
+    threads_.reserve(workers);
+    for (std::size_t idx = 0; idx < workers; ++idx) {
+      threads_.emplace_back([this] { work(); });
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread &thread : threads_) {
+      thread.join();
+    }
+  }
+
+  std::size_t size() const {
+    return threads_.size();
+  }
+
+  void post(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    wake_.notify_one();
+  }
+
+private:
+  void work() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stopping_ = false;
+};
+
+std::size_t defaultThreadCount() {
+  return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+std::mutex poolMutex;
+std::shared_ptr<WorkerPool> sharedPool;
+
+// A pool replaced by setParallelWorkerCount lives on until the loops still
+// using it have finished, then drains its queue and joins its threads.
+std::shared_ptr<WorkerPool> workerPool() {
+  std::lock_guard<std::mutex> lock(poolMutex);
+  if (!sharedPool) {
+    sharedPool = std::make_shared<WorkerPool>(defaultThreadCount() - 1);
+  }
+  return sharedPool;
+}
+
+// Shared by the caller and its helpers; helpers hold it by shared_ptr since
+// a helper may only get to run after the loop has been drained.
+struct LoopState {
+  std::size_t count = 0;
+  const std::function<void(std::size_t)> *body = nullptr;
+  std::atomic<std::size_t> next{0};
+  std::atomic<bool> cancelled{false};
+  std::size_t finished = 0;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable done;
+
+  // Claims indices until none are left. After a failure the remaining
+  // indices are still claimed and counted, just not run.
+  void run() {
+    std::size_t ran = 0;
+    for (std::size_t idx; (idx = next.fetch_add(1)) < count; ++ran) {
+      if (cancelled.load(std::memory_order_relaxed)) {
+        continue;
+      }
+      try {
+        (*body)(idx);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        cancelled.store(true, std::memory_order_relaxed);
+      }
+    }
+    if (ran > 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      finished += ran;
+      if (finished == count) {
+        done.notify_all();
+      }
+    }
+  }
+};
+} // namespace
+
+std::size_t parallelWorkerCount() {
+  return workerPool()->size() + 1;
+}
+
+void setParallelWorkerCount(std::size_t threads) {
+  if (threads == 0) {
+    threads = defaultThreadCount();
+  }
+  auto pool = std::make_shared<WorkerPool>(threads - 1);
+  std::lock_guard<std::mutex> lock(poolMutex);
+  sharedPool.swap(pool);
+}
+
+void parallelFor(std::size_t count,
+                 const std::function<void(std::size_t)> &body) {
+  if (count == 0) {
+    return;
+  }
+  std::shared_ptr<WorkerPool> pool = workerPool();
+  if (count == 1 || pool->size() == 0) {
+    for (std::size_t idx = 0; idx < count; ++idx) {
+      body(idx);
+    }
+    return;
+  }
+
+  auto state = std::make_shared<LoopState>();
+  state->count = count;
+  state->body = &body;
+  std::size_t helpers = std::min(pool->size(), count - 1);
+  for (std::size_t idx = 0; idx < helpers; ++idx) {
+    pool->post([state] { state->run(); });
+  }
+  state->run();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(lock, [&] { return state->finished >= count; });
+  if (state->error) {
+    std::rethrow_exception(state->error);
+  }
+}
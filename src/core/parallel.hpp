@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+// Number of threads parallelFor spreads work over, the caller included.
+// Defaults to the hardware concurrency; the setter takes effect for
+// parallelFor calls that start after it returns, and 0 restores the default.
+std::size_t parallelWorkerCount();
+void setParallelWorkerCount(std::size_t threads);
+
+// Runs body(0) .. body(count - 1) on a process-wide pool of worker threads
+// and returns once every call has finished. The calling thread takes work
+// too, so nested calls cannot deadlock. After a call throws, no further
+// calls are started and the first exception is rethrown here.
+void parallelFor(std::size_t count,
+                 const std::function<void(std::size_t)> &body);
@@ -1,29 +1,235 @@
 #include "prime_factors.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <numeric>
 #include <stdexcept>
 
+namespace {
+using u64 = std::uint64_t;
+#if defined(__SIZEOF_INT128__)
+__extension__ using u128 = unsigned __int128;
+#endif
+
+constexpr std::array<u64, 25> SmallPrimes = {
+    2,  3,  5,  7,  11, 13, 17, 19, 23, 29, 31, 37, 41,
+    43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97};
+
+// High 64 bits of the 128-bit product a * b.
+u64 multiplyHigh(u64 a, u64 b) {
+#if defined(__SIZEOF_INT128__)
+  return static_cast<u64>((static_cast<u128>(a) * b) >> 64);
+#else
+  const u64 aLow = a & 0xffffffffu;
+  const u64 aHigh = a >> 32;
+  const u64 bLow = b & 0xffffffffu;
+  const u64 bHigh = b >> 32;
+  const u64 lowLow = aLow * bLow;
+  const u64 highLow = aHigh * bLow;
+  const u64 lowHigh = aLow * bHigh;
+  const u64 middle = (lowLow >> 32) + (highLow & 0xffffffffu) + lowHigh;
+  return aHigh * bHigh + (highLow >> 32) + (middle >> 32);
+#endif
+}
+
+// Arithmetic modulo an odd n in Montgomery form, with R = 2^64, so a
+// modular multiplication costs two 64x64->128 products and no division.
+// Values passed in and returned are Montgomery residues below n.
+class Montgomery {
+public:
+  explicit Montgomery(u64 modulus) : n_(modulus), inverse_(modulus) {
+    // Newton's iteration doubles the correct low bits of n^-1 mod 2^64
+    // each step, starting from 3 correct bits.
+    for (int step = 0; step < 5; ++step) {
+      inverse_ *= 2 - n_ * inverse_;
+    }
+    // R mod n, then R^2 mod n by doubling it 64 times.
+    u64 r = (0 - n_) % n_;
+    squaredR_ = r;
+    for (int bit = 0; bit < 64; ++bit) {
+      squaredR_ = add(squaredR_, squaredR_);
+    }
+    one_ = r;
+  }
+
+  u64 modulus() const {
+    return n_;
+  }
+  u64 one() const {
+    return one_;
+  }
+
+  u64 toResidue(u64 value) const {
+    return multiply(value % n_, squaredR_);
+  }
+  u64 fromResidue(u64 residue) const {
+    return reduce(0, residue);
+  }
+
+  u64 add(u64 a, u64 b) const {
+    return a >= n_ - b ? a - (n_ - b) : a + b;
+  }
+  u64 subtract(u64 a, u64 b) const {
+    return a >= b ? a - b : a + (n_ - b);
+  }
+  u64 multiply(u64 a, u64 b) const {
+    return reduce(multiplyHigh(a, b), a * b);
+  }
+  u64 power(u64 base, u64 exponent) const {
+    u64 result = one_;
+    while (exponent > 0) {
+      if (exponent & 1) {
+        result = multiply(result, base);
+      }
+      base = multiply(base, base);
+      exponent >>= 1;
+    }
+    return result;
+  }
+
+private:
+  // (high * 2^64 + low) / R mod n. With m = low * n^-1, the low words of
+  // m * n and the input agree, so only the high words need subtracting.
+  u64 reduce(u64 high, u64 low) const {
+    u64 correction = multiplyHigh(low * inverse_, n_);
+    return high >= correction ? high - correction : high - correction + n_;
+  }
+
+  u64 n_;
+  u64 inverse_;
+  u64 squaredR_;
+  u64 one_;
+};
+
+// Brent's variant of Pollard's rho for an odd composite n. Differences are
+// multiplied together and checked with one gcd per batch, backtracking
+// when a batch overshoots to n.
+u64 pollardRho(u64 n) {
+  constexpr u64 BatchSize = 128;
+  const Montgomery mont(n);
+  for (u64 increment = 1;; ++increment) {
+    const u64 c = mont.toResidue(increment);
+    auto next = [&](u64 x) { return mont.add(mont.multiply(x, x), c); };
+    auto distance = [](u64 a, u64 b) { return a > b ? a - b : b - a; };
+
+    u64 y = mont.toResidue(2);
+    u64 x = y;
+    u64 saved = y;
+    u64 product = mont.one();
+    u64 divisor = 1;
+    for (u64 length = 1; divisor == 1; length *= 2) {
+      x = y;
+      for (u64 step = 0; step < length; ++step) {
+        y = next(y);
+      }
+      for (u64 done = 0; done < length && divisor == 1; done += BatchSize) {
+        saved = y;
+        u64 batch = std::min(BatchSize, length - done);
+        for (u64 step = 0; step < batch; ++step) {
+          y = next(y);
+          product = mont.multiply(product, distance(x, y));
+        }
+        // Montgomery form scales by R, which is coprime to n.
+        divisor = std::gcd(product, n);
+      }
+    }
+    if (divisor == n) {
+      do {
+        saved = next(saved);
+        divisor = std::gcd(distance(x, saved), n);
+      } while (divisor == 1);
+    }
+    if (divisor != n) {
+      return divisor;
+    }
+  }
+}
+
+void collectFactors(u64 n, std::vector<u64> &primes) {
+  if (n == 1) {
+    return;
+  }
+  if (isPrime(n)) {
+    primes.push_back(n);
+    return;
+  }
+  u64 divisor = pollardRho(n);
+  collectFactors(divisor, primes);
+  collectFactors(n / divisor, primes);
+}
+} // namespace
+
+bool isPrime(std::uint64_t n) {
+  if (n < 2) {
+    return false;
+  }
+  for (u64 prime : SmallPrimes) {
+    if (n % prime == 0) {
+      return n == prime;
+    }
+  }
+  if (n < SmallPrimes.back() * SmallPrimes.back()) {
+    return true;
+  }
+
+  u64 odd = n - 1;
+  int twos = 0;
+  while ((odd & 1) == 0) {
+    odd >>= 1;
+    ++twos;
+  }
+  const Montgomery mont(n);
+  const u64 minusOne = mont.subtract(0, mont.one());
+  // Jim Sinclair's bases; together they are deterministic below 2^64.
+  for (u64 base : {2ULL, 325ULL, 9375ULL, 28178ULL, 450775ULL, 9780504ULL,
+                   1795265022ULL}) {
+    u64 residue = mont.toResidue(base);
+    if (residue == 0) {
+      continue;
+    }
+    u64 x = mont.power(residue, odd);
+    if (x == mont.one() || x == minusOne) {
+      continue;
+    }
+    bool witness = true;
+    for (int square = 1; square < twos && witness; ++square) {
+      x = mont.multiply(x, x);
+      witness = x != minusOne;
+    }
+    if (witness) {
+      return false;
+    }
+  }
+  return true;
+}
+
 std::vector<std::pair<long long, int>> calculatePrimeFactors(long long n) {
   if (n <= 0) {
     throw std::invalid_argument(
         "Prime factorization defined only for positive integers.");
   }
 
-  std::vector<std::pair<long long, int>> factors;
-  long long remaining = n;
-
-  for (long long divisor = 2; divisor <= remaining / divisor; ++divisor) {
-    int exponent = 0;
-    while (remaining % divisor == 0) {
-      ++exponent;
-      remaining /= divisor;
-    }
-    if (exponent > 0) {
-      factors.emplace_back(divisor, exponent);
+  // Small primes come out by trial division; what remains has no factor
+  // below 100 and goes to Pollard's rho.
+  std::vector<u64> primes;
+  u64 remaining = static_cast<u64>(n);
+  for (u64 prime : SmallPrimes) {
+    while (remaining % prime == 0) {
+      primes.push_back(prime);
+      remaining /= prime;
     }
   }
+  collectFactors(remaining, primes);
+  std::sort(primes.begin(), primes.end());
 
-  if (remaining > 1) {
-    factors.emplace_back(remaining, 1);
+  std::vector<std::pair<long long, int>> factors;
+  for (u64 prime : primes) {
+    if (!factors.empty() &&
+        factors.back().first == static_cast<long long>(prime)) {
+      ++factors.back().second;
+    } else {
+      factors.emplace_back(static_cast<long long>(prime), 1);
+    }
   }
-
   return factors;
 }
@@ -1,7 +1,12 @@
 #pragma once
+#include <cstdint>
 #include <utility>
 #include <vector>
 
 // Returns the prime factors of n as pairs of (prime, exponent).
 // Throws std::invalid_argument if n is less than or equal to zero.
 std::vector<std::pair<long long, int>> calculatePrimeFactors(long long n);
+
+// Deterministic primality test for every 64-bit value (Miller-Rabin with a
+// base set known to have no 64-bit strong pseudoprimes).
+bool isPrime(std::uint64_t n);
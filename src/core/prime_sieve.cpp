@@ -0,0 +1,346 @@
+#include "prime_sieve.hpp"
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+using u64 = std::uint64_t;
+
+// Bytes crossed off at a time, the size of a typical L1 data cache.
+constexpr std::size_t SegmentBytes = 32 * 1024;
+constexpr u64 SegmentSpan = 30 * SegmentBytes;
+// Segments per block, the unit of work one worker takes.
+constexpr std::size_t BlockSegments = 16;
+constexpr std::size_t BlockBytes = SegmentBytes * BlockSegments;
+constexpr u64 BlockSpan = 30 * BlockBytes;
+
+// The residues mod 30 coprime to 30, one per bit of a wheel byte, and the
+// gaps from each to the next.
+constexpr std::array<u64, 8> WheelResidues = {1, 7, 11, 13, 17, 19, 23, 29};
+constexpr std::array<u64, 8> WheelGaps = {6, 4, 2, 4, 2, 4, 6, 2};
+
+// Lookups by r = value mod 30.
+struct WheelTables {
+  // The bit holding r, or 0 when r shares a factor with 30.
+  std::array<std::uint8_t, 30> bit{};
+  // Distance from r up to the next residue coprime to 30, and the wheel
+  // index of that residue.
+  std::array<std::uint8_t, 30> advance{};
+  std::array<std::uint8_t, 30> index{};
+};
+
+constexpr WheelTables makeWheelTables() {
+  WheelTables tables;
+  for (std::size_t r = 0; r < 30; ++r) {
+    std::size_t wheel = 0;
+    while (WheelResidues[wheel] < r) {
+      ++wheel;
+    }
+    tables.advance[r] = static_cast<std::uint8_t>(WheelResidues[wheel] - r);
+    tables.index[r] = static_cast<std::uint8_t>(wheel);
+    if (WheelResidues[wheel] == r) {
+      tables.bit[r] = static_cast<std::uint8_t>(1u << wheel);
+    }
+  }
+  return tables;
+}
+constexpr WheelTables Wheel = makeWheelTables();
+
+// Index of the lowest set bit of each nonzero byte.
+constexpr std::array<std::uint8_t, 256> makeLowestBits() {
+  std::array<std::uint8_t, 256> lowest{};
+  for (std::size_t value = 1; value < 256; ++value) {
+    std::uint8_t bit = 0;
+    while (((value >> bit) & 1u) == 0) {
+      ++bit;
+    }
+    lowest[value] = bit;
+  }
+  return lowest;
+}
+constexpr std::array<std::uint8_t, 256> LowestBit = makeLowestBits();
+
+u64 integerSquareRoot(u64 n) {
+  u64 root = static_cast<u64>(std::sqrt(static_cast<double>(n)));
+  while (root * root > n) {
+    --root;
+  }
+  while ((root + 1) * (root + 1) <= n) {
+    ++root;
+  }
+  return root;
+}
+
+void checkRange(u64 from, u64 to) {
+  if (from > to) {
+    throw std::invalid_argument("The range start must not exceed its end.");
+  }
+  if (to > MaxSieveValue) {
+    throw std::out_of_range("Prime ranges are limited to values up to " +
+                            std::to_string(MaxSieveValue) + ".");
+  }
+}
+
+// The primes from 7 up to sqrt(to). Small ones make several turns of the
+// wheel in every segment and are crossed off a segment at a time; large
+// ones make less than a turn and go straight through the whole block.
+struct SievingPrimes {
+  std::vector<u64> small;
+  std::vector<u64> large;
+};
+
+SievingPrimes sievingPrimes(u64 to) {
+  SievingPrimes primes;
+  const u64 root = integerSquareRoot(to);
+  if (root < 7) {
+    return primes;
+  }
+  for (u64 prime : primesUpTo(root)) {
+    if (prime >= 7) {
+      (prime < SegmentBytes ? primes.small : primes.large).push_back(prime);
+    }
+  }
+  return primes;
+}
+
+// A run of wheel bytes; `low`, a multiple of 30, is the value of the first
+// byte's residue 0.
+struct Block {
+  u64 low;
+  std::size_t size;
+};
+
+class BlockLayout {
+public:
+  BlockLayout(u64 from, u64 to)
+      : low_(from / 30 * 30), bytes_((to - low_) / 30 + 1) {}
+
+  std::size_t count() const {
+    return static_cast<std::size_t>((bytes_ + BlockBytes - 1) / BlockBytes);
+  }
+  Block block(std::size_t idx) const {
+    const u64 first = static_cast<u64>(idx) * BlockBytes;
+    return {low_ + static_cast<u64>(idx) * BlockSpan,
+            static_cast<std::size_t>(
+                std::min<u64>(BlockBytes, bytes_ - first))};
+  }
+
+private:
+  u64 low_;
+  u64 bytes_;
+};
+
+// For a prime p = 30q + r, crossing off p * k and stepping k to the next
+// wheel residue clears a fixed bit and advances a fixed byte count, both
+// determined by r and the wheel index of k: the bit is that of r * k mod
+// 30 and the advance is q * gap plus a carry. Indexed [r][wheel of k].
+struct CrossingTables {
+  std::array<std::array<std::uint8_t, 8>, 8> keep{};
+  std::array<std::array<std::uint8_t, 8>, 8> carry{};
+};
+
+constexpr CrossingTables makeCrossingTables() {
+  CrossingTables tables;
+  for (std::size_t r = 0; r < 8; ++r) {
+    for (std::size_t wheel = 0; wheel < 8; ++wheel) {
+      const u64 residue = WheelResidues[r] * WheelResidues[wheel] % 30;
+      tables.keep[r][wheel] = static_cast<std::uint8_t>(~Wheel.bit[residue]);
+      tables.carry[r][wheel] = static_cast<std::uint8_t>(
+          (residue + WheelResidues[r] * WheelGaps[wheel]) / 30);
+    }
+  }
+  return tables;
+}
+constexpr CrossingTables Crossing = makeCrossingTables();
+
+// Where the next multiple of a sieving prime to cross off lies: its byte,
+// counted from the block start, and the wheel index of its cofactor.
+struct Position {
+  u64 byte;
+  std::uint8_t wheel;
+};
+
+// The first multiple p * k >= max(p * p, low) with k coprime to 30.
+Position firstMultiple(u64 prime, u64 low) {
+  u64 k = std::max(prime, (low + prime - 1) / prime);
+  const u64 r = k % 30;
+  k += Wheel.advance[r];
+  return {(prime * k - low) / 30, Wheel.index[r]};
+}
+
+// Clears the multiples of `prime` in the bytes before `end`. Only
+// cofactors coprime to 30 are visited, and a whole turn of the wheel
+// advances exactly `prime` bytes, so full turns run unrolled with
+// precomputed offsets.
+void crossOff(std::uint8_t *bytes, u64 prime, u64 end, Position &position) {
+  const std::size_t r = Wheel.index[prime % 30];
+  const auto &keep = Crossing.keep[r];
+  const u64 quotient = prime / 30;
+  std::array<u64, 8> steps;
+  for (std::size_t wheel = 0; wheel < 8; ++wheel) {
+    steps[wheel] = quotient * WheelGaps[wheel] + Crossing.carry[r][wheel];
+  }
+
+  u64 byte = position.byte;
+  std::size_t wheel = position.wheel;
+  while (wheel != 0 && byte < end) {
+    bytes[byte] &= keep[wheel];
+    byte += steps[wheel];
+    wheel = (wheel + 1) & 7;
+  }
+  if (wheel == 0) {
+    std::array<u64, 8> offsets;
+    offsets[0] = 0;
+    for (std::size_t idx = 1; idx < 8; ++idx) {
+      offsets[idx] = offsets[idx - 1] + steps[idx - 1];
+    }
+    for (; byte + prime <= end; byte += prime) {
+      for (std::size_t idx = 0; idx < 8; ++idx) {
+        bytes[byte + offsets[idx]] &= keep[idx];
+      }
+    }
+    while (byte < end) {
+      bytes[byte] &= keep[wheel];
+      byte += steps[wheel];
+      wheel = (wheel + 1) & 7;
+    }
+  }
+  position = {byte, static_cast<std::uint8_t>(wheel)};
+}
+
+// Leaves a bit of `bytes` set exactly for the primes of [from, to] that the
+// block covers.
+void sieveBlock(const Block &block, u64 from, u64 to,
+                const SievingPrimes &primes, std::vector<std::uint8_t> &bytes) {
+  bytes.assign(block.size, 0xff);
+  const u64 high = block.low + 30 * static_cast<u64>(block.size);
+  for (u64 prime : primes.large) {
+    if (prime * prime >= high) {
+      break;
+    }
+    Position position = firstMultiple(prime, block.low);
+    crossOff(bytes.data(), prime, block.size, position);
+  }
+
+  std::vector<Position> positions;
+  for (u64 prime : primes.small) {
+    if (prime * prime >= high) {
+      break;
+    }
+    positions.push_back(firstMultiple(prime, block.low));
+  }
+  for (u64 segment = 0; segment < block.size; segment += SegmentBytes) {
+    const u64 end = std::min<u64>(block.size, segment + SegmentBytes);
+    for (std::size_t idx = 0; idx < positions.size(); ++idx) {
+      crossOff(bytes.data(), primes.small[idx], end, positions[idx]);
+    }
+  }
+
+  // 1 is not prime, and the ends of the range rarely fall on a byte
+  // boundary.
+  for (std::size_t bit = 0; bit < 8; ++bit) {
+    const u64 firstValue = block.low + WheelResidues[bit];
+    if (firstValue < from || firstValue == 1) {
+      bytes.front() &= static_cast<std::uint8_t>(~(1u << bit));
+    }
+    const u64 lastValue = high - 30 + WheelResidues[bit];
+    if (lastValue > to) {
+      bytes.back() &= static_cast<std::uint8_t>(~(1u << bit));
+    }
+  }
+}
+
+void appendPrimes(const std::vector<std::uint8_t> &bytes, u64 low,
+                  std::vector<u64> &primes) {
+  for (std::size_t idx = 0; idx < bytes.size(); ++idx) {
+    const u64 base = low + 30 * static_cast<u64>(idx);
+    for (unsigned bits = bytes[idx]; bits != 0; bits &= bits - 1) {
+      primes.push_back(base + WheelResidues[LowestBit[bits]]);
+    }
+  }
+}
+
+u64 countBits(const std::vector<std::uint8_t> &bytes) {
+  u64 count = 0;
+  std::size_t idx = 0;
+  for (; idx + sizeof(u64) <= bytes.size(); idx += sizeof(u64)) {
+    u64 word = 0;
+    std::memcpy(&word, bytes.data() + idx, sizeof(u64));
+    count += std::bitset<64>(word).count();
+  }
+  for (; idx < bytes.size(); ++idx) {
+    count += std::bitset<8>(bytes[idx]).count();
+  }
+  return count;
+}
+
+// 2, 3 and 5 have no bit on the wheel.
+std::vector<u64> wheelPrimesIn(u64 from, u64 to) {
+  std::vector<u64> primes;
+  for (u64 prime : {2, 3, 5}) {
+    if (from <= prime && prime <= to) {
+      primes.push_back(prime);
+    }
+  }
+  return primes;
+}
+} // namespace
+
+void streamPrimes(
+    std::uint64_t from, std::uint64_t to,
+    const std::function<void(const std::vector<std::uint64_t> &)> &consume) {
+  checkRange(from, to);
+  const SievingPrimes sieving = sievingPrimes(to);
+  const BlockLayout layout(from, to);
+  const std::size_t blocks = layout.count();
+
+  // Each round sieves one block per worker, then hands the blocks over in
+  // order; only those buffers and one block of primes are ever held.
+  const std::size_t round =
+      std::min(blocks, std::max<std::size_t>(1, parallelWorkerCount()));
+  std::vector<std::vector<std::uint8_t>> buffers(round);
+  std::vector<u64> primes = wheelPrimesIn(from, to);
+  for (std::size_t first = 0; first < blocks; first += round) {
+    const std::size_t count = std::min(round, blocks - first);
+    parallelFor(count, [&](std::size_t idx) {
+      sieveBlock(layout.block(first + idx), from, to, sieving, buffers[idx]);
+    });
+    for (std::size_t idx = 0; idx < count; ++idx) {
+      appendPrimes(buffers[idx], layout.block(first + idx).low, primes);
+      if (!primes.empty()) {
+        consume(primes);
+        primes.clear();
+      }
+    }
+  }
+}
+
+std::uint64_t countPrimes(std::uint64_t from, std::uint64_t to) {
+  checkRange(from, to);
+  const SievingPrimes sieving = sievingPrimes(to);
+  const BlockLayout layout(from, to);
+  std::atomic<u64> total{wheelPrimesIn(from, to).size()};
+  parallelFor(layout.count(), [&](std::size_t idx) {
+    std::vector<std::uint8_t> bytes;
+    sieveBlock(layout.block(idx), from, to, sieving, bytes);
+    total.fetch_add(countBits(bytes), std::memory_order_relaxed);
+  });
+  return total.load();
+}
+
+std::vector<std::uint64_t> primesUpTo(std::uint64_t limit) {
+  std::vector<std::uint64_t> primes;
+  streamPrimes(0, limit, [&](const std::vector<std::uint64_t> &block) {
+    primes.insert(primes.end(), block.begin(), block.end());
+  });
+  return primes;
+}
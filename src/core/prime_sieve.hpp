@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Segmented Sieve of Eratosthenes on a mod-30 wheel: each byte holds the
+// eight numbers of a run of 30 that are coprime to 2, 3 and 5, so
+// multiples of those primes are never stored or crossed off. A range is
+// split into blocks that parallelFor sieves concurrently, and each block is
+// crossed off one L1-sized segment at a time. Memory stays bounded by the
+// worker count times the block size however long the range is.
+
+// Largest value the sieve accepts; the sieving primes up to its square
+// root take a few megabytes.
+constexpr std::uint64_t MaxSieveValue = 1000000000000000ULL; // 10^15
+
+// Passes the primes in [from, to] to `consume` in ascending order, a block
+// at a time, on the calling thread. Throws std::invalid_argument if from
+// exceeds to and std::out_of_range if to exceeds MaxSieveValue.
+void streamPrimes(
+    std::uint64_t from, std::uint64_t to,
+    const std::function<void(const std::vector<std::uint64_t> &)> &consume);
+
+// Number of primes in [from, to], with the same limits as streamPrimes.
+std::uint64_t countPrimes(std::uint64_t from, std::uint64_t to);
+
+// Every prime up to `limit`, the small-prime table for trial division and
+// similar uses.
+std::vector<std::uint64_t> primesUpTo(std::uint64_t limit);
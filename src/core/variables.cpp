@@ -30,6 +30,7 @@ VariableStore::VariableStore(std::string filePath)
 
 bool VariableStore::load() {
   vars_.clear();
+  ++version_;
   std::ifstream file(filePath_);
   if (!file) {
     return true; // Missing file means no variables yet.
@@ -98,6 +99,7 @@ std::optional<double> VariableStore::find(const std::string &name) const {
 
 void VariableStore::set(const std::string &name, double value) {
   vars_[normalizeName(name)] = value;
+  ++version_;
 }
 
 bool VariableStore::remove(const std::string &name) {
@@ -107,9 +109,14 @@ bool VariableStore::remove(const std::string &name) {
     return false;
   }
   vars_.erase(it);
+  ++version_;
   return true;
 }
 
+std::uint64_t VariableStore::version() const {
+  return version_;
+}
+
 bool VariableStore::isValidName(const std::string &name) {
   if (name.empty()) {
     return false;
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <map>
 #include <optional>
 #include <string>
@@ -15,6 +16,10 @@ public:
   void set(const std::string &name, double value);
   bool remove(const std::string &name);
 
+  // Changes on every load, set and successful remove, so callers can tell
+  // whether variables() may differ from an earlier snapshot.
+  std::uint64_t version() const;
+
   static bool isValidName(const std::string &name);
 
 private:
@@ -22,6 +27,7 @@ private:
 
   std::string filePath_;
   std::map<std::string, double> vars_;
+  std::uint64_t version_ = 0;
 };
 
 VariableStore &globalVariableStore();
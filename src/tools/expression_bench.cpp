@@ -0,0 +1,119 @@
+#include "ansi_colors.hpp"
+#include "expression.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Times CompiledExpression on both evaluation engines over formulas of 50 or
+// more tokens. Usage: expression_bench [iterations] [--no-color]
+namespace {
+struct Formula {
+  const char *name;
+  std::string text;
+};
+
+// 1 + x*c1 - y/c2 + ... alternating over the four basic operators.
+std::string arithmeticChain(int terms) {
+  std::string text = "1";
+  const char *ops[] = {" + x * ", " - y / ", " + z * ", " - x / "};
+  for (int idx = 0; idx < terms; ++idx) {
+    text += ops[idx % 4];
+    text += std::to_string(idx + 2);
+  }
+  return text;
+}
+
+// Horner form of a polynomial in x: ((c0*x + c1)*x + c2)...
+std::string hornerPolynomial(int degree) {
+  std::string text = "3";
+  for (int idx = 0; idx < degree; ++idx) {
+    text = "(" + text + ") * x + " + std::to_string(idx % 7 + 1);
+  }
+  return text;
+}
+
+// A balanced mix of functions, powers and grouping.
+std::string mixedFormula() {
+  return "sin(x) * cos(y) + sqrt(x^2 + y^2) / (1 + z^2) - exp(-x / 10) * "
+         "log(1 + y^2) + atan(z) * (x - y) ^ 2 / (3 + sin(z)^2) + "
+         "(x + 1) * (y + 2) * (z + 3) / (x * y * z + 10)";
+}
+
+// Runs `iterations` evaluations, returning nanoseconds per evaluation and
+// accumulating the results so the work cannot be optimized away.
+double timeEngine(const CompiledExpression &expression,
+                  const std::vector<double> &slots, long iterations,
+                  double &checksum) {
+  std::vector<double> values = slots;
+  auto start = std::chrono::steady_clock::now();
+  for (long idx = 0; idx < iterations; ++idx) {
+    values[0] = slots[0] + static_cast<double>(idx % 16) * 0.125;
+    checksum += expression.evaluateSlots(values.data());
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         static_cast<double>(iterations);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  long iterations = 200000;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--no-color" || arg == "-nc") {
+      setColorsEnabled(false);
+    } else {
+      iterations = std::strtol(argv[i], nullptr, 10);
+      if (iterations <= 0) {
+        std::cerr << RED << "Invalid iteration count: " << arg << RESET
+                  << '\n';
+        return 1;
+      }
+    }
+  }
+
+  const std::vector<Formula> formulas = {
+      {"arithmetic chain", arithmeticChain(32)},
+      {"horner polynomial", hornerPolynomial(24)},
+      {"mixed functions", mixedFormula()},
+  };
+  const std::map<std::string, double> variables = {
+      {"x", 1.25}, {"y", -0.75}, {"z", 2.5}};
+
+  std::cout << BOLD << BLUE << "Evaluations per engine: " << RESET
+            << iterations << '\n';
+  std::cout << std::fixed << std::setprecision(1);
+  for (const Formula &formula : formulas) {
+    CompiledExpression interpreted(formula.text, EvalEngine::Interpreter);
+    CompiledExpression threaded(formula.text, EvalEngine::Threaded);
+    std::vector<double> slots = interpreted.bindVariables(variables);
+
+    double interpretedSum = 0.0;
+    double threadedSum = 0.0;
+    double interpretedNs =
+        timeEngine(interpreted, slots, iterations, interpretedSum);
+    double threadedNs = timeEngine(threaded, slots, iterations, threadedSum);
+
+    std::cout << GREEN << formula.name << RESET << " ("
+              << formula.text.size() << " chars)\n";
+    std::cout << "  interp:   " << interpretedNs << " ns/eval\n";
+    std::cout << "  threaded: " << threadedNs << " ns/eval\n";
+    std::cout << "  speedup:  " << YELLOW << std::setprecision(2)
+              << interpretedNs / threadedNs << "x" << RESET
+              << std::setprecision(1) << '\n';
+    if (interpretedSum != threadedSum &&
+        !(std::isnan(interpretedSum) && std::isnan(threadedSum))) {
+      std::cerr << RED << "Engines disagree on " << formula.name << RESET
+                << '\n';
+      return 1;
+    }
+  }
+  return 0;
+}
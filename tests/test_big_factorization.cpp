@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "core/big_factorization.hpp"
+#include "core/parallel.hpp"
+
+using boost::multiprecision::cpp_int;
+using BigFactors = std::vector<std::pair<cpp_int, int>>;
+
+// Restores the settings some tests change, even when an assertion ends a
+// test early.
+class BigFactorizationTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        setParallelWorkerCount(0);
+        setFactorTimeLimit(DefaultFactorTimeLimit);
+    }
+};
+
+TEST_F(BigFactorizationTest, NonPositiveThrows) {
+    EXPECT_THROW(factorBigInteger(0), std::invalid_argument);
+    EXPECT_THROW(factorBigInteger(-12), std::invalid_argument);
+}
+
+TEST_F(BigFactorizationTest, SmallValuesAndTrialDivision) {
+    EXPECT_EQ(factorBigInteger(1).factors, BigFactors{});
+    EXPECT_EQ(factorBigInteger(360).factors,
+              (BigFactors{{2, 3}, {3, 2}, {5, 1}}));
+    // 2^64 + 1 = 274177 * 67280421310721, just past the 64-bit path.
+    cpp_int value = (cpp_int(1) << 64) + 1;
+    EXPECT_EQ(factorBigInteger(value).factors,
+              (BigFactors{{274177, 1}, {cpp_int("67280421310721"), 1}}));
+    // 65521 is the largest prime trial division removes.
+    value = (cpp_int(1) << 70) * 65521 * 65521;
+    EXPECT_EQ(factorBigInteger(value).factors,
+              (BigFactors{{2, 70}, {65521, 2}}));
+}
+
+TEST_F(BigFactorizationTest, PrimesAndPowers) {
+    const cpp_int prime("100000000000000000039");
+    BigFactorization result = factorBigInteger(prime);
+    EXPECT_EQ(result.factors, (BigFactors{{prime, 1}}));
+    EXPECT_TRUE(result.composites.empty());
+    result = factorBigInteger(prime * prime * prime * 7);
+    EXPECT_EQ(result.factors, (BigFactors{{7, 1}, {prime, 3}}));
+}
+
+TEST_F(BigFactorizationTest, EllipticCurvesSplitFermatSeven) {
+    // F7 = 2^128 + 1 has a 17-digit factor, beyond the reach of rho.
+    setParallelWorkerCount(4);
+    cpp_int fermat = (cpp_int(1) << 128) + 1;
+    BigFactorization result = factorBigInteger(fermat);
+    EXPECT_EQ(result.factors,
+              (BigFactors{{cpp_int("59649589127497217"), 1},
+                          {cpp_int("5704689200685129054721"), 1}}));
+    EXPECT_TRUE(result.composites.empty());
+}
+
+TEST_F(BigFactorizationTest, ExhaustedBudgetLeavesComposites) {
+    setFactorTimeLimit(0);
+    cpp_int fermat = (cpp_int(1) << 128) + 1;
+    BigFactorization result = factorBigInteger(fermat * 9);
+    EXPECT_EQ(result.factors, (BigFactors{{3, 2}}));
+    EXPECT_EQ(result.composites, (BigFactors{{fermat, 1}}));
+}
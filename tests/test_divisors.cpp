@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
+#include <vector>
 
 #include "core/divisors.hpp"
 
@@ -12,4 +15,26 @@ TEST(DivisorTest, CalculatesDivisorsOfTen) {
 }
 TEST(DivisorTest, TestNegativeDivisors) {
     EXPECT_EQ(calculateDivisors(-10), std::vector<long long>({1, 2, 5, 10}));
-}
\ No newline at end of file
+}
+TEST(DivisorTest, DivisorsOfLargeCompositeAreSorted) {
+    // 2^6 * 3^4 * 7^2 * 1000003
+    std::vector<long long> divisors = calculateDivisors(254016762048LL);
+    EXPECT_EQ(divisors.size(), 7u * 5u * 3u * 2u);
+    EXPECT_TRUE(std::is_sorted(divisors.begin(), divisors.end()));
+    EXPECT_EQ(divisors.back(), 254016762048LL);
+    EXPECT_EQ(calculateDivisors(8999999843999998651LL),
+              std::vector<long long>({1, 2999999929LL, 3000000019LL,
+                                      8999999843999998651LL}));
+}
+TEST(DivisorTest, CountsAndSumsWithoutListing) {
+    EXPECT_EQ(countDivisors(1), 1);
+    EXPECT_EQ(countDivisors(-360), 24);
+    EXPECT_EQ(sumDivisors(360), 1170);
+    EXPECT_EQ(countDivisors(897612484786617600LL), 103680);
+    EXPECT_EQ(sumDivisors(897612484786617600LL).str(), "5785230588744499200");
+    // sigma(3 * 2^61) = 4 * (2^62 - 1) exceeds the long long range.
+    EXPECT_EQ(sumDivisors(6917529027641081856LL).str(), "18446744073709551612");
+    EXPECT_THROW(countDivisors(0), std::invalid_argument);
+    EXPECT_THROW(calculateDivisors(std::numeric_limits<long long>::min()),
+                 std::out_of_range);
+}
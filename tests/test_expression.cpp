@@ -1,9 +1,34 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
 #include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
+#include "core/big_factorial.hpp"
+#include "core/bigint_decimal.hpp"
 #include "core/expression.hpp"
+#include "core/expression_internal.hpp"
+#include "core/parallel.hpp"
 
-TEST(ExpressionTest, SimpleArithmetic)
+// Some tests change process-wide settings. Restoring them after every test
+// keeps a failed assertion from leaking a setting into the tests after it.
+class ExpressionTest : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        setParallelWorkerCount(0);
+        setBigDoublePrecision(DefaultBigDoublePrecision);
+        setFactorialLimit(DefaultFactorialLimit);
+        setPowerResultLimit(DefaultPowerResultLimit);
+    }
+};
+
+TEST_F(ExpressionTest, SimpleArithmetic)
 {
     EXPECT_DOUBLE_EQ(evaluateExpression("1+1"), 2);
     EXPECT_DOUBLE_EQ(evaluateExpression("10 - 3"), 7);
@@ -11,14 +36,14 @@ TEST(ExpressionTest, SimpleArithmetic)
     EXPECT_DOUBLE_EQ(evaluateExpression("20 / 4"), 5);
 }
 
-TEST(ExpressionTest, ComplexArithmetic)
+TEST_F(ExpressionTest, ComplexArithmetic)
 {
     EXPECT_DOUBLE_EQ(evaluateExpression("2+3*4"), 14);
     EXPECT_DOUBLE_EQ(evaluateExpression("(2+3)*4"), 20);
     EXPECT_NEAR(evaluateExpression("3.5 * 2.2"), 7.7, 1e-9);
 }
 
-TEST(ExpressionTest, TrigonometryAndFunctions)
+TEST_F(ExpressionTest, TrigonometryAndFunctions)
 {
     EXPECT_NEAR(evaluateExpression("sin(0)"), 0.0, 1e-9);
     EXPECT_NEAR(evaluateExpression("cos(0)"), 1.0, 1e-9);
@@ -26,12 +51,12 @@ TEST(ExpressionTest, TrigonometryAndFunctions)
     EXPECT_NEAR(evaluateExpression("log(exp(1))"), 1.0, 1e-9);
 }
 
-TEST(ExpressionTest, Factorial)
+TEST_F(ExpressionTest, Factorial)
 {
     EXPECT_DOUBLE_EQ(evaluateExpression("5!"), 120);
 }
 
-TEST(ExpressionTest, Variables)
+TEST_F(ExpressionTest, Variables)
 {
     std::map<std::string, double> vars{
         {"x", 2.5},
@@ -42,8 +67,725 @@ TEST(ExpressionTest, Variables)
     EXPECT_NEAR(evaluateExpression("pi + x", vars), 5.641592653589793, 1e-12);
 }
 
-TEST(ExpressionTest, BigDoubleArithmetic)
+TEST_F(ExpressionTest, BigDoubleArithmetic)
 {
     EXPECT_EQ(evaluateExpressionBigDouble("0.1 + 0.2"), "0.3");
     EXPECT_EQ(evaluateExpressionBigDouble("2^10"), "1024");
 }
+
+TEST_F(ExpressionTest, BigDoublePrecision)
+{
+    EXPECT_EQ(bigDoublePrecision(), DefaultBigDoublePrecision);
+    EXPECT_EQ(evaluateExpressionBigDouble("1/3"), "0." + std::string(50, '3'));
+    for (std::size_t digits : {1u, 30u, 31u, 100u, 250u, 500u, 1000u})
+    {
+        setBigDoublePrecision(digits);
+        EXPECT_EQ(evaluateExpressionBigDouble("2/3"),
+                  "0." + std::string(digits - 1, '6') + "7") << digits;
+        EXPECT_EQ(evaluateExpressionBigDouble("0.1 + 0.2"), "0.3") << digits;
+    }
+    // Decimal fractions are inexact in binary, but a sum that cancels down
+    // to rounding noise is zero, whatever the operands' magnitude.
+    for (std::size_t digits : {30u, 50u, 100u, 1000u})
+    {
+        setBigDoublePrecision(digits);
+        EXPECT_EQ(evaluateExpressionBigDouble("0.1 + 0.2 - 0.3"), "0")
+            << digits;
+        EXPECT_EQ(evaluateExpressionBigDouble("(0.1 + 0.2 - 0.3) * 10^90"),
+                  "0") << digits;
+        EXPECT_THROW(evaluateExpressionBigDouble("1 / (0.1 + 0.2 - 0.3)"),
+                     std::runtime_error) << digits;
+        EXPECT_EQ(evaluateExpressionBigDouble("10^-58 / 10^-58"), "1")
+            << digits;
+    }
+    setBigDoublePrecision(30);
+    EXPECT_EQ(evaluateExpressionBigDouble("4 * atan(1)"),
+              "3.14159265358979323846264338328");
+    EXPECT_EQ(evaluateExpressionBigDouble("3^200 mod 1000007"), "959082");
+    EXPECT_THROW(setBigDoublePrecision(0), std::out_of_range);
+    EXPECT_THROW(setBigDoublePrecision(MaxBigDoublePrecision + 1),
+                 std::out_of_range);
+    EXPECT_EQ(bigDoublePrecision(), 30u);
+}
+
+TEST_F(ExpressionTest, AdaptiveEvaluation)
+{
+    AdaptiveResult result = evaluateExpressionAdaptive("0.1 + 0.2");
+    EXPECT_EQ(result.text, "0.3");
+    EXPECT_EQ(result.path, EvalPath::Double);
+    EXPECT_DOUBLE_EQ(result.value, 0.3);
+
+    result = evaluateExpressionAdaptive("sin(x)^2 + cos(x)^2 + 2^10 / 4",
+                                        {{"x", 0.5}});
+    EXPECT_EQ(result.text, "257");
+    EXPECT_EQ(result.path, EvalPath::Double);
+    EXPECT_EQ(evaluateExpressionAdaptive("x - x", {{"x", 0.1}}).path,
+              EvalPath::Double);
+    result = evaluateExpressionAdaptive("10! mod 7 + powmod(3, 100, 101)");
+    EXPECT_EQ(result.path, EvalPath::Double);
+
+    // Cancellation: the double result is pure rounding error.
+    result =
+        evaluateExpressionAdaptive("10000000000000000 + 1 - 10000000000000000");
+    EXPECT_EQ(result.text, "1");
+    EXPECT_EQ(result.path, EvalPath::BigDouble);
+    // 2^53 + 1 rounds to 2^53 as a double, so the literal is not exact.
+    result = evaluateExpressionAdaptive("9007199254740993 - 9007199254740992");
+    EXPECT_EQ(result.text, "1");
+    EXPECT_EQ(result.path, EvalPath::BigDouble);
+    // Escalated results keep only the digits two precisions agree on.
+    result = evaluateExpressionAdaptive("0.1 + 0.2 - 0.3");
+    EXPECT_EQ(result.text, "0");
+    EXPECT_EQ(result.path, EvalPath::BigDouble);
+    result = evaluateExpressionAdaptive("(1 + 10^-20) - 1");
+    EXPECT_EQ(result.text, "1e-20");
+    EXPECT_EQ(result.path, EvalPath::BigDouble);
+    result = evaluateExpressionAdaptive("sin(3.14159265358979323846)");
+    EXPECT_EQ(result.path, EvalPath::BigDouble);
+    EXPECT_NE(result.text.find("e-21"), std::string::npos);
+
+    // Overflow.
+    result = evaluateExpressionAdaptive("200!");
+    EXPECT_EQ(result.path, EvalPath::BigDouble);
+    EXPECT_EQ(result.text.rfind(
+                  "7.88657867364790503552363213932185062295135977687", 0),
+              0u);
+
+    EXPECT_THROW(evaluateExpressionAdaptive("1 / (0.1 + 0.2 - 0.3)"),
+                 std::runtime_error);
+    EXPECT_THROW(evaluateExpressionAdaptive("log(0)"), std::domain_error);
+    EXPECT_THROW(evaluateExpressionAdaptive("y + 1"), std::invalid_argument);
+    EXPECT_THROW(evaluateExpressionAdaptive("(1"), std::invalid_argument);
+}
+
+TEST_F(ExpressionTest, IntervalEvaluation)
+{
+    Interval exact = evaluateExpressionInterval("(1 + 2) * 3^2 - 2^10 / 4");
+    EXPECT_EQ(exact.lo, -229.0);
+    EXPECT_EQ(exact.hi, -229.0);
+
+    Interval tenth = evaluateExpressionInterval("0.1 + 0.2");
+    EXPECT_LT(tenth.lo, tenth.hi);
+    EXPECT_TRUE(tenth.contains(0.1 + 0.2));
+    EXPECT_LE(tenth.hi - tenth.lo, 1e-15);
+    EXPECT_TRUE(evaluateExpressionInterval("0.1 + 0.2 - 0.3").contains(0.0));
+    EXPECT_EQ(evaluateExpressionInterval("0.5 + 1.25").hi, 1.75);
+    EXPECT_EQ(evaluateExpressionInterval("-0.75 + 1.25").lo, 0.5);
+
+    Interval root = evaluateExpressionInterval("sqrt(2)^2");
+    EXPECT_TRUE(root.contains(2.0));
+    Interval sine =
+        evaluateExpressionInterval("sin(x)", {{"x", 3.141592653589793}});
+    EXPECT_LE(sine.lo, std::sin(3.141592653589793));
+    EXPECT_GE(sine.hi, std::sin(3.141592653589793));
+    EXPECT_EQ(evaluateExpressionInterval("5! + 7 mod 3").lo, 121.0);
+
+    EXPECT_THROW(evaluateExpressionInterval("1 / (2 - 2)"), std::runtime_error);
+    EXPECT_THROW(evaluateExpressionInterval("log(0 - 1)"), std::domain_error);
+    EXPECT_THROW(evaluateExpressionInterval("2.5!"), std::invalid_argument);
+    EXPECT_THROW(evaluateExpressionInterval("y"), std::invalid_argument);
+}
+
+TEST_F(ExpressionTest, IntervalExpressionOverRanges)
+{
+    IntervalExpression parabola("x^2 - 2*x + 2");
+    ASSERT_EQ(parabola.variableNames(), std::vector<std::string>{"x"});
+    // (x - 1)^2 + 1 has no zero, and the bounds show it on [-1, 3].
+    Interval bounds = parabola.evaluate({{"x", {-1.0, 3.0}}});
+    EXPECT_GT(bounds.lo, -20.0);
+    EXPECT_GE(bounds.hi, 5.0);
+    EXPECT_GT(parabola.evaluate({{"x", {1.9, 2.1}}}).lo, 0.0);
+
+    IntervalExpression wave("sin(x) + cos(x)");
+    Interval full = wave.evaluate({{"x", {0.0, 10.0}}});
+    EXPECT_EQ(full.lo, -2.0);
+    EXPECT_EQ(full.hi, 2.0);
+    Interval narrow = wave.evaluate({{"x", {0.1, 0.2}}});
+    EXPECT_GT(narrow.lo, 1.0);
+    EXPECT_LT(narrow.hi, 1.2);
+
+    EXPECT_TRUE(IntervalExpression("1/x")
+                    .evaluate({{"x", {-1.0, 1.0}}})
+                    .contains(1e300));
+    EXPECT_EQ(IntervalExpression("x^3").evaluate({{"x", {-2.0, 1.0}}}).lo,
+              -8.0);
+    EXPECT_EQ(IntervalExpression("x^2").evaluate({{"x", {-2.0, 1.0}}}).lo, 0.0);
+    Interval logarithm =
+        IntervalExpression("log(x)").evaluate({{"x", {-1.0, 1.0}}});
+    EXPECT_EQ(logarithm.lo, -std::numeric_limits<double>::infinity());
+    EXPECT_LT(logarithm.hi, 1e-300);
+    EXPECT_EQ(IntervalExpression("x!").evaluate({{"x", {2.5, 4.5}}}).hi, 24.0);
+    IntervalExpression remainder("x mod 5");
+    EXPECT_EQ(remainder.evaluate({{"x", {6.0, 7.0}}}).hi, 2.0);
+    EXPECT_EQ(remainder.evaluate({{"x", {4.0, 6.0}}}).hi, 5.0);
+
+    Interval slots[] = {{0.0, 1.0}};
+    IntervalResult failed =
+        IntervalExpression("sqrt(x - 2)").tryEvaluateSlots(slots);
+    EXPECT_FALSE(failed.ok());
+    EXPECT_EQ(failed.status.error, EvalErrorCode::DomainError);
+    EXPECT_EQ(failed.status.position, 0u);
+    EXPECT_THROW(wave.evaluate({}), std::invalid_argument);
+}
+
+TEST_F(ExpressionTest, Gradient)
+{
+    GradientResult result = evaluateGradient(
+        "x^2 * y + sin(x) - y / x", {"x", "y"}, {{"x", 2.0}, {"y", 3.0}});
+    EXPECT_DOUBLE_EQ(result.value, 12.0 + std::sin(2.0) - 1.5);
+    ASSERT_EQ(result.gradient.size(), 2u);
+    EXPECT_DOUBLE_EQ(result.gradient[0],
+                     2 * 2.0 * 3.0 + std::cos(2.0) + 3.0 / 4.0);
+    EXPECT_DOUBLE_EQ(result.gradient[1], 4.0 - 0.5);
+
+    // Only the listed variables are differentiated, in the listed order.
+    result = evaluateGradient("X * y + z", {"z", "x"},
+                              {{"x", 5.0}, {"y", 7.0}, {"z", 1.0}});
+    EXPECT_DOUBLE_EQ(result.value, 36.0);
+    EXPECT_DOUBLE_EQ(result.gradient[0], 1.0);
+    EXPECT_DOUBLE_EQ(result.gradient[1], 7.0);
+    EXPECT_EQ(evaluateGradient("2 + 3", {"x"}).gradient,
+              std::vector<double>{0.0});
+
+    std::map<std::string, double> at{{"x", 0.5}, {"y", 2.0}};
+    EXPECT_DOUBLE_EQ(
+        evaluateGradient("exp(x) * log(y)", {"x", "y"}, at).gradient[1],
+        std::exp(0.5) / 2.0);
+    EXPECT_DOUBLE_EQ(evaluateGradient("y ^ x", {"x"}, at).gradient[0],
+                     std::sqrt(2.0) * std::log(2.0));
+    EXPECT_DOUBLE_EQ(
+        evaluateGradient("sqrt(x) + atan(x)", {"x"}, at).gradient[0],
+        0.5 / std::sqrt(0.5) + 1.0 / 1.25);
+    EXPECT_DOUBLE_EQ(evaluateGradient("(3 * x) mod 1", {"x"}, at).gradient[0],
+                     3.0);
+    EXPECT_NEAR(evaluateGradient("y!", {"y"}, at).gradient[0],
+                2.0 * (1.5 - 0.5772156649015329), 1e-12);
+
+    // A zero base has finite one-sided derivatives where the limits exist.
+    std::map<std::string, double> origin{{"x", 0.0}, {"y", 3.0}};
+    result = evaluateGradient("0^y", {"y"}, origin);
+    EXPECT_EQ(result.value, 0.0);
+    EXPECT_EQ(result.gradient[0], 0.0);
+    result = evaluateGradient("x^(y - 3)", {"x"}, origin);
+    EXPECT_EQ(result.value, 1.0);
+    EXPECT_EQ(result.gradient[0], 0.0);
+    EXPECT_EQ(evaluateGradient("x^0.5", {"x"}, origin).gradient[0],
+              std::numeric_limits<double>::infinity());
+
+    EXPECT_THROW(evaluateGradient("1 / (x - x)", {"x"}, at),
+                 std::runtime_error);
+    EXPECT_THROW(evaluateGradient("x + w", {"x"}, at), std::invalid_argument);
+    EXPECT_THROW(evaluateGradient("x", {"x", "x"}, at), std::invalid_argument);
+    const std::vector<std::string> tooMany(MaxGradientVariables + 1, "x");
+    EXPECT_THROW(evaluateGradient("x", tooMany, at), std::invalid_argument);
+}
+
+TEST_F(ExpressionTest, SampleExpression)
+{
+    // A straight line needs nothing beyond the initial grid.
+    SampledCurve line = sampleExpression("2 * x + 1", "x", -1.0, 1.0, 21);
+    ASSERT_EQ(line.xs.size(), 21u);
+    EXPECT_EQ(line.xs.front(), -1.0);
+    EXPECT_EQ(line.xs.back(), 1.0);
+    EXPECT_DOUBLE_EQ(line.ys[10], 1.0);
+
+    // A narrow peak gets dense samples around it and keeps the coarse
+    // spacing in the flat tails.
+    SampledCurve peak =
+        sampleExpression("1 / (1 + 10000 * x^2)", "x", -1.0, 1.0, 21);
+    ASSERT_TRUE(std::is_sorted(peak.xs.begin(), peak.xs.end()));
+    std::size_t nearPeak =
+        std::count_if(peak.xs.begin(), peak.xs.end(),
+                      [](double x) { return std::fabs(x) < 0.1; });
+    EXPECT_GT(nearPeak, 20u);
+    EXPECT_DOUBLE_EQ(peak.xs[1] - peak.xs[0], 0.1);
+    EXPECT_DOUBLE_EQ(*std::max_element(peak.ys.begin(), peak.ys.end()), 1.0);
+
+    // Undefined samples are NaN and the domain edge is closed in on.
+    SampledCurve root =
+        sampleExpression("sqrt(x) * k", "X", -1.0, 1.0, 5, {{"k", 2.0}});
+    EXPECT_TRUE(std::isnan(root.ys[0]));
+    auto firstDefined = std::find_if(root.ys.begin(), root.ys.end(),
+                                     [](double y) { return !std::isnan(y); });
+    ASSERT_NE(firstDefined, root.ys.end());
+    EXPECT_LT(root.xs[firstDefined - root.ys.begin()], 0.01);
+
+    EXPECT_THROW(sampleExpression("1 / 0 + x", "x", 0.0, 1.0),
+                 std::runtime_error);
+    EXPECT_THROW(sampleExpression("x + w", "x", 0.0, 1.0),
+                 std::invalid_argument);
+    EXPECT_THROW(sampleExpression("x", "x", 1.0, 0.0), std::invalid_argument);
+    EXPECT_THROW(sampleExpression("x", "x", 0.0, 1.0, 1),
+                 std::invalid_argument);
+}
+
+TEST(ParallelTest, ParallelForRunsEveryIndexOnce)
+{
+    setParallelWorkerCount(4);
+    EXPECT_EQ(parallelWorkerCount(), 4u);
+    std::vector<std::atomic<int>> hits(1000);
+    parallelFor(hits.size(), [&](std::size_t idx) {
+        hits[idx].fetch_add(1);
+        // Nested loops run on the same pool without deadlocking.
+        parallelFor(2, [](std::size_t) {});
+    });
+    EXPECT_TRUE(std::all_of(
+        hits.begin(), hits.end(),
+        [](const std::atomic<int> &hit) { return hit.load() == 1; }));
+    EXPECT_THROW(parallelFor(100,
+                             [](std::size_t idx) {
+                                 if (idx == 42) {
+                                     throw std::runtime_error("boom");
+                                 }
+                             }),
+                 std::runtime_error);
+}
+
+TEST_F(ExpressionTest, IntegrateExpression)
+{
+    // Refinement rounds are spread over several workers even on one core.
+    setParallelWorkerCount(4);
+    IntegrationResult cubic = integrateExpression("x^2", "x", 0.0, 3.0);
+    EXPECT_TRUE(cubic.converged);
+    EXPECT_NEAR(cubic.value, 9.0, 1e-12);
+    EXPECT_NEAR(integrateExpression("x^2", "x", 3.0, 0.0).value, -9.0, 1e-12);
+    EXPECT_EQ(integrateExpression("x", "x", 2.0, 2.0).value, 0.0);
+
+    const double pi = std::acos(-1.0);
+    IntegrationResult gaussian =
+        integrateExpression("exp(-x^2)", "X", -10.0, 10.0);
+    EXPECT_NEAR(gaussian.value, std::sqrt(pi), 1e-12);
+    EXPECT_LE(gaussian.error, 1e-10 * gaussian.value);
+    EXPECT_NEAR(integrateExpression("sin(k * x)", "x", 0.0, pi, 1e-12,
+                                    {{"k", 3.0}})
+                    .value,
+                2.0 / 3.0, 1e-12);
+
+    // The endpoint singularity of the derivative forces refinement near 0.
+    IntegrationResult root =
+        integrateExpression("sqrt(x)", "x", 0.0, 1.0, 1e-9);
+    EXPECT_NEAR(root.value, 2.0 / 3.0, 1e-9);
+    EXPECT_GT(root.segments, 16u);
+
+    EXPECT_THROW(integrateExpression("log(x)", "x", -1.0, 1.0),
+                 std::domain_error);
+    EXPECT_THROW(integrateExpression("1/x", "x", -1.0, 1.0),
+                 std::overflow_error);
+    EXPECT_THROW(integrateExpression("1/x", "x", 0.0, 1.0),
+                 std::overflow_error);
+    EXPECT_THROW(integrateExpression("x + w", "x", 0.0, 1.0),
+                 std::invalid_argument);
+    EXPECT_THROW(integrateExpression("x", "x", 0.0, 1.0, 0.0),
+                 std::invalid_argument);
+}
+
+TEST_F(ExpressionTest, FindRoots)
+{
+    setParallelWorkerCount(4);
+    const double pi = std::acos(-1.0);
+    std::vector<double> roots = findRoots("sin(x)", "x", -7.0, 7.0);
+    ASSERT_EQ(roots.size(), 5u);
+    for (int k = -2; k <= 2; ++k) {
+        EXPECT_NEAR(roots[k + 2], k * pi, 1e-14);
+    }
+
+    // Transcendental, with the default range.
+    roots = findRoots("cos(x) - x", "X");
+    ASSERT_EQ(roots.size(), 1u);
+    EXPECT_NEAR(roots[0], 0.7390851332151607, 1e-15);
+    roots = findRoots("x^3 - c", "x", -10.0, 10.0, {{"c", 2.0}});
+    ASSERT_EQ(roots.size(), 1u);
+    EXPECT_DOUBLE_EQ(roots[0], std::cbrt(2.0));
+
+    // Two close roots, a pole that is not a root, and a domain edge.
+    roots = findRoots("(x - 1) * (x - 1.01)", "x", 0.0, 2.0);
+    ASSERT_EQ(roots.size(), 2u);
+    EXPECT_NEAR(roots[1], 1.01, 1e-14);
+    EXPECT_TRUE(findRoots("1 / x", "x", -1.0, 1.0).empty());
+    roots = findRoots("log(x) - 1", "x", -5.0, 5.0);
+    ASSERT_EQ(roots.size(), 1u);
+    EXPECT_NEAR(roots[0], std::exp(1.0), 1e-14);
+    EXPECT_EQ(findRoots("x^2", "x", -1.0, 1.0), std::vector<double>{0.0});
+    // Roots that touch zero without crossing it, off the scan grid.
+    EXPECT_EQ(findRoots("(x - 1)^2", "x", 0.0, 3.0), std::vector<double>{1.0});
+    roots = findRoots("(x - 1)^2 * (x + 2)", "x", -3.0, 3.0);
+    ASSERT_EQ(roots.size(), 2u);
+    EXPECT_DOUBLE_EQ(roots[0], -2.0);
+    EXPECT_DOUBLE_EQ(roots[1], 1.0);
+    roots = findRoots("sin(x) + 1", "x", -3.0, 3.0);
+    ASSERT_EQ(roots.size(), 1u);
+    EXPECT_NEAR(roots[0], -pi / 2, 1e-14);
+    // A minimum just above zero is proven root-free.
+    EXPECT_TRUE(findRoots("(x - 1)^2 + 10^-20", "x", 0.0, 3.0).empty());
+    EXPECT_THROW(findRoots("x - w", "x", 0.0, 1.0), std::invalid_argument);
+}
+
+TEST_F(ExpressionTest, CompiledExpressionReuse)
+{
+    CompiledExpression compiled("a*x^2 + b*x + c");
+    std::map<std::string, double> vars{{"a", 2.0}, {"b", -3.0}, {"c", 1.0}};
+    for (int x = -5; x <= 5; ++x)
+    {
+        vars["x"] = x;
+        EXPECT_DOUBLE_EQ(compiled.evaluate(vars), 2.0 * x * x - 3.0 * x + 1.0);
+    }
+}
+
+TEST_F(ExpressionTest, CompiledExpressionErrors)
+{
+    EXPECT_THROW(CompiledExpression("2+*3"), std::invalid_argument);
+    CompiledExpression compiled("1 / y");
+    EXPECT_THROW(compiled.evaluate(), std::invalid_argument);
+    EXPECT_THROW(compiled.evaluate({{"y", 0.0}}), std::runtime_error);
+}
+
+TEST_F(ExpressionTest, CompiledExpressionSlots)
+{
+    CompiledExpression compiled("x*y + x");
+    ASSERT_EQ(compiled.variableNames(), std::vector<std::string>({"x", "y"}));
+    std::vector<double> slots =
+        compiled.bindVariables({{"x", 3.0}, {"y", 4.0}, {"z", 1.0}});
+    EXPECT_DOUBLE_EQ(compiled.evaluateSlots(slots.data()), 15.0);
+    slots[0] = 2.0;
+    EXPECT_DOUBLE_EQ(compiled.evaluateSlots(slots.data()), 10.0);
+    EXPECT_THROW(compiled.bindVariables({{"x", 1.0}}), std::invalid_argument);
+}
+
+TEST_F(ExpressionTest, CompiledExpressionSimplification)
+{
+    std::map<std::string, double> vars{{"x", -1.5}};
+    EXPECT_DOUBLE_EQ(CompiledExpression("2*3.14159/360*x").evaluate(vars),
+                     2 * 3.14159 / 360 * -1.5);
+    EXPECT_DOUBLE_EQ(CompiledExpression("x^2 - 1*x*1 + x/1 - 0").evaluate(vars),
+                     2.25);
+    EXPECT_DOUBLE_EQ(CompiledExpression("(x+1)^2").evaluate(vars), 0.25);
+    EXPECT_THROW(CompiledExpression("log(0) * x").evaluate(vars),
+                 std::domain_error);
+    EXPECT_THROW(CompiledExpression("x / (2 - 2)").evaluate(vars),
+                 std::runtime_error);
+    EXPECT_THROW(CompiledExpression("(0-3)! + x").evaluate(vars),
+                 std::invalid_argument);
+}
+
+TEST_F(ExpressionTest, CompiledExpressionColumns)
+{
+    CompiledExpression compiled("a*x^2 + b*x + c");
+    std::vector<std::vector<double>> columns(compiled.variableNames().size());
+    std::vector<double> xs;
+    for (int row = 0; row < 1000; ++row)
+    {
+        xs.push_back(row * 0.01 - 5.0);
+    }
+    for (std::size_t slot = 0; slot < columns.size(); ++slot)
+    {
+        const std::string &name = compiled.variableNames()[slot];
+        if (name == "x")
+        {
+            columns[slot] = xs;
+        }
+        else
+        {
+            columns[slot] = {name == "a" ? 2.0 : name == "b" ? -3.0 : 0.5};
+        }
+    }
+    std::vector<double> results = compiled.evaluateColumns(columns, xs.size());
+    ASSERT_EQ(results.size(), xs.size());
+    for (std::size_t row = 0; row < xs.size(); ++row)
+    {
+        std::map<std::string, double> vars{
+            {"a", 2.0}, {"b", -3.0}, {"c", 0.5}, {"x", xs[row]}};
+        EXPECT_DOUBLE_EQ(results[row], compiled.evaluate(vars));
+    }
+    EXPECT_THROW(CompiledExpression("1/x").evaluateColumns({{1.0, 0.0}}, 2),
+                 std::runtime_error);
+
+    // Only the failing row fails; the rest of its block still evaluates.
+    std::vector<double> logInputs(300, 1.0);
+    logInputs[7] = 0.0;
+    std::vector<EvalResult> rows = CompiledExpression("log(x) + 1")
+                                       .tryEvaluateColumns({logInputs},
+                                                           logInputs.size());
+    ASSERT_EQ(rows.size(), logInputs.size());
+    EXPECT_EQ(rows[7].error, EvalErrorCode::DomainError);
+    EXPECT_EQ(rows[7].position, 0u);
+    for (std::size_t row = 0; row < rows.size(); ++row)
+    {
+        if (row != 7)
+        {
+            EXPECT_TRUE(rows[row].ok()) << row;
+            EXPECT_EQ(rows[row].value, 1.0) << row;
+        }
+    }
+    EXPECT_THROW(CompiledExpression("x + y").tryEvaluateColumns({{1.0}}, 1),
+                 std::invalid_argument);
+}
+
+TEST_F(ExpressionTest, TokenizerViewsAndNumbers)
+{
+    std::string source = "SIN(0) + Rate * .5 - 12.25";
+    std::vector<expression_detail::Token> tokens;
+    expression_detail::tokenizeExpression(source, tokens);
+    ASSERT_EQ(tokens.size(), 10u);
+    EXPECT_EQ(tokens[0].type, expression_detail::Token::Type::Function);
+    EXPECT_EQ(tokens[0].function, expression_detail::FunctionId::Sin);
+    EXPECT_EQ(tokens[5].type, expression_detail::Token::Type::Variable);
+    EXPECT_EQ(tokens[5].text, "Rate");
+    EXPECT_EQ(tokens[5].text.data(), source.data() + 9);
+    EXPECT_EQ(tokens[7].text, ".5");
+    EXPECT_EQ(tokens[9].text, "12.25");
+
+    const auto *buffer = tokens.data();
+    expression_detail::tokenizeExpression("x + 1", tokens);
+    EXPECT_EQ(tokens.size(), 3u);
+    EXPECT_EQ(tokens.data(), buffer);
+
+    EXPECT_DOUBLE_EQ(evaluateExpression("RATE * 2", {{"rate", 1.5}}), 3.0);
+    EXPECT_EQ(evaluateExpressionBigInt("-12 * X", {{"x", 3}}), "-36");
+    EXPECT_EQ(evaluateExpressionBigDouble("-.5 + X", {{"x", 1}}), "0.5");
+    EXPECT_THROW(evaluateExpression("1" + std::string(400, '0')),
+                 std::out_of_range);
+}
+
+TEST_F(ExpressionTest, ModesShareFrontEnd)
+{
+    EXPECT_EQ(evaluateExpressionBigInt("2^3^2"), "512");
+    EXPECT_EQ(evaluateExpressionBigInt("2^100"),
+              "1267650600228229401496703205376");
+    EXPECT_EQ(evaluateExpressionBigInt("(0-3)^3 + x^2", {{"x", 4}}), "-11");
+    EXPECT_EQ(evaluateExpressionBigInt("(0-1)^(0-3)"), "-1");
+    EXPECT_THROW(evaluateExpressionBigInt("2^(0-1)"), std::domain_error);
+    EXPECT_THROW(evaluateExpressionBigInt("10^10^10"), std::overflow_error);
+    EXPECT_THROW(evaluateExpressionBigInt("sin(1)"), std::invalid_argument);
+    EXPECT_THROW(evaluateExpressionBigInt("1.5"), std::invalid_argument);
+    EXPECT_THROW(evaluateExpressionBigInt("7 / 2"), std::domain_error);
+    EXPECT_EQ(evaluateExpressionBigDouble("2^3^2"), "512");
+    EXPECT_EQ(evaluateExpressionBigDouble("x*1 + 0 - 0", {{"x", 2.5}}), "2.5");
+    EXPECT_THROW(evaluateExpressionBigDouble("1/(x-x)", {{"x", 1}}),
+                 std::runtime_error);
+    EXPECT_THROW(evaluateExpressionBigDouble("(1"), std::invalid_argument);
+    EXPECT_THROW(evaluateExpressionBigDouble("y + 1"), std::invalid_argument);
+}
+
+TEST_F(ExpressionTest, TryEvaluateReportsErrors)
+{
+    EvalResult ok = tryEvaluateExpression("2 * x", {{"x", 4}});
+    EXPECT_TRUE(ok.ok());
+    EXPECT_DOUBLE_EQ(ok.value, 8.0);
+    EXPECT_TRUE(ok.message.empty());
+
+    EvalResult division = tryEvaluateExpression("1 + 5 / (x - x)", {{"x", 2}});
+    EXPECT_EQ(division.error, EvalErrorCode::DivisionByZero);
+    EXPECT_EQ(division.position, 6u);
+    EXPECT_EQ(division.message, "Division by zero in expression.");
+
+    EvalResult logarithm = tryEvaluateExpression("3 * log(x)", {{"x", 0}});
+    EXPECT_EQ(logarithm.error, EvalErrorCode::DomainError);
+    EXPECT_EQ(logarithm.position, 4u);
+
+    EvalResult missing = tryEvaluateExpression("1 + Rate");
+    EXPECT_EQ(missing.error, EvalErrorCode::UnknownVariable);
+    EXPECT_EQ(missing.position, 4u);
+    EXPECT_EQ(missing.message, "Unknown variable: rate");
+
+    EvalResult factorial = tryEvaluateExpression("2.5!");
+    EXPECT_EQ(factorial.error, EvalErrorCode::InvalidOperand);
+    EXPECT_EQ(factorial.position, 3u);
+
+    EvalResult malformed = tryEvaluateExpression("2 + * 3");
+    EXPECT_EQ(malformed.error, EvalErrorCode::InvalidExpression);
+    EXPECT_FALSE(malformed.message.empty());
+
+    CompiledExpression compiled("sqrt(x)");
+    EXPECT_EQ(compiled.tryEvaluate({{"x", -1}}).error,
+              EvalErrorCode::DomainError);
+    EXPECT_DOUBLE_EQ(compiled.tryEvaluate({{"x", 9}}).value, 3.0);
+    EXPECT_THROW(compiled.evaluate({{"x", -1}}), std::domain_error);
+    EXPECT_THROW(evaluateExpression("171!"), std::overflow_error);
+}
+
+TEST_F(ExpressionTest, ThreadedEngineMatchesInterpreter)
+{
+    const std::map<std::string, double> vars = {{"x", 1.5}, {"y", -2.0}};
+    const char *expressions[] = {
+        "x",
+        "-3.5",
+        "1 + x * 2 - y / 4",
+        "(x + 1) * (y - 2) / (x * y + 10)",
+        "x^2 + y^3 - 2^x",
+        "sin(x) * cos(y) + sqrt(x^2 + y^2)",
+        "3! + (x + y)^2 - log(x) * exp(y)",
+        "((((x + 1) * x + 2) * x + 3) * x + 4) * x + 5",
+    };
+    for (const char *text : expressions)
+    {
+        CompiledExpression interpreted(text, EvalEngine::Interpreter);
+        CompiledExpression threaded(text, EvalEngine::Threaded);
+        EXPECT_EQ(interpreted.engine(), EvalEngine::Interpreter);
+        EXPECT_EQ(threaded.engine(), EvalEngine::Threaded);
+        EXPECT_EQ(threaded.evaluate(vars), interpreted.evaluate(vars)) << text;
+    }
+
+    CompiledExpression division("1 + 5 / (x - x) + sqrt(y)",
+                                EvalEngine::Threaded);
+    EvalResult failed = division.tryEvaluate({{"x", 2}, {"y", -1}});
+    EXPECT_EQ(failed.error, EvalErrorCode::DivisionByZero);
+    EXPECT_EQ(failed.position, 6u);
+    EXPECT_EQ(CompiledExpression("x / 0", EvalEngine::Threaded)
+                  .tryEvaluate({{"x", 1}})
+                  .position,
+              2u);
+    EXPECT_EQ(CompiledExpression("3 * log(x)", EvalEngine::Threaded)
+                  .tryEvaluate({{"x", 0}})
+                  .position,
+              4u);
+    EXPECT_THROW(CompiledExpression("2.5!", EvalEngine::Threaded).evaluate(),
+                 std::invalid_argument);
+
+    std::string longSum = "x";
+    for (int idx = 0; idx < 5000; ++idx)
+    {
+        longSum += " + x";
+    }
+    CompiledExpression fallback(longSum, EvalEngine::Threaded);
+    EXPECT_EQ(fallback.engine(), EvalEngine::Interpreter);
+    EXPECT_DOUBLE_EQ(fallback.evaluate({{"x", 1}}), 5001.0);
+}
+
+TEST_F(ExpressionTest, BigFactorials)
+{
+    boost::multiprecision::cpp_int naive = 1;
+    for (unsigned n = 0; n <= 300; ++n)
+    {
+        if (n > 1)
+        {
+            naive *= n;
+        }
+        ASSERT_EQ(bigIntFactorial(n), naive) << n;
+    }
+
+    EXPECT_EQ(evaluateExpressionBigInt("25!"), "15511210043330985984000000");
+    EXPECT_EQ(evaluateExpressionBigInt("(3!)!"), "720");
+    EXPECT_EQ(evaluateExpressionBigInt("20000!").size(), 77338u);
+    EXPECT_EQ(evaluateExpressionBigDouble("25!"), "15511210043330985984000000");
+    EXPECT_EQ(evaluateExpressionBigDouble("0!"), "1");
+
+    EXPECT_EQ(factorialLimit(), DefaultFactorialLimit);
+    setFactorialLimit(10);
+    EXPECT_EQ(evaluateExpressionBigInt("10!"), "3628800");
+    EXPECT_THROW(evaluateExpressionBigInt("11!"), std::overflow_error);
+    EXPECT_THROW(evaluateExpressionBigDouble("11!"), std::overflow_error);
+    setFactorialLimit(DefaultFactorialLimit);
+    EXPECT_THROW(evaluateExpressionBigDouble("100001!"), std::overflow_error);
+}
+
+TEST_F(ExpressionTest, BigIntPromotesPastInt64)
+{
+    EXPECT_EQ(evaluateExpressionBigInt("9223372036854775807"),
+              "9223372036854775807");
+    EXPECT_EQ(evaluateExpressionBigInt("-9223372036854775808"),
+              "-9223372036854775808");
+    EXPECT_EQ(evaluateExpressionBigInt("9223372036854775807 + 1"),
+              "9223372036854775808");
+    EXPECT_EQ(evaluateExpressionBigInt("-9223372036854775808 - 1"),
+              "-9223372036854775809");
+    EXPECT_EQ(evaluateExpressionBigInt("2^62 * 4"), "18446744073709551616");
+    EXPECT_EQ(evaluateExpressionBigInt("x^2", {{"x", 3037000500}}),
+              "9223372037000250000");
+    EXPECT_EQ(evaluateExpressionBigInt("(-9223372036854775808) / (0-1)"),
+              "9223372036854775808");
+    EXPECT_EQ(evaluateExpressionBigInt("2^64 / 2^32"), "4294967296");
+    EXPECT_EQ(evaluateExpressionBigInt("21! / 21"), "2432902008176640000");
+    // The overflowing product is computed exactly, then reduced.
+    EXPECT_EQ(evaluateExpressionBigInt("(x * x) mod 1000000007",
+                                       {{"x", 4611686018427387904.0}}),
+              "829977023");
+    EXPECT_THROW(evaluateExpressionBigInt("x", {{"x", 9223372036854775808.0}}),
+                 std::overflow_error);
+    EXPECT_EQ(evaluateExpressionBigInt("powmod(3, 10^18, 10^17 + 3)"),
+              "65103966461160042");
+    EXPECT_EQ(evaluateExpressionBigInt("powmod(12345, 678, 2^33 + 1)"),
+              "3849325029");
+    EXPECT_EQ(evaluateExpressionBigInt("2 * 3 + 100000000000000000000 - 1"),
+              "100000000000000000005");
+
+    // Errors are still reported by the exact evaluation.
+    EXPECT_THROW(evaluateExpressionBigInt("1 / (2 - 2)"), std::runtime_error);
+    EXPECT_THROW(evaluateExpressionBigInt("x / 2", {{"x", 7}}),
+                 std::domain_error);
+    EXPECT_THROW(evaluateExpressionBigInt("(0-3)!"), std::invalid_argument);
+    setPowerResultLimit(8);
+    EXPECT_THROW(evaluateExpressionBigInt("2^9"), std::overflow_error);
+}
+
+TEST_F(ExpressionTest, BigIntDecimalConversions)
+{
+    for (std::size_t digits : {1u, 17u, 18u, 19u, 4095u, 4096u, 4097u, 8193u,
+                               20000u})
+    {
+        std::string text = "9";
+        for (std::size_t idx = 1; idx < digits; ++idx)
+        {
+            text += static_cast<char>('0' + (idx * 7 + 3) % 10);
+        }
+        boost::multiprecision::cpp_int value = parseDecimalInteger(text);
+        ASSERT_EQ(value, boost::multiprecision::cpp_int(text)) << digits;
+        ASSERT_EQ(toDecimalString(value), text) << digits;
+        ASSERT_EQ(toDecimalString(-value), "-" + text) << digits;
+    }
+
+    // Runs of zeros land in the middle of split halves.
+    boost::multiprecision::cpp_int power = 1;
+    power <<= 70000;
+    EXPECT_EQ(toDecimalString(power), power.convert_to<std::string>());
+    std::string tenPower = "1" + std::string(16384, '0');
+    EXPECT_EQ(toDecimalString(parseDecimalInteger(tenPower)), tenPower);
+    EXPECT_EQ(toDecimalString(0), "0");
+    EXPECT_EQ(parseDecimalInteger("000123"), 123);
+
+    EXPECT_THROW(parseDecimalInteger(""), std::invalid_argument);
+    EXPECT_THROW(parseDecimalInteger("12a4"), std::invalid_argument);
+    EXPECT_EQ(evaluateExpressionBigInt(tenPower + " - 1"),
+              std::string(16384, '9'));
+}
+
+TEST_F(ExpressionTest, ModuloAndPowMod)
+{
+    EXPECT_DOUBLE_EQ(evaluateExpression("17 mod 5"), 2.0);
+    EXPECT_DOUBLE_EQ(evaluateExpression("-17 % 5"), 3.0);
+    EXPECT_DOUBLE_EQ(evaluateExpression("17 MOD -5"), -3.0);
+    EXPECT_DOUBLE_EQ(evaluateExpression("2 + 7 mod 4 * 3"), 11.0);
+    EXPECT_DOUBLE_EQ(evaluateExpression("powmod(3, 200, 1000007)"), 959082.0);
+    EXPECT_DOUBLE_EQ(evaluateExpression("3^200 mod 1000007"), 959082.0);
+    EXPECT_DOUBLE_EQ(evaluateExpression("x^200 mod 1000007", {{"x", 3}}),
+                     959082.0);
+    EXPECT_THROW(evaluateExpression("5 mod (x - x)", {{"x", 1}}),
+                 std::runtime_error);
+    EXPECT_THROW(evaluateExpression("powmod(2, 3)"), std::invalid_argument);
+    EXPECT_THROW(evaluateExpression("sqrt(4, 9)"), std::invalid_argument);
+    EXPECT_THROW(evaluateExpression("(1, 2)"), std::invalid_argument);
+
+    CompiledExpression threaded("x^200 mod m + powmod(x, 5, 7)",
+                                EvalEngine::Threaded);
+    EXPECT_DOUBLE_EQ(threaded.evaluate({{"x", 3}, {"m", 1000007}}),
+                     959082.0 + 5.0);
+
+    EXPECT_EQ(evaluateExpressionBigInt("-17 mod 5"), "3");
+    EXPECT_EQ(evaluateExpressionBigInt("2^127 - 1 mod 1000"),
+              "170141183460469231731687303715884105727");
+    EXPECT_EQ(evaluateExpressionBigInt("(2^127 - 1) mod 1000"), "727");
+    EXPECT_EQ(evaluateExpressionBigInt("2^99999999 mod 7"), "1");
+    EXPECT_EQ(evaluateExpressionBigInt("powmod(-2, 3, 5)"), "2");
+    EXPECT_EQ(evaluateExpressionBigInt("powmod(x, 65537, 3233)", {{"x", 65}}),
+              "2790");
+    EXPECT_EQ(evaluateExpressionBigInt("powmod(7, 0, 1)"), "0");
+    EXPECT_THROW(evaluateExpressionBigInt("powmod(2, 0-1, 5)"),
+                 std::domain_error);
+    EXPECT_THROW(evaluateExpressionBigInt("3 mod 0"), std::runtime_error);
+    EXPECT_EQ(evaluateExpressionBigDouble("3^200 mod 1000007"), "959082");
+
+    EXPECT_EQ(powerResultLimit(), DefaultPowerResultLimit);
+    setPowerResultLimit(64);
+    EXPECT_EQ(evaluateExpressionBigInt("2^63"), "9223372036854775808");
+    EXPECT_THROW(evaluateExpressionBigInt("2^64"), std::overflow_error);
+    EXPECT_EQ(evaluateExpressionBigInt("2^64 mod 1000"), "616");
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include "core/expression_cache.hpp"
+#include "core/variables.hpp"
+
+TEST(ExpressionCacheTest, DisabledByDefault)
+{
+    ExpressionCache cache;
+    EXPECT_DOUBLE_EQ(cache.evaluate("1+2", {}, 0).value, 3.0);
+    EXPECT_DOUBLE_EQ(cache.evaluate("1+2", {}, 0).value, 3.0);
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(cache.hits(), 0u);
+    EXPECT_EQ(cache.misses(), 0u);
+}
+
+TEST(ExpressionCacheTest, HitsAndVersions)
+{
+    ExpressionCache cache(8);
+    std::map<std::string, double> vars{{"x", 2.0}};
+    EXPECT_DOUBLE_EQ(cache.evaluate("x * 10", vars, 1).value, 20.0);
+    EXPECT_DOUBLE_EQ(cache.evaluate("  X*10 ", vars, 1).value, 20.0);
+    EXPECT_EQ(cache.hits(), 1u);
+    EXPECT_EQ(cache.misses(), 1u);
+
+    vars["x"] = 3.0;
+    EXPECT_DOUBLE_EQ(cache.evaluate("x * 10", vars, 2).value, 30.0);
+    EXPECT_EQ(cache.misses(), 2u);
+
+    // Whitespace between two numbers is significant.
+    EXPECT_FALSE(cache.evaluate("1 2", {}, 2).ok());
+    EXPECT_DOUBLE_EQ(cache.evaluate("12", {}, 2).value, 12.0);
+
+    EXPECT_EQ(cache.evaluateBigInt("20!", {}, 2), "2432902008176640000");
+    EXPECT_EQ(cache.evaluateBigInt("20 !", {}, 2), "2432902008176640000");
+    EXPECT_EQ(cache.evaluateBigDouble("20!", {}, 2), "2432902008176640000");
+    EXPECT_EQ(cache.hits(), 2u);
+
+    setBigDoublePrecision(5);
+    EXPECT_EQ(cache.evaluateBigDouble("20!", {}, 2), "2.4329e+18");
+    setBigDoublePrecision(DefaultBigDoublePrecision);
+    EXPECT_EQ(cache.hits(), 2u);
+}
+
+TEST(ExpressionCacheTest, FailuresAreNotCached)
+{
+    ExpressionCache cache(8);
+    EXPECT_EQ(cache.evaluate("log(0)", {}, 0).error,
+              EvalErrorCode::DomainError);
+    EXPECT_EQ(cache.evaluate("log(0)", {}, 0).error,
+              EvalErrorCode::DomainError);
+    EXPECT_THROW(cache.evaluateBigInt("1/0", {}, 0), std::runtime_error);
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(cache.hits(), 0u);
+}
+
+TEST(ExpressionCacheTest, EvictsLeastRecentlyUsed)
+{
+    ExpressionCache cache(2);
+    cache.evaluate("1", {}, 0);
+    cache.evaluate("2", {}, 0);
+    cache.evaluate("1", {}, 0);
+    cache.evaluate("3", {}, 0);
+    EXPECT_EQ(cache.size(), 2u);
+    cache.evaluate("1", {}, 0);
+    EXPECT_EQ(cache.hits(), 2u);
+    cache.evaluate("2", {}, 0);
+    EXPECT_EQ(cache.hits(), 2u);
+
+    cache.setCapacity(1);
+    EXPECT_EQ(cache.size(), 1u);
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(cache.misses(), 0u);
+}
+
+TEST(ExpressionCacheTest, VariableStoreVersionTracksChanges)
+{
+    VariableStore store("unused_vars.toml");
+    auto version = store.version();
+    store.set("a", 1.0);
+    EXPECT_NE(store.version(), version);
+    version = store.version();
+    EXPECT_FALSE(store.remove("missing"));
+    EXPECT_EQ(store.version(), version);
+    EXPECT_TRUE(store.remove("a"));
+    EXPECT_NE(store.version(), version);
+}
@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "core/prime_factors.hpp"
+
+using Factors = std::vector<std::pair<long long, int>>;
+
+TEST(PrimeFactorsTest, NonPositiveThrows) {
+    EXPECT_THROW(calculatePrimeFactors(0), std::invalid_argument);
+    EXPECT_THROW(calculatePrimeFactors(-12), std::invalid_argument);
+}
+
+TEST(PrimeFactorsTest, SmallValues) {
+    EXPECT_EQ(calculatePrimeFactors(1), Factors{});
+    EXPECT_EQ(calculatePrimeFactors(2), (Factors{{2, 1}}));
+    EXPECT_EQ(calculatePrimeFactors(360), (Factors{{2, 3}, {3, 2}, {5, 1}}));
+    EXPECT_EQ(calculatePrimeFactors(10403), (Factors{{101, 1}, {103, 1}}));
+    EXPECT_EQ(calculatePrimeFactors(1018081), (Factors{{1009, 2}}));
+}
+
+TEST(PrimeFactorsTest, LargeSemiprimesAndPowers) {
+    // Both factors near 3e9, far beyond the reach of trial division.
+    EXPECT_EQ(calculatePrimeFactors(8999999843999998651LL),
+              (Factors{{2999999929LL, 1}, {3000000019LL, 1}}));
+    EXPECT_EQ(calculatePrimeFactors(std::numeric_limits<long long>::max()),
+              (Factors{{7, 2},
+                       {73, 1},
+                       {127, 1},
+                       {337, 1},
+                       {92737, 1},
+                       {649657, 1}}));
+    EXPECT_EQ(calculatePrimeFactors(9223372036854775783LL),
+              (Factors{{9223372036854775783LL, 1}}));
+    EXPECT_EQ(calculatePrimeFactors(4611686018427387904LL), (Factors{{2, 62}}));
+    EXPECT_EQ(calculatePrimeFactors(3037000493LL * 3037000493LL),
+              (Factors{{3037000493LL, 2}}));
+}
+
+TEST(PrimeFactorsTest, IsPrime) {
+    EXPECT_FALSE(isPrime(0));
+    EXPECT_FALSE(isPrime(1));
+    EXPECT_TRUE(isPrime(2));
+    EXPECT_TRUE(isPrime(9973));
+    // A strong pseudoprime to the bases 2, 3, 5 and 7.
+    EXPECT_FALSE(isPrime(3215031751ULL));
+    EXPECT_TRUE(isPrime(18446744073709551557ULL)); // largest 64-bit prime
+    EXPECT_FALSE(isPrime(18446744073709551615ULL));
+    int count = 0;
+    for (std::uint64_t n = 0; n < 10000; ++n) {
+        count += isPrime(n) ? 1 : 0;
+    }
+    EXPECT_EQ(count, 1229);
+}
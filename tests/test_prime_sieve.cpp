@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "core/parallel.hpp"
+#include "core/prime_factors.hpp"
+#include "core/prime_sieve.hpp"
+
+namespace {
+std::vector<std::uint64_t> collect(std::uint64_t from, std::uint64_t to) {
+    std::vector<std::uint64_t> primes;
+    streamPrimes(from, to, [&](const std::vector<std::uint64_t> &block) {
+        primes.insert(primes.end(), block.begin(), block.end());
+    });
+    return primes;
+}
+} // namespace
+
+// Restores the worker count even when an assertion ends a test early.
+class PrimeSieveTest : public ::testing::Test {
+protected:
+    void TearDown() override { setParallelWorkerCount(0); }
+};
+
+TEST_F(PrimeSieveTest, SmallRanges) {
+    EXPECT_EQ(collect(0, 1), std::vector<std::uint64_t>{});
+    EXPECT_EQ(collect(0, 30), (std::vector<std::uint64_t>{2, 3, 5, 7, 11, 13,
+                                                          17, 19, 23, 29}));
+    EXPECT_EQ(collect(24, 28), std::vector<std::uint64_t>{});
+    EXPECT_EQ(collect(29, 31), (std::vector<std::uint64_t>{29, 31}));
+    EXPECT_EQ(collect(5, 5), std::vector<std::uint64_t>{5});
+    EXPECT_EQ(primesUpTo(100).size(), 25u);
+}
+
+TEST_F(PrimeSieveTest, CountsMatchKnownValues) {
+    EXPECT_EQ(countPrimes(0, 1000000), 78498u);
+    EXPECT_EQ(countPrimes(0, 10000000), 664579u);
+    EXPECT_EQ(countPrimes(1000000, 10000000), 664579u - 78498u);
+}
+
+TEST_F(PrimeSieveTest, ParallelBlocksAgreeWithMillerRabin) {
+    // A window near 10^12 spanning several blocks, sieved by four workers.
+    setParallelWorkerCount(4);
+    const std::uint64_t from = 1000000000000ULL - 20000000;
+    const std::uint64_t to = 1000000000000ULL + 20000000;
+    std::vector<std::uint64_t> primes = collect(from, to);
+    EXPECT_EQ(primes.size(), countPrimes(from, to));
+    for (std::size_t idx = 1; idx < primes.size(); ++idx) {
+        ASSERT_LT(primes[idx - 1], primes[idx]);
+    }
+    std::size_t next = 0;
+    for (std::uint64_t value = to - 100000; value <= to; ++value) {
+        while (next < primes.size() && primes[next] < value) {
+            ++next;
+        }
+        bool listed = next < primes.size() && primes[next] == value;
+        ASSERT_EQ(listed, isPrime(value)) << value;
+    }
+}
+
+TEST_F(PrimeSieveTest, InvalidRangesThrow) {
+    EXPECT_THROW(countPrimes(10, 9), std::invalid_argument);
+    EXPECT_THROW(countPrimes(0, MaxSieveValue + 1), std::out_of_range);
+    EXPECT_EQ(countPrimes(MaxSieveValue - 100, MaxSieveValue), 2u);
+}